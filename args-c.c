@@ -0,0 +1,4 @@
+// The single translation unit that compiles the args-c implementation for libargs-c.a. Programs
+// that link against the library define AC_EXTERN before including args-c.h.
+#define AC_IMPLEMENTATION
+#include "args-c.h"
@@ -5,15 +5,48 @@
 
 #pragma once
 
+// The implementation uses POSIX.1-2008 and a few common extensions, like anonymous mappings, which
+// strict modes like `-std=c11` hide unless they're requested before the first system header.
+#if !defined(_POSIX_C_SOURCE) && !defined(_GNU_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+#if defined(__APPLE__) && !defined(_DARWIN_C_SOURCE)
+#define _DARWIN_C_SOURCE
+#endif
+#if defined(__linux__) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE
+#endif
+
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #define __maybe_unused __attribute__((unused))
 
+// By default args-c is header-only, and every translation unit that includes it compiles its own
+// copy. When AC_EXTERN is defined in every translation unit, args-c.h only declares the API with
+// external linkage, and exactly one translation unit also defines AC_IMPLEMENTATION to compile the
+// definitions (or the program links against libargs-c.a).
+#if defined(AC_IMPLEMENTATION) && !defined(AC_EXTERN)
+#define AC_EXTERN
+#endif
+
+#ifdef AC_EXTERN
+#define AC_API
+#else
+#define AC_API __maybe_unused static
+#endif
+
 enum {
     /// @brief The maximum length of a string being parsed by args-c (in any context).
     MAX_STRING_LEN = 0x1000,
@@ -22,6 +55,11 @@ enum {
     /// @brief The maximum number of arguments that will be parsed by a command spec.
     MAX_NUM_ARGS = 0x100,
 };
+enum {
+    /// @brief The maximum number of options that a command or multi-command spec can declare, which
+    /// keeps the compiled option lookup tables compact.
+    MAX_NUM_SPEC_OPTIONS = 0xffff,
+};
 enum {
     /// @brief The size of a help message buffer.
     HELP_BUFFER_SZ = 0x1000,
@@ -30,7 +68,14 @@ enum {
     /// @brief The maximum number of options that will be parsed by a command spec.
     MAX_NUM_OPTIONS = 0x100,
 };
+enum {
+    /// @brief The size of the buffer used by @c ac_argument_stream. This bounds the memory used when
+    /// streaming arguments, and must be larger than @c MAX_STRING_LEN.
+    STREAM_BUFFER_SZ = 0x2000,
+};
 
+/// @brief The result of an operation. The values are part of the ABI, so new codes are only ever
+/// added at the end.
 enum ac_status_code {
     /// @brief Operation success.
     /// @par Context: None
@@ -55,8 +100,10 @@ enum ac_status_code {
     /// @brief An option value was expected but something else was provided instead.
     /// @par Context: char * of the option name for which a value was expected,
     AC_ERROR_OPTION_VALUE_EXPECTED,
-    /// @brief The number of options provided exceeded @c MAX_NUM_OPTIONS.
-    /// @par Context: size_t of the number of options provided.
+    /// @brief The number of options provided on the command line exceeded @c MAX_NUM_OPTIONS, or a
+    /// spec declares more than @c MAX_NUM_SPEC_OPTIONS options. Options filled from the
+    /// environment, a config file or defaults don't count towards the limit.
+    /// @par Context: size_t of the number of options provided or declared.
     AC_ERROR_OPTION_TOO_MANY,
     /// @brief An option specification was provided that didn't contain a long name for the option.
     /// @par Context: size_t of the index of the bad option in the `ac_command_spec`.
@@ -99,6 +146,101 @@ enum ac_status_code {
     /// @brief The provided multi-command contains a subcommand without a name..
     /// @par Context: size_t of the index of the invalid subcommand.
     AC_ERROR_MULTICOMMAND_NEEDS_NAME,
+
+    /// @brief Reading from an argument stream failed.
+    /// @par Context: int of the @c errno value set by @c read(2).
+    AC_ERROR_STREAM_READ_FAILED,
+    /// @brief An argument in a stream was longer than @c MAX_STRING_LEN.
+    /// @par Context: size_t of the index of the argument in the stream.
+    AC_ERROR_STREAM_ARGUMENT_TOO_LONG,
+
+    /// @brief The provided buffer is too small for the result.
+    /// @par Context: size_t of the required buffer size.
+    AC_ERROR_BUFFER_TOO_SMALL,
+    /// @brief A serialized command blob is truncated or corrupt.
+    /// @par Context: None.
+    AC_ERROR_BLOB_INVALID,
+    /// @brief A serialized command blob was produced from a different command spec.
+    /// @par Context: uint64_t of the fingerprint in the blob.
+    AC_ERROR_BLOB_FINGERPRINT_MISMATCH,
+    /// @brief A file could not be opened or mapped.
+    /// @par Context: char * of the file path.
+    AC_ERROR_FILE_OPEN_FAILED,
+
+    /// @brief The resolver of a @c COMMAND_LAZY subcommand failed.
+    /// @par Context: char * of the subcommand name.
+    AC_ERROR_COMMAND_RESOLVE_FAILED,
+
+    /// @brief An abbreviated option name matches more than one option.
+    /// @par Context: char * of the option name used.
+    AC_ERROR_OPTION_NAME_AMBIGUOUS,
+
+    /// @brief A constraint in the command spec names an option that the command doesn't have, or
+    /// the command has more than @c MAX_NUM_OPTIONS options.
+    /// @par Context: size_t of the index of the bad constraint in the `ac_command_spec`.
+    AC_ERROR_CONSTRAINT_INVALID,
+    /// @brief The option in @c ac_status::option was provided without an option that it requires.
+    /// @par Context: char * of the long name of the missing option.
+    AC_ERROR_CONSTRAINT_REQUIRES,
+    /// @brief The option in @c ac_status::option was provided with an option that it conflicts
+    /// with.
+    /// @par Context: char * of the long name of the conflicting option.
+    AC_ERROR_CONSTRAINT_CONFLICTS,
+    /// @brief None of the options in a @c CONSTRAINT_ONE_OF group were provided.
+    /// @par Context: struct ac_constraint_spec * of the group.
+    AC_ERROR_CONSTRAINT_ONE_OF_MISSING,
+    /// @brief The option in @c ac_status::option was provided with another option from the same
+    /// @c CONSTRAINT_ONE_OF group.
+    /// @par Context: char * of the long name of the other option.
+    AC_ERROR_CONSTRAINT_ONE_OF_MULTIPLE,
+
+    /// @brief An option specification was provided with the same long name as an earlier option.
+    /// @par Context: size_t of the index of the bad option in the `ac_command_spec`.
+    AC_ERROR_OPTION_LONG_NAME_DUPLICATE,
+    /// @brief An option specification was provided with the same short name as an earlier option.
+    /// @par Context: size_t of the index of the bad option in the `ac_command_spec`.
+    AC_ERROR_OPTION_SHORT_NAME_DUPLICATE,
+    /// @brief The provided multi-command contains two subcommands with the same name.
+    /// @par Context: char * of the duplicated name.
+    AC_ERROR_COMMAND_NAME_DUPLICATE,
+
+    /// @brief A value couldn't be converted to the type that its option or argument declares. The
+    /// option is in @c ac_status::option, which is @c NULL for arguments.
+    /// @par Context: char * of the value.
+    AC_ERROR_OPTION_VALUE_INVALID,
+
+    /// @brief An element of the user input isn't valid UTF-8, see @c ac_command_spec::utf8.
+    /// @par Context: char * of the element.
+    AC_ERROR_UTF8_INVALID,
+
+    /// @brief A value was provided for a flag with `--name=value`.
+    /// @par Context: char * of the option token.
+    AC_ERROR_OPTION_VALUE_UNEXPECTED,
+
+    /// @brief An option's choices are invalid, because it's a flag or a choice is @c NULL or
+    /// duplicated. The option is in @c ac_status::option.
+    /// @par Context: size_t of the index of the invalid choice.
+    AC_ERROR_OPTION_CHOICES_INVALID,
+
+    /// @brief An option's value isn't one of its @c ac_option_spec::choices. The option is in
+    /// @c ac_status::option.
+    /// @par Context: char * of the value.
+    AC_ERROR_OPTION_VALUE_NOT_IN_CHOICES,
+
+    /// @brief A line of the @c ac_command_spec::config file doesn't have the form `name=value`, or
+    /// names an option that the command doesn't have.
+    /// @par Context: char * of the option name in the file. It's valid until the file changes.
+    AC_ERROR_CONFIG_INVALID,
+
+    /// @brief An option has a @c ac_option_spec::default_value but is a flag or required, or the
+    /// value isn't one of its choices. The option is in @c ac_status::option.
+    /// @par Context: char * of the default value.
+    AC_ERROR_OPTION_DEFAULT_INVALID,
+
+    /// @brief A spec uses a feature that spec images can't represent, so @c ac_spec_image_compile
+    /// can't compile it. The spec is in @c ac_status::single or @c ac_status::multi.
+    /// @par Context: char * of the name of the field that sets the feature.
+    AC_ERROR_IMAGE_UNSUPPORTED,
 };
 
 /// @brief Describes the result of an args-c operation.
@@ -112,18 +254,58 @@ struct ac_status {
     /// @brief The multi-command that was being processed when the error occurred, if at all.
     struct ac_multi_command_spec const *multi;
 
+    /// @brief The option that caused the error, if at all.
+    struct ac_option_spec const *option;
+
     /// @brief A status code specific context value that can be used to debug the cause of the
     /// specified status code.
     /// @par The context values are described by documentation in the @c ac_status_code enum.
     void *context;
+
+    /// @brief Every error found by @c ac_command_parse_all or @c ac_multi_command_parse_all, if at
+    /// all. The other fields describe the first of them, and @c ac_status_string renders them all.
+    struct ac_diagnostics const *diagnostics;
 };
 
 /// @brief A convenience function for determining if the provided `status` indicates a successful
 /// operation.
-static bool ac_status_is_success(struct ac_status const status) {
+inline static bool ac_status_is_success(struct ac_status const status) {
     return status.code == AC_ERROR_SUCCESS;
 }
 
+/// @brief The @c token of a diagnostic that isn't about a single element of the user input, such
+/// as a missing required option.
+#define AC_DIAGNOSTIC_NO_TOKEN UINT32_MAX
+
+/// @brief One error found while parsing in collect-all mode.
+struct ac_diagnostic {
+    /// @brief The code of the error, as it would be returned by @c ac_command_parse.
+    enum ac_status_code code;
+    /// @brief The index in @c argv of the element that caused the error, or @c AC_DIAGNOSTIC_NO_TOKEN.
+    uint32_t token;
+    /// @brief The multi-command that was being processed, if at all.
+    struct ac_multi_command_spec const *multi;
+    /// @brief The option that caused the error, if at all.
+    struct ac_option_spec const *option;
+    /// @brief The context value of the error, as described in the @c ac_status_code enum.
+    void *context;
+};
+
+/// @brief The errors found by @c ac_command_parse_all or @c ac_multi_command_parse_all.
+/// @par Zero-initialise it before first use. The array is reused by each parse, so validating many
+/// inputs with the same diagnostics only allocates until it has grown to fit the worst of them.
+/// Release it with @c ac_diagnostics_release.
+struct ac_diagnostics {
+    /// @brief The command that was resolved, or @c NULL when parsing stopped before one was.
+    struct ac_command_spec const *single;
+    /// @brief The number of errors, in the order that they were found.
+    size_t n_diagnostics;
+    /// @brief The number of elements allocated for @c diagnostics.
+    size_t capacity;
+    /// @brief An array of errors with @c n_diagnostics elements.
+    struct ac_diagnostic *diagnostics;
+};
+
 /// @brief Encapsulates an argument specification.
 /// @par In args-c, an 'argument' is a required positional value. For example, the file argument to
 /// unix "cat <file>".
@@ -157,6 +339,61 @@ struct ac_option_spec {
     bool is_flag;
     /// @brief Whether this option is mandatory in the command.
     bool required;
+    /// @brief The number of values that this option accepts, or 0 to accept any value.
+    size_t n_choices;
+    /// @brief The values that this option accepts. Must contain exactly @c n_choices distinct
+    /// elements.
+    /// @par The index of the value is provided in @c ac_option::choice, so callers don't need to
+    /// compare strings, and any other value is rejected with
+    /// @c AC_ERROR_OPTION_VALUE_NOT_IN_CHOICES.
+    char **choices;
+    /// @brief The name of an environment variable that provides this option when it isn't on the
+    /// command line, or @c NULL.
+    /// @par Flags are set by any value other than an empty string or "0". The environment is read
+    /// once per process, the first time an option with an @c env name is parsed.
+    char *env;
+    /// @brief The value of this option when it isn't provided by the command line, the environment
+    /// or the config file, or @c NULL.
+    /// @par Only options that take a value may have a default, and it must be one of the @c choices
+    /// when there are any. Such an option is always in the parsed result, so callers can use its
+    /// value without checking for it.
+    char *default_value;
+};
+
+/// @brief Describes where the value of an @c ac_option came from.
+enum ac_option_source {
+    /// @brief The user input.
+    SOURCE_ARGV,
+    /// @brief The environment variable named by @c ac_option_spec::env.
+    SOURCE_ENV,
+    /// @brief The @c ac_command_spec::config file.
+    SOURCE_CONFIG,
+    /// @brief The @c ac_option_spec::default_value.
+    SOURCE_DEFAULT,
+};
+
+/// @brief Describes the rule that an @c ac_constraint_spec enforces.
+enum ac_constraint_type {
+    /// @brief When @c option is provided, all of @c options must be provided too.
+    CONSTRAINT_REQUIRES,
+    /// @brief When @c option is provided, none of @c options may be provided.
+    CONSTRAINT_CONFLICTS,
+    /// @brief Exactly one of @c options must be provided. @c option is unused.
+    CONSTRAINT_ONE_OF,
+};
+
+/// @brief Encapsulates a rule between the options of a command.
+/// @par Options are referred to by their long names. Constraints are compiled into bit masks over
+/// the command's options the first time the command is parsed, and are checked after parsing.
+struct ac_constraint_spec {
+    /// @brief The rule that this constraint enforces.
+    enum ac_constraint_type type;
+    /// @brief The long name of the option that the rule applies to.
+    char *option;
+    /// @brief The number of options in @c options .
+    size_t n_options;
+    /// @brief The long names of the options that the rule relates @c option to.
+    char **options;
 };
 
 /// @brief Describes whether a command in a multi-command points to another multi-command or just a
@@ -166,8 +403,27 @@ enum ac_command_type {
     COMMAND_SINGLE,
     /// @brief An @c ac_multi_command_spec value.
     COMMAND_MULTI,
+    /// @brief An @c ac_command_spec or @c ac_multi_command_spec value that is provided by a resolver
+    /// callback the first time it's needed.
+    COMMAND_LAZY,
 };
 
+struct ac_multi_command_subcommand;
+
+/// @brief A callback that provides the spec of a @c COMMAND_LAZY subcommand.
+/// @par This is called when parsing reaches the subcommand, for example to @c dlopen a plugin. The
+/// resolver sets @c type to either @c COMMAND_SINGLE or @c COMMAND_MULTI and sets the matching
+/// @c single or @c multi field of @p resolved . The result is memoized on the address of the lazy
+/// subcommand, which is never modified, so the resolver is called at most once per subcommand even
+/// when several threads parse at once. Resolvers are called one at a time, so a resolver must not
+/// itself parse a spec that has unresolved subcommands.
+/// @param name The name of the subcommand being resolved.
+/// @param context The @c resolver_context of the subcommand.
+/// @param resolved An output structure for the resolved subcommand.
+/// @result @c true when @p resolved was populated.
+typedef bool (*ac_subcommand_resolver)(char const *name, void *context,
+                                       struct ac_multi_command_subcommand *resolved);
+
 /// @brief Encapsulates a command specification.
 /// @par This structure is passed to @c ac_command_parse to describe the structure of the command to
 /// be parsed.
@@ -187,6 +443,63 @@ struct ac_command_spec {
     size_t n_options;
     /// @brief An array of options for this command. Must contain exactly @c n_options elements.
     struct ac_option_spec *options;
+
+    /// @brief Whether a long option may be abbreviated to any prefix that identifies it uniquely.
+    /// @par An exact match always takes precedence over an abbreviation. When @c false, long option
+    /// names must be provided in full.
+    bool allow_abbreviations;
+
+    /// @brief The number of constraints between the options of this command.
+    size_t n_constraints;
+    /// @brief An array of constraints between the options of this command. Must contain exactly @c
+    /// n_constraints elements.
+    struct ac_constraint_spec *constraints;
+
+    /// @brief Whether long option names may contain non-ASCII characters, encoded as UTF-8.
+    /// @par When set, every element of the user input must be valid UTF-8, or parsing fails with
+    /// @c AC_ERROR_UTF8_INVALID. Short names are always ASCII, and @c ac_spec_image_compile
+    /// rejects specs that set this.
+    bool utf8;
+
+    /// @brief The path of an optional file of defaults for this command's options, or @c NULL.
+    /// @par Each line of the file has the form `name=value`, where @c name is the long name of an
+    /// option, including inherited ones. Blank lines and lines starting with '#' are ignored, and a
+    /// later line overrides an earlier one. Options on the command line take precedence over the
+    /// environment, which takes precedence over the file. A file that doesn't exist is ignored.
+    /// @par The file is mapped and cached by path, and reloaded when its modification time
+    /// changes, so long-running processes only read it once. Option values borrow from the mapping,
+    /// so the file must be replaced, for example by renaming a new file over it, rather than
+    /// truncated and rewritten while parse results are alive.
+    char *config;
+};
+
+/// @brief A subcommand of an @c ac_multi_command_spec.
+struct ac_multi_command_subcommand {
+    /// @brief The name of this multi-command. This is the name provided by the user to invoke
+    /// this subcommand.
+    char *name;
+    /// @brief Indicates whether this sub-command is another multi-command or just a command.
+    enum ac_command_type type;
+    /// @brief The multi-command or command itself.
+    union {
+        struct {
+            struct ac_command_spec *single;
+        };
+
+        struct {
+            struct ac_multi_command_spec *multi;
+        };
+
+        struct {
+            /// @brief Provides the spec of a @c COMMAND_LAZY subcommand.
+            ac_subcommand_resolver resolver;
+            /// @brief An optional value that is passed through to @c resolver.
+            void *resolver_context;
+            /// @brief A help string that will appear in the @c ac_multi_command_help output
+            /// while this subcommand is unresolved.
+            char *help;
+        };
+    };
 };
 
 /// @brief Encapsulates a multi-command specification.
@@ -196,34 +509,34 @@ struct ac_multi_command_spec {
     /// @brief A help string that will appear in the @c ac_multi_command_help output.
     char *help;
 
+    /// @brief The number of options that this multi-command and all of its descendants accept.
+    size_t n_options;
+    /// @brief An array of options that apply to this multi-command and all of its descendants. Must
+    /// contain exactly @c n_options elements.
+    /// @par These may be used before or after the subcommand names on the command line. A command
+    /// that declares an option with the same name takes precedence.
+    struct ac_option_spec *options;
+    /// @brief Whether the long names of @c options may be abbreviated, see
+    /// @c ac_command_spec::allow_abbreviations.
+    bool allow_abbreviations;
+    /// @brief Whether the long names of @c options may contain non-ASCII characters, see
+    /// @c ac_command_spec::utf8. User input is validated whenever the command or any of its
+    /// multi-commands sets this.
+    bool utf8;
+
     /// @brief The number of commands that this multi-command encapsulates.
     size_t n_subcommands;
     /// @brief An array of subcommand for this command. Must contain exactly @c n_subcommands
     /// elements.
-    struct ac_multi_command_subcommand {
-        /// @brief The name of this multi-command. This is the name provided by the user to invoke
-        /// this subcommand.
-        char *name;
-        /// @brief Indicates whether this sub-command is another multi-command or just a command.
-        enum ac_command_type type;
-        /// @brief The multi-command or command itself.
-        union {
-            struct {
-                struct ac_command_spec *single;
-            };
-
-            struct {
-                struct ac_multi_command_spec *multi;
-            };
-        };
-    } *subcommands;
+    struct ac_multi_command_subcommand *subcommands;
 };
 
 /// @brief An output argument returned from parsing a user command.
 struct ac_argument {
     /// @brief A pointer to the argument specification that made this argument parseable.
     struct ac_argument_spec const *argument;
-    /// @brief The value provided for this argument.
+    /// @brief The value provided for this argument. This points into the user input, so it's valid
+    /// for as long as the user input is.
     char *value;
 };
 
@@ -232,9 +545,23 @@ struct ac_option {
     /// @brief A pointer to the option specification that made this argument parseable.
     struct ac_option_spec const *option;
     /// @brief The value provided to the this option, only when @c option->is_flag is @c false.
+    /// @par This points into the user input, either at the token after the option or after the '='
+    /// of `--name=value`, so it's valid for as long as the user input is.
     char *value;
+    /// @brief The number of times that a flag was given on the command line, counting each
+    /// repetition in a cluster, like 4 for `-vv -v --verbose`. Otherwise this is 1.
+    size_t count;
+    /// @brief The index of @c value in @c option->choices, when the option has choices.
+    size_t choice;
+    /// @brief Where this option came from. Values from the environment point into a snapshot of the
+    /// environment that lives for the rest of the process, and values from a config file point into
+    /// its mapping, which lives until the result is released.
+    enum ac_option_source source;
 };
 
+/// @brief A config file that options were read from, see @c ac_command_spec::config.
+struct ac_config;
+
 /// @brief An output command returned from parsing a user command.
 struct ac_command {
     /// @brief A pointer to the command specification used to parse the user input.
@@ -247,596 +574,6637 @@ struct ac_command {
     size_t n_options;
     /// @brief An array of options with @c n_options elements.
     struct ac_option *options;
+    /// @brief The number of multi-commands that were traversed to reach @c command. This is only
+    /// set by @c ac_multi_command_parse.
+    size_t n_parents;
+    /// @brief An array of the multi-commands that were traversed to reach @c command, from the root
+    /// to the immediate parent of @c command. Must contain exactly @c n_parents elements.
+    struct ac_multi_command_spec const **parents;
+    /// @brief The config file that some option values borrow from, or @c NULL. The result holds a
+    /// reference to it until it's released.
+    struct ac_config *config;
+    /// @brief A hash of the command path, the arguments and the effective value of each option,
+    /// which doesn't depend on the order of the options. See @c ac_command_fingerprint.
+    uint64_t fingerprint;
+};
+
+/// @brief A reusable parser for one spec, with a bounded cache of its results.
+/// @par Programs that see the same command lines over and over, like a job dispatcher, can parse
+/// with @c ac_parser_parse instead of @c ac_command_parse. Results are shared, immutable and
+/// reference-counted, so a repeated command line returns the cached result without parsing or
+/// allocating. Parsers are safe to use from several threads at once. Create one with
+/// @c ac_command_parser_create or @c ac_multi_command_parser_create.
+struct ac_parser;
+
+/// @brief The statistics of an @c ac_parser cache. The hit rate is @c hits / ( @c hits + @c misses ).
+struct ac_parser_stats {
+    /// @brief The number of parses that returned a cached result.
+    uint64_t hits;
+    /// @brief The number of parses that weren't cached, including those that failed.
+    uint64_t misses;
+    /// @brief The number of results that were evicted to make room for new ones.
+    uint64_t evictions;
+    /// @brief The number of results in the cache.
+    size_t n_entries;
+};
+
+/// @brief A mutable root multi-command, for programs like plugin hosts that add and remove
+/// subcommands and options at runtime.
+/// @par Edits are published as immutable snapshots, which are ordinary multi-command specs that
+/// can be parsed, validated and rendered like static ones. Snapshots share the arrays of
+/// subcommands and options that didn't change since the previous one, along with everything that
+/// was built from them for parsing, so only what changed is rebuilt. Create one with
+/// @c ac_spec_builder_create.
+struct ac_spec_builder;
+
+/// @brief The byte that separates arguments in an @c ac_argument_stream.
+enum ac_stream_delimiter {
+    /// @brief Arguments are separated by a NUL byte, like the output of `find -print0`.
+    STREAM_DELIMITER_NUL = '\0',
+    /// @brief Arguments are separated by a newline.
+    STREAM_DELIMITER_NEWLINE = '\n',
+};
+
+/// @brief Reads a variable number of arguments from a file descriptor using bounded memory.
+/// @par This is used for pipelines like `find . -print0 | tool compress -0`, where the options are
+/// parsed from the command line by @c ac_command_parse and the arguments are read from a stream.
+/// Arguments are yielded as soon as their delimiter is read, and there is no limit on the number
+/// of arguments in the stream.
+/// @par Initialise this structure with @c ac_argument_stream_init.
+struct ac_argument_stream {
+    /// @brief The file descriptor that arguments are read from.
+    int fd;
+    /// @brief The byte that separates arguments in the stream.
+    enum ac_stream_delimiter delimiter;
+    /// @brief The number of arguments that have been yielded so far.
+    size_t index;
+
+    /// @brief The offset of the first byte of the current argument in @c buffer.
+    size_t head;
+    /// @brief The offset of the first byte that hasn't been scanned for a delimiter yet.
+    size_t scanned;
+    /// @brief The offset of the end of the data read into @c buffer.
+    size_t tail;
+    /// @brief @c true once @c read(2) has reported the end of the stream.
+    bool eof;
+    /// @brief Storage for data read from @c fd. Yielded arguments point into this buffer.
+    char buffer[STREAM_BUFFER_SZ];
+};
+
+/// @brief A callback invoked by @c ac_argument_stream_foreach for each argument in a stream.
+/// @param value The argument. This is only valid for the duration of the callback.
+/// @param index The index of the argument in the stream.
+/// @param context The context value provided to @c ac_argument_stream_foreach.
+/// @result @c true to continue reading arguments, @c false to stop.
+typedef bool (*ac_argument_stream_callback)(char const *value, size_t index, void *context);
+
+/// @brief A callback that receives help text as it's rendered.
+/// @param text A chunk of the help text, which isn't NUL-terminated. This is only valid for the
+/// duration of the callback.
+/// @param length The number of bytes in @p text .
+/// @param context The context value provided with the callback.
+/// @result @c true to continue rendering, @c false to stop.
+typedef bool (*ac_help_sink)(char const *text, size_t length, void *context);
+
+/// @brief A multi-command in the walk of an @c ac_help_pager whose subcommands are being rendered.
+struct ac_help_pager_frame {
+    /// @brief The multi-command.
+    struct ac_multi_command_spec const *multi;
+    /// @brief The index of the next subcommand to render.
+    size_t next;
+    /// @brief The length of the command path of the multi-command.
+    size_t path_len;
+};
+
+/// @brief Renders the help of a whole @c ac_multi_command_spec tree one page at a time.
+/// @par The tree is walked lazily in depth-first order, one command at a time, so the first page
+/// is produced without walking the rest of the tree. Each command is rendered as a section that
+/// starts with its command path, like the usage line of @c ac_command_help. @c COMMAND_LAZY
+/// subcommands aren't resolved, so only their help is rendered.
+/// @par Initialise this structure with @c ac_help_pager_init, and release it with
+/// @c ac_help_pager_release.
+struct ac_help_pager {
+    /// @brief The maximum depth of subcommands below the root to render, or 0 for no limit.
+    /// @par Without a limit, a tree with multi-commands deeper than @c MAX_NUM_ARGS isn't rendered
+    /// past them, since they can't be reached by parsing, and @c AC_ERROR_ARGUMENT_MAX_EXCEEDED is
+    /// returned instead.
+    size_t max_depth;
+    /// @brief The number of commands rendered so far, including the root.
+    size_t n_rendered;
+
+    /// @brief Whether the root has been rendered.
+    bool started;
+    /// @brief The number of elements of @c frames in use.
+    size_t n_frames;
+    /// @brief The multi-commands from the root to the one being rendered.
+    struct ac_help_pager_frame frames[MAX_NUM_ARGS];
+    /// @brief The command path of the command being rendered, starting with the tool path.
+    char path[MAX_STRING_LEN];
+
+    /// @brief Rendered text that hasn't been paged yet.
+    char *pending;
+    /// @brief The number of bytes in @c pending.
+    size_t pending_len;
+    /// @brief The offset of the first byte of @c pending that hasn't been paged yet.
+    size_t pending_pos;
+    /// @brief The size of the allocation of @c pending.
+    size_t pending_capacity;
+    /// @brief The last page returned by @c ac_help_pager_next.
+    char *page;
+    /// @brief The size of the allocation of @c page.
+    size_t page_capacity;
+};
+
+enum {
+    /// @brief The magic number at the start of a blob produced by @c ac_command_serialize.
+    AC_BLOB_MAGIC = 0x31424341, // "ACB1"
+};
+enum {
+    /// @brief The blob format version produced by @c ac_command_serialize.
+    AC_BLOB_VERSION = 3,
+};
+enum {
+    /// @brief A string offset in a blob that indicates the absence of a value.
+    AC_BLOB_NO_VALUE = 0xffffffff,
+};
+
+/// @brief The header at the start of a blob produced by @c ac_command_serialize.
+/// @par A blob is laid out as this header, followed by @c n_parents subcommand indices, followed by
+/// @c n_arguments string offsets, followed by @c n_options @c ac_blob_option records, followed by
+/// the string table. All offsets are relative to the start of the blob, so a blob may be placed at
+/// any address.
+struct ac_blob_header {
+    /// @brief Always @c AC_BLOB_MAGIC.
+    uint32_t magic;
+    /// @brief Always @c AC_BLOB_VERSION.
+    uint32_t version;
+    /// @brief The @c ac_command_spec_fingerprint of the command spec that produced the blob.
+    uint64_t fingerprint;
+    /// @brief A fingerprint of the options that the command inherits from the multi-commands on its
+    /// path, which the indices of inherited options refer to.
+    uint64_t inherited;
+    /// @brief The total size of the blob in bytes.
+    uint32_t size;
+    /// @brief The number of argument string offsets following this header.
+    uint32_t n_arguments;
+    /// @brief The number of @c ac_blob_option records following the argument offsets.
+    uint32_t n_options;
+    /// @brief The offset of the string table.
+    uint32_t strings;
+    /// @brief The number of subcommand indices that lead from the root multi-command to the
+    /// command, or 0 when the command was parsed by @c ac_command_parse.
+    uint32_t n_parents;
+    /// @brief Padding to keep the header size a multiple of 8.
+    uint32_t reserved;
+};
+
+/// @brief An option in a blob produced by @c ac_command_serialize.
+struct ac_blob_option {
+    /// @brief The index of the option spec. Indices start with the command's own options, and
+    /// continue through the options inherited from each parent, from the nearest to the root.
+    uint32_t index;
+    /// @brief The offset of the option value, or @c AC_BLOB_NO_VALUE for flags.
+    uint32_t value;
+};
+
+/// @brief A read-only view over a blob produced by @c ac_command_serialize.
+/// @par Create a view using @c ac_command_view_from_blob. The view doesn't copy the blob, so the
+/// blob must outlive the view.
+struct ac_command_view {
+    /// @brief The command specification that produced the blob.
+    struct ac_command_spec const *command;
+    /// @brief The root multi-command specification, when the view was created by
+    /// @c ac_multi_command_view_from_blob. This is used to resolve inherited options.
+    struct ac_multi_command_spec const *root;
+    /// @brief The blob being viewed.
+    unsigned char const *blob;
+    /// @brief The number of arguments in the blob.
+    size_t n_arguments;
+    /// @brief The number of options in the blob.
+    size_t n_options;
+};
+
+enum {
+    /// @brief The magic number at the start of a spec image produced by @c ac_spec_image_compile.
+    AC_IMAGE_MAGIC = 0x31494341, // "ACI1"
+};
+enum {
+    /// @brief The spec image format version produced by @c ac_spec_image_compile.
+    AC_IMAGE_VERSION = 2,
+};
+
+/// @brief The header at the start of a spec image.
+/// @par A spec image is a flat, read-only encoding of an @c ac_multi_command_spec tree. Every
+/// reference in the image is an offset from the start of the image, so an image can be mapped at
+/// any address and parsed against without any pointer fixups.
+struct ac_image_header {
+    /// @brief Always @c AC_IMAGE_MAGIC.
+    uint32_t magic;
+    /// @brief Always @c AC_IMAGE_VERSION.
+    uint32_t version;
+    /// @brief The total size of the image in bytes.
+    uint32_t size;
+    /// @brief The number of @c ac_image_node records in the image.
+    uint32_t n_nodes;
+    /// @brief The offset of the @c ac_image_node array.
+    uint32_t nodes;
+    /// @brief The index of the root multi-command node.
+    uint32_t root;
+};
+
+/// @brief A multi-command or command in a spec image.
+struct ac_image_node {
+    /// @brief The @c ac_command_type of this node.
+    uint32_t type;
+    /// @brief The offset of the help string, or 0 when there is no help.
+    uint32_t help;
+    /// @brief The @c context value of an @c ac_command_spec, as an integer.
+    uint64_t context;
+
+    /// @brief The number of @c ac_image_entry records for a @c COMMAND_MULTI node.
+    uint32_t n_entries;
+    /// @brief The offset of the @c ac_image_entry records, sorted by name.
+    uint32_t entries;
+
+    /// @brief The number of @c ac_image_argument records for a @c COMMAND_SINGLE node.
+    uint32_t n_arguments;
+    /// @brief The offset of the @c ac_image_argument records.
+    uint32_t arguments;
+    /// @brief The number of @c ac_image_option records. For a @c COMMAND_MULTI node, these are the
+    /// options inherited by all of its descendants.
+    uint32_t n_options;
+    /// @brief The offset of the @c ac_image_option records.
+    uint32_t options;
+    /// @brief The number of slots in the long name hash table. Always a power of two.
+    uint32_t n_slots;
+    /// @brief The offset of the long name hash table. Each slot is an option index plus one, or 0
+    /// when the slot is empty.
+    uint32_t slots;
+    /// @brief The offset of the short name table. This has 128 slots indexed by the short name, each
+    /// holding an option index plus one, or 0 when there's no such short name.
+    uint32_t shorts;
+    /// @brief Padding to keep the node size a multiple of 8.
+    uint32_t reserved;
+};
+
+/// @brief A subcommand of a @c COMMAND_MULTI node in a spec image.
+struct ac_image_entry {
+    /// @brief The offset of the subcommand name.
+    uint32_t name;
+    /// @brief The index of the subcommand node.
+    uint32_t node;
+};
+
+/// @brief An argument of a @c COMMAND_SINGLE node in a spec image.
+struct ac_image_argument {
+    /// @brief The offset of the argument name.
+    uint32_t name;
+    /// @brief The offset of the help string, or 0 when there is no help.
+    uint32_t help;
+};
+
+/// @brief An option of a node in a spec image.
+struct ac_image_option {
+    /// @brief The offset of the long name.
+    uint32_t long_name;
+    /// @brief The offset of the help string, or 0 when there is no help.
+    uint32_t help;
+    /// @brief The offset of the default value, or 0 when there is none.
+    uint32_t default_value;
+    /// @brief The offset of the name of the environment variable, or 0 when there is none.
+    uint32_t env;
+    /// @brief The number of choices, or 0 when any value is accepted.
+    uint32_t n_choices;
+    /// @brief The offset of the choices, which are @c n_choices string offsets.
+    uint32_t choices;
+    /// @brief The short name, or 0 when the option doesn't have one.
+    char short_name;
+    /// @brief Mirrors @c ac_option_spec.is_flag.
+    bool is_flag;
+    /// @brief Mirrors @c ac_option_spec.required.
+    bool required;
+};
+
+/// @brief A spec image loaded by @c ac_spec_image_map or @c ac_spec_image_from_buffer.
+struct ac_spec_image {
+    /// @brief The start of the image.
+    unsigned char const *base;
+    /// @brief The size of the image in bytes.
+    size_t size;
+    /// @brief @c true when @c base was mapped by @c ac_spec_image_map.
+    bool mapped;
+};
+
+/// @brief An output option returned from parsing against a spec image.
+struct ac_image_option_value {
+    /// @brief The index of the node that declares the option. This is the command node, or one of
+    /// its parents for inherited options.
+    uint32_t node;
+    /// @brief The index of the option in the node that declares it.
+    uint32_t index;
+    /// @brief The value provided to this option, or @c NULL for flags. This points into the @c argv
+    /// that was parsed.
+    char const *value;
+    /// @brief The number of times that a flag was given, counting each repetition in a cluster,
+    /// like 4 for @c -vv @c -v @c --verbose, and 1 otherwise.
+    size_t count;
+    /// @brief The index of @c value in the option's choices, when the option has choices.
+    size_t choice;
+    /// @brief Where this option came from. Spec images don't have config files.
+    enum ac_option_source source;
+};
+
+/// @brief An output command returned from parsing against a spec image.
+struct ac_image_command {
+    /// @brief The image that was parsed against.
+    struct ac_spec_image const *image;
+    /// @brief The index of the command node that was resolved.
+    uint32_t node;
+    /// @brief The @c context value of the resolved command spec.
+    uint64_t context;
+    /// @brief The number of arguments parsed from the user input.
+    size_t n_arguments;
+    /// @brief An array of argument values with @c n_arguments elements. These point into the @c argv
+    /// that was parsed.
+    char const **arguments;
+    /// @brief The number of options parsed from the user input.
+    size_t n_options;
+    /// @brief An array of options with @c n_options elements.
+    struct ac_image_option_value *options;
+};
+
+/// @brief The first argument that asks a program to print completion candidates instead of running.
+/// @par The scripts generated by @c ac_completion_script invoke `tool __complete <words...>`, and
+/// the program passes the words to @c ac_multi_command_complete_print.
+#define AC_COMPLETE_COMMAND "__complete"
+
+/// @brief The shells that @c ac_completion_script can generate completion scripts for.
+enum ac_shell {
+    /// @brief The bash shell.
+    SHELL_BASH,
+    /// @brief The zsh shell.
+    SHELL_ZSH,
+    /// @brief The fish shell.
+    SHELL_FISH,
+};
+
+/// @brief Completion candidates produced by @c ac_multi_command_complete or @c ac_command_complete.
+struct ac_completion {
+    /// @brief The number of candidates.
+    size_t n_candidates;
+    /// @brief An array of candidates in sorted order with @c n_candidates elements. The candidate
+    /// strings are owned by args-c and remain valid for the lifetime of the process.
+    char const **candidates;
 };
 
+// Parsing
+AC_API struct ac_status ac_command_parse(int const argc, char const *const *const argv,
+                                         struct ac_command_spec const *const command,
+                                         struct ac_command *const args);
+AC_API struct ac_status ac_multi_command_parse(int const argc, char const *const *const argv,
+                                               struct ac_multi_command_spec const *const root,
+                                               struct ac_command *const args);
+AC_API struct ac_status ac_command_parse_all(int const argc, char const *const *const argv,
+                                             struct ac_command_spec const *const command,
+                                             struct ac_command *const            args,
+                                             struct ac_diagnostics *const        diagnostics);
+AC_API struct ac_status ac_multi_command_parse_all(int const argc, char const *const *const argv,
+                                                   struct ac_multi_command_spec const *const root,
+                                                   struct ac_command *const                  args,
+                                                   struct ac_diagnostics *const diagnostics);
+AC_API void ac_diagnostics_release(struct ac_diagnostics *const diagnostics);
+
+// Parsers
+AC_API struct ac_status ac_command_parser_create(struct ac_command_spec const *const command,
+                                                 size_t const capacity, struct ac_parser **const parser);
+AC_API struct ac_status ac_multi_command_parser_create(struct ac_multi_command_spec const *const root,
+                                                       size_t const                              capacity,
+                                                       struct ac_parser **const                  parser);
+AC_API struct ac_status ac_parser_parse(struct ac_parser *const parser, int const argc,
+                                        char const *const *const argv,
+                                        struct ac_command const **const args);
+AC_API void ac_parser_result_release(struct ac_command const *const args);
+AC_API struct ac_parser_stats ac_parser_stats_read(struct ac_parser *const parser);
+AC_API void ac_parser_destroy(struct ac_parser *const parser);
+
+// Spec builders
+AC_API struct ac_status ac_spec_builder_create(struct ac_multi_command_spec const *const base,
+                                               struct ac_spec_builder **const            builder);
+AC_API struct ac_status
+ac_spec_builder_add_subcommand(struct ac_spec_builder *const                   builder,
+                               struct ac_multi_command_subcommand const *const subcommand);
+AC_API struct ac_status ac_spec_builder_remove_subcommand(struct ac_spec_builder *const builder,
+                                                          char const *const             name);
+AC_API struct ac_status ac_spec_builder_add_option(struct ac_spec_builder *const      builder,
+                                                   struct ac_option_spec const *const option);
+AC_API struct ac_status ac_spec_builder_remove_option(struct ac_spec_builder *const builder,
+                                                      char const *const             long_name);
+AC_API struct ac_status ac_spec_builder_publish(struct ac_spec_builder *const              builder,
+                                                struct ac_multi_command_spec const **const snapshot);
+AC_API void ac_spec_snapshot_release(struct ac_multi_command_spec const *const snapshot);
+AC_API void ac_spec_builder_destroy(struct ac_spec_builder *const builder);
+AC_API void ac_command_spec_forget(struct ac_command_spec const *const command);
+
+// Argument streams
+AC_API struct ac_status ac_argument_stream_init(struct ac_argument_stream *const stream,
+                                                int const fd,
+                                                enum ac_stream_delimiter const delimiter);
+AC_API struct ac_status ac_argument_stream_next(struct ac_argument_stream *const stream,
+                                                char const **const value);
+AC_API struct ac_status ac_argument_stream_foreach(int const fd,
+                                                   enum ac_stream_delimiter const delimiter,
+                                                   ac_argument_stream_callback const callback,
+                                                   void *const context);
+
+// Help and validation
+AC_API char *ac_command_help(struct ac_command_spec const *const command,
+                             char const *const toolpath);
+AC_API char *ac_multi_command_help(struct ac_multi_command_spec const *const command,
+                                   char const *const toolpath);
+AC_API char *ac_multi_command_help_tree(struct ac_multi_command_spec const *const root,
+                                        char const *const toolpath, size_t const max_depth);
+AC_API struct ac_status
+ac_multi_command_help_tree_write(struct ac_multi_command_spec const *const root,
+                                 char const *const toolpath, size_t const max_depth,
+                                 ac_help_sink const sink, void *const context);
+AC_API struct ac_status ac_help_pager_init(struct ac_help_pager *const pager,
+                                           struct ac_multi_command_spec const *const root,
+                                           char const *const toolpath, size_t const max_depth);
+AC_API struct ac_status ac_help_pager_next(struct ac_help_pager *const pager, size_t const n_lines,
+                                           char **const page);
+AC_API void ac_help_pager_release(struct ac_help_pager *const pager);
+AC_API struct ac_status ac_command_validate(struct ac_command_spec const *const command);
+AC_API struct ac_status
+ac_multi_command_validate(struct ac_multi_command_spec const *const command);
+
+// Results
+AC_API struct ac_argument *ac_extract_argument(struct ac_command const *const command,
+                                               char const *const name);
+AC_API struct ac_option *ac_extract_option(struct ac_command const *const command,
+                                           char const *const long_name);
+AC_API char *ac_status_string(struct ac_status result);
+AC_API void ac_command_release(struct ac_command *command);
+
+// Serialization
+AC_API uint64_t ac_command_spec_fingerprint(struct ac_command_spec const *const command);
+AC_API uint64_t ac_command_fingerprint(struct ac_command const *const args);
+AC_API struct ac_status ac_command_serialize(struct ac_command const *const args,
+                                             void *const buffer, size_t const buffer_sz,
+                                             size_t *const written);
+AC_API struct ac_status ac_command_view_from_blob(void const *const blob, size_t const blob_sz,
+                                                  struct ac_command_spec const *const command,
+                                                  struct ac_command_view *const view);
+AC_API struct ac_status
+ac_multi_command_view_from_blob(void const *const blob, size_t const blob_sz,
+                                struct ac_multi_command_spec const *const root,
+                                struct ac_command_view *const view);
+AC_API char const *ac_command_view_argument(struct ac_command_view const *const view,
+                                            size_t const index);
+AC_API struct ac_option_spec const *ac_command_view_option(struct ac_command_view const *const view,
+                                                           size_t const index,
+                                                           char const **const value);
+
+// Spec images
+AC_API struct ac_status ac_spec_image_compile(struct ac_multi_command_spec const *const root,
+                                              void **const image, size_t *const image_sz);
+AC_API struct ac_status ac_spec_image_from_buffer(void const *const buffer, size_t const buffer_sz,
+                                                  struct ac_spec_image *const image);
+AC_API struct ac_status ac_spec_image_map(char const *const path,
+                                          struct ac_spec_image *const image);
+AC_API void ac_spec_image_unmap(struct ac_spec_image *const image);
+AC_API struct ac_status ac_spec_image_parse(struct ac_spec_image const *const image, int const argc,
+                                            char const *const *const argv,
+                                            struct ac_image_command *const args);
+AC_API struct ac_image_option_value *
+ac_image_extract_option(struct ac_image_command const *const command, char const *const long_name);
+AC_API void ac_image_command_release(struct ac_image_command *const command);
+
+// Shell completion
+AC_API struct ac_status ac_multi_command_complete(int const argc, char const *const *const argv,
+                                                  struct ac_multi_command_spec const *const root,
+                                                  struct ac_completion *const completion);
+AC_API struct ac_status ac_command_complete(int const argc, char const *const *const argv,
+                                            struct ac_command_spec const *const command,
+                                            struct ac_completion *const completion);
+AC_API void ac_completion_release(struct ac_completion *const completion);
+AC_API struct ac_status
+ac_multi_command_complete_print(int const argc, char const *const *const argv,
+                                struct ac_multi_command_spec const *const root, FILE *const output);
+AC_API char *ac_completion_script(enum ac_shell const shell, char const *const toolname);
+
+#if !defined(AC_EXTERN) || defined(AC_IMPLEMENTATION)
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 inline static bool _ac_char_is_alpha(char const target) {
     return 'A' <= target && target <= 'z';
 }
 
-inline static bool _ac_string_is_alpha(char const *const target, size_t const length) {
-    for(size_t i = 0; i < strnlen(target, length); i++) {
-        if(!_ac_char_is_alpha(target[i])) {
-            return false;
-        }
+// Whether `target` may appear in a long option name. Names in UTF-8 specs may also contain any
+// non-ASCII character, whose bytes all have the high bit set.
+inline static bool _ac_char_is_name(char const target, bool const utf8) {
+    return _ac_char_is_alpha(target) || (utf8 && (unsigned char) target >= 0x80);
+}
+
+inline static uint64_t _ac_fnv1a(uint64_t hash, void const *const data, size_t const length) {
+    unsigned char const *const bytes = (unsigned char const *) data;
+    for(size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
     }
+    return hash;
+}
 
-    return true;
+inline static uint64_t _ac_fnv1a_string(uint64_t const hash, char const *const string) {
+    if(string == NULL) {
+        return _ac_fnv1a(hash, "", 1);
+    }
+    return _ac_fnv1a(hash, string, strnlen(string, MAX_STRING_LEN) + 1);
 }
 
-/// @brief Parse user input using the provided @p command specification.
-/// @param argc The number of elements in @p argv
-/// @param argv The user input to be parsed. Must contain exactly @p argc elements.
-/// @note When parsing arguments from `int main(int argc, char **argv)`, the caller will
-/// typically want to cut the executable path (element 0) from the @p argv array when calling this
-/// function.
-/// @param command The command specification which describes how to parse @p argv .
-/// @param args An output structure that contains the parsed values when the return code is @c
-/// AC_ERROR_SUCCESS.
-/// @result @c AC_ERROR_SUCCESS when the user input is successfully parsed.
-__maybe_unused static struct ac_status ac_command_parse(int const                           argc,
-                                                        char const *const *const            argv,
-                                                        struct ac_command_spec const *const command,
-                                                        struct ac_command *const            args) {
-#define AC_STATUS(...) (struct ac_status){.single = command, ##__VA_ARGS__};
+// An independent hash function for each `seed`, for hash and displace tables. The final mix spreads
+// the high bits of FNV into the low bits, which are used as the index.
+inline static uint64_t _ac_hash_seeded(uint64_t const seed, void const *const data, size_t const length) {
+    uint64_t hash = _ac_fnv1a(0xcbf29ce484222325ULL ^ (seed * 0x9e3779b97f4a7c15ULL), data, length);
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash;
+}
 
-    if(argv == NULL || command == NULL || args == NULL) {
-        return AC_STATUS(.code = AC_ERROR_INVALID_PARAMETER);
+// Stamps tell whether a spec still has the contents that a structure was derived from, so that a
+// spec whose memory is reused for a different one isn't mistaken for it. They hash every field that
+// affects parsing, including the contents of strings. Memoized structures may point into the spec,
+// so their stamps include the addresses of the strings and arrays as well, while fingerprints,
+// which must be stable across processes, leave them out.
+static uint64_t _ac_stamp_string(uint64_t hash, char const *const string, bool const addresses) {
+    bool const present = string != NULL;
+    if(addresses) {
+        hash = _ac_fnv1a(hash, &string, sizeof(string));
     }
+    hash = _ac_fnv1a(hash, &present, sizeof(present));
+    return _ac_fnv1a_string(hash, string);
+}
 
-    if(argc > MAX_NUM_ARGS) {
-        return AC_STATUS(.code = AC_ERROR_ARGUMENT_MAX_EXCEEDED, .context = (void *) (size_t) argc);
+static uint64_t _ac_stamp_option(uint64_t hash, struct ac_option_spec const *const option,
+                                 bool const addresses) {
+    char const flags[] = {(char) option->has_short_name, option->short_name, (char) option->is_flag,
+                          (char) option->required};
+    hash = _ac_stamp_string(hash, option->long_name, addresses);
+    hash = _ac_stamp_string(hash, option->help, addresses);
+    hash = _ac_fnv1a(hash, flags, sizeof(flags));
+    hash = _ac_stamp_string(hash, option->env, addresses);
+    hash = _ac_stamp_string(hash, option->default_value, addresses);
+    hash = _ac_fnv1a(hash, &option->n_choices, sizeof(option->n_choices));
+    if(addresses) {
+        hash = _ac_fnv1a(hash, &option->choices, sizeof(option->choices));
+    }
+    for(size_t i = 0; option->choices != NULL && i < option->n_choices; i++) {
+        hash = _ac_stamp_string(hash, option->choices[i], addresses);
     }
+    return hash;
+}
 
-    bzero(args, sizeof(*args));
+static uint64_t _ac_stamp_options(uint64_t hash, struct ac_option_spec const *const options,
+                                  size_t const n_options, bool const addresses) {
+    hash = _ac_fnv1a(hash, &n_options, sizeof(n_options));
+    if(addresses) {
+        hash = _ac_fnv1a(hash, &options, sizeof(options));
+    }
+    for(size_t i = 0; options != NULL && i < n_options; i++) {
+        hash = _ac_stamp_option(hash, &options[i], addresses);
+    }
+    return hash;
+}
 
-    // We're going to continually reference the length of these strings, so
-    // pre-populate an array for fast lookup.
-    size_t strlens[MAX_NUM_ARGS] = {0};
-    for(size_t i = 0; i < argc; i++) {
-        strlens[i] = strnlen(argv[i], MAX_STRING_LEN);
+static uint64_t _ac_stamp_command(uint64_t hash, struct ac_command_spec const *const command,
+                                  bool const addresses) {
+    char const flags[] = {(char) command->allow_abbreviations, (char) command->utf8};
+    hash = _ac_stamp_string(hash, command->help, addresses);
+    hash = _ac_fnv1a(hash, flags, sizeof(flags));
+    hash = _ac_fnv1a(hash, &command->n_arguments, sizeof(command->n_arguments));
+    for(size_t i = 0; command->arguments != NULL && i < command->n_arguments; i++) {
+        hash = _ac_stamp_string(hash, command->arguments[i].name, addresses);
+        hash = _ac_stamp_string(hash, command->arguments[i].help, addresses);
+    }
+    hash = _ac_stamp_options(hash, command->options, command->n_options, addresses);
+    hash = _ac_fnv1a(hash, &command->n_constraints, sizeof(command->n_constraints));
+    for(size_t i = 0; command->constraints != NULL && i < command->n_constraints; i++) {
+        struct ac_constraint_spec const *const constraint = &command->constraints[i];
+        hash = _ac_fnv1a(hash, &constraint->type, sizeof(constraint->type));
+        hash = _ac_stamp_string(hash, constraint->option, addresses);
+        hash = _ac_fnv1a(hash, &constraint->n_options, sizeof(constraint->n_options));
+        for(size_t j = 0; constraint->options != NULL && j < constraint->n_options; j++) {
+            hash = _ac_stamp_string(hash, constraint->options[j], addresses);
+        }
     }
+    return _ac_stamp_string(hash, command->config, addresses);
+}
 
-    enum tag {
-        TAG_ARGUMENT,
-        TAG_SHORT_OPTION,
-        TAG_LONG_OPTION,
-        TAG_OPTION_VALUE,
-    };
-    enum tag tags[MAX_NUM_ARGS];
-    size_t   n_arguments        = 0;
-    size_t   n_options          = 0;
-    bool     arguments_complete = false;
-    for(size_t i = 0; i < argc; i++) {
-        // need to check for only alpha characters because e.g. '-1' is a valid
-        // value.
-        if(strlens[i] >= 3 && argv[i][0] == '-' && argv[i][1] == '-' &&
-           _ac_string_is_alpha(&argv[i][2], strlens[i])) {
-            tags[i] = TAG_LONG_OPTION;
-            n_options++;
-            arguments_complete = true;
-            continue;
+// The stamp of the names of `subcommands` and `options`, for the tables used by suggestions and
+// completions.
+static uint64_t _ac_stamp_names(struct ac_multi_command_subcommand const *const subcommands,
+                                size_t const n_subcommands, struct ac_option_spec const *const options,
+                                size_t const n_options) {
+    uint64_t hash = _ac_stamp_options(0xcbf29ce484222325ULL, options, n_options, true);
+    hash          = _ac_fnv1a(hash, &n_subcommands, sizeof(n_subcommands));
+    for(size_t i = 0; subcommands != NULL && i < n_subcommands; i++) {
+        hash = _ac_stamp_string(hash, subcommands[i].name, true);
+    }
+    return hash;
+}
+
+// Subcommands are stamped by their name and type, and by their address or their resolver, but not
+// their contents.
+static uint64_t _ac_stamp_multi(uint64_t hash, struct ac_multi_command_spec const *const multi,
+                                bool const addresses) {
+    char const flags[] = {(char) multi->allow_abbreviations, (char) multi->utf8};
+    hash = _ac_stamp_string(hash, multi->help, addresses);
+    hash = _ac_fnv1a(hash, flags, sizeof(flags));
+    hash = _ac_stamp_options(hash, multi->options, multi->n_options, addresses);
+    hash = _ac_fnv1a(hash, &multi->n_subcommands, sizeof(multi->n_subcommands));
+    if(addresses) {
+        hash = _ac_fnv1a(hash, &multi->subcommands, sizeof(multi->subcommands));
+    }
+    for(size_t i = 0; multi->subcommands != NULL && i < multi->n_subcommands; i++) {
+        struct ac_multi_command_subcommand const *const subcommand = &multi->subcommands[i];
+        hash = _ac_stamp_string(hash, subcommand->name, addresses);
+        hash = _ac_fnv1a(hash, &subcommand->type, sizeof(subcommand->type));
+        if(subcommand->type == COMMAND_LAZY) {
+            hash = _ac_stamp_string(hash, subcommand->help, addresses);
+            hash = _ac_fnv1a(hash, &subcommand->resolver, sizeof(subcommand->resolver));
+            hash = _ac_fnv1a(hash, &subcommand->resolver_context, sizeof(subcommand->resolver_context));
+        } else if(addresses) {
+            hash = _ac_fnv1a(hash, &subcommand->single, sizeof(subcommand->single));
         }
+    }
+    return hash;
+}
 
-        if(strlens[i] == 2 && argv[i][0] == '-' && _ac_char_is_alpha(argv[i][1])) {
-            tags[i] = TAG_SHORT_OPTION;
-            n_options++;
-            arguments_complete = true;
-            continue;
+// Derived structures, like lookup tables, are built from a spec the first time they're needed and
+// memoized for the lifetime of the process, keyed on the address of the spec and the kind of
+// structure. Each value carries the stamp of the spec it was derived from, and a lookup only finds
+// it while the stamp still matches, so a spec that's modified, or whose memory is reused for another
+// spec, gets new values rather than stale ones. Forgetting a spec, which happens when a spec builder
+// snapshot is released or with ac_command_spec_forget, frees its values early.
+//
+// Lookups happen on every parse, so they don't take a lock. Entries are immutable records in an
+// open-addressing table of atomic pointers, and writers, which serialize on the lock, only ever
+// replace a record with a new one or a tombstone, or the whole table with a bigger one. A lookup
+// that races with a writer may miss an entry that's being added, which only means the value is
+// built again, and then put finds the one that was added.
+//
+// Another thread may still be using a record or table when it's replaced, so records are only
+// looked up and used inside a read section, between _ac_memo_enter and _ac_memo_leave, and replaced
+// ones are retired rather than freed. Sections count towards the epoch in which they were entered,
+// and the epoch only advances once every section of the previous one has been left. Anything
+// retired during an epoch is freed when the epoch after it ends, since no section that could have
+// looked it up is left by then.
+enum _ac_memo_kind {
+    _AC_MEMO_COMPLETION,
+    _AC_MEMO_SUGGESTION,
+    _AC_MEMO_OPTION_INDEX,
+    _AC_MEMO_CONSTRAINTS,
+    _AC_MEMO_VALIDATED,
+    _AC_MEMO_CHOICES,
+    _AC_MEMO_RESOLVED,
+    _AC_MEMO_DISPATCH,
+};
+
+struct _ac_memo_record {
+    void const        *key;
+    enum _ac_memo_kind kind;
+    uint64_t           stamp;
+    void              *value;
+    // The next record retired in the same epoch.
+    struct _ac_memo_record *next;
+};
+
+struct _ac_memo_table {
+    size_t                   capacity;
+    struct _ac_memo_record **slots;
+    // The next table retired in the same epoch.
+    struct _ac_memo_table *next;
+};
+
+static struct {
+    pthread_mutex_t        lock;
+    struct _ac_memo_table *table;
+    // The records in the table, and the slots that are either records or tombstones.
+    size_t count;
+    size_t used;
+    // The current epoch, and the open sections and retired records and tables of it and the
+    // previous one, by parity.
+    size_t                  epoch;
+    size_t                  readers[2];
+    struct _ac_memo_record *retired[2];
+    struct _ac_memo_table  *retired_tables[2];
+} _ac_memo = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+// Takes the place of a removed record, so that lookups carry on probing past it.
+static struct _ac_memo_record _ac_memo_tombstone;
+
+inline static size_t _ac_memo_slot(void const *const key, enum _ac_memo_kind const kind) {
+    uint64_t hash = (uint64_t) (uintptr_t) key ^ ((uint64_t) kind << 56);
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return (size_t) hash;
+}
+
+// Retire `record`, which is freed once no read section can be using it. The lock must be held.
+static void _ac_memo_retire(struct _ac_memo_record *const record) {
+    size_t const parity = _ac_memo.epoch & 1;
+    record->next        = _ac_memo.retired[parity];
+    __atomic_store_n(&_ac_memo.retired[parity], record, __ATOMIC_RELAXED);
+}
+
+static void _ac_memo_free(struct _ac_memo_record *const record) {
+    // Every memoized value is a single allocation, except for the static result of a successful
+    // validation.
+    if(record->kind != _AC_MEMO_VALIDATED || !ac_status_is_success(*(struct ac_status *) record->value)) {
+        free(record->value);
+    }
+    free(record);
+}
+
+// Free what was retired during the previous epoch and advance, as long as no section of the
+// previous epoch is open. That happens twice at most, which frees everything when no section is
+// open at all. The lock must be held.
+static void _ac_memo_reclaim(void) {
+    for(size_t i = 0; i < 2; i++) {
+        size_t const previous = (_ac_memo.epoch + 1) & 1;
+        if(__atomic_load_n(&_ac_memo.readers[previous], __ATOMIC_SEQ_CST) != 0) {
+            break;
         }
 
-        // Anything that's not a option name is implicitly an argument or value.
-        if(!arguments_complete) {
-            n_arguments++;
-            tags[i] = TAG_ARGUMENT;
-        } else {
-            tags[i] = TAG_OPTION_VALUE;
+        struct _ac_memo_record *record = _ac_memo.retired[previous];
+        struct _ac_memo_table  *table  = _ac_memo.retired_tables[previous];
+        __atomic_store_n(&_ac_memo.retired[previous], NULL, __ATOMIC_RELAXED);
+        __atomic_store_n(&_ac_memo.retired_tables[previous], NULL, __ATOMIC_RELAXED);
+        while(record != NULL) {
+            struct _ac_memo_record *const next = record->next;
+            _ac_memo_free(record);
+            record = next;
         }
+        while(table != NULL) {
+            struct _ac_memo_table *const next = table->next;
+            free(table);
+            table = next;
+        }
+        __atomic_store_n(&_ac_memo.epoch, _ac_memo.epoch + 1, __ATOMIC_SEQ_CST);
     }
+}
 
-    if(n_arguments > command->n_arguments) {
-        return AC_STATUS(.code = AC_ERROR_ARGUMENT_EXCEEDED_SPEC, .context = (void *) n_arguments);
+// Enter a read section, in which memoized values that are looked up stay valid even if they're
+// forgotten. Returns the epoch to pass to _ac_memo_leave.
+static size_t _ac_memo_enter(void) {
+    for(;;) {
+        size_t const epoch = __atomic_load_n(&_ac_memo.epoch, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&_ac_memo.readers[epoch & 1], 1, __ATOMIC_SEQ_CST);
+        // If the epoch advanced in the meantime, what was retired before this section counted may
+        // already be freed, so it counts towards the new epoch instead.
+        if(__atomic_load_n(&_ac_memo.epoch, __ATOMIC_SEQ_CST) == epoch) {
+            return epoch;
+        }
+        __atomic_sub_fetch(&_ac_memo.readers[epoch & 1], 1, __ATOMIC_SEQ_CST);
     }
-    if(n_arguments < command->n_arguments) {
-        return AC_STATUS(.code    = AC_ERROR_ARGUMENT_EXPECTED_IN_SPEC,
-                         .context = (void *) n_arguments);
+}
+
+// Leave a read section entered in `epoch`. Memoized values from it must not be used afterwards.
+// The lock is only taken when something is waiting to be freed.
+static void _ac_memo_leave(size_t const epoch) {
+    __atomic_sub_fetch(&_ac_memo.readers[epoch & 1], 1, __ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&_ac_memo.retired[0], __ATOMIC_RELAXED) == NULL &&
+       __atomic_load_n(&_ac_memo.retired[1], __ATOMIC_RELAXED) == NULL &&
+       __atomic_load_n(&_ac_memo.retired_tables[0], __ATOMIC_RELAXED) == NULL &&
+       __atomic_load_n(&_ac_memo.retired_tables[1], __ATOMIC_RELAXED) == NULL) {
+        return;
     }
-    if(n_options > MAX_NUM_OPTIONS) {
-        return AC_STATUS(.code = AC_ERROR_OPTION_TOO_MANY, .context = (void *) n_options);
+    pthread_mutex_lock(&_ac_memo.lock);
+    _ac_memo_reclaim();
+    pthread_mutex_unlock(&_ac_memo.lock);
+}
+
+// Find the memoized value for `key`, or NULL if there isn't one or it was derived from a spec with
+// a different `stamp`. It's valid until the enclosing read section is left.
+static void *_ac_memo_get(void const *const key, enum _ac_memo_kind const kind, uint64_t const stamp) {
+    struct _ac_memo_table const *const table = __atomic_load_n(&_ac_memo.table, __ATOMIC_ACQUIRE);
+    if(table == NULL) {
+        return NULL;
     }
 
-    struct ac_argument *const arguments =
-        n_arguments > 0 ? (struct ac_argument *) calloc(n_arguments, sizeof(*arguments)) : NULL;
-    if(n_arguments != 0 && arguments == NULL) {
-        return AC_STATUS(.code = AC_ERROR_MEMORY_ALLOC_FAILED);
+    // The probe is bounded, since records may be replaced while it's running.
+    size_t const mask = table->capacity - 1;
+    for(size_t i = 0, probe = _ac_memo_slot(key, kind); i < table->capacity; i++, probe++) {
+        struct _ac_memo_record const *const record =
+            __atomic_load_n(&table->slots[probe & mask], __ATOMIC_ACQUIRE);
+        if(record == NULL) {
+            break;
+        }
+        if(record->key == key && record->kind == kind) {
+            return record->stamp == stamp ? record->value : NULL;
+        }
     }
+    return NULL;
+}
 
-    // Arguments are assigned in the order that they appear in the command.
-    for(size_t i = 0; i < n_arguments; i++) {
-        arguments[i].value    = strdup(argv[i]);
-        arguments[i].argument = &command->arguments[i];
+// Replace the table with one that has room for another record, without tombstones. The lock must
+// be held. Returns false when memory allocation fails.
+static bool _ac_memo_grow(void) {
+    struct _ac_memo_table *const old      = _ac_memo.table;
+    size_t                       capacity = old != NULL ? old->capacity : 64;
+    while(4 * (_ac_memo.count + 1) > capacity) {
+        capacity *= 2;
     }
 
-    struct ac_option *options =
-        n_options > 0 ? (struct ac_option *) calloc(n_options, sizeof(*options)) : NULL;
-    if(n_options != 0 && options == NULL) {
-        free(arguments);
-        return AC_STATUS(.code = AC_ERROR_MEMORY_ALLOC_FAILED);
+    struct _ac_memo_table *const table =
+        (struct _ac_memo_table *) calloc(1, sizeof(*table) + capacity * sizeof(*table->slots));
+    if(table == NULL) {
+        return false;
     }
+    table->capacity = capacity;
+    table->slots    = (struct _ac_memo_record **) &table[1];
 
-#define cleanup()                                                                                  \
-    free(arguments);                                                                               \
-    free(options)
-
-    size_t options_idx     = 0;
-    bool   expecting_value = false;
-    size_t i               = n_arguments;
-    for(; i < argc; i++) {
-        char const *const value = argv[i];
-        switch(tags[i]) {
-            case TAG_ARGUMENT: {
-                assert(false);
-            }
-            case TAG_LONG_OPTION:
-            case TAG_SHORT_OPTION: {
-                if(expecting_value) {
-                    cleanup();
-                    return AC_STATUS(.code    = AC_ERROR_OPTION_VALUE_EXPECTED,
-                                     .context = (char *) argv[i - 1]);
-                }
-
-                struct ac_option *const option = &options[options_idx];
-
-                // Find the option that this maps to in the command spec.
-                for(size_t j = 0; j < command->n_options; j++) {
-                    struct ac_option_spec const *const option_spec = &command->options[j];
-                    if(tags[i] == TAG_SHORT_OPTION) {
-                        if(option_spec->has_short_name && option_spec->short_name == value[1]) {
-                            option->option = option_spec;
-                        }
-                    } else if(tags[i] == TAG_LONG_OPTION) {
-                        if(0 == strncmp(option_spec->long_name, &value[2], strlens[i] - 2)) {
-                            option->option = option_spec;
-                        }
-                    } else {
-                        assert(false);
-                    }
-                }
-
-                if(option->option == NULL) {
-                    cleanup();
-                    return AC_STATUS(.code    = AC_ERROR_OPTION_NAME_NOT_IN_SPEC,
-                                     .context = (void *) value);
-                }
-
-                if(option->option->is_flag) {
-                    options_idx++;
-                } else {
-                    expecting_value = true;
-                }
-                break;
-            }
-            case TAG_OPTION_VALUE: {
-                if(!expecting_value) {
-                    cleanup();
-                    return AC_STATUS(.code    = AC_ERROR_OPTION_NAME_EXPECTED,
-                                     .context = (char *) value);
-                }
-
-                struct ac_option *const option = &options[options_idx];
-                assert(options->option != NULL);
-
-                option->value = strdup(value);
-
-                expecting_value = false;
-                options_idx++;
-                break;
-            }
+    for(size_t i = 0; old != NULL && i < old->capacity; i++) {
+        struct _ac_memo_record *const record = old->slots[i];
+        if(record == NULL || record == &_ac_memo_tombstone) {
+            continue;
         }
-    }
-
-    if(expecting_value) {
-        cleanup();
-        return AC_STATUS(.code = AC_ERROR_OPTION_VALUE_EXPECTED, .context = (void *) argv[i]);
-    }
-
-    // Make sure all the required options are present.
-    for(size_t i = 0; i < command->n_options; i++) {
-        struct ac_option_spec const *const option_spec = &command->options[i];
-        if(option_spec->required) {
-            bool found = false;
-            for(size_t j = 0; j < n_options; j++) {
-                if(options[j].option == option_spec) {
-                    found = true;
-                    break;
-                }
-            }
-
-            if(!found) {
-                cleanup();
-                return AC_STATUS(.code    = AC_ERROR_OPTION_NAME_REQUIRED_IN_SPEC,
-                                 .context = option_spec->long_name);
-            }
+        size_t probe = _ac_memo_slot(record->key, record->kind);
+        while(table->slots[probe & (capacity - 1)] != NULL) {
+            probe++;
         }
+        table->slots[probe & (capacity - 1)] = record;
     }
 
-    args->n_arguments = n_arguments;
-    args->arguments   = arguments;
-    args->n_options   = n_options;
-    args->options     = options;
-    args->command     = command;
-
-    return AC_STATUS(.code = AC_ERROR_SUCCESS);
-#undef cleanup
-#undef AC_STATUS
+    __atomic_store_n(&_ac_memo.table, table, __ATOMIC_RELEASE);
+    _ac_memo.used = _ac_memo.count;
+    if(old != NULL) {
+        old->next                                 = _ac_memo.retired_tables[_ac_memo.epoch & 1];
+        __atomic_store_n(&_ac_memo.retired_tables[_ac_memo.epoch & 1], old, __ATOMIC_RELAXED);
+    }
+    return true;
 }
 
-/// @brief Parse user input using the provided @p root multi-command specification.
-/// @param argc The number of elements in @p argv
-/// @param argv The user input to be parsed. Must contain exactly @p argc elements.
-/// @note When parsing arguments from @c 'int main(int argc, char **argv)', the caller will
-/// typically want to cut the executable path (element 0) from the @p argv array when calling this
-/// function.
-/// @param root The multi-command specification which describes how to parse @p argv .
-/// @param args An output structure that contains the parsed values when the return code is @c
-/// AC_ERROR_SUCCESS.
-/// @result @c AC_ERROR_SUCCESS when the user input is successfully parsed.
-__maybe_unused static struct ac_status
-ac_multi_command_parse(int const argc, char const *const *const argv,
-                       struct ac_multi_command_spec const *const root,
-                       struct ac_command *const                  args) {
-    if(argc == 0 || argv == NULL || root == NULL || args == NULL) {
-        return (struct ac_status) {.code = AC_ERROR_INVALID_PARAMETER, .multi = root};
+// Memoize `value` for `key`, replacing a value with a different `stamp`, or any value when
+// `replace`. If another thread memoized a value with the same stamp first, then that value is
+// returned and the caller is responsible for releasing `value`. Returns NULL when memory allocation
+// fails.
+static void *_ac_memo_store(void const *const key, enum _ac_memo_kind const kind, uint64_t const stamp,
+                            void *const value, bool const replace) {
+    struct _ac_memo_record *const record = (struct _ac_memo_record *) malloc(sizeof(*record));
+    if(record == NULL) {
+        return NULL;
     }
+    *record = (struct _ac_memo_record) {.key = key, .kind = kind, .stamp = stamp, .value = value};
 
-    if(argc > MAX_NUM_ARGS) {
-        return (struct ac_status) {.code    = AC_ERROR_ARGUMENT_MAX_EXCEEDED,
-                                   .context = (void *) (size_t) argc,
-                                   .multi   = root};
+    pthread_mutex_lock(&_ac_memo.lock);
+    // Keep the load factor, tombstones included, at or below 1/2.
+    if((_ac_memo.table == NULL || 2 * (_ac_memo.used + 1) > _ac_memo.table->capacity) &&
+       !_ac_memo_grow()) {
+        pthread_mutex_unlock(&_ac_memo.lock);
+        free(record);
+        return NULL;
     }
 
-    // Figure out how many of the arguments are multi-command names.
-    size_t n_command_names = 0;
-    for(size_t i = 0; i < argc; i++) {
-        size_t namelen = strnlen(argv[i], MAX_STRING_LEN);
-        if(namelen == 0 && n_command_names == 0) {
-            // Empty string is always an invalid start.
-            return (struct ac_status) {
-                .code = AC_ERROR_COMMAND_NAME_INVALID, .context = (void *) argv[i], .multi = root};
+    struct _ac_memo_table *const table    = _ac_memo.table;
+    size_t const                 mask     = table->capacity - 1;
+    struct _ac_memo_record     **vacant   = NULL;
+    void                        *result   = value;
+    size_t                       probe    = _ac_memo_slot(key, kind);
+    for(;; probe++) {
+        struct _ac_memo_record *const existing = table->slots[probe & mask];
+        if(existing == NULL) {
+            break;
+        }
+        if(existing == &_ac_memo_tombstone) {
+            vacant = vacant != NULL ? vacant : &table->slots[probe & mask];
+            continue;
         }
-        if(namelen == 0 || argv[i][0] == '-') {
+        if(existing->key == key && existing->kind == kind) {
             break;
         }
-        n_command_names++;
     }
 
-    // Traverse the command tree to resolve the command.
-    struct ac_multi_command_spec const *curr_node = root;
-    struct ac_command_spec const       *command   = NULL;
-    size_t                              i         = 0;
-    for(; (i < n_command_names) && (command == NULL); i++) {
-        char const *const curr_name = argv[i];
-        bool              found     = false;
+    struct _ac_memo_record *const existing = table->slots[probe & mask];
+    if(existing != NULL && existing->stamp == stamp && !replace) {
+        result = existing->value;
+        free(record);
+    } else if(existing != NULL) {
+        __atomic_store_n(&table->slots[probe & mask], record, __ATOMIC_RELEASE);
+        _ac_memo_retire(existing);
+    } else {
+        if(vacant == NULL) {
+            vacant = &table->slots[probe & mask];
+            _ac_memo.used++;
+        }
+        __atomic_store_n(vacant, record, __ATOMIC_RELEASE);
+        _ac_memo.count++;
+    }
 
-        for(size_t j = 0; j < curr_node->n_subcommands; j++) {
-            if(0 == strncmp(curr_node->subcommands[j].name, curr_name, MAX_STRING_LEN)) {
-                found = true;
+    pthread_mutex_unlock(&_ac_memo.lock);
+    return result;
+}
 
-                if(curr_node->subcommands[j].type == COMMAND_SINGLE) {
-                    command = curr_node->subcommands[j].single;
-                    break;
-                }
+// Memoize `value` for `key`, replacing a value with a different `stamp`. If another thread memoized
+// a value with the same stamp first, then that value is returned and the caller is responsible for
+// releasing `value`. Returns NULL when memory allocation fails.
+static void *_ac_memo_put(void const *const key, enum _ac_memo_kind const kind, uint64_t const stamp,
+                          void *const value) {
+    return _ac_memo_store(key, kind, stamp, value, false);
+}
 
-                // If this is the last iteration, then we expect the node to be single.
-                if(i + 1 == n_command_names) {
-                    return (struct ac_status) {.code    = AC_ERROR_COMMAND_NAME_REQUIRED,
-                                               .multi   = curr_node,
-                                               .context = (char *) curr_name};
-                }
+// Forget everything memoized for keys in [begin, end), for specs whose memory is about to be freed
+// or reused. The values are retired, and freed once no read section can be using them.
+static void _ac_memo_forget(void const *const begin, void const *const end) {
+    pthread_mutex_lock(&_ac_memo.lock);
+    struct _ac_memo_table *const table = _ac_memo.table;
+    for(size_t i = 0; table != NULL && i < table->capacity; i++) {
+        struct _ac_memo_record *const record = table->slots[i];
+        if(record == NULL || record == &_ac_memo_tombstone ||
+           (uintptr_t) record->key < (uintptr_t) begin || (uintptr_t) record->key >= (uintptr_t) end) {
+            continue;
+        }
+        __atomic_store_n(&table->slots[i], &_ac_memo_tombstone, __ATOMIC_RELEASE);
+        _ac_memo.count--;
+        _ac_memo_retire(record);
+    }
+    _ac_memo_reclaim();
+    pthread_mutex_unlock(&_ac_memo.lock);
+}
 
-                // Otherwise we've found a matching subcommand, progress to the next node.
-                curr_node = curr_node->subcommands[j].multi;
+// Whether `value` is an option token: `--name`, `--name=value`, `-c` or a cluster of short options
+// like `-vvx`.
+inline static bool _ac_token_is_option(char const *const value, size_t const length,
+                                       bool const utf8) {
+    if(length >= 3 && value[0] == '-' && value[1] == '-') {
+        // need to check for only alpha characters because e.g. '-1' is a valid value.
+        size_t i = 2;
+        while(i < length && value[i] != '=') {
+            if(!_ac_char_is_name(value[i], utf8)) {
+                return false;
             }
+            i++;
         }
+        return i > 2;
+    }
 
-        if(!found) {
-            return (struct ac_status) {.code    = AC_ERROR_COMMAND_NAME_NOT_IN_SPEC,
-                                       .context = (void *) curr_name,
-                                       .multi   = curr_node};
+    if(length < 2 || value[0] != '-') {
+        return false;
+    }
+    for(size_t i = 1; i < length; i++) {
+        if(!_ac_char_is_alpha(value[i])) {
+            return false;
         }
     }
-
-    assert(command != NULL);
-
-    return ac_command_parse(argc - i, &argv[i], command, args);
+    return true;
 }
 
-static size_t _ac_strcpy_safe(char dst[], char const src[], size_t const offset,
-                              size_t const dst_len) {
-    size_t const src_len = strnlen(src, MAX_STRING_LEN);
-
-    if(offset + src_len + 1 >= dst_len) {
-        return 0;
+// The length of the name in the option token `value`, which ends at the '=' of `--name=value`.
+inline static size_t _ac_option_name_length(char const *const value, size_t const length) {
+    if(length < 2 || value[1] != '-') {
+        return length;
     }
-
-    memcpy(&dst[offset], src, src_len);
-    dst[offset + src_len] = '\0';
-    return src_len;
+    char const *const equals = (char const *) memchr(value, '=', length);
+    return equals != NULL ? (size_t) (equals - value) : length;
 }
 
-/// @brief Generate a help text string for the given @p command specification
-/// @param command The command to generate a help string for.
-/// @param toolpath [optional] The path to the binary that executes this tools. If not `NULL`, a
-///                 usage line will be inserted into the help message.
-/// @result A help string if successful, otherwise @c NULL.
-__maybe_unused static char *ac_command_help(struct ac_command_spec const *const command,
-                                            char const *const                   toolpath) {
-    char *const help = (char *) malloc(HELP_BUFFER_SZ);
-    if(help == NULL) {
-        return NULL;
+// The most entries that the option token `value` can resolve to. A run of the same flag in a cluster
+// like `-vvvv` collapses into one entry with a count, so each run is counted rather than each
+// character.
+inline static size_t _ac_option_token_entries(char const *const value, size_t const length) {
+    if(value[1] == '-') {
+        return 1;
     }
 
-    size_t cursor = 0;
-    cursor += _ac_strcpy_safe(help, command->help, cursor, HELP_BUFFER_SZ);
-    cursor += _ac_strcpy_safe(help, "\n", cursor, HELP_BUFFER_SZ);
+    size_t n_entries = 1;
+    for(size_t c = 2; c < length; c++) {
+        n_entries += value[c] != value[c - 1] ? 1 : 0;
+    }
+    return n_entries;
+}
 
-    if(toolpath) {
-        cursor += _ac_strcpy_safe(help, "\nUsage: ", cursor, HELP_BUFFER_SZ);
-        cursor += _ac_strcpy_safe(help, toolpath, cursor, HELP_BUFFER_SZ);
-        for(size_t i = 0; i < command->n_arguments; i++) {
-            cursor += _ac_strcpy_safe(help, " <", cursor, HELP_BUFFER_SZ);
-            cursor += _ac_strcpy_safe(help, command->arguments[i].name, cursor, HELP_BUFFER_SZ);
-            cursor += _ac_strcpy_safe(help, ">", cursor, HELP_BUFFER_SZ);
+// Validate the UTF-8 sequences in `value` from `i`, up to its terminator or `MAX_STRING_LEN`,
+// rejecting overlong encodings, surrogates and code points above U+10FFFF as RFC 3629 requires.
+static bool _ac_utf8_validate(unsigned char const *const value, size_t i, size_t *const length) {
+    while(i < MAX_STRING_LEN && value[i] != '\0') {
+        unsigned char const lead = value[i];
+        if(lead < 0x80) {
+            i++;
+            continue;
         }
-        if(command->n_options > 0) {
-            cursor += _ac_strcpy_safe(help, " {options}", cursor, HELP_BUFFER_SZ);
+
+        // The number of continuation bytes, and the range of the first one, depend on the lead.
+        size_t        n_continuations = 0;
+        unsigned char low             = 0x80;
+        unsigned char high            = 0xbf;
+        if(0xc2 <= lead && lead <= 0xdf) {
+            n_continuations = 1;
+        } else if(0xe0 <= lead && lead <= 0xef) {
+            n_continuations = 2;
+            low             = lead == 0xe0 ? 0xa0 : 0x80;
+            high            = lead == 0xed ? 0x9f : 0xbf;
+        } else if(0xf0 <= lead && lead <= 0xf4) {
+            n_continuations = 3;
+            low             = lead == 0xf0 ? 0x90 : 0x80;
+            high            = lead == 0xf4 ? 0x8f : 0xbf;
+        } else {
+            return false;
         }
-        cursor += _ac_strcpy_safe(help, "\n", cursor, HELP_BUFFER_SZ);
+
+        for(size_t j = 1; j <= n_continuations; j++) {
+            // The terminator fails this check, so a truncated sequence is never read past.
+            if(value[i + j] < (j == 1 ? low : 0x80) || value[i + j] > (j == 1 ? high : 0xbf)) {
+                return false;
+            }
+        }
+        i += n_continuations + 1;
     }
 
-    if(command->n_arguments > 0) {
-        assert(command->n_arguments <= MAX_NUM_ARGS);
-        cursor += _ac_strcpy_safe(help, "\nArguments:\n", cursor, HELP_BUFFER_SZ);
+    *length = i < MAX_STRING_LEN ? i : MAX_STRING_LEN;
+    return true;
+}
+
+#if defined(__AVX2__)
+#define _AC_SCAN_WIDTH 32
+typedef __m256i _ac_scan_block;
+#define _ac_scan_load(block) _mm256_load_si256((__m256i const *) (block))
+#define _ac_scan_zeros(bytes)                                                                      \
+    (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8((bytes), _mm256_setzero_si256()))
+#define _ac_scan_high(bytes) (uint32_t) _mm256_movemask_epi8(bytes)
+#elif defined(__SSE2__)
+#define _AC_SCAN_WIDTH 16
+typedef __m128i _ac_scan_block;
+#define _ac_scan_load(block) _mm_load_si128((__m128i const *) (block))
+#define _ac_scan_zeros(bytes)                                                                      \
+    (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8((bytes), _mm_setzero_si128()))
+#define _ac_scan_high(bytes) (uint32_t) _mm_movemask_epi8(bytes)
+#endif
 
-        size_t max_argument_name_len = 0;
-        for(size_t i = 0; i < command->n_arguments; i++) {
-            char const *const name = command->arguments[i].name;
-            assert(name != NULL);
+#if defined(__has_attribute)
+#if __has_attribute(no_sanitize)
+#define _AC_NO_SANITIZE_ADDRESS __attribute__((no_sanitize("address")))
+#endif
+#endif
+#ifndef _AC_NO_SANITIZE_ADDRESS
+#define _AC_NO_SANITIZE_ADDRESS
+#endif
 
-            size_t const name_len = strnlen(name, MAX_STRING_LEN);
-            max_argument_name_len =
-                name_len > max_argument_name_len ? name_len : max_argument_name_len;
+// Find the length of `value`, up to `MAX_STRING_LEN`, and check that it's valid UTF-8 when `utf8`
+// is set. The terminator and any non-ASCII byte are found with the same vector compare, so ASCII
+// input costs the same as `strnlen`, and only the text from the first non-ASCII byte is validated
+// byte by byte.
+_AC_NO_SANITIZE_ADDRESS static bool _ac_token_scan(char const *const value, bool const utf8,
+                                                   size_t *const length) {
+    size_t i = 0;
+#if defined(_AC_SCAN_WIDTH)
+    // Aligned loads never cross a page boundary, so reading the rest of the block after the
+    // terminator is safe. Bytes before `value` in the first block are masked off.
+    uintptr_t const offset = (uintptr_t) value % _AC_SCAN_WIDTH;
+    uint32_t        skip   = UINT32_MAX << offset;
+    for(uintptr_t block = (uintptr_t) value - offset;; block += _AC_SCAN_WIDTH) {
+        size_t const start = (size_t) (block - (uintptr_t) value);
+        if(block > (uintptr_t) value && start >= MAX_STRING_LEN) {
+            *length = MAX_STRING_LEN;
+            return true;
         }
 
-        for(size_t i = 0; i < command->n_arguments; i++) {
-            char const *const name = command->arguments[i].name;
-            assert(name != NULL);
-
-            size_t const name_len = strnlen(name, MAX_STRING_LEN);
-            cursor += _ac_strcpy_safe(help, "  ", cursor, HELP_BUFFER_SZ);
-            cursor += _ac_strcpy_safe(help, name, cursor, HELP_BUFFER_SZ);
-            for(size_t j = 0; j < (max_argument_name_len - name_len) + 1; j++) {
-                cursor += _ac_strcpy_safe(help, " ", cursor, HELP_BUFFER_SZ);
-            }
+        _ac_scan_block const bytes = _ac_scan_load(block);
+        uint32_t const       zeros = _ac_scan_zeros(bytes) & skip;
+        uint32_t const       high  = utf8 ? _ac_scan_high(bytes) & skip : 0;
+        skip                       = UINT32_MAX;
+        if((zeros | high) == 0) {
+            continue;
+        }
 
-            char *arghelp = command->arguments[i].help;
-            if(arghelp != NULL) {
-                cursor += _ac_strcpy_safe(help, arghelp, cursor, HELP_BUFFER_SZ);
-            }
-            cursor += _ac_strcpy_safe(help, "\n", cursor, HELP_BUFFER_SZ);
+        uint32_t const first_bit = (zeros | high) & (~(zeros | high) + 1);
+        size_t const   first     = start + (size_t) __builtin_ctz(first_bit);
+        if(first >= MAX_STRING_LEN || (zeros & first_bit)) {
+            *length = first < MAX_STRING_LEN ? first : MAX_STRING_LEN;
+            return true;
         }
-    }
 
-    if(command->n_options > 0) {
-        assert(command->n_options <= MAX_NUM_OPTIONS);
-        cursor += _ac_strcpy_safe(help, "\nOptions:\n", cursor, HELP_BUFFER_SZ);
+        // Everything before the first non-ASCII byte is ASCII, so validation starts there.
+        i = first;
+        break;
+    }
+#endif
+    return utf8 ? _ac_utf8_validate((unsigned char const *) value, i, length)
+                : ((*length = strnlen(value, MAX_STRING_LEN)), true);
+}
 
-        size_t max_option_name_len = 0;
-        for(size_t i = 0; i < command->n_options; i++) {
-            struct ac_option_spec const *const option = &command->options[i];
-            char const *const                  name   = option->long_name;
-            assert(name != NULL);
+// Whether `target` is a valid long option name for a spec that does or doesn't allow UTF-8.
+static bool _ac_string_is_name(char const *const target, bool const utf8) {
+    size_t length = 0;
+    if(!_ac_token_scan(target, utf8, &length)) {
+        return false;
+    }
 
-            size_t const name_len = strnlen(name, MAX_STRING_LEN);
-            max_option_name_len   = name_len > max_option_name_len ? name_len : max_option_name_len;
+    for(size_t i = 0; i < length; i++) {
+        if(!_ac_char_is_name(target[i], utf8)) {
+            return false;
         }
+    }
+    return true;
+}
 
-        for(size_t i = 0; i < command->n_options; i++) {
-            struct ac_option_spec const *const option = &command->options[i];
+// A set of options that are visible to a command. Options declared by a multi-command are visible
+// to all of its descendants, so a command sees its own options followed by one layer for each
+// multi-command between it and the root.
+struct _ac_option_layer {
+    struct ac_option_spec const *options;
+    size_t                       n_options;
+    bool                         allow_abbreviations;
+    // The multi-command that declares the options, or NULL for a command's own options.
+    struct ac_multi_command_spec const *multi;
+};
 
-            cursor += _ac_strcpy_safe(help, "  ", cursor, HELP_BUFFER_SZ);
+inline static struct _ac_option_layer _ac_option_layer_single(struct ac_command_spec const *const command) {
+    return (struct _ac_option_layer) {command->options, command->n_options,
+                                      command->allow_abbreviations, NULL};
+}
 
-            if(option->has_short_name) {
-                cursor += _ac_strcpy_safe(help, "-", cursor, HELP_BUFFER_SZ);
-                help[cursor++] = option->short_name;
-                cursor += _ac_strcpy_safe(help, ", ", cursor, HELP_BUFFER_SZ);
-            } else {
-                cursor += _ac_strcpy_safe(help, "    ", cursor, HELP_BUFFER_SZ);
-            }
+inline static struct _ac_option_layer _ac_option_layer_multi(struct ac_multi_command_spec const *const multi) {
+    return (struct _ac_option_layer) {multi->options, multi->n_options, multi->allow_abbreviations,
+                                      multi};
+}
 
-            char const *const long_name = option->long_name;
-            assert(long_name != NULL);
+// The options of a layer compiled for resolution. Lookups only touch these dense arrays, rather
+// than the option specs, whose names, flags and cold help text are interleaved with padding:
+// - The long names in sorted order, packed NUL-terminated into one pool with the length, spec index
+//   and hash of each, and the length of the longest common prefix of each name and its
+//   predecessor. The names that start with a given prefix are contiguous, so a binary search finds
+//   the first one and the LCP array tells whether it's the only one in O(1).
+// - An open addressing table of the hashes of the names, since most names are given in full.
+// - The spec index of the option with each short name plus one, and the flags of each option.
+// - A template of the results for the options with defaults, which parsing copies as a block.
+struct _ac_option_index {
+    size_t n_names;
+    size_t n_slots;
+    // The size of the allocation that holds the index.
+    size_t            size;
+    size_t            n_defaults;
+    struct ac_option *defaults;
+    uint32_t         *offsets;
+    uint32_t         *lengths;
+    uint32_t         *hashes;
+    uint32_t         *lcp;
+    uint16_t         *options;
+    // The position of each name in sorted order plus one, or zero for an empty slot.
+    uint16_t *slots;
+    uint8_t  *flags;
+    char     *pool;
+    uint16_t  shorts[128];
+};
 
-            size_t const name_len = strnlen(long_name, MAX_STRING_LEN);
-            cursor += _ac_strcpy_safe(help, "--", cursor, HELP_BUFFER_SZ);
-            cursor += _ac_strcpy_safe(help, long_name, cursor, HELP_BUFFER_SZ);
-            for(size_t j = 0; j < (max_option_name_len - name_len) + 1; j++) {
-                cursor += _ac_strcpy_safe(help, " ", cursor, HELP_BUFFER_SZ);
-            }
+// The flags of each option in an index, by spec index.
+enum _ac_option_flags {
+    _AC_OPTION_IS_FLAG  = 1 << 0,
+    _AC_OPTION_REQUIRED = 1 << 1,
+    _AC_OPTION_ENV      = 1 << 2,
+};
 
-            char const *const arghelp = option->help;
-            if(arghelp != NULL) {
-                cursor += _ac_strcpy_safe(help, arghelp, cursor, HELP_BUFFER_SZ);
-            }
-            if(option->required) {
-                cursor += _ac_strcpy_safe(help, " (required)", cursor, HELP_BUFFER_SZ);
-            }
-            cursor += _ac_strcpy_safe(help, "\n", cursor, HELP_BUFFER_SZ);
-        }
-    }
+struct _ac_option_index_name {
+    char const *name;
+    size_t      length;
+    size_t      option;
+};
 
-    return help;
+static int _ac_compare_index_names(void const *const a, void const *const b) {
+    struct _ac_option_index_name const *const a_name = (struct _ac_option_index_name const *) a;
+    struct _ac_option_index_name const *const b_name = (struct _ac_option_index_name const *) b;
+    int const order = strncmp(a_name->name, b_name->name, MAX_STRING_LEN);
+    return order != 0 ? order : (a_name->option > b_name->option) - (a_name->option < b_name->option);
 }
 
-/// @brief Generate a help text string for the given @p command multi-command specification
-/// @param command The multi-command to generate a help string for.
-/// @param toolpath [optional] The path to the binary that executes this tools. If not `NULL`, a
-///                 usage line will be inserted into the help message.
-/// @result A help string if successful, otherwise @c NULL.
-__maybe_unused static char *ac_multi_command_help(struct ac_multi_command_spec const *const command,
-                                                  char const *const toolpath) {
-    char *const help = (char *) malloc(HELP_BUFFER_SZ);
-    if(help == NULL) {
+inline static uint32_t _ac_option_index_hash(char const *const name, size_t const length) {
+    return (uint32_t) _ac_hash_seeded(0, name, length);
+}
+
+inline static char const *_ac_option_index_name(struct _ac_option_index const *const index,
+                                                size_t const                         position) {
+    return &index->pool[index->offsets[position]];
+}
+
+// Find the memoized index of the options in `layer`, building it on first use. Returns NULL when
+// the layer has more options than its 16-bit indices can hold, or memory allocation fails.
+static struct _ac_option_index const *_ac_option_index(struct _ac_option_layer const layer) {
+    uint64_t const stamp = _ac_stamp_options(0xcbf29ce484222325ULL, layer.options, layer.n_options, true);
+    struct _ac_option_index *index =
+        (struct _ac_option_index *) _ac_memo_get(layer.options, _AC_MEMO_OPTION_INDEX, stamp);
+    if(index != NULL) {
+        return index;
+    }
+    if(layer.n_options > MAX_NUM_SPEC_OPTIONS) {
         return NULL;
     }
 
-    size_t cursor = 0;
+    size_t const n_names = layer.n_options;
+    struct _ac_option_index_name *const names =
+        (struct _ac_option_index_name *) calloc(n_names > 0 ? n_names : 1, sizeof(*names));
+    if(names == NULL) {
+        return NULL;
+    }
 
-    if(command->help != NULL) {
-        cursor += _ac_strcpy_safe(help, command->help, cursor, HELP_BUFFER_SZ);
-        cursor += _ac_strcpy_safe(help, "\n", cursor, HELP_BUFFER_SZ);
+    size_t pool_size = 0;
+    for(size_t i = 0; i < n_names; i++) {
+        names[i] = (struct _ac_option_index_name) {
+            .name   = layer.options[i].long_name,
+            .length = strnlen(layer.options[i].long_name, MAX_STRING_LEN),
+            .option = i,
+        };
+        pool_size += names[i].length + 1;
     }
+    qsort(names, n_names, sizeof(*names), _ac_compare_index_names);
 
-    if(toolpath) {
-        cursor += _ac_strcpy_safe(help, "\nUsage: ", cursor, HELP_BUFFER_SZ);
-        cursor += _ac_strcpy_safe(help, toolpath, cursor, HELP_BUFFER_SZ);
-        cursor += _ac_strcpy_safe(help, " {subcommands}\n", cursor, HELP_BUFFER_SZ);
+    size_t n_defaults = 0;
+    for(size_t i = 0; i < n_names; i++) {
+        n_defaults += layer.options[i].default_value != NULL && !layer.options[i].is_flag ? 1 : 0;
     }
 
-    size_t max_command_name_len = 0;
-    for(size_t i = 0; i < command->n_subcommands; i++) {
-        assert(command->subcommands[i].name != NULL);
-        size_t const name_len = strnlen(command->subcommands[i].name, MAX_STRING_LEN);
-        max_command_name_len  = name_len > max_command_name_len ? name_len : max_command_name_len;
+    // The arrays are laid out after the header from the widest element type to the narrowest.
+    size_t n_slots = 4;
+    while(n_slots < 2 * n_names) {
+        n_slots *= 2;
+    }
+    size_t const size = sizeof(*index) + n_defaults * sizeof(struct ac_option) +
+                        n_names * (4 * sizeof(uint32_t) + sizeof(uint16_t) + 1) +
+                        n_slots * sizeof(uint16_t) + pool_size;
+    index = (struct _ac_option_index *) calloc(1, size);
+    if(index == NULL) {
+        free(names);
+        return NULL;
     }
 
-    cursor += _ac_strcpy_safe(help, "\nCommands:\n", cursor, HELP_BUFFER_SZ);
-    for(size_t i = 0; i < command->n_subcommands; i++) {
-        cursor += _ac_strcpy_safe(help, "  ", cursor, HELP_BUFFER_SZ);
-        cursor += _ac_strcpy_safe(help, command->subcommands[i].name, cursor, HELP_BUFFER_SZ);
+    index->n_names = n_names;
+    index->n_slots = n_slots;
+    index->size       = size;
+    index->n_defaults = n_defaults;
+    index->defaults   = (struct ac_option *) &index[1];
+    index->offsets    = (uint32_t *) &index->defaults[n_defaults];
+    index->lengths = &index->offsets[n_names];
+    index->hashes  = &index->lengths[n_names];
+    index->lcp     = &index->hashes[n_names];
+    index->options = (uint16_t *) &index->lcp[n_names];
+    index->slots   = &index->options[n_names];
+    index->flags   = (uint8_t *) &index->slots[n_slots];
+    index->pool    = (char *) &index->flags[n_names];
 
-        size_t const name_len = strnlen(command->subcommands[i].name, MAX_STRING_LEN);
-        for(size_t j = 0; j < (max_command_name_len - name_len) + 1; j++) {
-            cursor += _ac_strcpy_safe(help, " ", cursor, HELP_BUFFER_SZ);
-        }
+    size_t cursor = 0;
+    for(size_t i = 0; i < n_names; i++) {
+        memcpy(&index->pool[cursor], names[i].name, names[i].length);
+        index->offsets[i] = (uint32_t) cursor;
+        index->lengths[i] = (uint32_t) names[i].length;
+        index->hashes[i]  = _ac_option_index_hash(names[i].name, names[i].length);
+        index->options[i] = (uint16_t) names[i].option;
+        cursor += names[i].length + 1;
 
-        switch(command->subcommands[i].type) {
-            case COMMAND_SINGLE: {
-                if(command->subcommands[i].single->help) {
-                    cursor += _ac_strcpy_safe(help, command->subcommands[i].single->help, cursor,
-                                              HELP_BUFFER_SZ);
-                }
+        // Equal names keep the first option, like the binary search.
+        for(size_t probe = index->hashes[i];; probe++) {
+            uint16_t *const slot = &index->slots[probe & (n_slots - 1)];
+            if(*slot == 0) {
+                *slot = (uint16_t) (i + 1);
                 break;
             }
-            case COMMAND_MULTI: {
-                if(command->subcommands[i].multi->help) {
-                    cursor += _ac_strcpy_safe(help, command->subcommands[i].multi->help, cursor,
-                                              HELP_BUFFER_SZ);
-                }
+            if(index->hashes[*slot - 1] == index->hashes[i] &&
+               index->lengths[*slot - 1] == names[i].length &&
+               0 == memcmp(_ac_option_index_name(index, *slot - 1), names[i].name, names[i].length)) {
                 break;
             }
         }
-        cursor += _ac_strcpy_safe(help, "\n", cursor, HELP_BUFFER_SZ);
-    }
-
-    return help;
-}
 
-/// @brief Determine if the provided `command` is a valid spec, therefore may safely be passed to
-/// `ac_command_parse`.
-/// @result `AC_ERROR_SUCCESS` when the `command` is valid.
-__maybe_unused static struct ac_status
-ac_command_validate(struct ac_command_spec const *const command) {
-    if(command == NULL) {
-        return (struct ac_status) {.code = AC_ERROR_INVALID_PARAMETER};
+        if(i > 0) {
+            size_t lcp = 0;
+            while(lcp < names[i - 1].length && names[i - 1].name[lcp] == names[i].name[lcp]) {
+                lcp++;
+            }
+            index->lcp[i] = (uint32_t) lcp;
+        }
     }
+    free(names);
 
-    for(size_t i = 0; i < command->n_arguments; i++) {
-        struct ac_argument_spec const *const arg = &command->arguments[i];
-        if(arg->name == NULL) {
-            return (struct ac_status) {.code    = AC_ERROR_ARGUMENT_SPEC_NEEDS_NAME,
-                                       .context = (void *) i};
+    for(size_t i = 0; i < n_names; i++) {
+        struct ac_option_spec const *const option = &layer.options[i];
+        index->flags[i] = (uint8_t) ((option->is_flag ? _AC_OPTION_IS_FLAG : 0) |
+                                     (option->required ? _AC_OPTION_REQUIRED : 0) |
+                                     (option->env != NULL ? _AC_OPTION_ENV : 0));
+        if(option->has_short_name && (unsigned char) option->short_name < 128) {
+            index->shorts[(unsigned char) option->short_name] = (uint16_t) (i + 1);
         }
     }
 
-    for(size_t i = 0; i < command->n_options; i++) {
-        struct ac_option_spec const *const option = &command->options[i];
-        if(option->long_name == NULL) {
-            return (struct ac_status) {.code    = AC_ERROR_OPTION_SPEC_NEEDS_NAME,
-                                       .context = (void *) i};
-        }
-        if(!_ac_string_is_alpha(option->long_name, strnlen(option->long_name, MAX_STRING_LEN))) {
-            return (struct ac_status) {.code    = AC_ERROR_OPTION_LONG_NAME_INVALID,
-                                       .context = (void *) i};
+    // The defaults are resolved to results once, including the index of the choice.
+    for(size_t i = 0, j = 0; i < n_names; i++) {
+        struct ac_option_spec const *const option = &layer.options[i];
+        if(option->default_value == NULL || option->is_flag) {
+            continue;
         }
-        if(option->has_short_name && !_ac_char_is_alpha(option->short_name)) {
-            return (struct ac_status) {.code    = AC_ERROR_OPTION_SHORT_NAME_INVALID,
-                                       .context = (void *) i};
+
+        size_t choice = 0;
+        while(choice < option->n_choices &&
+              0 != strncmp(option->choices[choice], option->default_value, MAX_STRING_LEN)) {
+            choice++;
         }
-        if(option->is_flag && option->required) {
-            return (struct ac_status) {.code    = AC_ERROR_OPTION_FLAG_AND_REQUIRED,
-                                       .context = (void *) i};
+        index->defaults[j++] = (struct ac_option) {
+            .option = option,
+            .value  = option->default_value,
+            .count  = 1,
+            .choice = choice,
+            .source = SOURCE_DEFAULT,
+        };
+    }
+
+    struct _ac_option_index *const memoized =
+        (struct _ac_option_index *) _ac_memo_put(layer.options, _AC_MEMO_OPTION_INDEX, stamp, index);
+    if(memoized != index) {
+        free(index);
+    }
+    return memoized;
+}
+
+// The position of the name in `index` that is exactly `name`, or `index->n_names`.
+static size_t _ac_option_index_exact(struct _ac_option_index const *const index,
+                                     char const *const name, size_t const length) {
+    uint32_t const hash = _ac_option_index_hash(name, length);
+    for(size_t probe = hash;; probe++) {
+        uint16_t const slot = index->slots[probe & (index->n_slots - 1)];
+        if(slot == 0) {
+            return index->n_names;
+        }
+        if(index->hashes[slot - 1] == hash && index->lengths[slot - 1] == length &&
+           0 == memcmp(_ac_option_index_name(index, slot - 1), name, length)) {
+            return slot - 1;
+        }
+    }
+}
+
+// The position of the first name in `index` that isn't less than `prefix`.
+static size_t _ac_option_index_lower_bound(struct _ac_option_index const *const index,
+                                           char const *const prefix, size_t const length) {
+    size_t low = 0, high = index->n_names;
+    while(low < high) {
+        size_t const mid = low + (high - low) / 2;
+        if(strncmp(_ac_option_index_name(index, mid), prefix, length) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+// The result of looking an option name up in a layer.
+enum _ac_option_match {
+    _AC_OPTION_MATCH_NONE,
+    _AC_OPTION_MATCH_FOUND,
+    _AC_OPTION_MATCH_AMBIGUOUS,
+};
+
+// Find the option in a single layer that matches the option name token in `value`.
+static enum _ac_option_match _ac_option_find(struct _ac_option_layer const  layer,
+                                             char const *const              value,
+                                             size_t const                   length,
+                                             struct ac_option_spec const  **found) {
+    *found = NULL;
+    if(layer.n_options == 0) {
+        return _AC_OPTION_MATCH_NONE;
+    }
+
+    struct _ac_option_index const *const index = _ac_option_index(layer);
+    if(index == NULL) {
+        return _AC_OPTION_MATCH_NONE;
+    }
+
+    if(value[1] != '-') {
+        size_t const option = (unsigned char) value[1] < 128 ? index->shorts[(unsigned char) value[1]] : 0;
+        if(option == 0) {
+            return _AC_OPTION_MATCH_NONE;
+        }
+        *found = &layer.options[option - 1];
+        return _AC_OPTION_MATCH_FOUND;
+    }
+
+    // An exact match takes precedence over any longer name that it's a prefix of.
+    char const *const prefix     = &value[2];
+    size_t const      prefix_len = length - 2;
+    size_t const      exact      = _ac_option_index_exact(index, prefix, prefix_len);
+    if(exact < index->n_names) {
+        *found = &layer.options[index->options[exact]];
+        return _AC_OPTION_MATCH_FOUND;
+    }
+    if(!layer.allow_abbreviations) {
+        return _AC_OPTION_MATCH_NONE;
+    }
+
+    size_t const first = _ac_option_index_lower_bound(index, prefix, prefix_len);
+    if(first == index->n_names || 0 != strncmp(_ac_option_index_name(index, first), prefix, prefix_len)) {
+        return _AC_OPTION_MATCH_NONE;
+    }
+    if(first + 1 < index->n_names && index->lcp[first + 1] >= prefix_len) {
+        return _AC_OPTION_MATCH_AMBIGUOUS;
+    }
+
+    *found = &layer.options[index->options[first]];
+    return _AC_OPTION_MATCH_FOUND;
+}
+
+// Find the option that matches `value`, checking the layers from the leaf up to the root. When the
+// name is ambiguous in a layer, the search stops and `ambiguous` is set to that layer.
+static struct ac_option_spec const *_ac_option_find_layered(struct _ac_option_layer const *const layers,
+                                                            size_t const      n_layers,
+                                                            char const *const value,
+                                                            size_t const      length,
+                                                            struct _ac_option_layer const **ambiguous) {
+    *ambiguous = NULL;
+    for(size_t i = n_layers; i > 0; i--) {
+        struct ac_option_spec const *found = NULL;
+        switch(_ac_option_find(layers[i - 1], value, length, &found)) {
+            case _AC_OPTION_MATCH_NONE:
+                break;
+            case _AC_OPTION_MATCH_FOUND:
+                return found;
+            case _AC_OPTION_MATCH_AMBIGUOUS:
+                *ambiguous = &layers[i - 1];
+                return NULL;
+        }
+    }
+
+    return NULL;
+}
+
+// Resolve the option token `value` into entries appended to `options`, checking `own` when it's set
+// and then `layers` from the leaf up to the root. A cluster like `-vvx` is resolved with one lookup
+// per character, and a run of the same flag becomes one entry with a count. Only the last option in
+// a cluster may take a value. The value of `--name=value` points into `value`, and `pending` is set
+// when the last entry takes its value from the next token instead.
+static struct ac_status _ac_option_token_resolve(struct _ac_option_layer const *const own,
+                                                 struct _ac_option_layer const *const layers,
+                                                 size_t const n_layers, char const *const value,
+                                                 size_t const length, struct ac_option *const options,
+                                                 size_t *const n_options, bool *const pending) {
+    *pending = false;
+
+    bool const   cluster  = value[1] != '-' && length > 2;
+    size_t const name_len = _ac_option_name_length(value, length);
+    size_t const first    = *n_options;
+    for(size_t c = 1; c < (cluster ? length : 2); c++) {
+        // Each character of a cluster is looked up as its own short option.
+        char const        short_name[2] = {'-', value[c]};
+        char const *const name          = cluster ? short_name : value;
+
+        struct _ac_option_layer const *ambiguous = NULL;
+        struct ac_option_spec const   *option    = NULL;
+        if(own != NULL && _AC_OPTION_MATCH_AMBIGUOUS ==
+                              _ac_option_find(*own, name, cluster ? 2 : name_len, &option)) {
+            ambiguous = own;
+        } else if(option == NULL) {
+            option = _ac_option_find_layered(layers, n_layers, name, cluster ? 2 : name_len,
+                                             &ambiguous);
+        }
+
+        if(ambiguous != NULL) {
+            return (struct ac_status) {.code    = AC_ERROR_OPTION_NAME_AMBIGUOUS,
+                                       .multi   = ambiguous->multi,
+                                       .context = (void *) value};
+        }
+        if(option == NULL) {
+            return (struct ac_status) {.code = AC_ERROR_OPTION_NAME_NOT_IN_SPEC, .context = (void *) value};
+        }
+
+        if(*n_options > first && options[*n_options - 1].option == option && option->is_flag) {
+            options[*n_options - 1].count++;
+            continue;
+        }
+
+        struct ac_option *const entry = &options[(*n_options)++];
+        *entry                        = (struct ac_option) {.option = option, .count = 1};
+        if(option->is_flag) {
+            if(name_len < length) {
+                return (struct ac_status) {.code    = AC_ERROR_OPTION_VALUE_UNEXPECTED,
+                                           .context = (void *) value};
+            }
+        } else if(name_len < length) {
+            entry->value = (char *) &value[name_len + 1];
+        } else if(cluster && c + 1 < length) {
+            return (struct ac_status) {.code = AC_ERROR_OPTION_VALUE_EXPECTED, .context = (void *) value};
+        } else {
+            *pending = true;
+        }
+    }
+
+    return (struct ac_status) {.code = AC_ERROR_SUCCESS};
+}
+
+// The constraints of a command compiled into bit masks over the indices of its options.
+struct _ac_constraints {
+    size_t n_words;
+    size_t n_constraints;
+    struct _ac_constraint {
+        enum ac_constraint_type type;
+        size_t                  option;
+        uint64_t const         *mask;
+    } *constraints;
+};
+
+// Find the index of the option with `long_name` in `command`, or `command->n_options`.
+static size_t _ac_constraint_option(struct ac_command_spec const *const command,
+                                    char const *const                   long_name) {
+    size_t i = 0;
+    for(; long_name != NULL && i < command->n_options; i++) {
+        if(0 == strncmp(command->options[i].long_name, long_name, MAX_STRING_LEN)) {
+            break;
+        }
+    }
+
+    return long_name != NULL ? i : command->n_options;
+}
+
+// Find the memoized compiled constraints of `command`, compiling them on first use. `status` is set
+// when the constraints are invalid or memory allocation fails.
+static struct _ac_constraints const *_ac_constraints(struct ac_command_spec const *const command,
+                                                     struct ac_status *const             status) {
+    uint64_t const          stamp = _ac_stamp_command(0xcbf29ce484222325ULL, command, true);
+    struct _ac_constraints *compiled =
+        (struct _ac_constraints *) _ac_memo_get(command, _AC_MEMO_CONSTRAINTS, stamp);
+    if(compiled != NULL) {
+        return compiled;
+    }
+
+    if(command->n_options > MAX_NUM_OPTIONS) {
+        *status = (struct ac_status) {.code = AC_ERROR_CONSTRAINT_INVALID, .single = command};
+        return NULL;
+    }
+
+    size_t const n_words = (command->n_options + 63) / 64;
+    compiled             = (struct _ac_constraints *) calloc(
+        1, sizeof(*compiled) +
+               command->n_constraints * (sizeof(*compiled->constraints) + n_words * sizeof(uint64_t)));
+    if(compiled == NULL) {
+        *status = (struct ac_status) {.code = AC_ERROR_MEMORY_ALLOC_FAILED, .single = command};
+        return NULL;
+    }
+
+    compiled->n_words       = n_words;
+    compiled->n_constraints = command->n_constraints;
+    compiled->constraints   = (struct _ac_constraint *) &compiled[1];
+    uint64_t *masks         = (uint64_t *) &compiled->constraints[command->n_constraints];
+    for(size_t i = 0; i < command->n_constraints; i++) {
+        struct ac_constraint_spec const *const spec = &command->constraints[i];
+        struct _ac_constraint *const           constraint = &compiled->constraints[i];
+
+        constraint->type   = spec->type;
+        constraint->option = _ac_constraint_option(command, spec->option);
+        constraint->mask   = masks;
+        bool valid         = spec->type == CONSTRAINT_ONE_OF || constraint->option < command->n_options;
+        for(size_t j = 0; valid && j < spec->n_options; j++) {
+            size_t const option = _ac_constraint_option(command, spec->options[j]);
+            valid               = option < command->n_options;
+            if(valid) {
+                masks[option / 64] |= 1ULL << (option % 64);
+            }
+        }
+
+        if(!valid) {
+            free(compiled);
+            *status = (struct ac_status) {
+                .code = AC_ERROR_CONSTRAINT_INVALID, .single = command, .context = (void *) i};
+            return NULL;
+        }
+        masks += n_words;
+    }
+
+    struct _ac_constraints *const memoized =
+        (struct _ac_constraints *) _ac_memo_put(command, _AC_MEMO_CONSTRAINTS, stamp, compiled);
+    if(memoized != compiled) {
+        free(compiled);
+    }
+    if(memoized == NULL) {
+        *status = (struct ac_status) {.code = AC_ERROR_MEMORY_ALLOC_FAILED, .single = command};
+    }
+    return memoized;
+}
+
+// The index of the lowest set bit in `mask`, which has `n_words` words and at least one bit set.
+static size_t _ac_mask_first(uint64_t const *const mask, size_t const n_words) {
+    for(size_t word = 0; word < n_words; word++) {
+        for(size_t bit = 0; mask[word] != 0 && bit < 64; bit++) {
+            if(mask[word] & (1ULL << bit)) {
+                return word * 64 + bit;
+            }
+        }
+    }
+
+    return SIZE_MAX;
+}
+
+// In collect-all mode, record `status` as a diagnostic for the element `token` of argv and return
+// true, so that parsing carries on past the error. Otherwise, or when memory allocation fails,
+// return false and the caller returns `status` as usual.
+static bool _ac_diagnose(struct ac_diagnostics *const diagnostics, size_t const token,
+                         struct ac_status const status) {
+    if(diagnostics == NULL) {
+        return false;
+    }
+
+    if(diagnostics->n_diagnostics == diagnostics->capacity) {
+        size_t const                capacity = diagnostics->capacity > 0 ? 2 * diagnostics->capacity : 8;
+        struct ac_diagnostic *const grown    = (struct ac_diagnostic *) realloc(
+            diagnostics->diagnostics, capacity * sizeof(*diagnostics->diagnostics));
+        if(grown == NULL) {
+            return false;
+        }
+        diagnostics->diagnostics = grown;
+        diagnostics->capacity    = capacity;
+    }
+
+    diagnostics->diagnostics[diagnostics->n_diagnostics++] = (struct ac_diagnostic) {
+        .code    = status.code,
+        .token   = token < AC_DIAGNOSTIC_NO_TOKEN ? (uint32_t) token : AC_DIAGNOSTIC_NO_TOKEN,
+        .multi   = status.multi,
+        .option  = status.option,
+        .context = status.context,
+    };
+    return true;
+}
+
+// Check the constraints of `command` against its `options` that were provided. In collect-all
+// mode every violation is recorded, rather than returning the first.
+static struct ac_status _ac_constraints_check(struct ac_command_spec const *const command,
+                                              struct ac_option const *const       options,
+                                              size_t const                        n_options,
+                                              struct ac_diagnostics *const        diagnostics) {
+    struct ac_status status = {.code = AC_ERROR_SUCCESS};
+    if(command->n_constraints == 0) {
+        return status;
+    }
+
+    struct _ac_constraints const *const compiled = _ac_constraints(command, &status);
+    if(compiled == NULL) {
+        return status;
+    }
+
+    // Inherited options aren't part of the command's options, so they're ignored here, and so are
+    // defaults, since the user didn't ask for them.
+    uint64_t present[MAX_NUM_OPTIONS / 64] = {0};
+    for(size_t i = 0; i < n_options; i++) {
+        struct ac_option_spec const *const option = options[i].option;
+        if(options[i].source != SOURCE_DEFAULT && option >= command->options && option < &command->options[command->n_options]) {
+            size_t const index = (size_t) (option - command->options);
+            present[index / 64] |= 1ULL << (index % 64);
+        }
+    }
+
+    size_t const n_words = compiled->n_words;
+    for(size_t i = 0; i < compiled->n_constraints; i++) {
+        struct _ac_constraint const *const constraint = &compiled->constraints[i];
+        uint64_t const *const              mask       = constraint->mask;
+        uint64_t                           violated[MAX_NUM_OPTIONS / 64];
+        bool                               any       = false;
+        struct ac_status                   violation = {.code = AC_ERROR_SUCCESS};
+
+        switch(constraint->type) {
+            case CONSTRAINT_REQUIRES:
+            case CONSTRAINT_CONFLICTS: {
+                size_t const option = constraint->option;
+                if(!(present[option / 64] & (1ULL << (option % 64)))) {
+                    break;
+                }
+
+                // The required options that are missing, or the conflicting options that are present.
+                for(size_t word = 0; word < n_words; word++) {
+                    violated[word] = constraint->type == CONSTRAINT_REQUIRES ? mask[word] & ~present[word]
+                                                                             : mask[word] & present[word];
+                    any |= violated[word] != 0;
+                }
+                if(any) {
+                    violation = (struct ac_status) {
+                        .code    = constraint->type == CONSTRAINT_REQUIRES ? AC_ERROR_CONSTRAINT_REQUIRES
+                                                                           : AC_ERROR_CONSTRAINT_CONFLICTS,
+                        .single  = command,
+                        .option  = &command->options[option],
+                        .context = command->options[_ac_mask_first(violated, n_words)].long_name};
+                }
+                break;
+            }
+            case CONSTRAINT_ONE_OF: {
+                // More than one bit is set when a word has several bits or several words have one.
+                bool multiple = false;
+                for(size_t word = 0; word < n_words; word++) {
+                    violated[word] = mask[word] & present[word];
+                    multiple |= (any && violated[word] != 0) || (violated[word] & (violated[word] - 1));
+                    any |= violated[word] != 0;
+                }
+                if(!any) {
+                    violation = (struct ac_status) {.code    = AC_ERROR_CONSTRAINT_ONE_OF_MISSING,
+                                                    .single  = command,
+                                                    .context = &command->constraints[i]};
+                }
+                if(multiple) {
+                    size_t const first = _ac_mask_first(violated, n_words);
+                    violated[first / 64] &= ~(1ULL << (first % 64));
+                    violation = (struct ac_status) {
+                        .code    = AC_ERROR_CONSTRAINT_ONE_OF_MULTIPLE,
+                        .single  = command,
+                        .option  = &command->options[first],
+                        .context = command->options[_ac_mask_first(violated, n_words)].long_name};
+                }
+                break;
+            }
+        }
+
+        if(!ac_status_is_success(violation) &&
+           !_ac_diagnose(diagnostics, AC_DIAGNOSTIC_NO_TOKEN, violation)) {
+            return violation;
+        }
+    }
+
+    return status;
+}
+
+extern char **environ;
+
+// A snapshot of the environment, taken the first time that an option with an `env` name is parsed,
+// with an open addressing hash index over the variable names. Filling any number of options from
+// the environment then costs one scan of `environ` per process, rather than one per `getenv`.
+static struct {
+    pthread_once_t once;
+    char          *strings;
+    size_t         capacity;
+    struct _ac_env_entry {
+        char const *name;
+        size_t      name_len;
+        char const *value;
+    } *entries;
+} _ac_env = {.once = PTHREAD_ONCE_INIT};
+
+static void _ac_env_snapshot(void) {
+    size_t n_variables = 0;
+    size_t size        = 0;
+    for(char **variable = environ; variable != NULL && *variable != NULL; variable++) {
+        n_variables++;
+        size += strnlen(*variable, MAX_STRING_LEN) + 1;
+    }
+
+    size_t capacity = 16;
+    while(capacity < n_variables * 2) {
+        capacity *= 2;
+    }
+
+    char *const                 strings = (char *) malloc(size > 0 ? size : 1);
+    struct _ac_env_entry *const entries =
+        (struct _ac_env_entry *) calloc(capacity, sizeof(struct _ac_env_entry));
+    if(strings == NULL || entries == NULL) {
+        free(strings);
+        free(entries);
+        return;
+    }
+
+    size_t cursor = 0;
+    for(size_t i = 0; i < n_variables; i++) {
+        size_t const len = strnlen(environ[i], MAX_STRING_LEN);
+        char *const  name = &strings[cursor];
+        memcpy(name, environ[i], len);
+        name[len] = '\0';
+        cursor += len + 1;
+
+        char *const equals = (char *) memchr(name, '=', len);
+        if(equals == NULL) {
+            continue;
+        }
+
+        // Like getenv, the first definition of a name wins.
+        size_t const name_len = (size_t) (equals - name);
+        for(size_t probe = (size_t) _ac_fnv1a(0xcbf29ce484222325ULL, name, name_len);; probe++) {
+            struct _ac_env_entry *const entry = &entries[probe & (capacity - 1)];
+            if(entry->name == NULL) {
+                *entry = (struct _ac_env_entry) {.name = name, .name_len = name_len, .value = &equals[1]};
+                break;
+            }
+            if(entry->name_len == name_len && 0 == memcmp(entry->name, name, name_len)) {
+                break;
+            }
+        }
+    }
+
+    _ac_env.strings  = strings;
+    _ac_env.capacity = capacity;
+    _ac_env.entries  = entries;
+}
+
+// The value of the environment variable `name` in the snapshot, or NULL when it isn't set.
+static char const *_ac_env_get(char const *const name) {
+    pthread_once(&_ac_env.once, _ac_env_snapshot);
+    if(_ac_env.entries == NULL) {
+        return getenv(name);
+    }
+
+    size_t const name_len = strnlen(name, MAX_STRING_LEN);
+    for(size_t probe = (size_t) _ac_fnv1a(0xcbf29ce484222325ULL, name, name_len);; probe++) {
+        struct _ac_env_entry const *const entry = &_ac_env.entries[probe & (_ac_env.capacity - 1)];
+        if(entry->name == NULL) {
+            return NULL;
+        }
+        if(entry->name_len == name_len && 0 == memcmp(entry->name, name, name_len)) {
+            return entry->value;
+        }
+    }
+}
+
+// Find the option in a single layer whose long name is exactly `name`.
+static struct ac_option_spec const *_ac_option_find_exact(struct _ac_option_layer const layer,
+                                                          char const *const             name,
+                                                          size_t const                  length) {
+    if(layer.n_options == 0) {
+        return NULL;
+    }
+
+    struct _ac_option_index const *const index = _ac_option_index(layer);
+    if(index == NULL) {
+        return NULL;
+    }
+
+    size_t const exact = _ac_option_index_exact(index, name, length);
+    return exact < index->n_names ? &layer.options[index->options[exact]] : NULL;
+}
+
+// Darwin names the modification time of a file differently from Linux and the BSDs.
+#ifdef __APPLE__
+#define _AC_STAT_MTIME(info) ((info).st_mtimespec)
+#else
+#define _AC_STAT_MTIME(info) ((info).st_mtim)
+#endif
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+// A config file of `name=value` lines, mapped privately and tokenized in place, so that the keys
+// and values are NUL-terminated strings in the mapping. Configs are cached by path and shared
+// between parse results, which hold a reference while they borrow values from it. An entry is
+// replaced when the file's identity or modification time changes.
+struct ac_config {
+    // The number of parse results that borrow from this config, plus one while it's cached.
+    size_t            refs;
+    char             *path;
+    dev_t             dev;
+    ino_t             ino;
+    off_t             size;
+    struct timespec   mtime;
+    char             *base;
+    size_t            map_size;
+    size_t            n_entries;
+    struct _ac_config_entry {
+        char const *key;
+        size_t      key_len;
+        char const *value;
+    } *entries;
+    struct ac_config *next;
+};
+
+static struct {
+    pthread_mutex_t   lock;
+    struct ac_config *head;
+} _ac_configs = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+inline static bool _ac_config_is_space(char const c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Must be called with `_ac_configs.lock` held.
+static void _ac_config_unref(struct ac_config *const config) {
+    if(--config->refs > 0) {
+        return;
+    }
+
+    if(config->base != NULL) {
+        munmap(config->base, config->map_size);
+    }
+    free(config->entries);
+    free(config->path);
+    free(config);
+}
+
+// Map the file at `path` and split it into entries. The mapping is one byte longer than the file
+// and backed by anonymous memory past the end of the file, so that the last line is terminated
+// even when the file size is a multiple of the page size.
+static struct ac_config *_ac_config_load(char const *const path, int const fd,
+                                         struct stat const *const info) {
+    struct ac_config *const config = (struct ac_config *) calloc(1, sizeof(*config));
+    if(config == NULL) {
+        return NULL;
+    }
+    size_t const path_len = strnlen(path, MAX_STRING_LEN);
+    config->path          = (char *) malloc(path_len + 1);
+    config->dev           = info->st_dev;
+    config->ino           = info->st_ino;
+    config->size          = info->st_size;
+    config->mtime         = _AC_STAT_MTIME(*info);
+    if(config->path == NULL) {
+        free(config);
+        return NULL;
+    }
+    memcpy(config->path, path, path_len);
+    config->path[path_len] = '\0';
+
+    size_t const size = (size_t) info->st_size;
+    config->map_size  = size + 1;
+    config->base      = (char *) mmap(NULL, config->map_size, PROT_READ | PROT_WRITE,
+                                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(config->base == MAP_FAILED) {
+        config->base = NULL;
+        config->refs = 1;
+        _ac_config_unref(config);
+        return NULL;
+    }
+    if(size > 0 && MAP_FAILED == mmap(config->base, size, PROT_READ | PROT_WRITE,
+                                      MAP_PRIVATE | MAP_FIXED, fd, 0)) {
+        config->refs = 1;
+        _ac_config_unref(config);
+        return NULL;
+    }
+
+    size_t n_lines = 1;
+    for(size_t i = 0; i < size; i++) {
+        n_lines += config->base[i] == '\n' ? 1 : 0;
+    }
+    config->entries = (struct _ac_config_entry *) calloc(n_lines, sizeof(*config->entries));
+    if(config->entries == NULL) {
+        config->refs = 1;
+        _ac_config_unref(config);
+        return NULL;
+    }
+
+    char *const end = &config->base[size];
+    for(char *line = config->base; line < end;) {
+        char *line_end = (char *) memchr(line, '\n', (size_t) (end - line));
+        line_end       = line_end != NULL ? line_end : end;
+        *line_end      = '\0';
+
+        while(_ac_config_is_space(*line)) {
+            line++;
+        }
+        if(*line != '\0' && *line != '#') {
+            // A line without '=' is kept with a NULL value, and reported when it's parsed.
+            char *const equals = (char *) memchr(line, '=', (size_t) (line_end - line));
+            char       *key_end = equals != NULL ? equals : line_end;
+            while(key_end > line && _ac_config_is_space(key_end[-1])) {
+                key_end--;
+            }
+
+            char *value = NULL;
+            if(equals != NULL) {
+                value = &equals[1];
+                while(_ac_config_is_space(*value)) {
+                    value++;
+                }
+                char *value_end = line_end;
+                while(value_end > value && _ac_config_is_space(value_end[-1])) {
+                    value_end--;
+                }
+                *value_end = '\0';
+            }
+            *key_end = '\0';
+
+            config->entries[config->n_entries++] = (struct _ac_config_entry) {
+                .key = line, .key_len = (size_t) (key_end - line), .value = value};
+        }
+        line = &line_end[1];
+    }
+
+    config->refs = 1;
+    return config;
+}
+
+// Find the config at `path`, loading it when it isn't cached or the file has changed, and take a
+// reference to it. A file that doesn't exist isn't an error, and `config` is set to NULL.
+static struct ac_status _ac_config_acquire(char const *const path, struct ac_config **const config) {
+    *config = NULL;
+    int const fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        return (struct ac_status) {.code    = errno == ENOENT ? AC_ERROR_SUCCESS : AC_ERROR_FILE_OPEN_FAILED,
+                                   .context = (void *) path};
+    }
+
+    struct stat info;
+    if(fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        close(fd);
+        return (struct ac_status) {.code = AC_ERROR_FILE_OPEN_FAILED, .context = (void *) path};
+    }
+
+    pthread_mutex_lock(&_ac_configs.lock);
+    struct ac_config **link = &_ac_configs.head;
+    for(; *link != NULL; link = &(*link)->next) {
+        if(0 == strncmp((*link)->path, path, MAX_STRING_LEN)) {
+            break;
+        }
+    }
+
+    struct ac_config *cached = *link;
+    if(cached != NULL && (cached->dev != info.st_dev || cached->ino != info.st_ino ||
+                          cached->size != info.st_size ||
+                          cached->mtime.tv_sec != _AC_STAT_MTIME(info).tv_sec ||
+                          cached->mtime.tv_nsec != _AC_STAT_MTIME(info).tv_nsec)) {
+        // Results that still borrow from the stale config keep it alive until they're released.
+        *link = cached->next;
+        _ac_config_unref(cached);
+        cached = NULL;
+    }
+
+    if(cached == NULL) {
+        cached = _ac_config_load(path, fd, &info);
+        if(cached != NULL) {
+            cached->next      = _ac_configs.head;
+            _ac_configs.head  = cached;
+        }
+    }
+    close(fd);
+
+    if(cached == NULL) {
+        pthread_mutex_unlock(&_ac_configs.lock);
+        return (struct ac_status) {.code = AC_ERROR_MEMORY_ALLOC_FAILED};
+    }
+    cached->refs++;
+    pthread_mutex_unlock(&_ac_configs.lock);
+
+    *config = cached;
+    return (struct ac_status) {.code = AC_ERROR_SUCCESS};
+}
+
+static void _ac_config_release(struct ac_config *const config) {
+    if(config == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&_ac_configs.lock);
+    _ac_config_unref(config);
+    pthread_mutex_unlock(&_ac_configs.lock);
+}
+
+// A minimal perfect hash of the choices of an option: each choice has its own slot in
+// [0, n_choices), so a value is resolved with two hashes and one comparison. Choices are hashed into
+// buckets, and each bucket has a displacement, the seed of a second hash, that places all of its
+// choices into free slots. The largest buckets are placed first, while most slots are free.
+struct _ac_choices {
+    size_t    n_buckets;
+    uint32_t *displacements;
+    // The index of the choice in each slot.
+    size_t *slots;
+};
+
+struct _ac_choices_bucket {
+    size_t bucket;
+    size_t size;
+};
+
+static int _ac_compare_choices_buckets(void const *const a, void const *const b) {
+    struct _ac_choices_bucket const *const a_bucket = (struct _ac_choices_bucket const *) a;
+    struct _ac_choices_bucket const *const b_bucket = (struct _ac_choices_bucket const *) b;
+    if(a_bucket->size != b_bucket->size) {
+        return a_bucket->size < b_bucket->size ? 1 : -1;
+    }
+    return (a_bucket->bucket > b_bucket->bucket) - (a_bucket->bucket < b_bucket->bucket);
+}
+
+inline static size_t _ac_choices_slot(char const *const value, size_t const length,
+                                      uint32_t const displacement, size_t const n_choices) {
+    return (size_t) (_ac_hash_seeded(displacement, value, length) % n_choices);
+}
+
+// Place the choices in `members` into free slots, returning false when no displacement fits.
+static bool _ac_choices_place(struct ac_option_spec const *const option,
+                              struct _ac_choices *const choices, size_t const bucket,
+                              size_t const *const members, size_t const n_members,
+                              size_t const *const lengths, bool *const taken) {
+    size_t const n_choices = option->n_choices;
+#define slot_of(j)                                                                                 \
+    _ac_choices_slot(option->choices[members[j]], lengths[members[j]], displacement, n_choices)
+
+    for(uint32_t displacement = 1; displacement < (1u << 20); displacement++) {
+        size_t j = 0;
+        while(j < n_members && !taken[slot_of(j)]) {
+            taken[slot_of(j)] = true;
+            j++;
+        }
+
+        if(j == n_members) {
+            for(size_t k = 0; k < n_members; k++) {
+                choices->slots[slot_of(k)] = members[k];
+            }
+            choices->displacements[bucket] = displacement;
+            return true;
+        }
+
+        // Release the slots that this attempt took.
+        for(size_t k = 0; k < j; k++) {
+            taken[slot_of(k)] = false;
+        }
+    }
+#undef slot_of
+
+    return false;
+}
+
+// Find the memoized choices table of `option`, building it on first use. This fails when the option
+// is a flag, or a choice is NULL or duplicated.
+static struct _ac_choices const *_ac_choices(struct ac_option_spec const *const option,
+                                             struct ac_status *const            status) {
+    uint64_t const      stamp   = _ac_stamp_option(0xcbf29ce484222325ULL, option, true);
+    struct _ac_choices *choices = (struct _ac_choices *) _ac_memo_get(option, _AC_MEMO_CHOICES, stamp);
+    if(choices != NULL) {
+        return choices;
+    }
+
+    size_t const n_choices = option->n_choices;
+    if(option->is_flag || option->choices == NULL) {
+        *status = (struct ac_status) {.code = AC_ERROR_OPTION_CHOICES_INVALID, .option = option};
+        return NULL;
+    }
+    for(size_t i = 0; i < n_choices; i++) {
+        if(option->choices[i] == NULL) {
+            *status = (struct ac_status) {
+                .code = AC_ERROR_OPTION_CHOICES_INVALID, .option = option, .context = (void *) i};
+            return NULL;
+        }
+    }
+
+    size_t const n_buckets = n_choices / 2 + 1;
+    choices                = (struct _ac_choices *) calloc(
+        1, sizeof(*choices) + n_choices * sizeof(*choices->slots) +
+               n_buckets * sizeof(*choices->displacements));
+    size_t *const                    lengths = (size_t *) calloc(n_choices, sizeof(size_t));
+    size_t *const                    members = (size_t *) calloc(n_choices, sizeof(size_t));
+    size_t *const                    starts  = (size_t *) calloc(n_buckets + 1, sizeof(size_t));
+    struct _ac_choices_bucket *const order =
+        (struct _ac_choices_bucket *) calloc(n_buckets, sizeof(*order));
+    bool *const taken = (bool *) calloc(n_choices, sizeof(bool));
+
+#define cleanup()                                                                                  \
+    free(lengths);                                                                                 \
+    free(members);                                                                                 \
+    free(starts);                                                                                  \
+    free(order);                                                                                   \
+    free(taken)
+
+    if(choices == NULL || lengths == NULL || members == NULL || starts == NULL || order == NULL ||
+       taken == NULL) {
+        cleanup();
+        free(choices);
+        *status = (struct ac_status) {.code = AC_ERROR_MEMORY_ALLOC_FAILED, .option = option};
+        return NULL;
+    }
+    choices->n_buckets     = n_buckets;
+    choices->slots         = (size_t *) &choices[1];
+    choices->displacements = (uint32_t *) &choices->slots[n_choices];
+
+    // Group the choices by bucket.
+#define bucket_of(i) (size_t) (_ac_hash_seeded(0, option->choices[i], lengths[i]) % n_buckets)
+    for(size_t b = 0; b < n_buckets; b++) {
+        order[b].bucket = b;
+    }
+    for(size_t i = 0; i < n_choices; i++) {
+        lengths[i] = strnlen(option->choices[i], MAX_STRING_LEN);
+        order[bucket_of(i)].size++;
+    }
+    for(size_t b = 0; b < n_buckets; b++) {
+        starts[b + 1] = starts[b] + order[b].size;
+        order[b].size = 0;
+    }
+    for(size_t i = 0; i < n_choices; i++) {
+        size_t const b                       = bucket_of(i);
+        members[starts[b] + order[b].size++] = i;
+    }
+#undef bucket_of
+
+    // Duplicates always share a bucket, so they're found by comparing the choices in each bucket.
+    size_t invalid = n_choices;
+    for(size_t b = 0; b < n_buckets && invalid == n_choices; b++) {
+        for(size_t j = starts[b]; j < starts[b + 1]; j++) {
+            for(size_t k = starts[b]; k < j; k++) {
+                if(lengths[members[j]] == lengths[members[k]] &&
+                   0 == memcmp(option->choices[members[j]], option->choices[members[k]],
+                               lengths[members[j]])) {
+                    invalid = members[j] > members[k] ? members[j] : members[k];
+                }
+            }
+        }
+    }
+
+    qsort(order, n_buckets, sizeof(*order), _ac_compare_choices_buckets);
+    for(size_t i = 0; i < n_buckets && invalid == n_choices && order[i].size > 0; i++) {
+        size_t const b = order[i].bucket;
+        if(!_ac_choices_place(option, choices, b, &members[starts[b]], order[i].size, lengths, taken)) {
+            invalid = members[starts[b]];
+        }
+    }
+    cleanup();
+#undef cleanup
+
+    if(invalid != n_choices) {
+        free(choices);
+        *status = (struct ac_status) {
+            .code = AC_ERROR_OPTION_CHOICES_INVALID, .option = option, .context = (void *) invalid};
+        return NULL;
+    }
+
+    struct _ac_choices *const memoized =
+        (struct _ac_choices *) _ac_memo_put(option, _AC_MEMO_CHOICES, stamp, choices);
+    if(memoized != choices) {
+        free(choices);
+    }
+    if(memoized == NULL) {
+        *status = (struct ac_status) {.code = AC_ERROR_MEMORY_ALLOC_FAILED, .option = option};
+    }
+    return memoized;
+}
+
+// The index of `value` in the choices of `option`, or `n_choices` when it isn't one of them.
+static size_t _ac_choices_find(struct ac_option_spec const *const option,
+                               struct _ac_choices const *const choices, char const *const value) {
+    size_t const length = strnlen(value, MAX_STRING_LEN);
+    size_t const bucket = (size_t) (_ac_hash_seeded(0, value, length) % choices->n_buckets);
+    size_t const choice = choices->slots[_ac_choices_slot(value, length, choices->displacements[bucket],
+                                                          option->n_choices)];
+    return 0 == strncmp(option->choices[choice], value, MAX_STRING_LEN) ? choice : option->n_choices;
+}
+
+// The index of the element of `argv` that `value` points into, or `AC_DIAGNOSTIC_NO_TOKEN`.
+static size_t _ac_token_of(int const argc, char const *const *const argv, size_t const *const strlens,
+                           char const *const value) {
+    for(size_t i = 0; i < argc; i++) {
+        if(value >= argv[i] && value <= &argv[i][strlens[i]]) {
+            return i;
+        }
+    }
+
+    return AC_DIAGNOSTIC_NO_TOKEN;
+}
+
+// The index of `option` among the options visible to a command: its own, and then the ones in
+// `layers` from the leaf up, like `_ac_option_layered_index`.
+static size_t _ac_option_visible_index(struct _ac_option_layer const        own,
+                                       struct _ac_option_layer const *const layers,
+                                       size_t const n_layers, struct ac_option_spec const *const option) {
+    if(option >= own.options && option < &own.options[own.n_options]) {
+        return (size_t) (option - own.options);
+    }
+
+    size_t offset = own.n_options;
+    for(size_t i = n_layers; i > 0; i--) {
+        struct _ac_option_layer const *const layer = &layers[i - 1];
+        if(option >= layer->options && option < &layer->options[layer->n_options]) {
+            return offset + (size_t) (option - layer->options);
+        }
+        offset += layer->n_options;
+    }
+
+    return offset;
+}
+
+// Parse `argv` for `command`, which inherits the options in `layers`. The `preset` options have
+// already been resolved, and are placed before the options from `argv` in the result, after the
+// defaults. `path` is a
+// hash of the names of the command path, which seeds the fingerprint of the result. With
+// `diagnostics`, errors in the user input are recorded and parsing carries on, and the first of
+// them is returned at the end.
+static struct ac_status _ac_command_parse(int const argc, char const *const *const argv,
+                                          struct ac_command_spec const *const  command,
+                                          struct _ac_option_layer const *const layers,
+                                          size_t const n_layers, struct ac_option const *const preset,
+                                          size_t const n_preset, uint64_t const path,
+                                          struct ac_diagnostics *const diagnostics,
+                                          struct ac_command *const     args) {
+#define AC_STATUS(...) (struct ac_status){.single = command, ##__VA_ARGS__};
+
+    if(argv == NULL || command == NULL || args == NULL) {
+        return AC_STATUS(.code = AC_ERROR_INVALID_PARAMETER);
+    }
+
+    if(argc > MAX_NUM_ARGS) {
+        return AC_STATUS(.code = AC_ERROR_ARGUMENT_MAX_EXCEEDED, .context = (void *) (size_t) argc);
+    }
+
+    bzero(args, sizeof(*args));
+    size_t const n_recorded = diagnostics != NULL ? diagnostics->n_diagnostics : 0;
+    if(diagnostics != NULL) {
+        diagnostics->single = command;
+    }
+
+    // User input is validated as UTF-8 when the command or any of its multi-commands allows it.
+    bool utf8 = command->utf8;
+    for(size_t i = 0; i < n_layers; i++) {
+        utf8 = utf8 || (layers[i].multi != NULL && layers[i].multi->utf8);
+    }
+
+    // We're going to continually reference the length of these strings, so they're recorded when
+    // each one is classified.
+    size_t strlens[MAX_NUM_ARGS] = {0};
+
+    enum tag {
+        TAG_ARGUMENT,
+        TAG_OPTION_NAME,
+        TAG_OPTION_VALUE,
+    };
+    enum tag tags[MAX_NUM_ARGS];
+    size_t   n_arguments        = 0;
+    size_t   n_options          = 0;
+    bool     arguments_complete = false;
+    for(size_t i = 0; i < argc; i++) {
+        if(!_ac_token_scan(argv[i], utf8, &strlens[i])) {
+            struct ac_status const status =
+                AC_STATUS(.code = AC_ERROR_UTF8_INVALID, .context = (void *) argv[i]);
+            if(!_ac_diagnose(diagnostics, i, status)) {
+                return status;
+            }
+            strlens[i] = strnlen(argv[i], MAX_STRING_LEN);
+        }
+
+        if(_ac_token_is_option(argv[i], strlens[i], utf8)) {
+            tags[i] = TAG_OPTION_NAME;
+            // Each run of a character in a cluster may be a separate option.
+            n_options += _ac_option_token_entries(argv[i], strlens[i]);
+            arguments_complete = true;
+            continue;
+        }
+
+        // Anything that's not a option name is implicitly an argument or value.
+        if(!arguments_complete) {
+            n_arguments++;
+            tags[i] = TAG_ARGUMENT;
+        } else {
+            tags[i] = TAG_OPTION_VALUE;
+        }
+    }
+
+    if(n_arguments != command->n_arguments) {
+        // The first extra argument is the one to blame, while missing ones have no token.
+        struct ac_status const status =
+            AC_STATUS(.code    = n_arguments > command->n_arguments ? AC_ERROR_ARGUMENT_EXCEEDED_SPEC
+                                                                   : AC_ERROR_ARGUMENT_EXPECTED_IN_SPEC,
+                      .context = (void *) n_arguments);
+        if(!_ac_diagnose(diagnostics,
+                         n_arguments > command->n_arguments ? command->n_arguments : AC_DIAGNOSTIC_NO_TOKEN,
+                         status)) {
+            return status;
+        }
+    }
+    n_options += n_preset;
+    if(n_options > MAX_NUM_OPTIONS) {
+        return AC_STATUS(.code = AC_ERROR_OPTION_TOO_MANY, .context = (void *) n_options);
+    }
+
+    // Options may also be filled from the environment, and then from the config file, which can
+    // provide each visible option at most once, and from defaults. Those only depend on the spec,
+    // so room is made for all of them rather than counting them towards the limit. The per-option
+    // scans read the flags of the compiled indices rather than the specs.
+    struct _ac_option_index const *indices[MAX_NUM_ARGS + 1] = {0};
+    size_t                         n_visible                 = 0;
+    size_t                         capacity                  = n_options;
+    for(size_t layer = 0; layer <= n_layers; layer++) {
+        struct _ac_option_layer const current =
+            layer == n_layers ? _ac_option_layer_single(command) : layers[layer];
+        if(current.n_options == 0) {
+            continue;
+        }
+        if(current.n_options > MAX_NUM_SPEC_OPTIONS) {
+            return AC_STATUS(.code = AC_ERROR_OPTION_TOO_MANY, .context = (void *) current.n_options);
+        }
+
+        indices[layer] = _ac_option_index(current);
+        if(indices[layer] == NULL) {
+            return AC_STATUS(.code = AC_ERROR_MEMORY_ALLOC_FAILED);
+        }
+        for(size_t j = 0; j < current.n_options; j++) {
+            capacity += indices[layer]->flags[j] & _AC_OPTION_ENV ? 1 : 0;
+        }
+        capacity += indices[layer]->n_defaults;
+        n_visible += current.n_options;
+    }
+
+    struct ac_config *config = NULL;
+    if(command->config != NULL) {
+        struct ac_status status = _ac_config_acquire(command->config, &config);
+        if(!ac_status_is_success(status)) {
+            status.single = command;
+            if(!_ac_diagnose(diagnostics, AC_DIAGNOSTIC_NO_TOKEN, status)) {
+                return status;
+            }
+            config = NULL;
+        }
+        capacity += config == NULL ? 0 : config->n_entries < n_visible ? config->n_entries : n_visible;
+    }
+
+    struct ac_argument *const arguments =
+        n_arguments > 0 ? (struct ac_argument *) calloc(n_arguments, sizeof(*arguments)) : NULL;
+    if(n_arguments != 0 && arguments == NULL) {
+        _ac_config_release(config);
+        return AC_STATUS(.code = AC_ERROR_MEMORY_ALLOC_FAILED);
+    }
+
+    // Arguments are assigned in the order that they appear in the command. Values are borrowed from
+    // the user input rather than copied. Extra arguments are only kept while collecting errors.
+    uint64_t arguments_hash = 0xcbf29ce484222325ULL;
+    for(size_t i = 0; i < n_arguments && i < command->n_arguments; i++) {
+        arguments[i].value    = (char *) argv[i];
+        arguments[i].argument = &command->arguments[i];
+        arguments_hash        = _ac_fnv1a(arguments_hash, argv[i], strlens[i] + 1);
+    }
+
+    struct ac_option *options =
+        capacity > 0 ? (struct ac_option *) calloc(capacity, sizeof(*options)) : NULL;
+    // The position in `options` plus one of the first entry for each visible option, or 0, so
+    // that the later sources can find what they override.
+    size_t *const slots = n_visible > 0 ? (size_t *) calloc(n_visible, sizeof(*slots)) : NULL;
+    if((capacity != 0 && options == NULL) || (n_visible != 0 && slots == NULL)) {
+        free(arguments);
+        free(options);
+        free(slots);
+        _ac_config_release(config);
+        return AC_STATUS(.code = AC_ERROR_MEMORY_ALLOC_FAILED);
+    }
+
+#define cleanup()                                                                                  \
+    free(arguments);                                                                               \
+    free(options);                                                                                 \
+    free(slots);                                                                                   \
+    _ac_config_release(config)
+
+    // The defaults of each layer are copied from its template as a block, and the sources that
+    // take precedence overwrite them in place. Visible indices number the command's own options
+    // first, and then the inherited ones from the leaf up.
+    struct _ac_option_layer const own = _ac_option_layer_single(command);
+    size_t                        offsets[MAX_NUM_ARGS + 1];
+    size_t                        n_defaults = 0;
+    for(size_t layer = n_layers + 1, offset = 0; layer > 0; layer--) {
+        offsets[layer - 1] = offset;
+        offset += layer - 1 == n_layers ? own.n_options : layers[layer - 1].n_options;
+    }
+    for(size_t layer = 0; layer <= n_layers; layer++) {
+        struct _ac_option_index const *const index = indices[layer];
+        if(index == NULL || index->n_defaults == 0) {
+            continue;
+        }
+        struct ac_option_spec const *const first = layer == n_layers ? own.options : layers[layer].options;
+        memcpy(&options[n_defaults], index->defaults, index->n_defaults * sizeof(*options));
+        for(size_t j = 0; j < index->n_defaults; j++, n_defaults++) {
+            slots[offsets[layer] + (size_t) (options[n_defaults].option - first)] = n_defaults + 1;
+        }
+    }
+
+    if(n_preset > 0) {
+        memcpy(&options[n_defaults], preset, n_preset * sizeof(*options));
+    }
+
+    size_t options_idx     = n_defaults + n_preset;
+    bool   expecting_value = false;
+    // After an option that couldn't be resolved, a value that follows it is assumed to be its own
+    // rather than reported as a second error.
+    bool   skip_value = false;
+    size_t i          = n_arguments;
+    for(; i < argc; i++) {
+        char const *const value = argv[i];
+        switch(tags[i]) {
+            case TAG_ARGUMENT: {
+                assert(false);
+            }
+            case TAG_OPTION_NAME: {
+                if(expecting_value) {
+                    struct ac_status const status =
+                        AC_STATUS(.code = AC_ERROR_OPTION_VALUE_EXPECTED, .context = (char *) argv[i - 1]);
+                    if(!_ac_diagnose(diagnostics, i - 1, status)) {
+                        cleanup();
+                        return status;
+                    }
+                    expecting_value = false;
+                }
+
+                // Find the options that this maps to in the command spec, or the options it
+                // inherits from its multi-commands.
+                skip_value              = false;
+                struct ac_status status = _ac_option_token_resolve(
+                    &own, layers, n_layers, value, strlens[i], options, &options_idx, &expecting_value);
+                if(!ac_status_is_success(status)) {
+                    status.single = command;
+                    if(!_ac_diagnose(diagnostics, i, status)) {
+                        cleanup();
+                        return status;
+                    }
+                    expecting_value = false;
+                    skip_value      = true;
+                }
+                break;
+            }
+            case TAG_OPTION_VALUE: {
+                if(skip_value) {
+                    skip_value = false;
+                    break;
+                }
+                if(!expecting_value) {
+                    struct ac_status const status =
+                        AC_STATUS(.code = AC_ERROR_OPTION_NAME_EXPECTED, .context = (char *) value);
+                    if(!_ac_diagnose(diagnostics, i, status)) {
+                        cleanup();
+                        return status;
+                    }
+                    break;
+                }
+
+                struct ac_option *const option = &options[options_idx - 1];
+                assert(option->option != NULL);
+
+                option->value   = (char *) value;
+                expecting_value = false;
+                break;
+            }
+        }
+    }
+
+    if(expecting_value) {
+        struct ac_status const status =
+            AC_STATUS(.code = AC_ERROR_OPTION_VALUE_EXPECTED, .context = (void *) argv[i - 1]);
+        if(!_ac_diagnose(diagnostics, i - 1, status)) {
+            cleanup();
+            return status;
+        }
+    }
+    // Entries from the command line replace the defaults of their options. A flag appears once,
+    // with the count of all of its occurrences, so `-vv -v --verbose` counts 4. Later occurrences
+    // of other options are kept after the first, which is the effective one.
+    n_options = n_defaults;
+    for(size_t j = n_defaults; j < options_idx; j++) {
+        size_t const visible = _ac_option_visible_index(own, layers, n_layers, options[j].option);
+        size_t const slot    = slots[visible];
+        if(slot != 0 && options[slot - 1].source == SOURCE_DEFAULT) {
+            options[slot - 1] = options[j];
+            continue;
+        }
+        if(slot != 0 && options[j].option->is_flag) {
+            options[slot - 1].count += options[j].count;
+            continue;
+        }
+        if(slot == 0) {
+            slots[visible] = n_options + 1;
+        }
+        options[n_options++] = options[j];
+    }
+
+    // Fill the options that weren't provided from their environment variables, including inherited
+    // ones. Flags are set by any value other than "" or "0".
+    for(size_t layer = 0; layer <= n_layers; layer++) {
+        struct _ac_option_layer const current = layer == n_layers ? own : layers[layer];
+        for(size_t j = 0; j < current.n_options; j++) {
+            if(!(indices[layer]->flags[j] & _AC_OPTION_ENV)) {
+                continue;
+            }
+            struct ac_option_spec const *const option_spec = &current.options[j];
+            size_t const                       slot        = slots[offsets[layer] + j];
+            bool const provided = slot != 0 && options[slot - 1].source != SOURCE_DEFAULT;
+            char const *const value = provided ? NULL : _ac_env_get(option_spec->env);
+            if(value == NULL || (option_spec->is_flag && (value[0] == '\0' || 0 == strcmp(value, "0")))) {
+                continue;
+            }
+
+            size_t value_len = 0;
+            if(!_ac_token_scan(value, utf8, &value_len)) {
+                struct ac_status const status =
+                    AC_STATUS(.code = AC_ERROR_UTF8_INVALID, .context = (void *) value);
+                if(!_ac_diagnose(diagnostics, AC_DIAGNOSTIC_NO_TOKEN, status)) {
+                    cleanup();
+                    return status;
+                }
+                continue;
+            }
+            struct ac_option *const entry = slot != 0 ? &options[slot - 1] : &options[n_options++];
+            slots[offsets[layer] + j]     = (size_t) (entry - options) + 1;
+            *entry                        = (struct ac_option) {
+                .option = option_spec,
+                .value  = option_spec->is_flag ? NULL : (char *) value,
+                .count  = 1,
+                .source = SOURCE_ENV,
+            };
+        }
+    }
+
+    // Then fill them from the config file, where a later line overrides an earlier one. Keys are
+    // looked up in the command's options first, and then in the inherited ones from the leaf up.
+    for(size_t j = config != NULL ? config->n_entries : 0; j > 0; j--) {
+        struct _ac_config_entry const *const entry = &config->entries[j - 1];
+        struct ac_option_spec const *option_spec = _ac_option_find_exact(own, entry->key, entry->key_len);
+        for(size_t layer = n_layers; option_spec == NULL && layer > 0; layer--) {
+            option_spec = _ac_option_find_exact(layers[layer - 1], entry->key, entry->key_len);
+        }
+        if(option_spec == NULL || entry->value == NULL) {
+            struct ac_status const status =
+                AC_STATUS(.code = AC_ERROR_CONFIG_INVALID, .context = (void *) entry->key);
+            if(!_ac_diagnose(diagnostics, AC_DIAGNOSTIC_NO_TOKEN, status)) {
+                cleanup();
+                return status;
+            }
+            continue;
+        }
+
+        size_t const visible  = _ac_option_visible_index(own, layers, n_layers, option_spec);
+        size_t const slot     = slots[visible];
+        bool const   provided = slot != 0 && options[slot - 1].source != SOURCE_DEFAULT;
+        if(provided || (option_spec->is_flag && (entry->value[0] == '\0' || 0 == strcmp(entry->value, "0")))) {
+            continue;
+        }
+
+        size_t value_len = 0;
+        if(!_ac_token_scan(entry->value, utf8, &value_len)) {
+            struct ac_status const status =
+                AC_STATUS(.code = AC_ERROR_UTF8_INVALID, .context = (void *) entry->value);
+            if(!_ac_diagnose(diagnostics, AC_DIAGNOSTIC_NO_TOKEN, status)) {
+                cleanup();
+                return status;
+            }
+            continue;
+        }
+        struct ac_option *const result = slot != 0 ? &options[slot - 1] : &options[n_options++];
+        slots[visible]                 = (size_t) (result - options) + 1;
+        *result                        = (struct ac_option) {
+            .option = option_spec,
+            .value  = option_spec->is_flag ? NULL : (char *) entry->value,
+            .count  = 1,
+            .source = SOURCE_CONFIG,
+        };
+    }
+
+    // Resolve the values of options with choices to their indices. Defaults were resolved when
+    // their template was built.
+    for(size_t j = 0; j < n_options; j++) {
+        struct ac_option *const option = &options[j];
+        if(option->option->n_choices == 0 || option->value == NULL || option->source == SOURCE_DEFAULT) {
+            continue;
+        }
+
+        struct ac_status                status  = {.code = AC_ERROR_SUCCESS};
+        struct _ac_choices const *const choices = _ac_choices(option->option, &status);
+        if(choices == NULL) {
+            cleanup();
+            status.single = command;
+            return status;
+        }
+
+        option->choice = _ac_choices_find(option->option, choices, option->value);
+        if(option->choice == option->option->n_choices) {
+            status = AC_STATUS(.code    = AC_ERROR_OPTION_VALUE_NOT_IN_CHOICES,
+                               .option  = option->option,
+                               .context = option->value);
+            size_t const token = option->source == SOURCE_ARGV
+                                     ? _ac_token_of(argc, argv, strlens, option->value)
+                                     : AC_DIAGNOSTIC_NO_TOKEN;
+            if(!_ac_diagnose(diagnostics, token, status)) {
+                cleanup();
+                return status;
+            }
+        }
+    }
+
+    // Make sure all the required options are present, including inherited ones.
+
+    for(size_t layer = 0; layer <= n_layers; layer++) {
+        struct _ac_option_layer const current = layer == n_layers ? own : layers[layer];
+        for(size_t i = 0; i < current.n_options; i++) {
+            struct ac_option_spec const *const option_spec = &current.options[i];
+            if(indices[layer]->flags[i] & _AC_OPTION_REQUIRED) {
+                if(slots[offsets[layer] + i] == 0) {
+                    struct ac_status const status = AC_STATUS(.code   = AC_ERROR_OPTION_NAME_REQUIRED_IN_SPEC,
+                                                              .option = option_spec,
+                                                              .context = option_spec->long_name);
+                    if(!_ac_diagnose(diagnostics, AC_DIAGNOSTIC_NO_TOKEN, status)) {
+                        cleanup();
+                        return status;
+                    }
+                }
+            }
+        }
+    }
+
+    struct ac_status const constraints = _ac_constraints_check(command, options, n_options, diagnostics);
+    if(!ac_status_is_success(constraints)) {
+        cleanup();
+        return constraints;
+    }
+
+    // In collect-all mode, the first error that was recorded stands for all of them.
+    if(diagnostics != NULL && diagnostics->n_diagnostics > n_recorded) {
+        struct ac_diagnostic const *const first  = &diagnostics->diagnostics[n_recorded];
+        struct ac_status const            status = AC_STATUS(.code        = first->code,
+                                                             .multi       = first->multi,
+                                                             .option      = first->option,
+                                                             .context     = first->context,
+                                                             .diagnostics = diagnostics);
+        cleanup();
+        return status;
+    }
+
+    // Only the effective value of each option counts, which is the entry that its slot points to,
+    // like ac_extract_option returns, and a flag counts all of its occurrences. Each one is hashed
+    // on its own with its visible index and the hashes are summed, so the order that options were
+    // given in doesn't matter and nothing needs to be sorted.
+    uint64_t options_hash = 0xcbf29ce484222325ULL;
+    for(size_t j = 0; j < n_options; j++) {
+        struct ac_option const *const option  = &options[j];
+        size_t const                  visible = _ac_option_visible_index(own, layers, n_layers, option->option);
+        if(slots[visible] != j + 1) {
+            continue;
+        }
+        size_t const length = option->value != NULL ? strnlen(option->value, MAX_STRING_LEN) : 0;
+        uint64_t const header[] = {visible, option->value != NULL, option->value != NULL ? length : option->count};
+        uint64_t const entry = _ac_fnv1a(_ac_fnv1a(0xcbf29ce484222325ULL, header, sizeof(header)), option->value, length);
+        options_hash += _ac_hash_seeded(visible, &entry, sizeof(entry));
+    }
+    uint64_t const parts[] = {arguments_hash, options_hash};
+
+    args->n_arguments = n_arguments;
+    args->arguments   = arguments;
+    args->n_options   = n_options;
+    args->options     = options;
+    args->command     = command;
+    args->config      = config;
+    args->fingerprint = _ac_hash_seeded(path, parts, sizeof(parts));
+
+    return AC_STATUS(.code = AC_ERROR_SUCCESS);
+#undef cleanup
+#undef AC_STATUS
+}
+
+/// @brief Parse user input using the provided @p command specification.
+/// @param argc The number of elements in @p argv
+/// @param argv The user input to be parsed. Must contain exactly @p argc elements.
+/// @note When parsing arguments from `int main(int argc, char **argv)`, the caller will
+/// typically want to cut the executable path (element 0) from the @p argv array when calling this
+/// function.
+/// @param command The command specification which describes how to parse @p argv .
+/// @param args An output structure that contains the parsed values when the return code is @c
+/// AC_ERROR_SUCCESS.
+/// @result @c AC_ERROR_SUCCESS when the user input is successfully parsed.
+AC_API struct ac_status ac_command_parse(int const                           argc,
+                                                        char const *const *const            argv,
+                                                        struct ac_command_spec const *const command,
+                                                        struct ac_command *const            args) {
+    size_t const           epoch  = _ac_memo_enter();
+    struct ac_status const status = _ac_command_parse(argc, argv, command, NULL, 0, NULL, 0, 0, NULL, args);
+    _ac_memo_leave(epoch);
+    return status;
+}
+
+// Serializes calls to resolvers, so that each lazy subcommand is only resolved once.
+static pthread_mutex_t _ac_resolve_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// The stamp of a COMMAND_LAZY `subcommand`, which covers everything its resolution depends on.
+static uint64_t _ac_subcommand_stamp(struct ac_multi_command_subcommand const *const subcommand) {
+    uint64_t hash = _ac_stamp_string(0xcbf29ce484222325ULL, subcommand->name, true);
+    hash          = _ac_fnv1a(hash, &subcommand->resolver, sizeof(subcommand->resolver));
+    return _ac_fnv1a(hash, &subcommand->resolver_context, sizeof(subcommand->resolver_context));
+}
+
+// The resolved form of `subcommand`, which is `subcommand` itself unless it's a COMMAND_LAZY
+// subcommand. Returns NULL for a lazy subcommand that hasn't been resolved yet.
+static struct ac_multi_command_subcommand const *
+_ac_subcommand_resolved(struct ac_multi_command_subcommand const *const subcommand) {
+    if(subcommand->type != COMMAND_LAZY) {
+        return subcommand;
+    }
+    return (struct ac_multi_command_subcommand const *) _ac_memo_get(subcommand, _AC_MEMO_RESOLVED,
+                                                                     _ac_subcommand_stamp(subcommand));
+}
+
+// Resolve a COMMAND_LAZY subcommand the first time it's needed. The spec isn't modified, since it
+// may be read-only or shared with other threads, so the resolution is memoized on its address
+// instead. Returns NULL when the resolver fails.
+static struct ac_multi_command_subcommand const *
+_ac_subcommand_resolve(struct ac_multi_command_subcommand const *const subcommand) {
+    struct ac_multi_command_subcommand const *result = _ac_subcommand_resolved(subcommand);
+    if(result != NULL) {
+        return result;
+    }
+
+    pthread_mutex_lock(&_ac_resolve_lock);
+    // Another thread may have resolved it while this one was waiting.
+    result = _ac_subcommand_resolved(subcommand);
+    if(result != NULL) {
+        pthread_mutex_unlock(&_ac_resolve_lock);
+        return result;
+    }
+
+    struct ac_multi_command_subcommand resolved = {.name = subcommand->name};
+    bool valid = subcommand->resolver != NULL &&
+                 subcommand->resolver(subcommand->name, subcommand->resolver_context, &resolved);
+    valid      = valid && ((resolved.type == COMMAND_SINGLE && resolved.single != NULL) ||
+                      (resolved.type == COMMAND_MULTI && resolved.multi != NULL));
+
+    struct ac_multi_command_subcommand *const memoized =
+        valid ? (struct ac_multi_command_subcommand *) malloc(sizeof(*memoized)) : NULL;
+    if(memoized != NULL) {
+        *memoized      = resolved;
+        memoized->name = subcommand->name;
+        result = (struct ac_multi_command_subcommand const *) _ac_memo_put(
+            subcommand, _AC_MEMO_RESOLVED, _ac_subcommand_stamp(subcommand), memoized);
+        if(result != memoized) {
+            free(memoized);
+        }
+    }
+    pthread_mutex_unlock(&_ac_resolve_lock);
+    return result;
+}
+
+// A hash table from the names of the subcommands of a multi-command to their positions, so that
+// dispatching on a name doesn't compare it with every sibling. Slots hold a position plus one, or 0
+// when they're empty.
+struct _ac_dispatch_index {
+    size_t  capacity;
+    size_t *slots;
+};
+
+static struct _ac_dispatch_index *
+_ac_dispatch_index_build(struct ac_multi_command_subcommand const *const subcommands,
+                         size_t const                                    n_subcommands) {
+    size_t capacity = 8;
+    while(capacity < 2 * n_subcommands) {
+        capacity *= 2;
+    }
+
+    struct _ac_dispatch_index *const index =
+        (struct _ac_dispatch_index *) calloc(1, sizeof(*index) + capacity * sizeof(*index->slots));
+    if(index == NULL) {
+        return NULL;
+    }
+    index->capacity = capacity;
+    index->slots    = (size_t *) &index[1];
+
+    for(size_t i = 0; i < n_subcommands; i++) {
+        char const *const name = subcommands[i].name;
+        if(name == NULL) {
+            continue;
+        }
+        // Only the first of several subcommands with the same name is found, like with a scan.
+        size_t probe = (size_t) _ac_hash_seeded(0, name, strnlen(name, MAX_STRING_LEN));
+        for(;; probe++) {
+            size_t const slot = index->slots[probe & (capacity - 1)];
+            if(slot == 0 || 0 == strncmp(subcommands[slot - 1].name, name, MAX_STRING_LEN)) {
+                break;
+            }
+        }
+        if(index->slots[probe & (capacity - 1)] == 0) {
+            index->slots[probe & (capacity - 1)] = i + 1;
+        }
+    }
+    return index;
+}
+
+// Find the subcommand of `multi` called `name`, which is `length` bytes long, or NULL if there's
+// none. The index is memoized on the subcommands array and only stamped with its length, since
+// stamping every name would cost as much as the scan it replaces. Instead, a name that's found is
+// compared with the subcommand, and a miss is confirmed by a scan, which rebuilds the index when it
+// finds that the names were changed in place.
+static struct ac_multi_command_subcommand const *
+_ac_subcommand_find(struct ac_multi_command_spec const *const multi, char const *const name,
+                    size_t const length) {
+    struct ac_multi_command_subcommand const *const subcommands   = multi->subcommands;
+    size_t const                                    n_subcommands = multi->n_subcommands;
+    if(subcommands == NULL || n_subcommands == 0) {
+        return NULL;
+    }
+
+    struct _ac_dispatch_index const *index =
+        (struct _ac_dispatch_index const *) _ac_memo_get(subcommands, _AC_MEMO_DISPATCH, n_subcommands);
+    bool stale = index == NULL;
+    for(size_t probe = (size_t) _ac_hash_seeded(0, name, length); index != NULL; probe++) {
+        size_t const slot = index->slots[probe & (index->capacity - 1)];
+        if(slot == 0) {
+            break;
+        }
+        if(0 == strncmp(subcommands[slot - 1].name, name, MAX_STRING_LEN)) {
+            return &subcommands[slot - 1];
+        }
+    }
+
+    struct ac_multi_command_subcommand const *found = NULL;
+    for(size_t i = 0; i < n_subcommands && found == NULL; i++) {
+        if(0 == strncmp(subcommands[i].name, name, MAX_STRING_LEN)) {
+            found = &subcommands[i];
+            stale = true;
+        }
+    }
+
+    if(stale) {
+        struct _ac_dispatch_index *const built = _ac_dispatch_index_build(subcommands, n_subcommands);
+        if(built != NULL &&
+           _ac_memo_store(subcommands, _AC_MEMO_DISPATCH, n_subcommands, built, index != NULL) != built) {
+            free(built);
+        }
+    }
+    return found;
+}
+
+// Parse `argv` for `root`, recording errors in `diagnostics` once the command has been resolved.
+static struct ac_status _ac_multi_command_parse(int const argc, char const *const *const argv,
+                                                struct ac_multi_command_spec const *const root,
+                                                struct ac_diagnostics *const              diagnostics,
+                                                struct ac_command *const                  args);
+
+/// @brief Parse user input using the provided @p root multi-command specification.
+/// @par Options declared by a multi-command apply to all of its descendants. They may be used
+/// before the subcommand name (`tool --verbose compress`) or after it, and are resolved from the
+/// command up to the root, so a command's own options take precedence over inherited ones.
+/// @param argc The number of elements in @p argv
+/// @param argv The user input to be parsed. Must contain exactly @p argc elements.
+/// @note When parsing arguments from @c 'int main(int argc, char **argv)', the caller will
+/// typically want to cut the executable path (element 0) from the @p argv array when calling this
+/// function.
+/// @param root The multi-command specification which describes how to parse @p argv .
+/// @param args An output structure that contains the parsed values when the return code is @c
+/// AC_ERROR_SUCCESS.
+/// @result @c AC_ERROR_SUCCESS when the user input is successfully parsed.
+AC_API struct ac_status
+ac_multi_command_parse(int const argc, char const *const *const argv,
+                       struct ac_multi_command_spec const *const root,
+                       struct ac_command *const                  args) {
+    size_t const           epoch  = _ac_memo_enter();
+    struct ac_status const status = _ac_multi_command_parse(argc, argv, root, NULL, args);
+    _ac_memo_leave(epoch);
+    return status;
+}
+
+static struct ac_status _ac_multi_command_parse(int const argc, char const *const *const argv,
+                                                struct ac_multi_command_spec const *const root,
+                                                struct ac_diagnostics *const              diagnostics,
+                                                struct ac_command *const                  args) {
+    if(argc == 0 || argv == NULL || root == NULL || args == NULL) {
+        return (struct ac_status) {.code = AC_ERROR_INVALID_PARAMETER, .multi = root};
+    }
+
+    if(argc > MAX_NUM_ARGS) {
+        return (struct ac_status) {.code    = AC_ERROR_ARGUMENT_MAX_EXCEEDED,
+                                   .context = (void *) (size_t) argc,
+                                   .multi   = root};
+    }
+
+    // Every multi-command on the path to the command is a layer of inherited options, and each
+    // one consumes at least one element of argv.
+    struct _ac_option_layer             layers[MAX_NUM_ARGS];
+    struct ac_multi_command_spec const *parents[MAX_NUM_ARGS];
+    size_t                              n_layers = 0;
+
+    // Options that appear before the command name are resolved against the multi-command that
+    // they appear after.
+    struct ac_option inherited[MAX_NUM_ARGS];
+    size_t           n_inherited = 0;
+
+    // Traverse the command tree to resolve the command.
+    struct ac_multi_command_spec const *curr_node = root;
+    struct ac_command_spec const       *command   = NULL;
+    size_t                              i         = 0;
+    layers[n_layers]    = _ac_option_layer_multi(root);
+    parents[n_layers++] = root;
+    bool utf8           = root->utf8;
+    // The names of the command path seed the fingerprint of the result.
+    uint64_t path_hash = 0xcbf29ce484222325ULL;
+    while(command == NULL) {
+        if(i == argc) {
+            return (struct ac_status) {.code    = AC_ERROR_COMMAND_NAME_REQUIRED,
+                                       .multi   = curr_node,
+                                       .context = (char *) argv[i - 1]};
+        }
+
+        char const *const curr_name = argv[i];
+        size_t            namelen   = 0;
+        if(!_ac_token_scan(curr_name, utf8, &namelen)) {
+            return (struct ac_status) {
+                .code = AC_ERROR_UTF8_INVALID, .context = (void *) curr_name, .multi = curr_node};
+        }
+        if(namelen == 0) {
+            // Empty string is never a valid command name.
+            return (struct ac_status) {
+                .code = AC_ERROR_COMMAND_NAME_INVALID, .context = (void *) curr_name, .multi = curr_node};
+        }
+
+        if(_ac_token_is_option(curr_name, namelen, utf8)) {
+            size_t const n_entries = _ac_option_token_entries(curr_name, namelen);
+            if(n_inherited + n_entries > MAX_NUM_ARGS) {
+                return (struct ac_status) {.code    = AC_ERROR_OPTION_TOO_MANY,
+                                           .context = (void *) (n_inherited + n_entries),
+                                           .multi   = curr_node};
+            }
+
+            bool             pending = false;
+            struct ac_status status  = _ac_option_token_resolve(
+                NULL, layers, n_layers, curr_name, namelen, inherited, &n_inherited, &pending);
+            if(!ac_status_is_success(status)) {
+                status.multi = status.multi != NULL ? status.multi : curr_node;
+                return status;
+            }
+
+            i++;
+            if(pending) {
+                size_t value_len = 0;
+                if(i < argc && !_ac_token_scan(argv[i], utf8, &value_len)) {
+                    return (struct ac_status) {.code    = AC_ERROR_UTF8_INVALID,
+                                               .context = (void *) argv[i],
+                                               .multi   = curr_node};
+                }
+                if(i == argc || _ac_token_is_option(argv[i], value_len, utf8)) {
+                    return (struct ac_status) {.code    = AC_ERROR_OPTION_VALUE_EXPECTED,
+                                               .context = (void *) curr_name,
+                                               .multi   = curr_node};
+                }
+                inherited[n_inherited - 1].value = (char *) argv[i++];
+            }
+            continue;
+        }
+
+        struct ac_multi_command_subcommand const *const found =
+            _ac_subcommand_find(curr_node, curr_name, namelen);
+        if(found == NULL) {
+            return (struct ac_status) {.code    = AC_ERROR_COMMAND_NAME_NOT_IN_SPEC,
+                                       .context = (void *) curr_name,
+                                       .multi   = curr_node};
+        }
+        path_hash = _ac_fnv1a(path_hash, curr_name, namelen + 1);
+
+        struct ac_multi_command_subcommand const *const subcommand = _ac_subcommand_resolve(found);
+        if(subcommand == NULL) {
+            return (struct ac_status) {.code    = AC_ERROR_COMMAND_RESOLVE_FAILED,
+                                       .multi   = curr_node,
+                                       .context = (char *) curr_name};
+        }
+
+        if(subcommand->type == COMMAND_SINGLE) {
+            command = subcommand->single;
+        } else {
+            // Otherwise we've found a matching subcommand, progress to the next node.
+            curr_node           = subcommand->multi;
+            layers[n_layers]    = _ac_option_layer_multi(curr_node);
+            parents[n_layers++] = curr_node;
+            utf8                = utf8 || curr_node->utf8;
+        }
+        i++;
+    }
+
+    struct ac_multi_command_spec const **const path =
+        (struct ac_multi_command_spec const **) calloc(n_layers, sizeof(*path));
+    if(path == NULL) {
+        return (struct ac_status) {.code = AC_ERROR_MEMORY_ALLOC_FAILED, .multi = curr_node};
+    }
+    memcpy(path, parents, n_layers * sizeof(*path));
+
+    size_t const           n_recorded = diagnostics != NULL ? diagnostics->n_diagnostics : 0;
+    struct ac_status const result     = _ac_command_parse(argc - (int) i, &argv[i], command, layers,
+                                                          n_layers, inherited, n_inherited, path_hash,
+                                                          diagnostics, args);
+    if(!ac_status_is_success(result)) {
+        // The command was parsed from the rest of argv, so its tokens are offset by the path.
+        for(size_t j = n_recorded; diagnostics != NULL && j < diagnostics->n_diagnostics; j++) {
+            if(diagnostics->diagnostics[j].token != AC_DIAGNOSTIC_NO_TOKEN) {
+                diagnostics->diagnostics[j].token += (uint32_t) i;
+            }
+        }
+        free(path);
+        return result;
+    }
+
+    args->n_parents = n_layers;
+    args->parents   = path;
+    return result;
+}
+
+// Finish a parse in collect-all mode. An error that stopped parsing, like a command name that
+// isn't in the spec, is recorded after the ones that were found before it.
+static struct ac_status _ac_parse_all_finish(struct ac_status status,
+                                             struct ac_diagnostics *const diagnostics) {
+    if(!ac_status_is_success(status) && status.diagnostics == NULL) {
+        (void) _ac_diagnose(diagnostics, AC_DIAGNOSTIC_NO_TOKEN, status);
+        status.diagnostics = diagnostics->n_diagnostics > 0 ? diagnostics : NULL;
+    }
+    return status;
+}
+
+/// @brief Parse user input like @c ac_command_parse, but carry on past errors in it and record
+/// every one of them in @p diagnostics.
+/// @par This is meant for validating inputs in bulk, where the user wants to see everything that's
+/// wrong with an input at once. Parsing correct input costs the same as @c ac_command_parse.
+/// Errors that leave nothing sensible to carry on with, like a failed allocation, still stop
+/// parsing and are recorded last.
+/// @param argc The number of elements in @p argv
+/// @param argv The user input to be parsed. Must contain exactly @p argc elements.
+/// @param command The command specification which describes how to parse @p argv .
+/// @param args An output structure that contains the parsed values when the return code is @c
+/// AC_ERROR_SUCCESS.
+/// @param diagnostics Receives the errors, replacing any from a previous parse.
+/// @result @c AC_ERROR_SUCCESS when the user input is successfully parsed. Otherwise the first error,
+/// with @c diagnostics set so that @c ac_status_string renders all of them.
+AC_API struct ac_status ac_command_parse_all(int const argc, char const *const *const argv,
+                                             struct ac_command_spec const *const command,
+                                             struct ac_command *const            args,
+                                             struct ac_diagnostics *const        diagnostics) {
+    if(diagnostics == NULL) {
+        return (struct ac_status) {.code = AC_ERROR_INVALID_PARAMETER, .single = command};
+    }
+
+    diagnostics->single        = NULL;
+    diagnostics->n_diagnostics = 0;
+    size_t const           epoch  = _ac_memo_enter();
+    struct ac_status const status =
+        _ac_command_parse(argc, argv, command, NULL, 0, NULL, 0, 0, diagnostics, args);
+    _ac_memo_leave(epoch);
+    return _ac_parse_all_finish(status, diagnostics);
+}
+
+/// @brief Parse user input like @c ac_multi_command_parse, but carry on past errors in it and
+/// record every one of them in @p diagnostics.
+/// @par The command path is resolved as usual, and an error in it stops parsing, since there is no
+/// command to check the rest of the input against. Errors after the command name are all recorded,
+/// as in @c ac_command_parse_all.
+/// @param argc The number of elements in @p argv
+/// @param argv The user input to be parsed. Must contain exactly @p argc elements.
+/// @param root The multi-command specification which describes how to parse @p argv .
+/// @param args An output structure that contains the parsed values when the return code is @c
+/// AC_ERROR_SUCCESS.
+/// @param diagnostics Receives the errors, replacing any from a previous parse.
+/// @result @c AC_ERROR_SUCCESS when the user input is successfully parsed. Otherwise the first error,
+/// with @c diagnostics set so that @c ac_status_string renders all of them.
+AC_API struct ac_status ac_multi_command_parse_all(int const argc, char const *const *const argv,
+                                                   struct ac_multi_command_spec const *const root,
+                                                   struct ac_command *const                  args,
+                                                   struct ac_diagnostics *const diagnostics) {
+    if(diagnostics == NULL) {
+        return (struct ac_status) {.code = AC_ERROR_INVALID_PARAMETER, .multi = root};
+    }
+
+    diagnostics->single        = NULL;
+    diagnostics->n_diagnostics = 0;
+    size_t const           epoch  = _ac_memo_enter();
+    struct ac_status const status = _ac_multi_command_parse(argc, argv, root, diagnostics, args);
+    _ac_memo_leave(epoch);
+    return _ac_parse_all_finish(status, diagnostics);
+}
+
+/// @brief Free the memory held by @p diagnostics, leaving it empty and ready for reuse.
+AC_API void ac_diagnostics_release(struct ac_diagnostics *const diagnostics) {
+    if(diagnostics == NULL) {
+        return;
+    }
+
+    free(diagnostics->diagnostics);
+    bzero(diagnostics, sizeof(*diagnostics));
+}
+
+// A result in an ac_parser cache, with its own copy of the argv that it was parsed from. The result
+// comes first, so the pointer handed out to callers is also the entry's.
+struct _ac_parser_entry {
+    struct ac_command args;
+    // The references held by callers, plus one while the entry is in the cache.
+    size_t   refs;
+    uint64_t hash;
+    // The parser's clock when the entry was last used, which picks the entry to evict.
+    uint64_t                 used;
+    int                      argc;
+    char const             **argv;
+    size_t                  *lengths;
+    struct _ac_parser_entry *next;
+};
+
+// Entries are chained in buckets by the hash of their argv. Lookups take the lock for reading, and
+// only bump the reference count and the use stamp of the entry they find, with atomics, so hits
+// don't contend. Inserting and evicting take it for writing.
+struct ac_parser {
+    pthread_rwlock_t                    lock;
+    struct ac_command_spec const       *command;
+    struct ac_multi_command_spec const *root;
+    size_t                              capacity;
+    size_t                              n_entries;
+    size_t                              n_buckets;
+    struct _ac_parser_entry           **buckets;
+    uint64_t                            clock;
+    struct ac_parser_stats              stats;
+};
+
+static struct ac_status _ac_parser_create(struct ac_command_spec const *const       command,
+                                          struct ac_multi_command_spec const *const root,
+                                          size_t const capacity, struct ac_parser **const parser) {
+    if(parser == NULL || (command == NULL && root == NULL)) {
+        return (struct ac_status) {.code = AC_ERROR_INVALID_PARAMETER, .single = command, .multi = root};
+    }
+
+    size_t n_buckets = 4;
+    while(n_buckets < capacity) {
+        n_buckets *= 2;
+    }
+    struct ac_parser *const created = (struct ac_parser *) calloc(1, sizeof(*created));
+    struct _ac_parser_entry **const buckets =
+        (struct _ac_parser_entry **) calloc(n_buckets, sizeof(*buckets));
+    if(created == NULL || buckets == NULL || pthread_rwlock_init(&created->lock, NULL) != 0) {
+        free(created);
+        free(buckets);
+        return (struct ac_status) {.code = AC_ERROR_MEMORY_ALLOC_FAILED, .single = command, .multi = root};
+    }
+
+    created->command   = command;
+    created->root      = root;
+    created->capacity  = capacity;
+    created->n_buckets = n_buckets;
+    created->buckets   = buckets;
+    *parser            = created;
+    return (struct ac_status) {.code = AC_ERROR_SUCCESS};
+}
+
+/// @brief Create a parser for @p command that caches up to @p capacity results.
+/// @param command The command specification, which must outlive the parser.
+/// @param capacity The maximum number of cached results. With 0, nothing is cached.
+/// @param parser Receives the parser, which is released with @c ac_parser_destroy.
+/// @result @c AC_ERROR_SUCCESS when the parser was created.
+AC_API struct ac_status ac_command_parser_create(struct ac_command_spec const *const command,
+                                                 size_t const capacity, struct ac_parser **const parser) {
+    return _ac_parser_create(command, NULL, capacity, parser);
+}
+
+/// @brief Create a parser for the multi-command @p root that caches up to @p capacity results.
+/// @param root The multi-command specification, which must outlive the parser.
+/// @param capacity The maximum number of cached results. With 0, nothing is cached.
+/// @param parser Receives the parser, which is released with @c ac_parser_destroy.
+/// @result @c AC_ERROR_SUCCESS when the parser was created.
+AC_API struct ac_status ac_multi_command_parser_create(struct ac_multi_command_spec const *const root,
+                                                       size_t const                              capacity,
+                                                       struct ac_parser **const                  parser) {
+    return _ac_parser_create(NULL, root, capacity, parser);
+}
+
+// Drop a reference to `entry`, releasing it with the last one.
+static void _ac_parser_entry_unref(struct _ac_parser_entry *const entry) {
+    if(__atomic_sub_fetch(&entry->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        ac_command_release(&entry->args);
+        free(entry);
+    }
+}
+
+// Whether `entry` was parsed from exactly `argv`.
+static bool _ac_parser_entry_matches(struct _ac_parser_entry const *const entry, uint64_t const hash,
+                                     int const argc, char const *const *const argv,
+                                     size_t const *const lengths) {
+    if(entry->hash != hash || entry->argc != argc) {
+        return false;
+    }
+    for(size_t i = 0; i < argc; i++) {
+        if(entry->lengths[i] != lengths[i] || 0 != memcmp(entry->argv[i], argv[i], lengths[i])) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Find the cached entry for `argv` and take a reference to it, or return NULL. The lock must be
+// held, for reading at least.
+static struct _ac_parser_entry *_ac_parser_find(struct ac_parser *const parser, uint64_t const hash,
+                                                int const argc, char const *const *const argv,
+                                                size_t const *const lengths) {
+    for(struct _ac_parser_entry *entry = parser->buckets[hash & (parser->n_buckets - 1)]; entry != NULL;
+        entry                          = entry->next) {
+        if(_ac_parser_entry_matches(entry, hash, argc, argv, lengths)) {
+            __atomic_add_fetch(&entry->refs, 1, __ATOMIC_RELAXED);
+            __atomic_store_n(&entry->used, __atomic_add_fetch(&parser->clock, 1, __ATOMIC_RELAXED),
+                             __ATOMIC_RELAXED);
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+// Remove the least recently used entry from the cache. The lock must be held for writing.
+static void _ac_parser_evict(struct ac_parser *const parser) {
+    struct _ac_parser_entry **oldest = NULL;
+    for(size_t i = 0; i < parser->n_buckets; i++) {
+        for(struct _ac_parser_entry **link = &parser->buckets[i]; *link != NULL; link = &(*link)->next) {
+            if(oldest == NULL || __atomic_load_n(&(*link)->used, __ATOMIC_RELAXED) <
+                                     __atomic_load_n(&(*oldest)->used, __ATOMIC_RELAXED)) {
+                oldest = link;
+            }
+        }
+    }
+    if(oldest == NULL) {
+        return;
+    }
+
+    struct _ac_parser_entry *const evicted = *oldest;
+    *oldest                                = evicted->next;
+    parser->n_entries--;
+    parser->stats.evictions++;
+    _ac_parser_entry_unref(evicted);
+}
+
+// The copy in `entry` of `value`, when it points into one of the elements of `argv`.
+static char *_ac_parser_rebase(struct _ac_parser_entry const *const entry, char const *const *const argv,
+                               char *const value) {
+    for(size_t i = 0; value != NULL && i < entry->argc; i++) {
+        if(value >= argv[i] && value <= &argv[i][entry->lengths[i]]) {
+            return (char *) &entry->argv[i][value - argv[i]];
+        }
+    }
+
+    return value;
+}
+
+/// @brief Parse user input with @p parser, returning a cached result when the same input has been
+/// parsed before.
+/// @par Inputs are looked up by a hash of their bytes and then compared in full. On a miss, the
+/// input is parsed and the result is inserted, evicting the least recently used one when the cache
+/// is full. Results hold their own copy of the input, so they don't borrow from @p argv. Like the
+/// rest of the parser, only the first @c MAX_STRING_LEN bytes of each element are considered.
+/// Results that read a config file aren't cached, since the file may change.
+/// @param parser The parser to use.
+/// @param argc The number of elements in @p argv
+/// @param argv The user input to be parsed. Must contain exactly @p argc elements.
+/// @param args Receives the result when the return code is @c AC_ERROR_SUCCESS. It's shared with
+/// other callers and must not be modified. Release it with @c ac_parser_result_release, which may
+/// happen after the parser is destroyed.
+/// @result @c AC_ERROR_SUCCESS when the user input is successfully parsed, or the error as
+/// @c ac_command_parse would return it.
+AC_API struct ac_status ac_parser_parse(struct ac_parser *const parser, int const argc,
+                                        char const *const *const argv,
+                                        struct ac_command const **const args) {
+    if(parser == NULL || argv == NULL || args == NULL || argc < 0) {
+        return (struct ac_status) {.code = AC_ERROR_INVALID_PARAMETER};
+    }
+    if(argc > MAX_NUM_ARGS) {
+        return (struct ac_status) {.code    = AC_ERROR_ARGUMENT_MAX_EXCEEDED,
+                                   .single  = parser->command,
+                                   .multi   = parser->root,
+                                   .context = (void *) (size_t) argc};
+    }
+
+    size_t   lengths[MAX_NUM_ARGS];
+    size_t   size = 0;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for(size_t i = 0; i < argc; i++) {
+        lengths[i] = strnlen(argv[i], MAX_STRING_LEN);
+        hash       = _ac_fnv1a(hash, argv[i], lengths[i]);
+        hash       = _ac_fnv1a(hash, &lengths[i], sizeof(lengths[i]));
+        size += lengths[i] + 1;
+    }
+
+    pthread_rwlock_rdlock(&parser->lock);
+    struct _ac_parser_entry *entry = _ac_parser_find(parser, hash, argc, argv, lengths);
+    pthread_rwlock_unlock(&parser->lock);
+    if(entry != NULL) {
+        __atomic_add_fetch(&parser->stats.hits, 1, __ATOMIC_RELAXED);
+        *args = &entry->args;
+        return (struct ac_status) {.code = AC_ERROR_SUCCESS};
+    }
+    __atomic_add_fetch(&parser->stats.misses, 1, __ATOMIC_RELAXED);
+
+    // The input is parsed as given, so that errors refer to it, and the result is then rebased onto
+    // the entry's copy.
+    struct ac_command      parsed = {0};
+    struct ac_status const status = parser->command != NULL
+                                        ? ac_command_parse(argc, argv, parser->command, &parsed)
+                                        : ac_multi_command_parse(argc, argv, parser->root, &parsed);
+    if(!ac_status_is_success(status)) {
+        return status;
+    }
+
+    entry = (struct _ac_parser_entry *) malloc(sizeof(*entry) + argc * (sizeof(char *) + sizeof(size_t)) +
+                                               size);
+    if(entry == NULL) {
+        ac_command_release(&parsed);
+        return (struct ac_status) {
+            .code = AC_ERROR_MEMORY_ALLOC_FAILED, .single = parser->command, .multi = parser->root};
+    }
+    entry->argv    = (char const **) &entry[1];
+    entry->lengths = (size_t *) &entry->argv[argc];
+    char *cursor   = (char *) &entry->lengths[argc];
+    for(size_t i = 0; i < argc; i++) {
+        memcpy(cursor, argv[i], lengths[i]);
+        cursor[lengths[i]] = '\0';
+        entry->argv[i]     = cursor;
+        entry->lengths[i]  = lengths[i];
+        cursor += lengths[i] + 1;
+    }
+    entry->argc = argc;
+    entry->hash = hash;
+    entry->refs = 1;
+    entry->next = NULL;
+    entry->used = __atomic_add_fetch(&parser->clock, 1, __ATOMIC_RELAXED);
+    entry->args = parsed;
+    for(size_t i = 0; i < parsed.n_arguments; i++) {
+        entry->args.arguments[i].value = _ac_parser_rebase(entry, argv, parsed.arguments[i].value);
+    }
+    for(size_t i = 0; i < parsed.n_options; i++) {
+        entry->args.options[i].value = _ac_parser_rebase(entry, argv, parsed.options[i].value);
+    }
+
+    if(parser->capacity == 0 || parsed.config != NULL) {
+        *args = &entry->args;
+        return status;
+    }
+
+    // Another thread may have inserted the same input while this one was parsing it.
+    pthread_rwlock_wrlock(&parser->lock);
+    struct _ac_parser_entry *const existing = _ac_parser_find(parser, hash, argc, argv, lengths);
+    if(existing == NULL) {
+        if(parser->n_entries == parser->capacity) {
+            _ac_parser_evict(parser);
+        }
+        struct _ac_parser_entry **const bucket = &parser->buckets[hash & (parser->n_buckets - 1)];
+        entry->next                            = *bucket;
+        entry->refs                            = 2;
+        *bucket                                = entry;
+        parser->n_entries++;
+    }
+    pthread_rwlock_unlock(&parser->lock);
+
+    if(existing != NULL) {
+        _ac_parser_entry_unref(entry);
+        entry = existing;
+    }
+    *args = &entry->args;
+    return status;
+}
+
+/// @brief Release a result returned by @c ac_parser_parse.
+AC_API void ac_parser_result_release(struct ac_command const *const args) {
+    if(args != NULL) {
+        _ac_parser_entry_unref((struct _ac_parser_entry *) args);
+    }
+}
+
+/// @brief Read the statistics of the cache of @p parser.
+AC_API struct ac_parser_stats ac_parser_stats_read(struct ac_parser *const parser) {
+    struct ac_parser_stats stats = {0};
+    if(parser == NULL) {
+        return stats;
+    }
+
+    pthread_rwlock_rdlock(&parser->lock);
+    stats.hits      = __atomic_load_n(&parser->stats.hits, __ATOMIC_RELAXED);
+    stats.misses    = __atomic_load_n(&parser->stats.misses, __ATOMIC_RELAXED);
+    stats.evictions = parser->stats.evictions;
+    stats.n_entries = parser->n_entries;
+    pthread_rwlock_unlock(&parser->lock);
+    return stats;
+}
+
+/// @brief Destroy @p parser and its cache. Results that are still held by callers remain valid
+/// until they're released.
+AC_API void ac_parser_destroy(struct ac_parser *const parser) {
+    if(parser == NULL) {
+        return;
+    }
+
+    for(size_t i = 0; i < parser->n_buckets; i++) {
+        for(struct _ac_parser_entry *entry = parser->buckets[i]; entry != NULL;) {
+            struct _ac_parser_entry *const next = entry->next;
+            _ac_parser_entry_unref(entry);
+            entry = next;
+        }
+    }
+    pthread_rwlock_destroy(&parser->lock);
+    free(parser->buckets);
+    free(parser);
+}
+
+// An array of subcommands or options that's shared by a spec builder and the snapshots that
+// contain it, with its elements after the header. Once published, an array is never modified
+// again, and the first edit after that copies it. Everything memoized for its elements is
+// forgotten when it's freed.
+struct _ac_spec_array {
+    size_t refs;
+    bool   published;
+    size_t count;
+    size_t capacity;
+    size_t element_size;
+};
+
+inline static char *_ac_spec_array_data(struct _ac_spec_array *const array) {
+    return (char *) &array[1];
+}
+
+static struct _ac_spec_array *_ac_spec_array_create(size_t const element_size, size_t const capacity,
+                                                    void const *const elements, size_t const count) {
+    struct _ac_spec_array *const array =
+        (struct _ac_spec_array *) malloc(sizeof(*array) + capacity * element_size);
+    if(array == NULL) {
+        return NULL;
+    }
+
+    *array = (struct _ac_spec_array) {
+        .refs = 1, .count = count, .capacity = capacity, .element_size = element_size};
+    if(count > 0) {
+        memcpy(_ac_spec_array_data(array), elements, count * element_size);
+    }
+    return array;
+}
+
+static void _ac_spec_array_unref(struct _ac_spec_array *const array) {
+    if(__atomic_sub_fetch(&array->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        char *const data = _ac_spec_array_data(array);
+        _ac_memo_forget(data, &data[array->capacity * array->element_size]);
+        free(array);
+    }
+}
+
+// Make `*array` safe to modify, with room for one more element. A published array is replaced by
+// a copy, while an unpublished one was never parsed, so it's grown in place.
+static bool _ac_spec_array_writable(struct _ac_spec_array **const array) {
+    struct _ac_spec_array *const current = *array;
+    if(!current->published && current->count < current->capacity) {
+        return true;
+    }
+
+    size_t const capacity = current->count < 4 ? 8 : 2 * current->count;
+    if(!current->published) {
+        struct _ac_spec_array *const grown =
+            (struct _ac_spec_array *) realloc(current, sizeof(*current) + capacity * current->element_size);
+        if(grown == NULL) {
+            return false;
+        }
+        grown->capacity = capacity;
+        *array          = grown;
+        return true;
+    }
+
+    struct _ac_spec_array *const copy = _ac_spec_array_create(
+        current->element_size, capacity, _ac_spec_array_data(current), current->count);
+    if(copy == NULL) {
+        return false;
+    }
+    _ac_spec_array_unref(current);
+    *array = copy;
+    return true;
+}
+
+// Remove the element at `index` of `*array`, which must be writable.
+static void _ac_spec_array_remove(struct _ac_spec_array *const array, size_t const index) {
+    char *const data = _ac_spec_array_data(array);
+    memmove(&data[index * array->element_size], &data[(index + 1) * array->element_size],
+            (array->count - index - 1) * array->element_size);
+    array->count--;
+}
+
+// A published snapshot. The spec comes first, so the pointer handed out is also the snapshot's.
+struct _ac_spec_snapshot {
+    struct ac_multi_command_spec spec;
+    size_t                       refs;
+    struct _ac_spec_array       *subcommands;
+    struct _ac_spec_array       *options;
+};
+
+struct ac_spec_builder {
+    pthread_mutex_t lock;
+    // The fields of the root, whose arrays are replaced by the builder's when publishing.
+    struct ac_multi_command_spec root;
+    struct _ac_spec_array       *subcommands;
+    struct _ac_spec_array       *options;
+};
+
+/// @brief Create a spec builder that starts from the subcommands and options of @p base.
+/// @param base The multi-command to start from, whose help and other fields are kept by every
+/// snapshot. Its arrays are copied, so it isn't referenced after this returns.
+/// @param builder Receives the builder, which is released with @c ac_spec_builder_destroy.
+/// @result @c AC_ERROR_SUCCESS when the builder was created.
+AC_API struct ac_status ac_spec_builder_create(struct ac_multi_command_spec const *const base,
+                                               struct ac_spec_builder **const            builder) {
+    if(base == NULL || builder == NULL) {
+        return (struct ac_status) {.code = AC_ERROR_INVALID_PARAMETER, .multi = base};
+    }
+
+    struct ac_spec_builder *const created = (struct ac_spec_builder *) calloc(1, sizeof(*created));
+    if(created == NULL) {
+        return (struct ac_status) {.code = AC_ERROR_MEMORY_ALLOC_FAILED, .multi = base};
+    }
+    created->root        = *base;
+    created->subcommands = _ac_spec_array_create(sizeof(*base->subcommands), base->n_subcommands,
+                                                 base->subcommands, base->n_subcommands);
+    created->options     = _ac_spec_array_create(sizeof(*base->options), base->n_options, base->options,
+                                                 base->n_options);
+    if(created->subcommands == NULL || created->options == NULL ||
+       pthread_mutex_init(&created->lock, NULL) != 0) {
+        free(created->subcommands);
+        free(created->options);
+        free(created);
+        return (struct ac_status) {.code = AC_ERROR_MEMORY_ALLOC_FAILED, .multi = base};
+    }
+
+    *builder = created;
+    return (struct ac_status) {.code = AC_ERROR_SUCCESS};
+}
+
+/// @brief Add @p subcommand to the root of @p builder. It takes effect in the next snapshot.
+/// @param subcommand The subcommand, which is copied. The specs that it points to must outlive
+/// every snapshot that contains it.
+/// @result @c AC_ERROR_SUCCESS when it was added, or @c AC_ERROR_COMMAND_NAME_DUPLICATE when there
+/// is already a subcommand with its name.
+AC_API struct ac_status
+ac_spec_builder_add_subcommand(struct ac_spec_builder *const                   builder,
+                               struct ac_multi_command_subcommand const *const subcommand) {
+    if(builder == NULL || subcommand == NULL || subcommand->name == NULL) {
+        return (struct ac_status) {.code = AC_ERROR_INVALID_PARAMETER};
+    }
+
+    struct ac_status status = {.code = AC_ERROR_SUCCESS};
+    pthread_mutex_lock(&builder->lock);
+    struct ac_multi_command_subcommand const *subcommands =
+        (struct ac_multi_command_subcommand const *) _ac_spec_array_data(builder->subcommands);
+    for(size_t i = 0; i < builder->subcommands->count && ac_status_is_success(status); i++) {
+        if(0 == strncmp(subcommands[i].name, subcommand->name, MAX_STRING_LEN)) {
+            status = (struct ac_status) {.code = AC_ERROR_COMMAND_NAME_DUPLICATE, .context = subcommand->name};
+        }
+    }
+    if(ac_status_is_success(status) && !_ac_spec_array_writable(&builder->subcommands)) {
+        status = (struct ac_status) {.code = AC_ERROR_MEMORY_ALLOC_FAILED};
+    }
+    if(ac_status_is_success(status)) {
+        ((struct ac_multi_command_subcommand *) _ac_spec_array_data(
+            builder->subcommands))[builder->subcommands->count++] = *subcommand;
+    }
+    pthread_mutex_unlock(&builder->lock);
+    return status;
+}
+
+/// @brief Remove the subcommand called @p name from the root of @p builder. It takes effect in the
+/// next snapshot, and earlier snapshots keep it.
+/// @result @c AC_ERROR_SUCCESS when it was removed, or @c AC_ERROR_COMMAND_NAME_NOT_IN_SPEC when
+/// there's no such subcommand.
+AC_API struct ac_status ac_spec_builder_remove_subcommand(struct ac_spec_builder *const builder,
+                                                          char const *const             name) {
+    if(builder == NULL || name == NULL) {
+        return (struct ac_status) {.code = AC_ERROR_INVALID_PARAMETER};
+    }
+
+    struct ac_status status = {.code = AC_ERROR_COMMAND_NAME_NOT_IN_SPEC, .context = (void *) name};
+    pthread_mutex_lock(&builder->lock);
+    for(size_t i = 0; i < builder->subcommands->count; i++) {
+        struct ac_multi_command_subcommand const *const subcommands =
+            (struct ac_multi_command_subcommand const *) _ac_spec_array_data(builder->subcommands);
+        if(0 != strncmp(subcommands[i].name, name, MAX_STRING_LEN)) {
+            continue;
+        }
+
+        if(_ac_spec_array_writable(&builder->subcommands)) {
+            _ac_spec_array_remove(builder->subcommands, i);
+            status = (struct ac_status) {.code = AC_ERROR_SUCCESS};
+        } else {
+            status = (struct ac_status) {.code = AC_ERROR_MEMORY_ALLOC_FAILED};
+        }
+        break;
+    }
+    pthread_mutex_unlock(&builder->lock);
+    return status;
+}
+
+/// @brief Add @p option to the options of the root of @p builder, which apply to all of its
+/// subcommands. It takes effect in the next snapshot.
+/// @param option The option, which is copied. The strings that it points to must outlive every
+/// snapshot that contains it.
+/// @result @c AC_ERROR_SUCCESS when it was added, or @c AC_ERROR_OPTION_LONG_NAME_DUPLICATE when
+/// there is already an option with its long name.
+AC_API struct ac_status ac_spec_builder_add_option(struct ac_spec_builder *const      builder,
+                                                   struct ac_option_spec const *const option) {
+    if(builder == NULL || option == NULL || option->long_name == NULL) {
+        return (struct ac_status) {.code = AC_ERROR_INVALID_PARAMETER};
+    }
+
+    struct ac_status status = {.code = AC_ERROR_SUCCESS};
+    pthread_mutex_lock(&builder->lock);
+    struct ac_option_spec const *const options =
+        (struct ac_option_spec const *) _ac_spec_array_data(builder->options);
+    for(size_t i = 0; i < builder->options->count && ac_status_is_success(status); i++) {
+        if(0 == strncmp(options[i].long_name, option->long_name, MAX_STRING_LEN)) {
+            status = (struct ac_status) {
+                .code = AC_ERROR_OPTION_LONG_NAME_DUPLICATE, .option = option, .context = (void *) i};
+        }
+    }
+    if(ac_status_is_success(status) && !_ac_spec_array_writable(&builder->options)) {
+        status = (struct ac_status) {.code = AC_ERROR_MEMORY_ALLOC_FAILED};
+    }
+    if(ac_status_is_success(status)) {
+        ((struct ac_option_spec *) _ac_spec_array_data(builder->options))[builder->options->count++] =
+            *option;
+    }
+    pthread_mutex_unlock(&builder->lock);
+    return status;
+}
+
+/// @brief Remove the option called @p long_name from the root of @p builder. It takes effect in
+/// the next snapshot, and earlier snapshots keep it.
+/// @result @c AC_ERROR_SUCCESS when it was removed, or @c AC_ERROR_OPTION_NAME_NOT_IN_SPEC when
+/// there's no such option.
+AC_API struct ac_status ac_spec_builder_remove_option(struct ac_spec_builder *const builder,
+                                                      char const *const             long_name) {
+    if(builder == NULL || long_name == NULL) {
+        return (struct ac_status) {.code = AC_ERROR_INVALID_PARAMETER};
+    }
+
+    struct ac_status status = {.code = AC_ERROR_OPTION_NAME_NOT_IN_SPEC, .context = (void *) long_name};
+    pthread_mutex_lock(&builder->lock);
+    for(size_t i = 0; i < builder->options->count; i++) {
+        struct ac_option_spec const *const options =
+            (struct ac_option_spec const *) _ac_spec_array_data(builder->options);
+        if(0 != strncmp(options[i].long_name, long_name, MAX_STRING_LEN)) {
+            continue;
+        }
+
+        if(_ac_spec_array_writable(&builder->options)) {
+            _ac_spec_array_remove(builder->options, i);
+            status = (struct ac_status) {.code = AC_ERROR_SUCCESS};
+        } else {
+            status = (struct ac_status) {.code = AC_ERROR_MEMORY_ALLOC_FAILED};
+        }
+        break;
+    }
+    pthread_mutex_unlock(&builder->lock);
+    return status;
+}
+
+/// @brief Publish the current state of @p builder as an immutable snapshot.
+/// @par The snapshot shares the arrays that haven't changed since the previous snapshot, and the
+/// option indexes and other structures built for them. Indexes aren't patched per edit: an array
+/// that changed was copied by its first edit, and its index is rebuilt the next time it's parsed, so
+/// publishing and then parsing costs time linear in the size of the arrays that changed rather than
+/// the whole tree. Publishing again without edits shares everything.
+/// @param snapshot Receives the snapshot, which can be used anywhere a multi-command spec can, and
+/// is released with @c ac_spec_snapshot_release once nothing uses it, including any
+/// @c ac_parser created for it.
+/// @result @c AC_ERROR_SUCCESS when the snapshot was published.
+AC_API struct ac_status ac_spec_builder_publish(struct ac_spec_builder *const              builder,
+                                                struct ac_multi_command_spec const **const snapshot) {
+    if(builder == NULL || snapshot == NULL) {
+        return (struct ac_status) {.code = AC_ERROR_INVALID_PARAMETER};
+    }
+
+    struct _ac_spec_snapshot *const published =
+        (struct _ac_spec_snapshot *) malloc(sizeof(*published));
+    if(published == NULL) {
+        return (struct ac_status) {.code = AC_ERROR_MEMORY_ALLOC_FAILED};
+    }
+
+    pthread_mutex_lock(&builder->lock);
+    builder->subcommands->published = true;
+    builder->options->published     = true;
+    __atomic_add_fetch(&builder->subcommands->refs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&builder->options->refs, 1, __ATOMIC_RELAXED);
+
+    published->spec          = builder->root;
+    published->spec.subcommands =
+        (struct ac_multi_command_subcommand *) _ac_spec_array_data(builder->subcommands);
+    published->spec.n_subcommands = builder->subcommands->count;
+    published->spec.options       = (struct ac_option_spec *) _ac_spec_array_data(builder->options);
+    published->spec.n_options     = builder->options->count;
+    published->refs               = 1;
+    published->subcommands        = builder->subcommands;
+    published->options            = builder->options;
+    pthread_mutex_unlock(&builder->lock);
+
+    *snapshot = &published->spec;
+    return (struct ac_status) {.code = AC_ERROR_SUCCESS};
+}
+
+/// @brief Release a snapshot published by @c ac_spec_builder_publish. Everything that was built
+/// for parsing it, and not shared with other snapshots, is released too.
+AC_API void ac_spec_snapshot_release(struct ac_multi_command_spec const *const snapshot) {
+    if(snapshot == NULL) {
+        return;
+    }
+
+    struct _ac_spec_snapshot *const published = (struct _ac_spec_snapshot *) snapshot;
+    if(__atomic_sub_fetch(&published->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        _ac_memo_forget(published, &published[1]);
+        _ac_spec_array_unref(published->subcommands);
+        _ac_spec_array_unref(published->options);
+        free(published);
+    }
+}
+
+/// @brief Destroy @p builder. Snapshots that it published remain valid until they're released.
+AC_API void ac_spec_builder_destroy(struct ac_spec_builder *const builder) {
+    if(builder == NULL) {
+        return;
+    }
+
+    _ac_spec_array_unref(builder->subcommands);
+    _ac_spec_array_unref(builder->options);
+    pthread_mutex_destroy(&builder->lock);
+    free(builder);
+}
+
+/// @brief Forget everything that was built from @p command for parsing it, such as its option
+/// index. Those structures are only used while the spec is unchanged, so a spec whose memory is
+/// freed or reused is never parsed with stale ones, but they're kept until their address is parsed
+/// again. Call this before freeing a command spec that has been parsed, for example before
+/// unloading the plugin that defines it, to free them too. Parses in other threads that are still
+/// using them aren't affected, since they're only freed once those parses return.
+AC_API void ac_command_spec_forget(struct ac_command_spec const *const command) {
+    if(command == NULL) {
+        return;
+    }
+
+    _ac_memo_forget(command, &command[1]);
+    if(command->n_options > 0) {
+        _ac_memo_forget(command->options, &command->options[command->n_options]);
+    }
+}
+
+/// @brief Prepare @p stream for reading arguments from @p fd.
+/// @param stream The stream to initialise.
+/// @param fd The file descriptor to read arguments from, typically @c STDIN_FILENO.
+/// @param delimiter The byte that separates arguments in the stream.
+/// @result @c AC_ERROR_SUCCESS when the stream is ready to be read.
+AC_API struct ac_status
+ac_argument_stream_init(struct ac_argument_stream *const stream, int const fd,
+                        enum ac_stream_delimiter const delimiter) {
+    if(stream == NULL || fd < 0) {
+        return (struct ac_status) {.code = AC_ERROR_INVALID_PARAMETER};
+    }
+
+    stream->fd        = fd;
+    stream->delimiter = delimiter;
+    stream->index     = 0;
+    stream->head      = 0;
+    stream->scanned   = 0;
+    stream->tail      = 0;
+    stream->eof       = false;
+
+    return (struct ac_status) {.code = AC_ERROR_SUCCESS};
+}
+
+/// @brief Read the next argument from @p stream .
+/// @param stream A stream initialised by @c ac_argument_stream_init.
+/// @param value An output pointer to the argument. This points into @p stream and is only valid
+/// until the next call to this function. Set to @c NULL when the stream has no more arguments.
+/// @result @c AC_ERROR_SUCCESS when an argument was read, or the end of the stream was reached.
+AC_API struct ac_status ac_argument_stream_next(struct ac_argument_stream *const stream,
+                                                              char const **const value) {
+    if(stream == NULL || value == NULL) {
+        return (struct ac_status) {.code = AC_ERROR_INVALID_PARAMETER};
+    }
+
+    *value = NULL;
+
+    while(true) {
+        char *const delimiter = (char *) memchr(&stream->buffer[stream->scanned], stream->delimiter,
+                                                stream->tail - stream->scanned);
+        if(delimiter != NULL) {
+            // The whole argument may have been read at once, so the length is checked here too.
+            if((size_t) (delimiter - &stream->buffer[stream->head]) > MAX_STRING_LEN) {
+                return (struct ac_status) {.code    = AC_ERROR_STREAM_ARGUMENT_TOO_LONG,
+                                           .context = (void *) stream->index};
+            }
+            *delimiter = '\0';
+            *value     = &stream->buffer[stream->head];
+
+            stream->head    = (size_t) (delimiter - stream->buffer) + 1;
+            stream->scanned = stream->head;
+            stream->index++;
+            return (struct ac_status) {.code = AC_ERROR_SUCCESS};
+        }
+        stream->scanned = stream->tail;
+
+        if(stream->tail - stream->head > MAX_STRING_LEN) {
+            return (struct ac_status) {.code    = AC_ERROR_STREAM_ARGUMENT_TOO_LONG,
+                                       .context = (void *) stream->index};
+        }
+
+        if(stream->eof) {
+            // The final argument doesn't need a trailing delimiter.
+            if(stream->tail > stream->head) {
+                stream->buffer[stream->tail] = '\0';
+                *value                       = &stream->buffer[stream->head];
+
+                stream->head    = stream->tail;
+                stream->scanned = stream->tail;
+                stream->index++;
+            }
+            return (struct ac_status) {.code = AC_ERROR_SUCCESS};
+        }
+
+        // Move the partial argument to the front of the buffer when there's no more room to read
+        // into. One byte is always kept free so the final argument can be terminated.
+        if(stream->tail + 1 >= STREAM_BUFFER_SZ) {
+            size_t const partial = stream->tail - stream->head;
+            memmove(stream->buffer, &stream->buffer[stream->head], partial);
+            stream->head    = 0;
+            stream->scanned = partial;
+            stream->tail    = partial;
+        }
+
+        ssize_t const n_read =
+            read(stream->fd, &stream->buffer[stream->tail], STREAM_BUFFER_SZ - 1 - stream->tail);
+        if(n_read < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return (struct ac_status) {.code    = AC_ERROR_STREAM_READ_FAILED,
+                                       .context = (void *) (size_t) errno};
+        }
+
+        if(n_read == 0) {
+            stream->eof = true;
+        }
+        stream->tail += (size_t) n_read;
+    }
+}
+
+/// @brief Read every argument from @p fd and pass each one to @p callback as soon as it's complete.
+/// @param fd The file descriptor to read arguments from, typically @c STDIN_FILENO.
+/// @param delimiter The byte that separates arguments in the stream.
+/// @param callback The function to call for each argument.
+/// @param context [optional] A value that is passed through to @p callback.
+/// @result @c AC_ERROR_SUCCESS when the stream was read until its end, or @p callback stopped it.
+AC_API struct ac_status
+ac_argument_stream_foreach(int const fd, enum ac_stream_delimiter const delimiter,
+                           ac_argument_stream_callback const callback, void *const context) {
+    if(callback == NULL) {
+        return (struct ac_status) {.code = AC_ERROR_INVALID_PARAMETER};
+    }
+
+    struct ac_argument_stream stream;
+    struct ac_status          result = ac_argument_stream_init(&stream, fd, delimiter);
+    if(!ac_status_is_success(result)) {
+        return result;
+    }
+
+    while(true) {
+        char const *value = NULL;
+        result            = ac_argument_stream_next(&stream, &value);
+        if(!ac_status_is_success(result) || value == NULL) {
+            return result;
+        }
+
+        if(!callback(value, stream.index - 1, context)) {
+            return result;
+        }
+    }
+}
+
+static size_t _ac_strcpy_safe(char dst[], char const src[], size_t const offset,
+                              size_t const dst_len) {
+    size_t const src_len = strnlen(src, MAX_STRING_LEN);
+
+    if(offset + src_len + 1 >= dst_len) {
+        return 0;
+    }
+
+    memcpy(&dst[offset], src, src_len);
+    dst[offset + src_len] = '\0';
+    return src_len;
+}
+
+// Help text is written through a sink, so that the same rendering can fill a fixed buffer, measure
+// the output, or stream it. Once the sink asks to stop, nothing else is written.
+struct _ac_help_writer {
+    ac_help_sink sink;
+    void        *context;
+    bool         stopped;
+};
+
+static void _ac_help_write(struct _ac_help_writer *const writer, char const *const text,
+                           size_t const length) {
+    if(!writer->stopped && length > 0) {
+        writer->stopped = !writer->sink(text, length, writer->context);
+    }
+}
+
+static void _ac_help_puts(struct _ac_help_writer *const writer, char const *const text) {
+    _ac_help_write(writer, text, strnlen(text, MAX_STRING_LEN));
+}
+
+static void _ac_help_pad(struct _ac_help_writer *const writer, size_t n) {
+    static char const spaces[] = "                                ";
+    while(n > 0) {
+        size_t const chunk = n < sizeof(spaces) - 1 ? n : sizeof(spaces) - 1;
+        _ac_help_write(writer, spaces, chunk);
+        n -= chunk;
+    }
+}
+
+// A sink for a HELP_BUFFER_SZ buffer, which skips any text that doesn't fit like `_ac_strcpy_safe`.
+struct _ac_help_buffer {
+    char  *help;
+    size_t cursor;
+};
+
+static bool _ac_help_buffer_sink(char const *const text, size_t const length, void *const context) {
+    struct _ac_help_buffer *const buffer = (struct _ac_help_buffer *) context;
+    if(buffer->cursor + length + 1 < HELP_BUFFER_SZ) {
+        memcpy(&buffer->help[buffer->cursor], text, length);
+        buffer->cursor += length;
+        buffer->help[buffer->cursor] = '\0';
+    }
+    return true;
+}
+
+// Write a table of `options` under `title`.
+static void _ac_help_write_options(struct _ac_help_writer *const writer, char const *const title,
+                                   struct ac_option_spec const *const options, size_t const n_options) {
+    if(n_options == 0) {
+        return;
+    }
+    _ac_help_puts(writer, title);
+
+    size_t max_option_name_len = 0;
+    for(size_t i = 0; i < n_options; i++) {
+        struct ac_option_spec const *const option = &options[i];
+        char const *const                  name   = option->long_name;
+        assert(name != NULL);
+
+        size_t const name_len = strnlen(name, MAX_STRING_LEN);
+        max_option_name_len   = name_len > max_option_name_len ? name_len : max_option_name_len;
+    }
+
+    for(size_t i = 0; i < n_options; i++) {
+        struct ac_option_spec const *const option = &options[i];
+
+        _ac_help_puts(writer, "  ");
+        if(option->has_short_name) {
+            _ac_help_puts(writer, "-");
+            _ac_help_write(writer, &option->short_name, 1);
+            _ac_help_puts(writer, ", ");
+        } else {
+            _ac_help_pad(writer, 4);
+        }
+
+        char const *const long_name = option->long_name;
+        assert(long_name != NULL);
+
+        size_t const name_len = strnlen(long_name, MAX_STRING_LEN);
+        _ac_help_puts(writer, "--");
+        _ac_help_write(writer, long_name, name_len);
+        _ac_help_pad(writer, (max_option_name_len - name_len) + 1);
+
+        if(option->help != NULL) {
+            _ac_help_puts(writer, option->help);
+        }
+        for(size_t j = 0; j < option->n_choices; j++) {
+            _ac_help_puts(writer, j == 0 ? " {" : ", ");
+            _ac_help_puts(writer, option->choices[j]);
+        }
+        if(option->n_choices > 0) {
+            _ac_help_puts(writer, "}");
+        }
+        if(option->default_value != NULL) {
+            _ac_help_puts(writer, " [default: ");
+            _ac_help_puts(writer, option->default_value);
+            _ac_help_puts(writer, "]");
+        }
+        if(option->env != NULL) {
+            _ac_help_puts(writer, " [env: ");
+            _ac_help_puts(writer, option->env);
+            _ac_help_puts(writer, "]");
+        }
+        if(option->required) {
+            _ac_help_puts(writer, " (required)");
+        }
+        _ac_help_puts(writer, "\n");
+    }
+}
+
+// Write a table of the arguments of `command`.
+static void _ac_help_write_arguments(struct _ac_help_writer *const       writer,
+                                     struct ac_command_spec const *const command) {
+    if(command->n_arguments == 0) {
+        return;
+    }
+    assert(command->n_arguments <= MAX_NUM_ARGS);
+    _ac_help_puts(writer, "\nArguments:\n");
+
+    size_t max_argument_name_len = 0;
+    for(size_t i = 0; i < command->n_arguments; i++) {
+        char const *const name = command->arguments[i].name;
+        assert(name != NULL);
+
+        size_t const name_len = strnlen(name, MAX_STRING_LEN);
+        max_argument_name_len = name_len > max_argument_name_len ? name_len : max_argument_name_len;
+    }
+
+    for(size_t i = 0; i < command->n_arguments; i++) {
+        char const *const name = command->arguments[i].name;
+        assert(name != NULL);
+
+        size_t const name_len = strnlen(name, MAX_STRING_LEN);
+        _ac_help_puts(writer, "  ");
+        _ac_help_write(writer, name, name_len);
+        _ac_help_pad(writer, (max_argument_name_len - name_len) + 1);
+
+        if(command->arguments[i].help != NULL) {
+            _ac_help_puts(writer, command->arguments[i].help);
+        }
+        _ac_help_puts(writer, "\n");
+    }
+}
+
+// Append a table of `options` to `help` under `title`, returning the new cursor.
+static size_t _ac_help_options(char help[], size_t cursor, char const *const title,
+                               struct ac_option_spec const *const options, size_t const n_options) {
+    assert(n_options <= MAX_NUM_OPTIONS);
+    struct _ac_help_buffer buffer = {help, cursor};
+    struct _ac_help_writer writer = {_ac_help_buffer_sink, &buffer, false};
+    _ac_help_write_options(&writer, title, options, n_options);
+    return buffer.cursor;
+}
+
+/// @brief Generate a help text string for the given @p command specification
+/// @param command The command to generate a help string for.
+/// @param toolpath [optional] The path to the binary that executes this tools. If not `NULL`, a
+///                 usage line will be inserted into the help message.
+/// @result A help string if successful, otherwise @c NULL.
+AC_API char *ac_command_help(struct ac_command_spec const *const command,
+                                            char const *const                   toolpath) {
+    char *const help = (char *) malloc(HELP_BUFFER_SZ);
+    if(help == NULL) {
+        return NULL;
+    }
+
+    size_t cursor = 0;
+    cursor += _ac_strcpy_safe(help, command->help, cursor, HELP_BUFFER_SZ);
+    cursor += _ac_strcpy_safe(help, "\n", cursor, HELP_BUFFER_SZ);
+
+    if(toolpath) {
+        cursor += _ac_strcpy_safe(help, "\nUsage: ", cursor, HELP_BUFFER_SZ);
+        cursor += _ac_strcpy_safe(help, toolpath, cursor, HELP_BUFFER_SZ);
+        for(size_t i = 0; i < command->n_arguments; i++) {
+            cursor += _ac_strcpy_safe(help, " <", cursor, HELP_BUFFER_SZ);
+            cursor += _ac_strcpy_safe(help, command->arguments[i].name, cursor, HELP_BUFFER_SZ);
+            cursor += _ac_strcpy_safe(help, ">", cursor, HELP_BUFFER_SZ);
+        }
+        if(command->n_options > 0) {
+            cursor += _ac_strcpy_safe(help, " {options}", cursor, HELP_BUFFER_SZ);
+        }
+        cursor += _ac_strcpy_safe(help, "\n", cursor, HELP_BUFFER_SZ);
+    }
+
+    struct _ac_help_buffer buffer = {help, cursor};
+    struct _ac_help_writer writer = {_ac_help_buffer_sink, &buffer, false};
+    _ac_help_write_arguments(&writer, command);
+    _ac_help_write_options(&writer, "\nOptions:\n", command->options, command->n_options);
+
+    return help;
+}
+
+/// @brief Generate a help text string for the given @p command multi-command specification
+/// @param command The multi-command to generate a help string for.
+/// @param toolpath [optional] The path to the binary that executes this tools. If not `NULL`, a
+///                 usage line will be inserted into the help message.
+/// @result A help string if successful, otherwise @c NULL.
+AC_API char *ac_multi_command_help(struct ac_multi_command_spec const *const command,
+                                                  char const *const toolpath) {
+    char *const help = (char *) malloc(HELP_BUFFER_SZ);
+    if(help == NULL) {
+        return NULL;
+    }
+
+    size_t cursor = 0;
+
+    if(command->help != NULL) {
+        cursor += _ac_strcpy_safe(help, command->help, cursor, HELP_BUFFER_SZ);
+        cursor += _ac_strcpy_safe(help, "\n", cursor, HELP_BUFFER_SZ);
+    }
+
+    if(toolpath) {
+        cursor += _ac_strcpy_safe(help, "\nUsage: ", cursor, HELP_BUFFER_SZ);
+        cursor += _ac_strcpy_safe(help, toolpath, cursor, HELP_BUFFER_SZ);
+        if(command->n_options > 0) {
+            cursor += _ac_strcpy_safe(help, " {options}", cursor, HELP_BUFFER_SZ);
+        }
+        cursor += _ac_strcpy_safe(help, " {subcommands}\n", cursor, HELP_BUFFER_SZ);
+    }
+
+    // Options of a multi-command apply to all of its subcommands.
+    cursor =
+        _ac_help_options(help, cursor, "\nOptions:\n", command->options, command->n_options);
+
+    size_t max_command_name_len = 0;
+    for(size_t i = 0; i < command->n_subcommands; i++) {
+        assert(command->subcommands[i].name != NULL);
+        size_t const name_len = strnlen(command->subcommands[i].name, MAX_STRING_LEN);
+        max_command_name_len  = name_len > max_command_name_len ? name_len : max_command_name_len;
+    }
+
+    cursor += _ac_strcpy_safe(help, "\nCommands:\n", cursor, HELP_BUFFER_SZ);
+    for(size_t i = 0; i < command->n_subcommands; i++) {
+        cursor += _ac_strcpy_safe(help, "  ", cursor, HELP_BUFFER_SZ);
+        cursor += _ac_strcpy_safe(help, command->subcommands[i].name, cursor, HELP_BUFFER_SZ);
+
+        size_t const name_len = strnlen(command->subcommands[i].name, MAX_STRING_LEN);
+        for(size_t j = 0; j < (max_command_name_len - name_len) + 1; j++) {
+            cursor += _ac_strcpy_safe(help, " ", cursor, HELP_BUFFER_SZ);
+        }
+
+        switch(command->subcommands[i].type) {
+            case COMMAND_SINGLE: {
+                if(command->subcommands[i].single->help) {
+                    cursor += _ac_strcpy_safe(help, command->subcommands[i].single->help, cursor,
+                                              HELP_BUFFER_SZ);
+                }
+                break;
+            }
+            case COMMAND_MULTI: {
+                if(command->subcommands[i].multi->help) {
+                    cursor += _ac_strcpy_safe(help, command->subcommands[i].multi->help, cursor,
+                                              HELP_BUFFER_SZ);
+                }
+                break;
+            }
+            case COMMAND_LAZY: {
+                // Help is generated without resolving, so unresolved plugins aren't loaded.
+                if(command->subcommands[i].help) {
+                    cursor += _ac_strcpy_safe(help, command->subcommands[i].help, cursor,
+                                              HELP_BUFFER_SZ);
+                }
+                break;
+            }
+        }
+        cursor += _ac_strcpy_safe(help, "\n", cursor, HELP_BUFFER_SZ);
+    }
+
+    return help;
+}
+
+// Write the section of one command of a tree, starting with its command path and, like a usage
+// line, its arguments.
+static void _ac_help_write_section(struct _ac_help_writer *const                   writer,
+                                   char const *const                               path,
+                                   struct ac_multi_command_subcommand const *const subcommand) {
+    _ac_help_puts(writer, path);
+    switch(subcommand->type) {
+        case COMMAND_SINGLE: {
+            struct ac_command_spec const *const command = subcommand->single;
+            for(size_t i = 0; i < command->n_arguments; i++) {
+                _ac_help_puts(writer, " <");
+                _ac_help_puts(writer, command->arguments[i].name);
+                _ac_help_puts(writer, ">");
+            }
+            if(command->n_options > 0) {
+                _ac_help_puts(writer, " {options}");
+            }
+            _ac_help_puts(writer, "\n");
+            if(command->help != NULL) {
+                _ac_help_puts(writer, command->help);
+                _ac_help_puts(writer, "\n");
+            }
+            _ac_help_write_arguments(writer, command);
+            _ac_help_write_options(writer, "\nOptions:\n", command->options, command->n_options);
+            break;
+        }
+        case COMMAND_MULTI: {
+            struct ac_multi_command_spec const *const multi = subcommand->multi;
+            if(multi->n_options > 0) {
+                _ac_help_puts(writer, " {options}");
+            }
+            _ac_help_puts(writer, " {subcommands}\n");
+            if(multi->help != NULL) {
+                _ac_help_puts(writer, multi->help);
+                _ac_help_puts(writer, "\n");
+            }
+            _ac_help_write_options(writer, "\nOptions:\n", multi->options, multi->n_options);
+            break;
+        }
+        case COMMAND_LAZY: {
+            _ac_help_puts(writer, "\n");
+            if(subcommand->help != NULL) {
+                _ac_help_puts(writer, subcommand->help);
+                _ac_help_puts(writer, "\n");
+            }
+            break;
+        }
+    }
+    _ac_help_puts(writer, "\n");
+}
+
+/// @brief Prepare @p pager for rendering the help of the tree under @p root .
+/// @param pager The pager to initialise.
+/// @param root The root of the tree.
+/// @param toolpath [optional] The path to the binary that executes this tool, which starts the
+///                 command path of each section.
+/// @param max_depth The maximum depth of subcommands below @p root to render, or 0 for no limit.
+/// @result @c AC_ERROR_SUCCESS when @p pager is ready.
+AC_API struct ac_status ac_help_pager_init(struct ac_help_pager *const               pager,
+                                                          struct ac_multi_command_spec const *const root,
+                                                          char const *const toolpath,
+                                                          size_t const      max_depth) {
+    if(pager == NULL || root == NULL) {
+        return (struct ac_status) {.code = AC_ERROR_INVALID_PARAMETER};
+    }
+
+    size_t const path_len = toolpath != NULL ? strnlen(toolpath, MAX_STRING_LEN) : 0;
+    if(path_len >= MAX_STRING_LEN) {
+        return (struct ac_status) {.code = AC_ERROR_BUFFER_TOO_SMALL, .context = (void *) (path_len + 1)};
+    }
+
+    bzero(pager, sizeof(*pager));
+    pager->max_depth = max_depth;
+    pager->n_frames  = 1;
+    pager->frames[0] = (struct ac_help_pager_frame) {.multi = root, .next = 0, .path_len = path_len};
+    memcpy(pager->path, toolpath != NULL ? toolpath : "", path_len);
+    pager->path[path_len] = '\0';
+    return (struct ac_status) {.code = AC_ERROR_SUCCESS};
+}
+
+// Render the next command of the walk of `pager` to `writer`, and set `done` when there isn't one.
+static struct ac_status _ac_help_pager_step(struct ac_help_pager *const   pager,
+                                            struct _ac_help_writer *const writer, bool *const done) {
+    *done = false;
+    if(!pager->started) {
+        pager->started = true;
+        pager->n_rendered++;
+        struct ac_multi_command_subcommand const root = {
+            .type = COMMAND_MULTI, .multi = (struct ac_multi_command_spec *) pager->frames[0].multi};
+        _ac_help_write_section(writer, pager->path, &root);
+        return (struct ac_status) {.code = AC_ERROR_SUCCESS};
+    }
+
+    while(pager->n_frames > 0) {
+        struct ac_help_pager_frame *const frame = &pager->frames[pager->n_frames - 1];
+        if(frame->next == frame->multi->n_subcommands) {
+            pager->n_frames--;
+            continue;
+        }
+
+        struct ac_multi_command_subcommand const *const subcommand = &frame->multi->subcommands[frame->next];
+        assert(subcommand->name != NULL);
+        bool const deeper = pager->max_depth == 0 || pager->n_frames < pager->max_depth;
+        if(subcommand->type == COMMAND_MULTI && deeper && pager->n_frames == MAX_NUM_ARGS) {
+            return (struct ac_status) {.code    = AC_ERROR_ARGUMENT_MAX_EXCEEDED,
+                                       .multi   = frame->multi,
+                                       .context = (void *) (size_t) (pager->n_frames + 1)};
+        }
+        frame->next++;
+        size_t const name_len = strnlen(subcommand->name, MAX_STRING_LEN);
+        size_t const space    = frame->path_len > 0 ? 1 : 0;
+        size_t const path_len = frame->path_len + space + name_len;
+        if(path_len >= MAX_STRING_LEN) {
+            return (struct ac_status) {.code    = AC_ERROR_BUFFER_TOO_SMALL,
+                                       .multi   = frame->multi,
+                                       .context = (void *) (path_len + 1)};
+        }
+        pager->path[frame->path_len] = ' ';
+        memcpy(&pager->path[frame->path_len + space], subcommand->name, name_len);
+        pager->path[path_len] = '\0';
+
+        pager->n_rendered++;
+        _ac_help_write_section(writer, pager->path, subcommand);
+
+        if(subcommand->type == COMMAND_MULTI && deeper) {
+            pager->frames[pager->n_frames++] =
+                (struct ac_help_pager_frame) {.multi = subcommand->multi, .next = 0, .path_len = path_len};
+        }
+        return (struct ac_status) {.code = AC_ERROR_SUCCESS};
+    }
+
+    *done = true;
+    return (struct ac_status) {.code = AC_ERROR_SUCCESS};
+}
+
+static bool _ac_help_pending_sink(char const *const text, size_t const length, void *const context) {
+    struct ac_help_pager *const pager = (struct ac_help_pager *) context;
+    if(pager->pending_len + length > pager->pending_capacity) {
+        size_t capacity = pager->pending_capacity > 0 ? pager->pending_capacity : HELP_BUFFER_SZ;
+        while(capacity < pager->pending_len + length) {
+            capacity *= 2;
+        }
+        char *const pending = (char *) realloc(pager->pending, capacity);
+        if(pending == NULL) {
+            return false;
+        }
+        pager->pending          = pending;
+        pager->pending_capacity = capacity;
+    }
+
+    memcpy(&pager->pending[pager->pending_len], text, length);
+    pager->pending_len += length;
+    return true;
+}
+
+/// @brief Render the next page of the help of a tree.
+/// @par Only as many commands as are needed to fill the page are rendered.
+/// @param pager A pager prepared by @c ac_help_pager_init.
+/// @param n_lines The maximum number of lines on the page.
+/// @param page An output pointer to the page, or @c NULL once the whole tree has been rendered. The
+/// page is owned by @p pager and is valid until the next call or @c ac_help_pager_release.
+/// @result @c AC_ERROR_SUCCESS when @p page is set, or @c AC_ERROR_ARGUMENT_MAX_EXCEEDED when the
+/// walk reaches a multi-command deeper than @c MAX_NUM_ARGS, as described by @c ac_help_pager.
+AC_API struct ac_status ac_help_pager_next(struct ac_help_pager *const pager,
+                                                          size_t const n_lines, char **const page) {
+    if(pager == NULL || n_lines == 0 || page == NULL) {
+        return (struct ac_status) {.code = AC_ERROR_INVALID_PARAMETER};
+    }
+    *page = NULL;
+
+    size_t page_len = 0;
+    size_t lines    = 0;
+    while(lines < n_lines) {
+        if(pager->pending_pos == pager->pending_len) {
+            pager->pending_len = pager->pending_pos = 0;
+
+            bool                   done   = false;
+            struct _ac_help_writer writer = {_ac_help_pending_sink, pager, false};
+            struct ac_status const status = _ac_help_pager_step(pager, &writer, &done);
+            if(!ac_status_is_success(status)) {
+                return status;
+            }
+            if(writer.stopped) {
+                return (struct ac_status) {.code = AC_ERROR_MEMORY_ALLOC_FAILED};
+            }
+            if(done) {
+                break;
+            }
+            continue;
+        }
+
+        // Move the rest of the current line to the page.
+        char const *const start = &pager->pending[pager->pending_pos];
+        size_t const      rest  = pager->pending_len - pager->pending_pos;
+        char const *const end   = (char const *) memchr(start, '\n', rest);
+        size_t const      n     = end != NULL ? (size_t) (end - start) + 1 : rest;
+        if(page_len + n + 1 > pager->page_capacity) {
+            size_t capacity = pager->page_capacity > 0 ? pager->page_capacity : HELP_BUFFER_SZ;
+            while(capacity < page_len + n + 1) {
+                capacity *= 2;
+            }
+            char *const grown = (char *) realloc(pager->page, capacity);
+            if(grown == NULL) {
+                return (struct ac_status) {.code = AC_ERROR_MEMORY_ALLOC_FAILED};
+            }
+            pager->page          = grown;
+            pager->page_capacity = capacity;
+        }
+        memcpy(&pager->page[page_len], start, n);
+        page_len += n;
+        pager->pending_pos += n;
+        lines += end != NULL ? 1 : 0;
+    }
+
+    if(page_len > 0) {
+        pager->page[page_len] = '\0';
+        *page                 = pager->page;
+    }
+    return (struct ac_status) {.code = AC_ERROR_SUCCESS};
+}
+
+/// @brief Release the resources of a pager prepared by @c ac_help_pager_init.
+AC_API void ac_help_pager_release(struct ac_help_pager *const pager) {
+    if(pager == NULL) {
+        return;
+    }
+
+    free(pager->pending);
+    free(pager->page);
+    pager->pending = pager->page = NULL;
+    pager->pending_len = pager->pending_pos = pager->pending_capacity = pager->page_capacity = 0;
+}
+
+/// @brief Render the help of every command in the tree under @p root to @p sink .
+/// @par Commands are rendered in depth-first order, as described by @c ac_help_pager, and no memory
+/// is allocated.
+/// @param root The root of the tree.
+/// @param toolpath [optional] The path to the binary that executes this tool, which starts the
+///                 command path of each section.
+/// @param max_depth The maximum depth of subcommands below @p root to render, or 0 for no limit.
+/// @param sink A callback that receives the help text. When it returns @c false, rendering stops.
+/// @param context An optional value that is passed through to @p sink .
+/// @result @c AC_ERROR_SUCCESS when the tree was rendered or @p sink stopped it, or
+/// @c AC_ERROR_ARGUMENT_MAX_EXCEEDED when it's deeper than @c MAX_NUM_ARGS and @p max_depth doesn't
+/// limit it.
+AC_API struct ac_status
+ac_multi_command_help_tree_write(struct ac_multi_command_spec const *const root,
+                                 char const *const toolpath, size_t const max_depth,
+                                 ac_help_sink const sink, void *const context) {
+    if(sink == NULL) {
+        return (struct ac_status) {.code = AC_ERROR_INVALID_PARAMETER};
+    }
+
+    struct ac_help_pager pager;
+    struct ac_status     status = ac_help_pager_init(&pager, root, toolpath, max_depth);
+    if(!ac_status_is_success(status)) {
+        return status;
+    }
+
+    struct _ac_help_writer writer = {sink, context, false};
+    for(bool done = false; !done && !writer.stopped;) {
+        status = _ac_help_pager_step(&pager, &writer, &done);
+        if(!ac_status_is_success(status)) {
+            return status;
+        }
+    }
+    return status;
+}
+
+static bool _ac_help_measure_sink(char const *const text, size_t const length, void *const context) {
+    (void) text;
+    *(size_t *) context += length;
+    return true;
+}
+
+struct _ac_help_copy {
+    char  *help;
+    size_t cursor;
+    // The size that was measured, which the copy never exceeds.
+    size_t size;
+    bool   overflowed;
+};
+
+// Copy the rendered help into the measured allocation. The tree belongs to the caller, who may
+// modify it between the passes, so the writer is stopped rather than overflowing.
+static bool _ac_help_copy_sink(char const *const text, size_t const length, void *const context) {
+    struct _ac_help_copy *const copy = (struct _ac_help_copy *) context;
+    if(length > copy->size - copy->cursor) {
+        copy->overflowed = true;
+        return false;
+    }
+    memcpy(&copy->help[copy->cursor], text, length);
+    copy->cursor += length;
+    return true;
+}
+
+/// @brief Generate the help of every command in the tree under @p root , as a reference.
+/// @par Unlike @c ac_multi_command_help, the output isn't limited to @c HELP_BUFFER_SZ. The tree is
+/// walked once to measure the output and again to render it into exactly one allocation, and
+/// @c NULL is returned if the tree grew in between.
+/// @param root The root of the tree.
+/// @param toolpath [optional] The path to the binary that executes this tool, which starts the
+///                 command path of each section.
+/// @param max_depth The maximum depth of subcommands below @p root to render, or 0 for no limit.
+/// @result A help string owned by the caller if successful, otherwise @c NULL.
+AC_API char *ac_multi_command_help_tree(struct ac_multi_command_spec const *const root,
+                                                       char const *const toolpath,
+                                                       size_t const      max_depth) {
+    size_t size = 0;
+    if(!ac_status_is_success(
+           ac_multi_command_help_tree_write(root, toolpath, max_depth, _ac_help_measure_sink, &size))) {
+        return NULL;
+    }
+
+    struct _ac_help_copy copy = {(char *) malloc(size + 1), 0, size, false};
+    if(copy.help == NULL) {
+        return NULL;
+    }
+    if(!ac_status_is_success(
+           ac_multi_command_help_tree_write(root, toolpath, max_depth, _ac_help_copy_sink, &copy)) ||
+       copy.overflowed) {
+        free(copy.help);
+        return NULL;
+    }
+    copy.help[copy.cursor] = '\0';
+    return copy.help;
+}
+
+// A set of names used to detect duplicates. Small sets live on the stack.
+struct _ac_name_set {
+    char const **slots;
+    size_t       capacity;
+    char const  *stack[64];
+};
+
+static bool _ac_name_set_init(struct _ac_name_set *const set, size_t const n_names) {
+    // Keep the load factor at or below 1/2.
+    set->capacity = 16;
+    while(set->capacity < 2 * n_names) {
+        set->capacity *= 2;
+    }
+
+    if(set->capacity <= sizeof(set->stack) / sizeof(set->stack[0])) {
+        bzero(set->stack, sizeof(set->stack));
+        set->slots = set->stack;
+        return true;
+    }
+
+    set->slots = (char const **) calloc(set->capacity, sizeof(*set->slots));
+    return set->slots != NULL;
+}
+
+static void _ac_name_set_release(struct _ac_name_set *const set) {
+    if(set->slots != set->stack) {
+        free((void *) set->slots);
+    }
+}
+
+// Add `name` to the set, returning false when it's already present.
+static bool _ac_name_set_insert(struct _ac_name_set *const set, char const *const name) {
+    for(size_t probe = (size_t) _ac_fnv1a_string(0xcbf29ce484222325ULL, name);; probe++) {
+        char const **const slot = &set->slots[probe & (set->capacity - 1)];
+        if(*slot == NULL) {
+            *slot = name;
+            return true;
+        }
+        if(0 == strncmp(*slot, name, MAX_STRING_LEN)) {
+            return false;
+        }
+    }
+}
+
+// Validate the options of a command or multi-command. This is linear in the number of options.
+static struct ac_status _ac_options_validate(struct ac_option_spec const *const options,
+                                             size_t const n_options, bool const utf8) {
+    if(n_options > MAX_NUM_SPEC_OPTIONS) {
+        return (struct ac_status) {.code = AC_ERROR_OPTION_TOO_MANY, .context = (void *) n_options};
+    }
+
+    struct _ac_name_set long_names;
+    if(!_ac_name_set_init(&long_names, n_options)) {
+        return (struct ac_status) {.code = AC_ERROR_MEMORY_ALLOC_FAILED};
+    }
+
+    // The choices tables are read to check the defaults, so they are looked up in a read section.
+    size_t const     epoch          = _ac_memo_enter();
+    uint64_t         short_names[2] = {0};
+    struct ac_status status         = {.code = AC_ERROR_SUCCESS};
+    for(size_t i = 0; i < n_options && ac_status_is_success(status); i++) {
+        struct ac_option_spec const *const option = &options[i];
+        if(option->long_name == NULL) {
+            status = (struct ac_status) {.code = AC_ERROR_OPTION_SPEC_NEEDS_NAME, .context = (void *) i};
+        } else if(!_ac_string_is_name(option->long_name, utf8)) {
+            status = (struct ac_status) {.code    = AC_ERROR_OPTION_LONG_NAME_INVALID,
+                                         .context = (void *) i};
+        } else if(option->has_short_name && !_ac_char_is_alpha(option->short_name)) {
+            status = (struct ac_status) {.code    = AC_ERROR_OPTION_SHORT_NAME_INVALID,
+                                         .context = (void *) i};
+        } else if(option->is_flag && option->required) {
+            status = (struct ac_status) {.code    = AC_ERROR_OPTION_FLAG_AND_REQUIRED,
+                                         .context = (void *) i};
+        } else if(option->n_choices > 0 && _ac_choices(option, &status) == NULL) {
+            // Building the choices table checks them.
+        } else if(option->default_value != NULL &&
+                  (option->is_flag || option->required ||
+                   (option->n_choices > 0 &&
+                    _ac_choices_find(option, _ac_choices(option, &status), option->default_value) ==
+                        option->n_choices))) {
+            status = (struct ac_status) {.code    = AC_ERROR_OPTION_DEFAULT_INVALID,
+                                         .option  = option,
+                                         .context = option->default_value};
+        } else if(!_ac_name_set_insert(&long_names, option->long_name)) {
+            status = (struct ac_status) {.code    = AC_ERROR_OPTION_LONG_NAME_DUPLICATE,
+                                         .option  = option,
+                                         .context = (void *) i};
+        } else if(option->has_short_name) {
+            // Valid short names are ASCII letters, so they fit in a 128-bit map.
+            unsigned char const short_name = (unsigned char) option->short_name;
+            uint64_t const      bit        = 1ULL << (short_name % 64);
+            if(short_names[short_name / 64] & bit) {
+                status = (struct ac_status) {.code    = AC_ERROR_OPTION_SHORT_NAME_DUPLICATE,
+                                             .option  = option,
+                                             .context = (void *) i};
+            }
+            short_names[short_name / 64] |= bit;
+        }
+    }
+
+    _ac_memo_leave(epoch);
+    _ac_name_set_release(&long_names);
+    return status;
+}
+
+// Copy the memoized validation result of `spec`, whose stamp is `stamp`, to `status`, if there is
+// one. Returns false when it hasn't been validated.
+static bool _ac_validated(void const *const spec, uint64_t const stamp, struct ac_status *const status) {
+    size_t const                  epoch = _ac_memo_enter();
+    struct ac_status const *const memoized =
+        (struct ac_status const *) _ac_memo_get(spec, _AC_MEMO_VALIDATED, stamp);
+    if(memoized != NULL) {
+        *status = *memoized;
+    }
+    _ac_memo_leave(epoch);
+    return memoized != NULL;
+}
+
+// Memoize the validation result of `spec`. Failing to memoize only means it's validated again.
+static struct ac_status _ac_validated_put(void const *const spec, uint64_t const stamp,
+                                          struct ac_status const status) {
+    static struct ac_status const success = {.code = AC_ERROR_SUCCESS};
+    if(ac_status_is_success(status)) {
+        (void) _ac_memo_put(spec, _AC_MEMO_VALIDATED, stamp, (void *) &success);
+        return status;
+    }
+
+    struct ac_status *const failure = (struct ac_status *) malloc(sizeof(*failure));
+    if(failure != NULL) {
+        *failure = status;
+        if(_ac_memo_put(spec, _AC_MEMO_VALIDATED, stamp, failure) != failure) {
+            free(failure);
+        }
+    }
+    return status;
+}
+
+/// @brief Determine if the provided `command` is a valid spec, therefore may safely be passed to
+/// `ac_command_parse`.
+/// @par The result is memoized for each spec, so only the first call does any work.
+/// @result `AC_ERROR_SUCCESS` when the `command` is valid.
+AC_API struct ac_status
+ac_command_validate(struct ac_command_spec const *const command) {
+    if(command == NULL) {
+        return (struct ac_status) {.code = AC_ERROR_INVALID_PARAMETER};
+    }
+
+    uint64_t const   stamp = _ac_stamp_command(0xcbf29ce484222325ULL, command, true);
+    struct ac_status memoized;
+    if(_ac_validated(command, stamp, &memoized)) {
+        return memoized;
+    }
+
+    for(size_t i = 0; i < command->n_arguments; i++) {
+        struct ac_argument_spec const *const arg = &command->arguments[i];
+        if(arg->name == NULL) {
+            return _ac_validated_put(command, stamp,
+                                     (struct ac_status) {.code    = AC_ERROR_ARGUMENT_SPEC_NEEDS_NAME,
+                                                         .single  = command,
+                                                         .context = (void *) i});
+        }
+    }
+
+    struct ac_status status = _ac_options_validate(command->options, command->n_options, command->utf8);
+    status.single           = command;
+    if(ac_status_is_success(status) && command->n_constraints > 0) {
+        // Compiling the constraints checks that they only name options of the command.
+        (void) _ac_constraints(command, &status);
+    }
+
+    if(status.code == AC_ERROR_MEMORY_ALLOC_FAILED) {
+        return status;
+    }
+    return _ac_validated_put(command, stamp, status);
+}
+
+// The stamp of the tree below a subcommand, as computed by _ac_multi_command_validate, which is 0 for
+// a COMMAND_LAZY subcommand.
+static uint64_t _ac_stamp_tree(struct ac_multi_command_subcommand const *const subcommand) {
+    if(subcommand->type == COMMAND_SINGLE && subcommand->single != NULL) {
+        return _ac_stamp_command(0xcbf29ce484222325ULL, subcommand->single, true);
+    }
+    if(subcommand->type != COMMAND_MULTI || subcommand->multi == NULL) {
+        return 0;
+    }
+    struct ac_multi_command_spec const *const multi = subcommand->multi;
+    uint64_t hash = _ac_stamp_multi(0xcbf29ce484222325ULL, multi, true);
+    for(size_t i = 0; multi->subcommands != NULL && i < multi->n_subcommands; i++) {
+        uint64_t const subtree = _ac_stamp_tree(&multi->subcommands[i]);
+        hash                   = _ac_fnv1a(hash, &subtree, sizeof(subtree));
+    }
+    return hash;
+}
+
+// Validate `command` and its subtrees, memoizing the result of each complete subtree. The subtrees
+// are validated before they're looked up, so that their stamps are only computed once, and `stamp`
+// is set to the stamp of the whole tree. `complete` is cleared when it has unresolved subcommands.
+static struct ac_status _ac_multi_command_validate(struct ac_multi_command_spec const *const command,
+                                                   uint64_t *const stamp, bool *const complete) {
+    struct ac_status status = _ac_options_validate(command->options, command->n_options, command->utf8);
+    status.multi            = command;
+
+    struct _ac_name_set names;
+    if(ac_status_is_success(status) && !_ac_name_set_init(&names, command->n_subcommands)) {
+        status = (struct ac_status) {.code = AC_ERROR_MEMORY_ALLOC_FAILED, .multi = command};
+    }
+    bool const checked = ac_status_is_success(status);
+
+    // The stamp of every subtree is needed even after an error, so the loop continues without
+    // validating anything else.
+    uint64_t hash = _ac_stamp_multi(0xcbf29ce484222325ULL, command, true);
+    for(size_t i = 0; i < command->n_subcommands; i++) {
+        struct ac_multi_command_subcommand const *const subcommand = &command->subcommands[i];
+        uint64_t                                        subtree    = 0;
+        bool const                                      valid      = ac_status_is_success(status);
+        if(valid && subcommand->name == NULL) {
+            status = (struct ac_status) {
+                .code = AC_ERROR_MULTICOMMAND_NEEDS_NAME, .multi = command, .context = (void *) i};
+        } else if(valid && !_ac_name_set_insert(&names, subcommand->name)) {
+            status = (struct ac_status) {
+                .code = AC_ERROR_COMMAND_NAME_DUPLICATE, .multi = command, .context = subcommand->name};
+        }
+
+        switch(subcommand->type) {
+            case COMMAND_SINGLE: {
+                subtree = _ac_stamp_tree(subcommand);
+                if(ac_status_is_success(status)) {
+                    status = ac_command_validate(subcommand->single);
+                }
+                break;
+            }
+            case COMMAND_MULTI: {
+                if(ac_status_is_success(status) && subcommand->multi == NULL) {
+                    status = (struct ac_status) {.code = AC_ERROR_INVALID_PARAMETER};
+                } else if(ac_status_is_success(status)) {
+                    status = _ac_multi_command_validate(subcommand->multi, &subtree, complete);
+                } else {
+                    subtree = _ac_stamp_tree(subcommand);
+                }
+                break;
+            }
+            case COMMAND_LAZY: {
+                // Unresolved subtrees aren't validated, since that would resolve the whole tree.
+                *complete = false;
+                if(ac_status_is_success(status) && subcommand->resolver == NULL) {
+                    status = (struct ac_status) {.code    = AC_ERROR_COMMAND_RESOLVE_FAILED,
+                                                 .multi   = command,
+                                                 .context = subcommand->name};
+                }
+                break;
+            }
+        }
+        hash = _ac_fnv1a(hash, &subtree, sizeof(subtree));
+    }
+
+    if(checked) {
+        _ac_name_set_release(&names);
+    }
+    *stamp = hash;
+    if(!*complete || status.code == AC_ERROR_MEMORY_ALLOC_FAILED) {
+        return status;
+    }
+    return _ac_validated_put(command, hash, status);
+}
+
+/// @brief Determine if the provided `command` is a valid multi-command spec, therefore may safely
+/// be passed to `ac_multi_command_parse`.
+/// @par All subcommands are validated recursively, apart from @c COMMAND_LAZY subcommands that
+/// haven't been resolved yet. This is linear in the size of the tree. The result is memoized for
+/// each spec, so later calls only check that the tree hasn't changed since.
+/// @result `AC_ERROR_SUCCESS` when the `command` is valid.
+AC_API struct ac_status
+ac_multi_command_validate(struct ac_multi_command_spec const *const command) {
+    if(command == NULL) {
+        return (struct ac_status) {.code = AC_ERROR_INVALID_PARAMETER};
+    }
+
+    struct ac_multi_command_subcommand const root = {
+        .type  = COMMAND_MULTI,
+        .multi = (struct ac_multi_command_spec *) command,
+    };
+    struct ac_status memoized;
+    if(_ac_validated(command, _ac_stamp_tree(&root), &memoized)) {
+        return memoized;
+    }
+
+    uint64_t stamp;
+    bool     complete = true;
+    return _ac_multi_command_validate(command, &stamp, &complete);
+}
+
+/// @brief Extracts an argument from the parsed `command` structure.
+/// @result The argument value, or `NULL` if the `name` wasn't in the `command`'s arguments.
+AC_API struct ac_argument *
+ac_extract_argument(struct ac_command const *const command, char const *const name) {
+    for(size_t i = 0; i < command->n_arguments; i++) {
+        if(0 == strncmp(command->arguments[i].argument->name, name, MAX_STRING_LEN)) {
+            return &command->arguments[i];
+        }
+    }
+
+    return NULL;
+}
+
+/// @brief Extracts an option from the parsed `command` structure.
+/// @result The option value, or `NULL` if the `name` wasn't in the `command`'s options.
+AC_API struct ac_option *ac_extract_option(struct ac_command const *const command,
+                                                          char const *const long_name) {
+    for(size_t i = 0; i < command->n_options; i++) {
+        if(0 == strncmp(command->options[i].option->long_name, long_name, MAX_STRING_LEN)) {
+            return &command->options[i];
+        }
+    }
+
+    return NULL;
+}
+
+/// @brief The maximum number of "did you mean" suggestions included in an error string.
+#define AC_MAX_SUGGESTIONS 3
+
+// The names that can be suggested at a node of the spec tree, each list ordered by length so that
+// only names within the distance threshold's length window are compared.
+struct _ac_suggestion_table {
+    size_t       n_commands;
+    char const **commands;
+    size_t       n_options;
+    char const **options;
+};
+
+// Order names by length, then alphabetically so that suggestions are listed deterministically.
+static int _ac_compare_lengths(void const *const a, void const *const b) {
+    size_t const a_len = strnlen(*(char const *const *) a, MAX_STRING_LEN);
+    size_t const b_len = strnlen(*(char const *const *) b, MAX_STRING_LEN);
+    if(a_len != b_len) {
+        return (a_len > b_len) - (a_len < b_len);
+    }
+    return strncmp(*(char const *const *) a, *(char const *const *) b, MAX_STRING_LEN);
+}
+
+// Find the memoized suggestion table for `spec`, building it on first use.
+static struct _ac_suggestion_table const *
+_ac_suggestion_table(void const *const spec, struct ac_multi_command_subcommand const *const subcommands,
+                     size_t const n_subcommands, struct ac_option_spec const *const options,
+                     size_t const n_options) {
+    uint64_t const stamp = _ac_stamp_names(subcommands, n_subcommands, options, n_options);
+    struct _ac_suggestion_table *table =
+        (struct _ac_suggestion_table *) _ac_memo_get(spec, _AC_MEMO_SUGGESTION, stamp);
+    if(table != NULL) {
+        return table;
+    }
+
+    table = (struct _ac_suggestion_table *) malloc(sizeof(*table) +
+                                                   (n_subcommands + n_options) * sizeof(char const *));
+    if(table == NULL) {
+        return NULL;
+    }
+
+    table->n_commands = n_subcommands;
+    table->commands   = (char const **) &table[1];
+    table->n_options  = n_options;
+    table->options    = &table->commands[n_subcommands];
+    for(size_t i = 0; i < n_subcommands; i++) {
+        table->commands[i] = subcommands[i].name;
+    }
+    for(size_t i = 0; i < n_options; i++) {
+        table->options[i] = options[i].long_name;
+    }
+    qsort(table->commands, table->n_commands, sizeof(char const *), _ac_compare_lengths);
+    qsort(table->options, table->n_options, sizeof(char const *), _ac_compare_lengths);
+
+    struct _ac_suggestion_table *const memoized =
+        (struct _ac_suggestion_table *) _ac_memo_put(spec, _AC_MEMO_SUGGESTION, stamp, table);
+    if(memoized != table) {
+        free(table);
+    }
+    return memoized;
+}
+
+// The Levenshtein distance between the pattern described by `peq` with length `m` (at most 64) and
+// `text`, using Myers' bit-vector algorithm with Hyyrö's modification for global distance. This
+// processes one character of `text` per step, independent of `m`.
+static size_t _ac_edit_distance(uint64_t const peq[256], size_t const m, char const *const text,
+                                size_t const n) {
+    uint64_t const last  = 1ULL << (m - 1);
+    uint64_t       pv    = ~0ULL;
+    uint64_t       mv    = 0;
+    size_t         score = m;
+
+    for(size_t j = 0; j < n; j++) {
+        uint64_t const eq = peq[(unsigned char) text[j]];
+        uint64_t const xv = eq | mv;
+        uint64_t const xh = (((eq & pv) + pv) ^ pv) | eq;
+        uint64_t       ph = mv | ~(xh | pv);
+        uint64_t       mh = pv & xh;
+        if(ph & last) {
+            score++;
+        } else if(mh & last) {
+            score--;
+        }
+        ph = (ph << 1) | 1;
+        mh <<= 1;
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+    }
+
+    return score;
+}
+
+// Fill `suggestions` with the names in the length-ordered `names` nearest to `word`, returning how
+// many were found. Only names within a small distance relative to the length of `word` are
+// suggested.
+static size_t _ac_suggest(char const *const word, char const *const *const names, size_t const n_names,
+                          char const *suggestions[AC_MAX_SUGGESTIONS]) {
+    size_t const m = strnlen(word, MAX_STRING_LEN);
+    if(m == 0 || m > 64) {
+        return 0;
+    }
+
+    uint64_t peq[256] = {0};
+    for(size_t i = 0; i < m; i++) {
+        peq[(unsigned char) word[i]] |= 1ULL << i;
+    }
+
+    size_t const threshold = m < 4 ? 1 : m < 8 ? 2 : 3;
+    size_t       best      = threshold + 1;
+    size_t       n_found   = 0;
+
+    // Names whose lengths differ from the word by more than the threshold can't be close enough.
+    size_t low = 0, high = n_names;
+    while(low < high) {
+        size_t const mid = low + (high - low) / 2;
+        if(strnlen(names[mid], MAX_STRING_LEN) + threshold < m) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    for(size_t i = low; i < n_names; i++) {
+        size_t const n = strnlen(names[i], MAX_STRING_LEN);
+        if(n > m + threshold) {
+            break;
+        }
+
+        size_t const distance = _ac_edit_distance(peq, m, names[i], n);
+        if(distance < best) {
+            best    = distance;
+            n_found = 0;
+        }
+        if(distance == best && n_found < AC_MAX_SUGGESTIONS) {
+            suggestions[n_found++] = names[i];
+        }
+    }
+
+    return n_found;
+}
+
+// Append "Did you mean ...?" to `error` for the unknown name in `result`, if any names are close.
+static void _ac_status_suggest(struct ac_status const result, char *const error) {
+    char const *word = (char const *) result.context;
+    if(word == NULL) {
+        return;
+    }
+
+    struct _ac_suggestion_table const *table = NULL;
+    if(result.single != NULL) {
+        table = _ac_suggestion_table(result.single, NULL, 0, result.single->options,
+                                     result.single->n_options);
+    } else if(result.multi != NULL) {
+        table = _ac_suggestion_table(result.multi, result.multi->subcommands,
+                                     result.multi->n_subcommands, result.multi->options,
+                                     result.multi->n_options);
+    }
+    if(table == NULL) {
+        return;
+    }
+
+    char const *suggestions[AC_MAX_SUGGESTIONS];
+    size_t      n_suggestions = 0;
+    char const *prefix        = "";
+    if(result.code == AC_ERROR_COMMAND_NAME_NOT_IN_SPEC) {
+        n_suggestions = _ac_suggest(word, table->commands, table->n_commands, suggestions);
+    } else if(0 == strncmp(word, "--", 2)) {
+        // Short options are a single character, so there's nothing meaningful to suggest. The name
+        // of `--name=value` ends at the '='.
+        char         name[MAX_STRING_LEN + 1];
+        size_t const name_len = _ac_option_name_length(word, strnlen(word, MAX_STRING_LEN));
+        memcpy(name, word, name_len);
+        name[name_len] = '\0';
+
+        prefix        = "--";
+        n_suggestions = _ac_suggest(&name[2], table->options, table->n_options, suggestions);
+    }
+    if(n_suggestions == 0) {
+        return;
+    }
+
+    size_t cursor = strnlen(error, HELP_BUFFER_SZ);
+    cursor += _ac_strcpy_safe(error, "Did you mean ", cursor, HELP_BUFFER_SZ);
+    for(size_t i = 0; i < n_suggestions; i++) {
+        if(i > 0) {
+            cursor += _ac_strcpy_safe(error, i + 1 == n_suggestions ? " or " : ", ", cursor,
+                                      HELP_BUFFER_SZ);
+        }
+        cursor += _ac_strcpy_safe(error, "'", cursor, HELP_BUFFER_SZ);
+        cursor += _ac_strcpy_safe(error, prefix, cursor, HELP_BUFFER_SZ);
+        cursor += _ac_strcpy_safe(error, suggestions[i], cursor, HELP_BUFFER_SZ);
+        cursor += _ac_strcpy_safe(error, "'", cursor, HELP_BUFFER_SZ);
+    }
+    (void) _ac_strcpy_safe(error, "?\n", cursor, HELP_BUFFER_SZ);
+}
+
+// Append the options that the ambiguous option name in `result` could refer to to `error`.
+static void _ac_status_candidates(struct ac_status const result, char *const error) {
+    char const *const word = (char const *) result.context;
+    if(word == NULL || 0 != strncmp(word, "--", 2)) {
+        return;
+    }
+
+    // The options are declared by the multi-command when it's set, otherwise by the command.
+    struct _ac_option_layer const layer = result.multi  ? _ac_option_layer_multi(result.multi)
+                                          : result.single ? _ac_option_layer_single(result.single)
+                                                          : (struct _ac_option_layer) {0};
+    if(layer.n_options == 0) {
+        return;
+    }
+
+    struct _ac_option_index const *const index = _ac_option_index(layer);
+    if(index == NULL) {
+        return;
+    }
+
+    size_t const prefix_len = _ac_option_name_length(word, strnlen(word, MAX_STRING_LEN)) - 2;
+    size_t       cursor     = strnlen(error, HELP_BUFFER_SZ);
+    cursor += _ac_strcpy_safe(error, "It could be", cursor, HELP_BUFFER_SZ);
+    for(size_t i = _ac_option_index_lower_bound(index, &word[2], prefix_len);
+        i < index->n_names && 0 == strncmp(_ac_option_index_name(index, i), &word[2], prefix_len); i++) {
+        cursor += _ac_strcpy_safe(error, " --", cursor, HELP_BUFFER_SZ);
+        cursor += _ac_strcpy_safe(error, _ac_option_index_name(index, i), cursor, HELP_BUFFER_SZ);
+    }
+    (void) _ac_strcpy_safe(error, "\n", cursor, HELP_BUFFER_SZ);
+}
+
+// Write the message for `result` into `error`, which holds `HELP_BUFFER_SZ` bytes. Returns whether
+// it's a user error, which is explained better with the help.
+static bool _ac_status_message(struct ac_status const result, char *const error) {
+    bool include_help = false;
+#define errorf(...)                                                                                \
+    snprintf(error, HELP_BUFFER_SZ, ##__VA_ARGS__);                                                \
+    break
+
+    switch(result.code) {
+        case AC_ERROR_SUCCESS:
+            errorf("Success\n");
+        case AC_ERROR_INVALID_PARAMETER:
+            errorf("Programmer error: Invalid parameter\n");
+        case AC_ERROR_MEMORY_ALLOC_FAILED:
+            errorf("System error: Memory allocation failed\n");
+        case AC_ERROR_OPTION_NAME_NOT_IN_SPEC:
+            include_help = true;
+            errorf("Option name '%s' is not valid.\n", (char *) result.context);
+        case AC_ERROR_OPTION_NAME_EXPECTED:
+            include_help = true;
+            errorf("Option value '%s' was provided where an option name was expected.",
+                   (char *) result.context);
+        case AC_ERROR_OPTION_NAME_REQUIRED_IN_SPEC:
+            include_help = true;
+            errorf("Option name '--%s' is required.\n", (char *) result.context);
+        case AC_ERROR_OPTION_VALUE_EXPECTED:
+            include_help = true;
+            errorf("Expected value for option %s\n", (char *) result.context);
+        case AC_ERROR_OPTION_TOO_MANY:
+            include_help = true;
+            errorf("Too many options provided.\n");
+        case AC_ERROR_OPTION_SPEC_NEEDS_NAME:
+            errorf("Programmer error: Option in spec has a NULL long name field.\n");
+        case AC_ERROR_OPTION_LONG_NAME_INVALID:
+            errorf("Programmer error: Option in spec has an invalid long name field.\n");
+        case AC_ERROR_OPTION_SHORT_NAME_INVALID:
+            errorf("Programmer error: Option in spec has an invalid short name field.\n");
+        case AC_ERROR_OPTION_FLAG_AND_REQUIRED:
+            errorf("Programmer error: Option in spec has both required and is_flag.\n");
+        case AC_ERROR_COMMAND_NAME_NOT_IN_SPEC:
+            include_help = true;
+            errorf("The command '%s' is not defined.\n", (char *) result.context);
+        case AC_ERROR_COMMAND_NAME_REQUIRED:
+            include_help = true;
+            errorf("Another command name is expected after %s.\n", (char *) result.context);
+        case AC_ERROR_COMMAND_NAME_INVALID:
+            include_help = true;
+            errorf("The command name %s is invalid.\n", (char *) result.context);
+        case AC_ERROR_ARGUMENT_MAX_EXCEEDED:
+            include_help = true;
+            errorf("Exceeded the maximum allowed number of arguments.\n");
+        case AC_ERROR_ARGUMENT_EXCEEDED_SPEC:
+            include_help = true;
+            errorf("Too many arguments. Got %zu which is more than expected.\n",
+                   (size_t) result.context);
+        case AC_ERROR_ARGUMENT_EXPECTED_IN_SPEC:
+            include_help = true;
+            errorf("Missing arguments.\n");
+        case AC_ERROR_ARGUMENT_SPEC_NEEDS_NAME:
+            errorf("Programmer error: Argument at index %zu needs a name.\n",
+                   (size_t) result.context);
+        case AC_ERROR_MULTICOMMAND_NEEDS_NAME:
+            errorf("Programmer error: Multi-command at index %zu needs a name.\n",
+                   (size_t) result.context);
+        case AC_ERROR_COMMAND_RESOLVE_FAILED:
+            errorf("Failed to load the command '%s'.\n", (char *) result.context);
+        case AC_ERROR_STREAM_READ_FAILED:
+            errorf("System error: Reading the argument stream failed: %s\n",
+                   strerror((int) (size_t) result.context));
+        case AC_ERROR_STREAM_ARGUMENT_TOO_LONG:
+            errorf("Argument %zu in the stream is too long.\n", (size_t) result.context);
+        case AC_ERROR_BUFFER_TOO_SMALL:
+            errorf("Programmer error: Buffer too small, %zu bytes are required.\n",
+                   (size_t) result.context);
+        case AC_ERROR_BLOB_INVALID:
+            errorf("Programmer error: Serialized command is invalid.\n");
+        case AC_ERROR_BLOB_FINGERPRINT_MISMATCH:
+            errorf("Programmer error: Serialized command was produced by a different spec.\n");
+        case AC_ERROR_FILE_OPEN_FAILED:
+            errorf("System error: Failed to open '%s'.\n", (char *) result.context);
+        case AC_ERROR_OPTION_NAME_AMBIGUOUS:
+            include_help = true;
+            errorf("Option name '%s' is ambiguous.\n", (char *) result.context);
+        case AC_ERROR_CONSTRAINT_INVALID:
+            errorf("Programmer error: Constraint at index %zu is invalid.\n", (size_t) result.context);
+        case AC_ERROR_CONSTRAINT_REQUIRES:
+            include_help = true;
+            errorf("Option '--%s' requires '--%s'.\n", result.option->long_name,
+                   (char *) result.context);
+        case AC_ERROR_CONSTRAINT_CONFLICTS:
+            include_help = true;
+            errorf("Option '--%s' can't be used with '--%s'.\n", result.option->long_name,
+                   (char *) result.context);
+        case AC_ERROR_CONSTRAINT_ONE_OF_MISSING:
+            include_help = true;
+            errorf("Exactly one of these options is required:");
+        case AC_ERROR_CONSTRAINT_ONE_OF_MULTIPLE:
+            include_help = true;
+            errorf("Only one of '--%s' and '--%s' may be used.\n", result.option->long_name,
+                   (char *) result.context);
+        case AC_ERROR_OPTION_LONG_NAME_DUPLICATE:
+            errorf("Programmer error: Option in spec has a duplicate long name '--%s'.\n",
+                   result.option->long_name);
+        case AC_ERROR_OPTION_SHORT_NAME_DUPLICATE:
+            errorf("Programmer error: Option in spec has a duplicate short name '-%c'.\n",
+                   result.option->short_name);
+        case AC_ERROR_COMMAND_NAME_DUPLICATE:
+            errorf("Programmer error: Multi-command has a duplicate subcommand '%s'.\n",
+                   (char *) result.context);
+        case AC_ERROR_OPTION_VALUE_INVALID:
+            include_help = true;
+            if(result.option != NULL) {
+                errorf("Value '%s' is not valid for option '--%s'.\n", (char *) result.context,
+                       result.option->long_name);
+            }
+            errorf("Value '%s' is not a valid argument.\n", (char *) result.context);
+        case AC_ERROR_UTF8_INVALID:
+            errorf("Input is not valid UTF-8: '%s'\n", (char *) result.context);
+        case AC_ERROR_OPTION_VALUE_UNEXPECTED:
+            include_help = true;
+            errorf("Option '%s' is a flag, so it doesn't take a value.\n", (char *) result.context);
+        case AC_ERROR_OPTION_CHOICES_INVALID:
+            errorf("Programmer error: Option '--%s' has an invalid choice at index %zu.\n",
+                   result.option->long_name, (size_t) result.context);
+        case AC_ERROR_OPTION_VALUE_NOT_IN_CHOICES:
+            include_help = true;
+            errorf("Value '%s' is not valid for option '--%s'. It must be one of:",
+                   (char *) result.context, result.option->long_name);
+        case AC_ERROR_CONFIG_INVALID:
+            include_help = true;
+            errorf("Config file '%s' has an invalid entry '%s'.\n", result.single->config,
+                   (char *) result.context);
+        case AC_ERROR_OPTION_DEFAULT_INVALID:
+            errorf("Programmer error: Option '--%s' can't take its default value '%s'.\n",
+                   result.option->long_name, (char *) result.context);
+        case AC_ERROR_IMAGE_UNSUPPORTED:
+            errorf("Programmer error: Spec images don't support '%s'.\n", (char *) result.context);
+    }
+#undef errorf
+
+    size_t const epoch = _ac_memo_enter();
+    if(result.code == AC_ERROR_OPTION_NAME_NOT_IN_SPEC ||
+       result.code == AC_ERROR_COMMAND_NAME_NOT_IN_SPEC) {
+        _ac_status_suggest(result, error);
+    }
+    if(result.code == AC_ERROR_OPTION_NAME_AMBIGUOUS) {
+        _ac_status_candidates(result, error);
+    }
+    _ac_memo_leave(epoch);
+    if(result.code == AC_ERROR_OPTION_VALUE_NOT_IN_CHOICES) {
+        size_t cursor = strnlen(error, HELP_BUFFER_SZ);
+        for(size_t i = 0; i < result.option->n_choices; i++) {
+            cursor += _ac_strcpy_safe(error, " ", cursor, HELP_BUFFER_SZ);
+            cursor += _ac_strcpy_safe(error, result.option->choices[i], cursor, HELP_BUFFER_SZ);
+        }
+        (void) _ac_strcpy_safe(error, "\n", cursor, HELP_BUFFER_SZ);
+    }
+    if(result.code == AC_ERROR_CONSTRAINT_ONE_OF_MISSING) {
+        struct ac_constraint_spec const *const constraint =
+            (struct ac_constraint_spec const *) result.context;
+        size_t cursor = strnlen(error, HELP_BUFFER_SZ);
+        for(size_t i = 0; i < constraint->n_options; i++) {
+            cursor += _ac_strcpy_safe(error, " --", cursor, HELP_BUFFER_SZ);
+            cursor += _ac_strcpy_safe(error, constraint->options[i], cursor, HELP_BUFFER_SZ);
+        }
+        (void) _ac_strcpy_safe(error, "\n", cursor, HELP_BUFFER_SZ);
+    }
+
+    return include_help;
+}
+
+// The messages for all of `diagnostics`, each on its own line, or NULL when memory allocation
+// fails. Sets `include_help` when any of them is a user error.
+static char *_ac_diagnostics_messages(struct ac_diagnostics const *const diagnostics,
+                                      bool *const                        include_help) {
+    char   message[HELP_BUFFER_SZ];
+    char  *messages = NULL;
+    size_t length   = 0;
+    for(size_t i = 0; i < diagnostics->n_diagnostics; i++) {
+        struct ac_diagnostic const *const diagnostic = &diagnostics->diagnostics[i];
+        struct ac_status const            status     = {.code    = diagnostic->code,
+                                                        .single  = diagnostics->single,
+                                                        .multi   = diagnostic->multi,
+                                                        .option  = diagnostic->option,
+                                                        .context = diagnostic->context};
+        *include_help |= _ac_status_message(status, message);
+
+        size_t const message_len = strnlen(message, HELP_BUFFER_SZ);
+        char *const  grown       = (char *) realloc(messages, length + message_len + 2);
+        if(grown == NULL) {
+            free(messages);
+            return NULL;
+        }
+        messages = grown;
+        memcpy(&messages[length], message, message_len);
+        length += message_len;
+        if(message_len == 0 || message[message_len - 1] != '\n') {
+            messages[length++] = '\n';
+        }
+        messages[length] = '\0';
+    }
+
+    return messages;
+}
+
+/// @brief Generates a helpful error string when `results.code` != `AC_ERROR_SUCCESS`.
+/// @remark This function should always be used after `ac_command_parse` if an error occurs.
+/// @par When @p result comes from a collect-all parse, every error it found is listed, followed by
+/// the help once.
+/// @return An error string owned by the caller.
+AC_API char *ac_status_string(struct ac_status result) {
+    if(result.code == AC_ERROR_SUCCESS) {
+        return NULL;
+    }
+
+    bool  include_help = false;
+    char *error        = result.diagnostics != NULL
+                             ? _ac_diagnostics_messages(result.diagnostics, &include_help)
+                             : (char *) malloc(HELP_BUFFER_SZ);
+    if(error == NULL) {
+        return NULL;
+    }
+    if(result.diagnostics == NULL) {
+        include_help = _ac_status_message(result, error);
+    }
+
+    if(!include_help) {
+        return error;
+    }
+
+    // There's no spec to generate help from, for example when parsing against a spec image.
+    if(result.single == NULL && result.multi == NULL) {
+        return error;
+    }
+
+    char *help =
+        result.single ? ac_command_help(result.single, NULL) : ac_multi_command_help(result.multi, NULL);
+    if(help == NULL) {
+        free(error);
+        return NULL;
+    }
+
+    // The list of diagnostics isn't bounded by the help buffer, so the help is grown to fit it.
+    if(result.diagnostics != NULL) {
+        size_t const help_len  = strnlen(help, HELP_BUFFER_SZ);
+        size_t const error_len = strlen(error);
+        char *const  merged    = (char *) realloc(help, help_len + error_len + 2);
+        if(merged == NULL) {
+            free(help);
+            free(error);
+            return NULL;
+        }
+        merged[help_len] = '\n';
+        memcpy(&merged[help_len + 1], error, error_len + 1);
+        free(error);
+        return merged;
+    }
+
+    size_t cursor = strnlen(help, HELP_BUFFER_SZ);
+    cursor += _ac_strcpy_safe(help, "\n", cursor, HELP_BUFFER_SZ);
+    (void) _ac_strcpy_safe(help, error, cursor, HELP_BUFFER_SZ);
+    free(error);
+
+    return help;
+}
+
+/// @brief Once the caller is done with the `ac_command` structure, it's underlying resources should
+/// be released using this function.
+AC_API void ac_command_release(struct ac_command *command) {
+    if(command == NULL) {
+        return;
+    }
+
+    if(command->arguments != NULL) {
+        free(command->arguments);
+    }
+
+    if(command->options != NULL) {
+        free(command->options);
+    }
+
+    if(command->parents != NULL) {
+        free(command->parents);
+    }
+
+    _ac_config_release(command->config);
+}
+
+/// @brief Compute a fingerprint of the structure of @p command .
+/// @par Two command specs have the same fingerprint when every field that affects parsing is the
+/// same, including the choices, defaults and environment variables of options, constraints and the
+/// config path. The @c context value and the addresses of strings are ignored since they aren't
+/// meaningful across processes.
+/// @result The fingerprint, or 0 if @p command is @c NULL.
+AC_API uint64_t ac_command_spec_fingerprint(struct ac_command_spec const *const command) {
+    return command != NULL ? _ac_stamp_command(0xcbf29ce484222325ULL, command, false) : 0;
+}
+
+// The fingerprint of the option layers that `parents` pass down to a command, from the root, which
+// blobs record because the indices of inherited options refer to them.
+static uint64_t _ac_inherited_fingerprint(uint64_t hash, struct ac_multi_command_spec const *const parent) {
+    char const flags[] = {(char) parent->allow_abbreviations, (char) parent->utf8};
+    hash = _ac_fnv1a(hash, flags, sizeof(flags));
+    return _ac_stamp_options(hash, parent->options, parent->n_options, false);
+}
+
+/// @brief The fingerprint of a parse result, for keying caches on a tool's effective options.
+/// @par It's a 64-bit hash of the command path, the arguments in order, and the effective value of
+/// each option, including those filled from the environment, a config file or defaults. The
+/// effective value is the first occurrence of an option, which is what @c ac_extract_option
+/// returns, so `--a 1 --b 2` and `--b 2 --a 1` have the same fingerprint while `--a 1 --a 2` and
+/// `--a 2 --a 1` don't. A flag contributes how many times it was given, so `-vv` and `-v -v` have
+/// the same fingerprint and `-v` doesn't. Options are identified by their position in the spec rather than their
+/// address, so fingerprints are stable across processes for the same spec, and combining it with
+/// @c ac_command_spec_fingerprint tells specs apart.
+/// @par It's summed over the effective options at the end of parsing, so this only reads it.
+/// @result The fingerprint, or 0 if @p args is @c NULL.
+AC_API uint64_t ac_command_fingerprint(struct ac_command const *const args) {
+    return args != NULL ? args->fingerprint : 0;
+}
+
+// The index of `option` among the options that are visible to the command in `args`.
+static uint32_t _ac_option_layered_index(struct ac_command const *const     args,
+                                         struct ac_option_spec const *const option) {
+    struct ac_command_spec const *const command = args->command;
+    if(option >= command->options && option < &command->options[command->n_options]) {
+        return (uint32_t) (option - command->options);
+    }
+
+    size_t offset = command->n_options;
+    for(size_t i = args->n_parents; i > 0; i--) {
+        struct ac_multi_command_spec const *const parent = args->parents[i - 1];
+        if(option >= parent->options && option < &parent->options[parent->n_options]) {
+            return (uint32_t) (offset + (size_t) (option - parent->options));
+        }
+        offset += parent->n_options;
+    }
+
+    return AC_BLOB_NO_VALUE;
+}
+
+/// @brief Serialize the parsed @p args into @p buffer so it can be handed to another process.
+/// @par The blob references option specs by index and contains copies of every value, so it doesn't
+/// depend on the address of @p args , its values, or the command spec.
+/// @param args A structure populated by a successful call to @c ac_command_parse.
+/// @param buffer [optional] The output buffer. May be @c NULL to query the required size.
+/// @param buffer_sz The size of @p buffer in bytes.
+/// @param written An output value set to the size of the blob in bytes. This is set even when the
+/// buffer is too small.
+/// @result @c AC_ERROR_SUCCESS when the blob was written, or @c AC_ERROR_BUFFER_TOO_SMALL when
+/// @p buffer isn't large enough.
+AC_API struct ac_status ac_command_serialize(struct ac_command const *const args,
+                                                            void *const buffer,
+                                                            size_t const buffer_sz,
+                                                            size_t *const written) {
+    if(args == NULL || args->command == NULL || written == NULL) {
+        return (struct ac_status) {.code = AC_ERROR_INVALID_PARAMETER};
+    }
+
+    // A flag that was repeated in a cluster is written as one record per repetition, so the blob
+    // means the same as `-v -v -v`.
+    size_t n_records = 0;
+    for(size_t i = 0; i < args->n_options; i++) {
+        n_records += args->options[i].count > 1 ? args->options[i].count : 1;
+    }
+
+    size_t const arguments = sizeof(struct ac_blob_header) + args->n_parents * sizeof(uint32_t);
+    size_t const tables    = arguments + args->n_arguments * sizeof(uint32_t) +
+                          n_records * sizeof(struct ac_blob_option);
+    size_t size = tables;
+    for(size_t i = 0; i < args->n_arguments; i++) {
+        size += strnlen(args->arguments[i].value, MAX_STRING_LEN) + 1;
+    }
+    for(size_t i = 0; i < args->n_options; i++) {
+        if(args->options[i].value != NULL) {
+            size += strnlen(args->options[i].value, MAX_STRING_LEN) + 1;
+        }
+    }
+    // A blob always ends with a NUL byte so that strings can't run off the end of it.
+    size += 1;
+
+    *written = size;
+    if(buffer == NULL || buffer_sz < size) {
+        return (struct ac_status) {.code    = AC_ERROR_BUFFER_TOO_SMALL,
+                                   .single  = args->command,
+                                   .context = (void *) size};
+    }
+    if(size >= AC_BLOB_NO_VALUE) {
+        return (struct ac_status) {.code = AC_ERROR_INVALID_PARAMETER, .single = args->command};
+    }
+
+    unsigned char *const blob   = (unsigned char *) buffer;
+    size_t               cursor = tables;
+
+    // Record the path through the tree as subcommand indices, so the receiver can find the command
+    // without searching.
+    for(size_t i = 0; i < args->n_parents; i++) {
+        struct ac_multi_command_spec const *const parent = args->parents[i];
+        void const *const next = i + 1 < args->n_parents ? (void const *) args->parents[i + 1]
+                                                         : (void const *) args->command;
+        size_t const epoch = _ac_memo_enter();
+        uint32_t     index = 0;
+        while(index < parent->n_subcommands &&
+              (_ac_subcommand_resolved(&parent->subcommands[index]) == NULL ||
+               (void const *) _ac_subcommand_resolved(&parent->subcommands[index])->single != next)) {
+            index++;
+        }
+        _ac_memo_leave(epoch);
+        if(index == parent->n_subcommands) {
+            return (struct ac_status) {.code = AC_ERROR_INVALID_PARAMETER, .single = args->command};
+        }
+
+        memcpy(&blob[sizeof(struct ac_blob_header) + i * sizeof(index)], &index, sizeof(index));
+    }
+
+    for(size_t i = 0; i < args->n_arguments; i++) {
+        uint32_t const offset = (uint32_t) cursor;
+        size_t const   len    = strnlen(args->arguments[i].value, MAX_STRING_LEN);
+        memcpy(&blob[cursor], args->arguments[i].value, len);
+        blob[cursor + len] = '\0';
+        cursor += len + 1;
+
+        memcpy(&blob[arguments + i * sizeof(uint32_t)], &offset, sizeof(offset));
+    }
+
+    size_t record = 0;
+    for(size_t i = 0; i < args->n_options; i++) {
+        struct ac_blob_option option = {
+            .index = _ac_option_layered_index(args, args->options[i].option),
+            .value = AC_BLOB_NO_VALUE,
+        };
+        if(option.index == AC_BLOB_NO_VALUE) {
+            return (struct ac_status) {.code = AC_ERROR_INVALID_PARAMETER, .single = args->command};
+        }
+
+        if(args->options[i].value != NULL) {
+            size_t const len = strnlen(args->options[i].value, MAX_STRING_LEN);
+            option.value     = (uint32_t) cursor;
+            memcpy(&blob[cursor], args->options[i].value, len);
+            blob[cursor + len] = '\0';
+            cursor += len + 1;
+        }
+
+        for(size_t j = 0; j < (args->options[i].count > 1 ? args->options[i].count : 1); j++) {
+            memcpy(&blob[arguments + args->n_arguments * sizeof(uint32_t) + record++ * sizeof(option)],
+                   &option, sizeof(option));
+        }
+    }
+    blob[cursor++] = '\0';
+    assert(cursor == size);
+
+    uint64_t inherited = 0xcbf29ce484222325ULL;
+    for(size_t i = 0; i < args->n_parents; i++) {
+        inherited = _ac_inherited_fingerprint(inherited, args->parents[i]);
+    }
+
+    struct ac_blob_header const header = {
+        .magic       = AC_BLOB_MAGIC,
+        .version     = AC_BLOB_VERSION,
+        .fingerprint = ac_command_spec_fingerprint(args->command),
+        .inherited   = inherited,
+        .size        = (uint32_t) size,
+        .n_arguments = (uint32_t) args->n_arguments,
+        .n_options   = (uint32_t) n_records,
+        .strings     = (uint32_t) tables,
+        .n_parents   = (uint32_t) args->n_parents,
+    };
+    memcpy(blob, &header, sizeof(header));
+
+    return (struct ac_status) {.code = AC_ERROR_SUCCESS, .single = args->command};
+}
+
+/// @brief Create a zero-copy view over a blob produced by @c ac_command_serialize.
+/// @par This only inspects the blob header, so it runs in constant time regardless of the size of
+/// the blob. Individual values are bounds checked when they're accessed.
+/// @param blob The blob, for example in shared memory or read from a pipe. Must outlive @p view .
+/// @param blob_sz The number of bytes available at @p blob .
+/// @param command The command spec that the blob is expected to have been produced by.
+/// @param view An output structure that is populated when the return code is @c AC_ERROR_SUCCESS.
+/// @result @c AC_ERROR_SUCCESS when @p view can be used to access the blob.
+AC_API struct ac_status
+ac_command_view_from_blob(void const *const blob, size_t const blob_sz,
+                          struct ac_command_spec const *const command,
+                          struct ac_command_view *const       view) {
+    if(blob == NULL || command == NULL || view == NULL) {
+        return (struct ac_status) {.code = AC_ERROR_INVALID_PARAMETER, .single = command};
+    }
+
+    struct ac_blob_header header;
+    if(blob_sz < sizeof(header)) {
+        return (struct ac_status) {.code = AC_ERROR_BLOB_INVALID, .single = command};
+    }
+    memcpy(&header, blob, sizeof(header));
+
+    unsigned char const *const bytes  = (unsigned char const *) blob;
+    size_t const               tables = sizeof(header) + header.n_parents * sizeof(uint32_t) +
+                          header.n_arguments * sizeof(uint32_t) +
+                          header.n_options * sizeof(struct ac_blob_option);
+    if(header.magic != AC_BLOB_MAGIC || header.version != AC_BLOB_VERSION ||
+       header.size > blob_sz || header.strings != tables || tables >= header.size ||
+       bytes[header.size - 1] != '\0') {
+        return (struct ac_status) {.code = AC_ERROR_BLOB_INVALID, .single = command};
+    }
+
+    if(header.fingerprint != ac_command_spec_fingerprint(command) ||
+       header.n_arguments != command->n_arguments) {
+        return (struct ac_status) {.code    = AC_ERROR_BLOB_FINGERPRINT_MISMATCH,
+                                   .single  = command,
+                                   .context = (void *) (uintptr_t) header.fingerprint};
+    }
+
+    view->command     = command;
+    view->root        = NULL;
+    view->blob        = bytes;
+    view->n_arguments = header.n_arguments;
+    view->n_options   = header.n_options;
+
+    return (struct ac_status) {.code = AC_ERROR_SUCCESS, .single = command};
+}
+
+/// @brief Create a zero-copy view over a blob produced by @c ac_command_serialize from a command
+/// parsed by @c ac_multi_command_parse.
+/// @par The command spec is found by following the path recorded in the blob from @p root , so this
+/// is linear in the depth of the tree. Lazy subcommands on the path are resolved.
+/// @result @c AC_ERROR_SUCCESS when @p view can be used to access the blob.
+AC_API struct ac_status
+ac_multi_command_view_from_blob(void const *const blob, size_t const blob_sz,
+                                struct ac_multi_command_spec const *const root,
+                                struct ac_command_view *const             view) {
+    if(blob == NULL || root == NULL || view == NULL) {
+        return (struct ac_status) {.code = AC_ERROR_INVALID_PARAMETER, .multi = root};
+    }
+
+    struct ac_blob_header header;
+    if(blob_sz < sizeof(header)) {
+        return (struct ac_status) {.code = AC_ERROR_BLOB_INVALID, .multi = root};
+    }
+    memcpy(&header, blob, sizeof(header));
+    if(header.n_parents == 0 || header.n_parents > MAX_NUM_ARGS ||
+       (blob_sz - sizeof(header)) / sizeof(uint32_t) < header.n_parents) {
+        return (struct ac_status) {.code = AC_ERROR_BLOB_INVALID, .multi = root};
+    }
+
+    struct ac_multi_command_spec const *node      = root;
+    uint64_t                            inherited = 0xcbf29ce484222325ULL;
+    for(size_t i = 0; i < header.n_parents; i++) {
+        inherited = _ac_inherited_fingerprint(inherited, node);
+        uint32_t index;
+        memcpy(&index, &((unsigned char const *) blob)[sizeof(header) + i * sizeof(index)],
+               sizeof(index));
+        // The resolution is copied, since it's memoized and only valid in the read section.
+        struct ac_multi_command_subcommand              subcommand = {0};
+        size_t const                                    epoch      = _ac_memo_enter();
+        struct ac_multi_command_subcommand const *const resolved =
+            index < node->n_subcommands ? _ac_subcommand_resolve(&node->subcommands[index]) : NULL;
+        if(resolved != NULL) {
+            subcommand = *resolved;
+        }
+        _ac_memo_leave(epoch);
+        if(resolved == NULL) {
+            return (struct ac_status) {.code = AC_ERROR_BLOB_FINGERPRINT_MISMATCH, .multi = node};
+        }
+
+        bool const last = i + 1 == header.n_parents;
+        if(last != (subcommand.type == COMMAND_SINGLE)) {
+            return (struct ac_status) {.code = AC_ERROR_BLOB_FINGERPRINT_MISMATCH, .multi = node};
+        }
+
+        if(last) {
+            // Inherited options are looked up by index in the layers of this tree, so they have to
+            // be the same layers that the blob was serialized with.
+            if(header.inherited != inherited) {
+                return (struct ac_status) {.code    = AC_ERROR_BLOB_FINGERPRINT_MISMATCH,
+                                           .multi   = root,
+                                           .context = (void *) (uintptr_t) header.fingerprint};
+            }
+            struct ac_status const result =
+                ac_command_view_from_blob(blob, blob_sz, subcommand.single, view);
+            if(ac_status_is_success(result)) {
+                view->root = root;
+            }
+            return result;
+        }
+        node = subcommand.multi;
+    }
+
+    return (struct ac_status) {.code = AC_ERROR_BLOB_INVALID, .multi = root};
+}
+
+/// @brief Access an argument in a command view.
+/// @result The argument value, or @c NULL if @p index is out of range.
+AC_API char const *ac_command_view_argument(struct ac_command_view const *const view,
+                                                           size_t const index) {
+    if(view == NULL || index >= view->n_arguments) {
+        return NULL;
+    }
+
+    struct ac_blob_header header;
+    memcpy(&header, view->blob, sizeof(header));
+
+    uint32_t offset;
+    memcpy(&offset,
+           &view->blob[sizeof(header) + (header.n_parents + index) * sizeof(offset)],
+           sizeof(offset));
+    if(offset < header.strings || offset >= header.size) {
+        return NULL;
+    }
+
+    return (char const *) &view->blob[offset];
+}
+
+/// @brief Access an option in a command view.
+/// @param view The view to access.
+/// @param index The index of the option, in the order they were parsed.
+/// @note Options inherited from a multi-command can only be resolved when the view was created by
+/// @c ac_multi_command_view_from_blob.
+/// @param value [optional] An output pointer to the option value, or @c NULL for flags.
+/// @result The option spec, or @c NULL if @p index is out of range or the blob is corrupt.
+AC_API struct ac_option_spec const *
+ac_command_view_option(struct ac_command_view const *const view, size_t const index,
+                       char const **const value) {
+    if(view == NULL || index >= view->n_options) {
+        return NULL;
+    }
+
+    struct ac_blob_header header;
+    memcpy(&header, view->blob, sizeof(header));
+
+    struct ac_blob_option option;
+    memcpy(&option,
+           &view->blob[sizeof(header) + (header.n_parents + header.n_arguments) * sizeof(uint32_t) +
+                       index * sizeof(option)],
+           sizeof(option));
+
+    if(value != NULL) {
+        bool const in_bounds = option.value >= header.strings && option.value < header.size;
+        *value = in_bounds ? (char const *) &view->blob[option.value] : NULL;
+    }
+
+    if(option.index < view->command->n_options) {
+        return &view->command->options[option.index];
+    }
+    if(view->root == NULL) {
+        return NULL;
+    }
+
+    // Inherited options are resolved by following the path from the root again.
+    struct ac_multi_command_spec const *parents[MAX_NUM_ARGS];
+    struct ac_multi_command_spec const *node  = view->root;
+    size_t const                        epoch = _ac_memo_enter();
+    for(size_t i = 0; i < header.n_parents; i++) {
+        uint32_t path;
+        memcpy(&path, &view->blob[sizeof(header) + i * sizeof(path)], sizeof(path));
+        parents[i] = node;
+        // The view was created from this path, so every subcommand on it has been resolved.
+        node = i + 1 < header.n_parents ? _ac_subcommand_resolved(&node->subcommands[path])->multi : NULL;
+    }
+    _ac_memo_leave(epoch);
+
+    size_t offset = view->command->n_options;
+    for(size_t i = header.n_parents; i > 0; i--) {
+        if(option.index < offset + parents[i - 1]->n_options) {
+            return &parents[i - 1]->options[option.index - offset];
+        }
+        offset += parents[i - 1]->n_options;
+    }
+
+    return NULL;
+}
+
+// The image being written. When `failed` is set, `status` says why, unless memory ran out.
+struct _ac_image_writer {
+    unsigned char   *data;
+    size_t           size;
+    size_t           capacity;
+    bool             failed;
+    struct ac_status status;
+};
+
+// Fail with AC_ERROR_IMAGE_UNSUPPORTED when the spec sets `field`, which `set` tells.
+static void _ac_image_unsupported(struct _ac_image_writer *const writer, bool const set,
+                                  struct ac_command_spec const *const       single,
+                                  struct ac_multi_command_spec const *const multi,
+                                  char const *const                         field) {
+    if(!set || writer->failed) {
+        return;
+    }
+    writer->failed = true;
+    writer->status = (struct ac_status) {
+        .code = AC_ERROR_IMAGE_UNSUPPORTED, .single = single, .multi = multi, .context = (void *) field};
+}
+
+static uint32_t _ac_image_reserve(struct _ac_image_writer *const writer, size_t const size,
+                                  size_t const align) {
+    size_t const offset = (writer->size + align - 1) & ~(align - 1);
+    if(writer->failed || offset + size >= UINT32_MAX) {
+        writer->failed = true;
+        return 0;
+    }
+
+    if(offset + size > writer->capacity) {
+        size_t capacity = writer->capacity ? writer->capacity : 0x1000;
+        while(capacity < offset + size) {
+            capacity *= 2;
+        }
+        unsigned char *const data = (unsigned char *) realloc(writer->data, capacity);
+        if(data == NULL) {
+            writer->failed = true;
+            return 0;
+        }
+        writer->data     = data;
+        writer->capacity = capacity;
+    }
+
+    memset(&writer->data[writer->size], 0, offset + size - writer->size);
+    writer->size = offset + size;
+    return (uint32_t) offset;
+}
+
+static uint32_t _ac_image_string(struct _ac_image_writer *const writer, char const *const string) {
+    if(string == NULL) {
+        return 0;
+    }
+
+    size_t const   len    = strnlen(string, MAX_STRING_LEN);
+    uint32_t const offset = _ac_image_reserve(writer, len + 1, 1);
+    if(!writer->failed) {
+        memcpy(&writer->data[offset], string, len);
+    }
+    return offset;
+}
+
+static uint64_t _ac_image_hash(char const *const name, size_t const length) {
+    return _ac_fnv1a(0xcbf29ce484222325ULL, name, length);
+}
+
+static int _ac_image_compare_entries(void const *const a, void const *const b) {
+    struct ac_multi_command_subcommand const *const *const lhs =
+        (struct ac_multi_command_subcommand const *const *) a;
+    struct ac_multi_command_subcommand const *const *const rhs =
+        (struct ac_multi_command_subcommand const *const *) b;
+    return strncmp((*lhs)->name, (*rhs)->name, MAX_STRING_LEN);
+}
+
+// Emit the option records and lookup tables of a node.
+static void _ac_image_emit_options(struct _ac_image_writer *const     writer,
+                                   struct ac_image_node *const        node,
+                                   struct ac_option_spec const *const options,
+                                   size_t const                       n_options) {
+    // The short name table holds 16-bit indices.
+    if(n_options > MAX_NUM_SPEC_OPTIONS) {
+        writer->failed = true;
+        return;
+    }
+    node->n_options = (uint32_t) n_options;
+    node->n_slots   = 1;
+    while(node->n_slots < 2 * n_options) {
+        node->n_slots *= 2;
+    }
+    node->options = _ac_image_reserve(writer, n_options * sizeof(struct ac_image_option), 4);
+    node->slots   = _ac_image_reserve(writer, node->n_slots * sizeof(uint32_t), 4);
+    node->shorts  = _ac_image_reserve(writer, 128 * sizeof(uint16_t), 2);
+    for(size_t i = 0; i < n_options && !writer->failed; i++) {
+        struct ac_option_spec const *const spec   = &options[i];
+        struct ac_image_option const       option = {
+                  .long_name     = _ac_image_string(writer, spec->long_name),
+                  .help          = _ac_image_string(writer, spec->help),
+                  .default_value = _ac_image_string(writer, spec->default_value),
+                  .env           = _ac_image_string(writer, spec->env),
+                  .n_choices     = (uint32_t) spec->n_choices,
+                  .choices       = _ac_image_reserve(writer, spec->n_choices * sizeof(uint32_t), 4),
+                  .short_name    = spec->has_short_name ? spec->short_name : 0,
+                  .is_flag       = spec->is_flag,
+                  .required      = spec->required,
+        };
+        for(size_t j = 0; j < spec->n_choices && !writer->failed; j++) {
+            uint32_t const choice = _ac_image_string(writer, spec->choices[j]);
+            if(!writer->failed) {
+                memcpy(&writer->data[option.choices + j * sizeof(choice)], &choice, sizeof(choice));
+            }
+        }
+        if(writer->failed) {
+            break;
+        }
+        memcpy(&writer->data[node->options + i * sizeof(option)], &option, sizeof(option));
+
+        uint32_t *const slots = (uint32_t *) &writer->data[node->slots];
+        size_t          probe =
+            _ac_image_hash(spec->long_name, strnlen(spec->long_name, MAX_STRING_LEN));
+        while(slots[probe & (node->n_slots - 1)] != 0) {
+            probe++;
+        }
+        slots[probe & (node->n_slots - 1)] = (uint32_t) i + 1;
+
+        if(spec->has_short_name && (unsigned char) spec->short_name < 128) {
+            ((uint16_t *) &writer->data[node->shorts])[(unsigned char) spec->short_name] =
+                (uint16_t) (i + 1);
+        }
+    }
+}
+
+static uint32_t _ac_image_emit_single(struct _ac_image_writer *const     writer,
+                                      struct _ac_image_writer *const     nodes,
+                                      struct ac_command_spec const *const command) {
+    uint32_t const index = (uint32_t) (nodes->size / sizeof(struct ac_image_node));
+    (void) _ac_image_reserve(nodes, sizeof(struct ac_image_node), 8);
+
+    // Abbreviations, constraints, config files and UTF-8 names aren't in the format, so specs that
+    // use them can't be parsed from an image in the same way.
+    _ac_image_unsupported(writer, command->allow_abbreviations, command, NULL, "allow_abbreviations");
+    _ac_image_unsupported(writer, command->n_constraints > 0, command, NULL, "constraints");
+    _ac_image_unsupported(writer, command->config != NULL, command, NULL, "config");
+    _ac_image_unsupported(writer, command->utf8, command, NULL, "utf8");
+
+    struct ac_image_node node = {
+        .type        = COMMAND_SINGLE,
+        .help        = _ac_image_string(writer, command->help),
+        .context     = (uint64_t) (uintptr_t) command->context,
+        .n_arguments = (uint32_t) command->n_arguments,
+    };
+
+    node.arguments = _ac_image_reserve(writer, command->n_arguments * sizeof(struct ac_image_argument), 4);
+    for(size_t i = 0; i < command->n_arguments; i++) {
+        struct ac_image_argument const argument = {
+            .name = _ac_image_string(writer, command->arguments[i].name),
+            .help = _ac_image_string(writer, command->arguments[i].help),
+        };
+        if(!writer->failed) {
+            memcpy(&writer->data[node.arguments + i * sizeof(argument)], &argument, sizeof(argument));
+        }
+    }
+
+    _ac_image_emit_options(writer, &node, command->options, command->n_options);
+
+    if(!nodes->failed) {
+        memcpy(&nodes->data[index * sizeof(node)], &node, sizeof(node));
+    }
+    return index;
+}
+
+static uint32_t _ac_image_emit_multi(struct _ac_image_writer *const           writer,
+                                     struct _ac_image_writer *const           nodes,
+                                     struct ac_multi_command_spec const *const command) {
+    uint32_t const index = (uint32_t) (nodes->size / sizeof(struct ac_image_node));
+    (void) _ac_image_reserve(nodes, sizeof(struct ac_image_node), 8);
+
+    _ac_image_unsupported(writer, command->allow_abbreviations, NULL, command, "allow_abbreviations");
+    _ac_image_unsupported(writer, command->utf8, NULL, command, "utf8");
+
+    struct ac_image_node node = {
+        .type      = COMMAND_MULTI,
+        .help      = _ac_image_string(writer, command->help),
+        .n_entries = (uint32_t) command->n_subcommands,
+    };
+    _ac_image_emit_options(writer, &node, command->options, command->n_options);
+
+    // Entries are sorted by name so that they can be binary searched when parsing.
+    struct ac_multi_command_subcommand const **const sorted =
+        (struct ac_multi_command_subcommand const **) calloc(command->n_subcommands + 1,
+                                                              sizeof(*sorted));
+    if(sorted == NULL) {
+        writer->failed = true;
+        return 0;
+    }
+    for(size_t i = 0; i < command->n_subcommands; i++) {
+        // The image contains the whole tree, so every lazy subcommand has to be resolved.
+        sorted[i] = _ac_subcommand_resolve(&command->subcommands[i]);
+        if(sorted[i] == NULL) {
+            free(sorted);
+            writer->failed = true;
+            return 0;
+        }
+    }
+    qsort(sorted, command->n_subcommands, sizeof(*sorted), _ac_image_compare_entries);
+
+    node.entries = _ac_image_reserve(writer, command->n_subcommands * sizeof(struct ac_image_entry), 4);
+    for(size_t i = 0; i < command->n_subcommands && !writer->failed; i++) {
+        struct ac_image_entry entry = {.name = _ac_image_string(writer, sorted[i]->name)};
+        switch(sorted[i]->type) {
+            case COMMAND_SINGLE: {
+                entry.node = _ac_image_emit_single(writer, nodes, sorted[i]->single);
+                break;
+            }
+            case COMMAND_MULTI: {
+                entry.node = _ac_image_emit_multi(writer, nodes, sorted[i]->multi);
+                break;
+            }
+            case COMMAND_LAZY: {
+                assert(false);
+            }
+        }
+        if(!writer->failed) {
+            memcpy(&writer->data[node.entries + i * sizeof(entry)], &entry, sizeof(entry));
+        }
+    }
+    free(sorted);
+
+    if(!nodes->failed) {
+        memcpy(&nodes->data[index * sizeof(node)], &node, sizeof(node));
+    }
+    return index;
+}
+
+/// @brief Compile the @p root multi-command specification into a flat spec image.
+/// @par The image contains the string table, sorted subcommand dispatch tables and option hash
+/// tables for the whole tree. It can be written to a file at build time and loaded by
+/// @c ac_spec_image_map at startup, which avoids building the spec structures in the program.
+/// @par Options keep their defaults, environment variables and choices. Specs that allow
+/// abbreviations or UTF-8 names, or that have constraints or a config file, are rejected.
+/// @param root The multi-command spec to compile. This should be validated first.
+/// @param image An output pointer to the image, which is owned by the caller.
+/// @param image_sz An output value set to the size of the image in bytes.
+/// @result @c AC_ERROR_SUCCESS when the image was compiled, or @c AC_ERROR_IMAGE_UNSUPPORTED with
+/// the spec that uses a feature that images don't have.
+AC_API struct ac_status
+ac_spec_image_compile(struct ac_multi_command_spec const *const root, void **const image,
+                      size_t *const image_sz) {
+    if(root == NULL || image == NULL || image_sz == NULL) {
+        return (struct ac_status) {.code = AC_ERROR_INVALID_PARAMETER, .multi = root};
+    }
+
+    struct _ac_image_writer writer = {0};
+    struct _ac_image_writer nodes  = {0};
+
+    // Offset 0 is the header, which also means that no string is ever at offset 0.
+    (void) _ac_image_reserve(&writer, sizeof(struct ac_image_header), 8);
+    size_t const   epoch      = _ac_memo_enter();
+    uint32_t const root_index = _ac_image_emit_multi(&writer, &nodes, root);
+    _ac_memo_leave(epoch);
+
+    uint32_t const nodes_offset = _ac_image_reserve(&writer, nodes.size, 8);
+    if(writer.failed || nodes.failed) {
+        free(writer.data);
+        free(nodes.data);
+        return !ac_status_is_success(writer.status)
+                   ? writer.status
+                   : (struct ac_status) {.code = AC_ERROR_MEMORY_ALLOC_FAILED, .multi = root};
+    }
+    memcpy(&writer.data[nodes_offset], nodes.data, nodes.size);
+
+    struct ac_image_header const header = {
+        .magic   = AC_IMAGE_MAGIC,
+        .version = AC_IMAGE_VERSION,
+        .size    = (uint32_t) writer.size,
+        .n_nodes = (uint32_t) (nodes.size / sizeof(struct ac_image_node)),
+        .nodes   = nodes_offset,
+        .root    = root_index,
+    };
+    memcpy(writer.data, &header, sizeof(header));
+    free(nodes.data);
+
+    *image    = writer.data;
+    *image_sz = writer.size;
+    return (struct ac_status) {.code = AC_ERROR_SUCCESS, .multi = root};
+}
+
+// Whether the `count` records of `element_size` bytes at `offset` lie within the image, suitably
+// aligned.
+inline static bool _ac_image_range_valid(size_t const size, uint32_t const offset,
+                                         uint64_t const count, size_t const element_size,
+                                         size_t const align) {
+    return (offset & (align - 1)) == 0 && offset <= size &&
+           count <= (size - offset) / element_size;
+}
+
+// Whether `offset` is 0, for an optional string, or the start of a terminated string within the
+// image. Strings are never longer than MAX_STRING_LEN, so this is bounded.
+static bool _ac_image_string_valid(unsigned char const *const base, size_t const size,
+                                   uint32_t const offset, bool const optional) {
+    if(offset == 0) {
+        return optional;
+    }
+    if(offset < sizeof(struct ac_image_header) || offset >= size) {
+        return false;
+    }
+
+    size_t const limit = size - offset < MAX_STRING_LEN + 1 ? size - offset : MAX_STRING_LEN + 1;
+    return memchr(&base[offset], '\0', limit) != NULL;
+}
+
+// Check every offset, count and index in an image once, so that parsing can trust them. Subcommand
+// nodes always come after their parent, which rules out cycles.
+static bool _ac_image_valid(unsigned char const *const base, size_t const size) {
+    struct ac_image_header const *const header = (struct ac_image_header const *) base;
+    if(!_ac_image_range_valid(size, header->nodes, header->n_nodes, sizeof(struct ac_image_node), 8) ||
+       header->root >= header->n_nodes) {
+        return false;
+    }
+
+    struct ac_image_node const *const nodes = (struct ac_image_node const *) &base[header->nodes];
+    for(uint32_t i = 0; i < header->n_nodes; i++) {
+        struct ac_image_node const *const node = &nodes[i];
+        if((node->type != COMMAND_SINGLE && node->type != COMMAND_MULTI) ||
+           !_ac_image_string_valid(base, size, node->help, true) ||
+           !_ac_image_range_valid(size, node->options, node->n_options, sizeof(struct ac_image_option), 4) ||
+           !_ac_image_range_valid(size, node->slots, node->n_slots, sizeof(uint32_t), 4) ||
+           !_ac_image_range_valid(size, node->shorts, 128, sizeof(uint16_t), 2) ||
+           node->n_slots == 0 || (node->n_slots & (node->n_slots - 1)) != 0 ||
+           node->n_options >= node->n_slots) {
+            return false;
+        }
+
+        struct ac_image_option const *const options = (struct ac_image_option const *) &base[node->options];
+        for(uint32_t j = 0; j < node->n_options; j++) {
+            if(!_ac_image_string_valid(base, size, options[j].long_name, false) ||
+               !_ac_image_string_valid(base, size, options[j].help, true) ||
+               !_ac_image_string_valid(base, size, options[j].default_value, true) ||
+               !_ac_image_string_valid(base, size, options[j].env, true) ||
+               !_ac_image_range_valid(size, options[j].choices, options[j].n_choices, sizeof(uint32_t), 4)) {
+                return false;
+            }
+            uint32_t const *const choices = (uint32_t const *) &base[options[j].choices];
+            for(uint32_t k = 0; k < options[j].n_choices; k++) {
+                if(!_ac_image_string_valid(base, size, choices[k], false)) {
+                    return false;
+                }
+            }
+        }
+        // Probing stops at the first empty slot, which the check on n_slots above guarantees as
+        // long as no option appears twice.
+        uint32_t const *const slots  = (uint32_t const *) &base[node->slots];
+        uint32_t              filled = 0;
+        for(uint32_t j = 0; j < node->n_slots; j++) {
+            if(slots[j] > node->n_options) {
+                return false;
+            }
+            filled += slots[j] != 0;
+        }
+        if(filled > node->n_options) {
+            return false;
+        }
+        uint16_t const *const shorts = (uint16_t const *) &base[node->shorts];
+        for(size_t j = 0; j < 128; j++) {
+            if(shorts[j] > node->n_options) {
+                return false;
+            }
+        }
+
+        if(node->type == COMMAND_SINGLE) {
+            if(!_ac_image_range_valid(size, node->arguments, node->n_arguments,
+                                      sizeof(struct ac_image_argument), 4)) {
+                return false;
+            }
+            struct ac_image_argument const *const arguments =
+                (struct ac_image_argument const *) &base[node->arguments];
+            for(uint32_t j = 0; j < node->n_arguments; j++) {
+                if(!_ac_image_string_valid(base, size, arguments[j].name, false) ||
+                   !_ac_image_string_valid(base, size, arguments[j].help, true)) {
+                    return false;
+                }
+            }
+        } else {
+            if(!_ac_image_range_valid(size, node->entries, node->n_entries,
+                                      sizeof(struct ac_image_entry), 4)) {
+                return false;
+            }
+            struct ac_image_entry const *const entries = (struct ac_image_entry const *) &base[node->entries];
+            for(uint32_t j = 0; j < node->n_entries; j++) {
+                if(!_ac_image_string_valid(base, size, entries[j].name, false) ||
+                   entries[j].node <= i || entries[j].node >= header->n_nodes) {
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+/// @brief Use a spec image that is already in memory, for example one embedded in the binary.
+/// @param buffer The image. Must be 8-byte aligned and outlive @p image .
+/// @param buffer_sz The size of @p buffer in bytes.
+/// @param image An output structure that is populated when the return code is @c AC_ERROR_SUCCESS.
+/// @result @c AC_ERROR_SUCCESS when the image is usable, or @c AC_ERROR_BLOB_INVALID when it's
+/// truncated or corrupt. The whole image is checked once here, so parsing never reads outside it.
+AC_API struct ac_status ac_spec_image_from_buffer(void const *const          buffer,
+                                                                 size_t const                buffer_sz,
+                                                                 struct ac_spec_image *const image) {
+    if(buffer == NULL || image == NULL || ((uintptr_t) buffer & 7) != 0) {
+        return (struct ac_status) {.code = AC_ERROR_INVALID_PARAMETER};
+    }
+
+    struct ac_image_header const *const header = (struct ac_image_header const *) buffer;
+    if(buffer_sz < sizeof(*header) || header->magic != AC_IMAGE_MAGIC ||
+       header->version != AC_IMAGE_VERSION || header->size != buffer_sz ||
+       !_ac_image_valid((unsigned char const *) buffer, buffer_sz)) {
+        return (struct ac_status) {.code = AC_ERROR_BLOB_INVALID};
+    }
+
+    image->base   = (unsigned char const *) buffer;
+    image->size   = buffer_sz;
+    image->mapped = false;
+    return (struct ac_status) {.code = AC_ERROR_SUCCESS};
+}
+
+/// @brief Map a spec image file produced by @c ac_spec_image_compile into memory.
+/// @par The image is parsed against in place, so loading it costs a few page faults regardless of
+/// the size of the tree. Release it with @c ac_spec_image_unmap.
+/// @param path The path to the image file.
+/// @param image An output structure that is populated when the return code is @c AC_ERROR_SUCCESS.
+/// @result @c AC_ERROR_SUCCESS when the image is usable.
+AC_API struct ac_status ac_spec_image_map(char const *const           path,
+                                                         struct ac_spec_image *const image) {
+    if(path == NULL || image == NULL) {
+        return (struct ac_status) {.code = AC_ERROR_INVALID_PARAMETER};
+    }
+
+    int const fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        return (struct ac_status) {.code = AC_ERROR_FILE_OPEN_FAILED, .context = (void *) path};
+    }
+
+    struct stat info;
+    if(fstat(fd, &info) != 0 || info.st_size <= 0) {
+        close(fd);
+        return (struct ac_status) {.code = AC_ERROR_BLOB_INVALID};
+    }
+
+    void *const base = mmap(NULL, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(base == MAP_FAILED) {
+        return (struct ac_status) {.code = AC_ERROR_FILE_OPEN_FAILED, .context = (void *) path};
+    }
+
+    struct ac_status const result = ac_spec_image_from_buffer(base, (size_t) info.st_size, image);
+    if(!ac_status_is_success(result)) {
+        munmap(base, (size_t) info.st_size);
+        return result;
+    }
+
+    image->mapped = true;
+    return result;
+}
+
+/// @brief Release an image loaded by @c ac_spec_image_map.
+AC_API void ac_spec_image_unmap(struct ac_spec_image *const image) {
+    if(image == NULL || image->base == NULL) {
+        return;
+    }
+
+    if(image->mapped) {
+        munmap((void *) image->base, image->size);
+    }
+    image->base = NULL;
+    image->size = 0;
+}
+
+inline static struct ac_image_node const *_ac_image_node(struct ac_spec_image const *const image,
+                                                        uint32_t const                    index) {
+    struct ac_image_header const *const header = (struct ac_image_header const *) image->base;
+    return &((struct ac_image_node const *) &image->base[header->nodes])[index];
+}
+
+inline static char const *_ac_image_str(struct ac_spec_image const *const image,
+                                        uint32_t const                    offset) {
+    return offset == 0 ? NULL : (char const *) &image->base[offset];
+}
+
+inline static struct ac_image_option const *
+_ac_image_options(struct ac_spec_image const *const image, struct ac_image_node const *const node) {
+    return (struct ac_image_option const *) &image->base[node->options];
+}
+
+static uint32_t _ac_image_find_long(struct ac_spec_image const *const image,
+                                    struct ac_image_node const *const node, char const *const name,
+                                    size_t const length) {
+    if(node->n_options == 0) {
+        return 0;
+    }
+
+    uint32_t const *const slots = (uint32_t const *) &image->base[node->slots];
+    for(size_t probe = _ac_image_hash(name, length);; probe++) {
+        uint32_t const slot = slots[probe & (node->n_slots - 1)];
+        if(slot == 0) {
+            return 0;
+        }
+
+        char const *const long_name =
+            _ac_image_str(image, _ac_image_options(image, node)[slot - 1].long_name);
+        if(0 == strncmp(long_name, name, length) && long_name[length] == '\0') {
+            return slot;
+        }
+    }
+}
+
+// Find the option that matches the option name token `value` in the layers of nodes from the leaf
+// up to the root. On success, `layer` is set to the index of the matching node in `layers`.
+static uint32_t _ac_image_find_option(struct ac_spec_image const *const image,
+                                      uint32_t const *const layers, size_t const n_layers,
+                                      char const *const value, size_t const length,
+                                      size_t *const layer) {
+    for(size_t i = n_layers; i > 0; i--) {
+        struct ac_image_node const *const node = _ac_image_node(image, layers[i - 1]);
+        if(node->n_options == 0) {
+            continue;
+        }
+
+        uint32_t slot = 0;
+        if(value[1] == '-') {
+            slot = _ac_image_find_long(image, node, &value[2], length - 2);
+        } else if((unsigned char) value[1] < 128) {
+            slot = ((uint16_t const *) &image->base[node->shorts])[(unsigned char) value[1]];
+        }
+
+        if(slot != 0) {
+            *layer = i - 1;
+            return slot;
+        }
+    }
+
+    return 0;
+}
+
+// Resolve the option token `value` against the image, like _ac_option_token_resolve does against
+// specs: clusters are resolved one character at a time with every occurrence of a flag merged into
+// its first entry, and the value of `--name=value` points into `value`. `pending` is set when the last entry takes its value from the
+// next token.
+static struct ac_status _ac_image_token_resolve(struct ac_spec_image const *const   image,
+                                                uint32_t const *const               layers,
+                                                size_t const n_layers, char const *const value,
+                                                size_t const                        length,
+                                                struct ac_image_option_value *const options,
+                                                size_t *const n_options, bool *const pending) {
+    *pending = false;
+
+    bool const   cluster  = value[1] != '-' && length > 2;
+    size_t const name_len = _ac_option_name_length(value, length);
+    for(size_t c = 1; c < (cluster ? length : 2); c++) {
+        char const        short_name[2] = {'-', value[c]};
+        char const *const name          = cluster ? short_name : value;
+
+        size_t         layer = 0;
+        uint32_t const slot =
+            _ac_image_find_option(image, layers, n_layers, name, cluster ? 2 : name_len, &layer);
+        if(slot == 0) {
+            return (struct ac_status) {.code = AC_ERROR_OPTION_NAME_NOT_IN_SPEC, .context = (void *) value};
+        }
+
+        // A flag that was already given counts again. The entries are bounded by the number of
+        // tokens for other options, and by the number of distinct flags, so the scan is short.
+        bool const is_flag =
+            _ac_image_options(image, _ac_image_node(image, layers[layer]))[slot - 1].is_flag;
+        size_t previous = *n_options;
+        for(size_t k = *n_options; is_flag && k > 0; k--) {
+            if(options[k - 1].node == layers[layer] && options[k - 1].index == slot - 1) {
+                previous = k - 1;
+            }
+        }
+        if(previous < *n_options) {
+            options[previous].count++;
+            continue;
+        }
+
+        struct ac_image_option_value *const entry = &options[(*n_options)++];
+        *entry = (struct ac_image_option_value) {.node = layers[layer], .index = slot - 1, .count = 1};
+        if(is_flag) {
+            if(name_len < length) {
+                return (struct ac_status) {.code    = AC_ERROR_OPTION_VALUE_UNEXPECTED,
+                                           .context = (void *) value};
+            }
+        } else if(name_len < length) {
+            entry->value = &value[name_len + 1];
+        } else if(cluster && c + 1 < length) {
+            return (struct ac_status) {.code = AC_ERROR_OPTION_VALUE_EXPECTED, .context = (void *) value};
+        } else {
+            *pending = true;
         }
     }
 
     return (struct ac_status) {.code = AC_ERROR_SUCCESS};
 }
 
-/// @brief Determine if the provided `command` is a valid multi-command spec, therefore may safely
-/// be passed to `ac_multi_command_parse`.
-/// @result `AC_ERROR_SUCCESS` when the `command` is valid.
-__maybe_unused static struct ac_status
-ac_multi_command_validate(struct ac_multi_command_spec const *const command) {
-    if(command == NULL) {
+/// @brief Parse user input against a spec image.
+/// @par This parses like @c ac_multi_command_parse, with inherited options, clusters, environment
+/// variables, defaults and choices, but resolves subcommands by binary search and options by hash
+/// lookup directly in the image. Options from the environment and defaults follow the ones from
+/// @p argv in the result. Arguments and option values point into @p argv .
+/// @param image An image loaded by @c ac_spec_image_map or @c ac_spec_image_from_buffer.
+/// @param argc The number of elements in @p argv
+/// @param argv The user input to be parsed. Must contain exactly @p argc elements.
+/// @param args An output structure that contains the parsed values when the return code is @c
+/// AC_ERROR_SUCCESS. Release it with @c ac_image_command_release.
+/// @result @c AC_ERROR_SUCCESS when the user input is successfully parsed.
+AC_API struct ac_status ac_spec_image_parse(struct ac_spec_image const *const image,
+                                                           int const                argc,
+                                                           char const *const *const argv,
+                                                           struct ac_image_command *const args) {
+    if(image == NULL || image->base == NULL || argc == 0 || argv == NULL || args == NULL) {
         return (struct ac_status) {.code = AC_ERROR_INVALID_PARAMETER};
     }
+    if(argc > MAX_NUM_ARGS) {
+        return (struct ac_status) {.code    = AC_ERROR_ARGUMENT_MAX_EXCEEDED,
+                                   .context = (void *) (size_t) argc};
+    }
 
-    for(size_t i = 0; i < command->n_subcommands; i++) {
-        if(command->subcommands[i].name == NULL) {
-            return (struct ac_status) {.code    = AC_ERROR_MULTICOMMAND_NEEDS_NAME,
-                                       .context = (void *) i};
+    bzero(args, sizeof(*args));
+
+    // A cluster can resolve to more than one option.
+    size_t strlens[MAX_NUM_ARGS];
+    size_t max_options = 0;
+    for(size_t i = 0; i < argc; i++) {
+        strlens[i] = strnlen(argv[i], MAX_STRING_LEN);
+        max_options += _ac_token_is_option(argv[i], strlens[i], false)
+                           ? _ac_option_token_entries(argv[i], strlens[i])
+                           : 0;
+    }
+
+    struct ac_image_option_value *options = (struct ac_image_option_value *) calloc(
+        max_options > 0 ? max_options : 1, sizeof(*options));
+    if(options == NULL) {
+        return (struct ac_status) {.code = AC_ERROR_MEMORY_ALLOC_FAILED};
+    }
+    size_t n_options = 0;
+
+#define fail(...)                                                                                  \
+    free(options);                                                                                 \
+    return (struct ac_status) {__VA_ARGS__}
+
+    // Every node on the path to the command is a layer of options.
+    struct ac_image_header const *const header = (struct ac_image_header const *) image->base;
+    uint32_t                            layers[MAX_NUM_ARGS];
+    size_t                              n_layers = 0;
+    layers[n_layers++]                           = header->root;
+
+    // Parse options into `options` until the next non-option token, which is returned in `i`.
+#define parse_options(i)                                                                           \
+    while(i < (size_t) argc && _ac_token_is_option(argv[i], strlens[i], false)) {                  \
+        bool                   pending = false;                                                    \
+        struct ac_status const status  = _ac_image_token_resolve(                                  \
+            image, layers, n_layers, argv[i], strlens[i], options, &n_options, &pending);          \
+        if(!ac_status_is_success(status)) {                                                        \
+            fail(.code = status.code, .context = status.context);                                  \
+        }                                                                                          \
+        if(pending) {                                                                              \
+            if(i + 1 == (size_t) argc ||                                                           \
+               _ac_token_is_option(argv[i + 1], strlens[i + 1], false)) {                          \
+                fail(.code = AC_ERROR_OPTION_VALUE_EXPECTED, .context = (void *) argv[i]);         \
+            }                                                                                      \
+            options[n_options - 1].value = argv[++i];                                              \
+        }                                                                                          \
+        i++;                                                                                       \
+    }
+
+    // Traverse the dispatch tables to resolve the command.
+    struct ac_image_node const *node = _ac_image_node(image, header->root);
+    size_t                      i    = 0;
+    while(node->type == COMMAND_MULTI) {
+        parse_options(i);
+
+        if(i == (size_t) argc || strlens[i] == 0) {
+            fail(.code    = i == 0 || strlens[i - 1] == 0 ? AC_ERROR_COMMAND_NAME_INVALID
+                                                          : AC_ERROR_COMMAND_NAME_REQUIRED,
+                 .context = (void *) argv[i == (size_t) argc ? i - 1 : i]);
         }
 
-        switch(command->subcommands[i].type) {
-            case COMMAND_SINGLE: {
-                struct ac_status const result = ac_command_validate(command->subcommands->single);
-                if(!ac_status_is_success(result)) {
-                    return result;
-                }
+        struct ac_image_entry const *const entries =
+            (struct ac_image_entry const *) &image->base[node->entries];
+        size_t low = 0, high = node->n_entries;
+        while(low < high) {
+            size_t const mid = low + (high - low) / 2;
+            int const    cmp =
+                strncmp(_ac_image_str(image, entries[mid].name), argv[i], MAX_STRING_LEN);
+            if(cmp == 0) {
+                low = mid;
                 break;
             }
-            case COMMAND_MULTI: {
-                struct ac_status const result =
-                    ac_multi_command_validate(command->subcommands->multi);
-                if(!ac_status_is_success(result)) {
-                    return result;
-                }
-                break;
+            if(cmp < 0) {
+                low = mid + 1;
+            } else {
+                high = mid;
             }
         }
+        if(low >= node->n_entries ||
+           0 != strncmp(_ac_image_str(image, entries[low].name), argv[i], MAX_STRING_LEN)) {
+            fail(.code = AC_ERROR_COMMAND_NAME_NOT_IN_SPEC, .context = (void *) argv[i]);
+        }
+
+        layers[n_layers++] = entries[low].node;
+        node               = _ac_image_node(image, entries[low].node);
+        i++;
     }
 
-    return (struct ac_status) {.code = AC_ERROR_SUCCESS};
-}
+    // The rest mirrors ac_command_parse: arguments come first, followed by options.
+    size_t const first_argument = i;
+    while(i < (size_t) argc && !_ac_token_is_option(argv[i], strlens[i], false)) {
+        i++;
+    }
+    size_t const n_arguments = i - first_argument;
+    if(n_arguments > node->n_arguments) {
+        fail(.code = AC_ERROR_ARGUMENT_EXCEEDED_SPEC, .context = (void *) n_arguments);
+    }
+    if(n_arguments < node->n_arguments) {
+        fail(.code = AC_ERROR_ARGUMENT_EXPECTED_IN_SPEC, .context = (void *) n_arguments);
+    }
 
-/// @brief Extracts an argument from the parsed `command` structure.
-/// @result The argument value, or `NULL` if the `name` wasn't in the `command`'s arguments.
-__maybe_unused static struct ac_argument *
-ac_extract_argument(struct ac_command const *const command, char const *const name) {
-    for(size_t i = 0; i < command->n_arguments; i++) {
-        if(0 == strncmp(command->arguments[i].argument->name, name, MAX_STRING_LEN)) {
-            return &command->arguments[i];
+    parse_options(i);
+    if(i < (size_t) argc) {
+        fail(.code = AC_ERROR_OPTION_NAME_EXPECTED, .context = (void *) argv[i]);
+    }
+#undef parse_options
+
+    // Options that weren't provided are filled from their environment variables and then their
+    // defaults, including inherited ones, so make room for all of them.
+    size_t n_filled = 0;
+    for(size_t layer = 0; layer < n_layers; layer++) {
+        struct ac_image_node const *const   owner = _ac_image_node(image, layers[layer]);
+        struct ac_image_option const *const specs = _ac_image_options(image, owner);
+        for(uint32_t j = 0; j < owner->n_options; j++) {
+            n_filled += specs[j].env != 0 || specs[j].default_value != 0;
+        }
+    }
+    if(n_options + n_filled > max_options) {
+        struct ac_image_option_value *const grown =
+            (struct ac_image_option_value *) realloc(options, (n_options + n_filled) * sizeof(*options));
+        if(grown == NULL) {
+            fail(.code = AC_ERROR_MEMORY_ALLOC_FAILED);
         }
+        options = grown;
     }
 
-    return NULL;
+    size_t const n_provided = n_options;
+    for(size_t layer = 0; layer < n_layers; layer++) {
+        struct ac_image_node const *const   owner = _ac_image_node(image, layers[layer]);
+        struct ac_image_option const *const specs = _ac_image_options(image, owner);
+        for(uint32_t j = 0; j < owner->n_options; j++) {
+            bool found = false;
+            for(size_t k = 0; k < n_provided && !found; k++) {
+                found = options[k].node == layers[layer] && options[k].index == j;
+            }
+            if(found) {
+                continue;
+            }
+
+            // Flags are set by any value other than "" or "0".
+            char const *value = specs[j].env != 0 ? _ac_env_get(_ac_image_str(image, specs[j].env)) : NULL;
+            if(value != NULL && specs[j].is_flag && (value[0] == '\0' || 0 == strcmp(value, "0"))) {
+                value = NULL;
+            }
+            enum ac_option_source const source = value != NULL ? SOURCE_ENV : SOURCE_DEFAULT;
+            value = value != NULL ? value : _ac_image_str(image, specs[j].default_value);
+            if(value != NULL) {
+                options[n_options++] = (struct ac_image_option_value) {
+                    .node   = layers[layer],
+                    .index  = j,
+                    .value  = specs[j].is_flag ? NULL : value,
+                    .count  = 1,
+                    .source = source,
+                };
+                continue;
+            }
+
+            if(specs[j].required) {
+                fail(.code    = AC_ERROR_OPTION_NAME_REQUIRED_IN_SPEC,
+                     .context = (void *) _ac_image_str(image, specs[j].long_name));
+            }
+        }
+    }
+
+    // Resolve the values of options with choices to their indices.
+    for(size_t k = 0; k < n_options; k++) {
+        struct ac_image_option const *const spec =
+            &_ac_image_options(image, _ac_image_node(image, options[k].node))[options[k].index];
+        if(spec->n_choices == 0 || options[k].value == NULL) {
+            continue;
+        }
+
+        uint32_t const *const choices = (uint32_t const *) &image->base[spec->choices];
+        uint32_t              choice  = 0;
+        while(choice < spec->n_choices &&
+              0 != strncmp(_ac_image_str(image, choices[choice]), options[k].value, MAX_STRING_LEN)) {
+            choice++;
+        }
+        if(choice == spec->n_choices) {
+            char const *const value = options[k].value;
+            fail(.code = AC_ERROR_OPTION_VALUE_NOT_IN_CHOICES, .context = (void *) value);
+        }
+        options[k].choice = choice;
+    }
+
+    char const **arguments =
+        n_arguments > 0 ? (char const **) calloc(n_arguments, sizeof(*arguments)) : NULL;
+    if(n_arguments > 0 && arguments == NULL) {
+        fail(.code = AC_ERROR_MEMORY_ALLOC_FAILED);
+    }
+    for(size_t j = 0; j < n_arguments; j++) {
+        arguments[j] = argv[first_argument + j];
+    }
+#undef fail
+
+    args->image       = image;
+    args->node        = layers[n_layers - 1];
+    args->context     = node->context;
+    args->n_arguments = n_arguments;
+    args->arguments   = arguments;
+    args->n_options   = n_options;
+    args->options     = options;
+    return (struct ac_status) {.code = AC_ERROR_SUCCESS};
 }
 
-/// @brief Extracts an option from the parsed `command` structure.
-/// @result The option value, or `NULL` if the `name` wasn't in the `command`'s options.
-__maybe_unused static struct ac_option *ac_extract_option(struct ac_command const *const command,
-                                                          char const *const long_name) {
+/// @brief Extracts an option from a command parsed by @c ac_spec_image_parse.
+/// @result The option value, or `NULL` if the `long_name` wasn't in the `command`'s options.
+AC_API struct ac_image_option_value *
+ac_image_extract_option(struct ac_image_command const *const command, char const *const long_name) {
     for(size_t i = 0; i < command->n_options; i++) {
-        if(0 == strncmp(command->options[i].option->long_name, long_name, MAX_STRING_LEN)) {
+        struct ac_image_node const *const node =
+            _ac_image_node(command->image, command->options[i].node);
+        char const *const name = _ac_image_str(
+            command->image, _ac_image_options(command->image, node)[command->options[i].index].long_name);
+        if(0 == strncmp(name, long_name, MAX_STRING_LEN)) {
             return &command->options[i];
         }
     }
@@ -844,113 +7212,405 @@ __maybe_unused static struct ac_option *ac_extract_option(struct ac_command cons
     return NULL;
 }
 
-/// @brief Generates a helpful error string when `results.code` != `AC_ERROR_SUCCESS`.
-/// @remark This function should always be used after `ac_command_parse` if an error occurs.
-/// @return An error string owned by the caller.
-__maybe_unused static char *ac_status_string(struct ac_status result) {
-    if(result.code == AC_ERROR_SUCCESS) {
+/// @brief Release the resources owned by a command parsed by @c ac_spec_image_parse.
+AC_API void ac_image_command_release(struct ac_image_command *const command) {
+    if(command == NULL) {
+        return;
+    }
+
+    free(command->arguments);
+    free(command->options);
+    command->arguments = NULL;
+    command->options   = NULL;
+}
+
+// The sorted, prefix-searchable names that can be completed at a node of the spec tree.
+struct _ac_completion_table {
+    size_t       n_commands;
+    char const **commands;
+    size_t       n_options;
+    char const **options;
+};
+
+static int _ac_compare_strings(void const *const a, void const *const b) {
+    return strncmp(*(char const *const *) a, *(char const *const *) b, MAX_STRING_LEN);
+}
+
+// Build the completion table for a node. Option names are stored with their leading "--".
+static struct _ac_completion_table *
+_ac_completion_table_build(struct ac_multi_command_subcommand const *const subcommands,
+                           size_t const n_subcommands, struct ac_option_spec const *const options,
+                           size_t const n_options) {
+    size_t pool_sz = 0;
+    for(size_t i = 0; i < n_options; i++) {
+        pool_sz += strnlen(options[i].long_name, MAX_STRING_LEN) + 3;
+    }
+
+    // Everything is placed in a single allocation, so a table is released with a single free.
+    size_t const size = sizeof(struct _ac_completion_table) +
+                        (n_subcommands + n_options) * sizeof(char const *) + pool_sz;
+    struct _ac_completion_table *const table = (struct _ac_completion_table *) malloc(size);
+    if(table == NULL) {
         return NULL;
     }
 
-    bool  include_help = false;
-    char *error        = (char *) malloc(HELP_BUFFER_SZ);
-#define errorf(...)                                                                                \
-    snprintf(error, HELP_BUFFER_SZ, ##__VA_ARGS__);                                                \
-    break
+    table->n_commands = n_subcommands;
+    table->commands   = (char const **) &table[1];
+    table->n_options  = n_options;
+    table->options    = &table->commands[n_subcommands];
+    char *pool        = (char *) &table->options[n_options];
 
-    switch(result.code) {
-        case AC_ERROR_SUCCESS:
-            errorf("Success\n");
-        case AC_ERROR_INVALID_PARAMETER:
-            errorf("Programmer error: Invalid parameter\n");
-        case AC_ERROR_MEMORY_ALLOC_FAILED:
-            errorf("System error: Memory allocation failed\n");
-        case AC_ERROR_OPTION_NAME_NOT_IN_SPEC:
-            include_help = true;
-            errorf("Option name '--%s' is not valid.\n", (char *) result.context);
-        case AC_ERROR_OPTION_NAME_EXPECTED:
-            include_help = true;
-            errorf("Option value '%s' was provided where an option name was expected.",
-                   (char *) result.context);
-        case AC_ERROR_OPTION_NAME_REQUIRED_IN_SPEC:
-            include_help = true;
-            errorf("Option name '--%s' is required.\n", (char *) result.context);
-        case AC_ERROR_OPTION_VALUE_EXPECTED:
-            include_help = true;
-            errorf("Expected value for option %s\n", (char *) result.context);
-        case AC_ERROR_OPTION_TOO_MANY:
-            include_help = true;
-            errorf("Too many options provided.\n");
-        case AC_ERROR_OPTION_SPEC_NEEDS_NAME:
-            errorf("Programmer error: Option in spec has a NULL long name field.\n");
-        case AC_ERROR_OPTION_LONG_NAME_INVALID:
-            errorf("Programmer error: Option in spec has an invalid long name field.\n");
-        case AC_ERROR_OPTION_SHORT_NAME_INVALID:
-            errorf("Programmer error: Option in spec has an invalid short name field.\n");
-        case AC_ERROR_OPTION_FLAG_AND_REQUIRED:
-            errorf("Programmer error: Option in spec has both required and is_flag.\n");
-        case AC_ERROR_COMMAND_NAME_NOT_IN_SPEC:
-            include_help = true;
-            errorf("The command '%s' is not defined.\n", (char *) result.context);
-        case AC_ERROR_COMMAND_NAME_REQUIRED:
-            include_help = true;
-            errorf("Another command name is expected after %s.\n", (char *) result.context);
-        case AC_ERROR_COMMAND_NAME_INVALID:
-            include_help = true;
-            errorf("The command name %s is invalid.\n", (char *) result.context);
-        case AC_ERROR_ARGUMENT_MAX_EXCEEDED:
-            include_help = true;
-            errorf("Exceeded the maximum allowed number of arguments.\n");
-        case AC_ERROR_ARGUMENT_EXCEEDED_SPEC:
-            include_help = true;
-            errorf("Too many arguments. Got %zu which is more than expected.\n",
-                   (size_t) result.context);
-        case AC_ERROR_ARGUMENT_EXPECTED_IN_SPEC:
-            include_help = true;
-            errorf("Missing arguments.\n");
-        case AC_ERROR_ARGUMENT_SPEC_NEEDS_NAME:
-            errorf("Programmer error: Argument at index %zu needs a name.\n",
-                   (size_t) result.context);
-        case AC_ERROR_MULTICOMMAND_NEEDS_NAME:
-            errorf("Programmer error: Multi-command at index %zu needs a name.\n",
-                   (size_t) result.context);
+    for(size_t i = 0; i < n_subcommands; i++) {
+        table->commands[i] = subcommands[i].name;
+    }
+    for(size_t i = 0; i < n_options; i++) {
+        size_t const len = strnlen(options[i].long_name, MAX_STRING_LEN);
+        pool[0]          = '-';
+        pool[1]          = '-';
+        memcpy(&pool[2], options[i].long_name, len);
+        pool[len + 2]     = '\0';
+        table->options[i] = pool;
+        pool += len + 3;
     }
-#undef errorf
 
-    if(!include_help) {
-        return error;
+    qsort(table->commands, table->n_commands, sizeof(char const *), _ac_compare_strings);
+    qsort(table->options, table->n_options, sizeof(char const *), _ac_compare_strings);
+    return table;
+}
+
+// Find the memoized completion table for `spec`, building it on first use.
+static struct _ac_completion_table const *
+_ac_completion_table(void const *const spec, struct ac_multi_command_subcommand const *const subcommands,
+                     size_t const n_subcommands, struct ac_option_spec const *const options,
+                     size_t const n_options) {
+    uint64_t const stamp = _ac_stamp_names(subcommands, n_subcommands, options, n_options);
+    struct _ac_completion_table *table =
+        (struct _ac_completion_table *) _ac_memo_get(spec, _AC_MEMO_COMPLETION, stamp);
+    if(table != NULL) {
+        return table;
     }
 
-    if(result.single == NULL && result.multi == NULL) {
+    table = _ac_completion_table_build(subcommands, n_subcommands, options, n_options);
+    if(table == NULL) {
         return NULL;
     }
 
-    char *help =
-        result.single ? ac_command_help(result.single, NULL) : ac_multi_command_help(result.multi, NULL);
-    if(help == NULL) {
-        return NULL;
+    struct _ac_completion_table *const memoized =
+        (struct _ac_completion_table *) _ac_memo_put(spec, _AC_MEMO_COMPLETION, stamp, table);
+    if(memoized != table) {
+        free(table);
     }
+    return memoized;
+}
 
-    size_t cursor = strnlen(help, HELP_BUFFER_SZ);
-    cursor += _ac_strcpy_safe(help, "\n", cursor, HELP_BUFFER_SZ);
-    (void) _ac_strcpy_safe(help, error, cursor, HELP_BUFFER_SZ);
-    free(error);
+// Append the names in the sorted `names` that start with `prefix` to `completion`.
+static bool _ac_completion_append(struct ac_completion *const completion, size_t *const capacity,
+                                  char const *const *const names, size_t const n_names,
+                                  char const *const prefix) {
+    size_t const prefix_len = strnlen(prefix, MAX_STRING_LEN);
 
-    return help;
+    // Binary search for the first name that is not less than the prefix.
+    size_t low = 0, high = n_names;
+    while(low < high) {
+        size_t const mid = low + (high - low) / 2;
+        if(strncmp(names[mid], prefix, MAX_STRING_LEN) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    for(size_t i = low; i < n_names && 0 == strncmp(names[i], prefix, prefix_len); i++) {
+        if(completion->n_candidates == *capacity) {
+            size_t const       grown      = *capacity ? 2 * *capacity : 16;
+            char const **const candidates = (char const **) realloc(
+                (void *) completion->candidates, grown * sizeof(*candidates));
+            if(candidates == NULL) {
+                return false;
+            }
+            completion->candidates = candidates;
+            *capacity              = grown;
+        }
+        completion->candidates[completion->n_candidates++] = names[i];
+    }
+
+    return true;
 }
 
-/// @brief Once the caller is done with the `ac_command` structure, it's underlying resources should
-/// be released using this function.
-__maybe_unused static void ac_command_release(struct ac_command *command) {
-    if(command == NULL) {
+// Complete the last word of `argv` for `command`, or for `multi` when `command` is NULL, where the
+// options in `parents` are inherited.
+static struct ac_status _ac_complete(int const argc, char const *const *const argv,
+                                     struct ac_multi_command_spec const *multi,
+                                     struct ac_command_spec const       *command,
+                                     struct ac_completion *const         completion) {
+    if(argc < 1 || argc > MAX_NUM_ARGS || argv == NULL || completion == NULL ||
+       (multi == NULL && command == NULL)) {
+        return (struct ac_status) {.code = AC_ERROR_INVALID_PARAMETER, .multi = multi, .single = command};
+    }
+
+    bzero(completion, sizeof(*completion));
+
+    // The options at each node on the path, and the multi-command that owns them if it isn't the
+    // leaf single command.
+    struct _ac_option_layer             layers[MAX_NUM_ARGS + 1];
+    struct ac_multi_command_spec const *parents[MAX_NUM_ARGS + 1];
+    size_t                              n_layers = 0;
+    if(multi != NULL) {
+        layers[n_layers]    = _ac_option_layer_multi(multi);
+        parents[n_layers++] = multi;
+    } else {
+        layers[n_layers]    = _ac_option_layer_single(command);
+        parents[n_layers++] = NULL;
+    }
+
+    // Walk the words before the one being completed, following subcommands and skipping options
+    // and their values.
+    bool utf8            = multi != NULL ? multi->utf8 : command->utf8;
+    bool expecting_value = false;
+    for(size_t i = 0; i + 1 < (size_t) argc; i++) {
+        size_t const len = strnlen(argv[i], MAX_STRING_LEN);
+        if(expecting_value) {
+            expecting_value = false;
+            continue;
+        }
+
+        if(_ac_token_is_option(argv[i], len, utf8)) {
+            // Clusters and `--name=value` are resolved like the parser does, so that `-pl 9` skips
+            // the value of `-l`. A token that doesn't resolve doesn't take a value.
+            struct ac_option entries[MAX_NUM_ARGS];
+            size_t           n_entries = 0;
+            bool             pending   = false;
+            if(_ac_option_token_entries(argv[i], len) <= MAX_NUM_ARGS) {
+                struct ac_status const status = _ac_option_token_resolve(
+                    NULL, layers, n_layers, argv[i], len, entries, &n_entries, &pending);
+                expecting_value = ac_status_is_success(status) && pending;
+            }
+            continue;
+        }
+
+        if(command != NULL) {
+            // An argument of the command.
+            continue;
+        }
+
+        struct ac_multi_command_subcommand const *subcommand = _ac_subcommand_find(multi, argv[i], len);
+        subcommand = subcommand != NULL ? _ac_subcommand_resolve(subcommand) : NULL;
+        if(subcommand == NULL) {
+            // Nothing can be completed below an unknown command.
+            return (struct ac_status) {.code = AC_ERROR_SUCCESS, .multi = multi};
+        }
+
+        if(subcommand->type == COMMAND_SINGLE) {
+            command             = subcommand->single;
+            layers[n_layers]    = _ac_option_layer_single(command);
+            parents[n_layers++] = NULL;
+            utf8                = utf8 || command->utf8;
+        } else {
+            multi               = subcommand->multi;
+            layers[n_layers]    = _ac_option_layer_multi(multi);
+            parents[n_layers++] = multi;
+            utf8                = utf8 || multi->utf8;
+        }
+    }
+
+    // Option values and arguments are completed by the shell, for example as file names.
+    char const *const word = argv[argc - 1];
+    if(expecting_value || (command != NULL && word[0] != '-')) {
+        return (struct ac_status) {.code = AC_ERROR_SUCCESS, .single = command, .multi = multi};
+    }
+
+    size_t capacity = 0;
+    bool   ok       = true;
+
+    if(command != NULL) {
+        struct _ac_completion_table const *const table =
+            _ac_completion_table(command, NULL, 0, command->options, command->n_options);
+        ok = table != NULL && _ac_completion_append(completion, &capacity, table->options,
+                                                    table->n_options, word);
+    } else if(word[0] != '-') {
+        struct _ac_completion_table const *const table = _ac_completion_table(
+            multi, multi->subcommands, multi->n_subcommands, multi->options, multi->n_options);
+        ok = table != NULL && _ac_completion_append(completion, &capacity, table->commands,
+                                                    table->n_commands, word);
+    }
+
+    // Options of the multi-commands on the path, from the nearest to the root.
+    for(size_t i = n_layers; ok && word[0] == '-' && i > 0; i--) {
+        struct ac_multi_command_spec const *const parent = parents[i - 1];
+        if(parent == NULL) {
+            continue;
+        }
+        struct _ac_completion_table const *const table = _ac_completion_table(
+            parent, parent->subcommands, parent->n_subcommands, parent->options, parent->n_options);
+        ok = table != NULL && _ac_completion_append(completion, &capacity, table->options,
+                                                    table->n_options, word);
+    }
+
+    if(!ok) {
+        free((void *) completion->candidates);
+        bzero(completion, sizeof(*completion));
+        return (struct ac_status) {.code = AC_ERROR_MEMORY_ALLOC_FAILED, .single = command, .multi = multi};
+    }
+
+    // Names from different layers are merged, so sort them and drop shadowed duplicates.
+    qsort((void *) completion->candidates, completion->n_candidates, sizeof(char const *),
+          _ac_compare_strings);
+    size_t n_unique = 0;
+    for(size_t i = 0; i < completion->n_candidates; i++) {
+        if(n_unique == 0 ||
+           0 != strncmp(completion->candidates[n_unique - 1], completion->candidates[i], MAX_STRING_LEN)) {
+            completion->candidates[n_unique++] = completion->candidates[i];
+        }
+    }
+    completion->n_candidates = n_unique;
+
+    return (struct ac_status) {.code = AC_ERROR_SUCCESS, .single = command, .multi = multi};
+}
+
+/// @brief Produce completion candidates for the last element of @p argv .
+/// @par Candidates come from sorted tables that are built from the spec on first use and memoized,
+/// so each request is a binary search per node on the path. Subcommand names and long option names
+/// are completed. Option values and arguments produce no candidates, which lets the shell fall back
+/// to its default completion.
+/// @param argc The number of elements in @p argv . Must be at least 1.
+/// @param argv The words on the command line, excluding the program name. The last element is the
+/// word being completed, which may be empty.
+/// @param root The multi-command specification of the program.
+/// @param completion An output structure that contains the candidates when the return code is @c
+/// AC_ERROR_SUCCESS. Release it with @c ac_completion_release.
+/// @result @c AC_ERROR_SUCCESS when the candidates were produced, even if there are none.
+AC_API struct ac_status
+ac_multi_command_complete(int const argc, char const *const *const argv,
+                          struct ac_multi_command_spec const *const root,
+                          struct ac_completion *const               completion) {
+    size_t const           epoch  = _ac_memo_enter();
+    struct ac_status const status = _ac_complete(argc, argv, root, NULL, completion);
+    _ac_memo_leave(epoch);
+    return status;
+}
+
+/// @brief Produce completion candidates for the last element of @p argv .
+/// @par See @c ac_multi_command_complete.
+/// @result @c AC_ERROR_SUCCESS when the candidates were produced, even if there are none.
+AC_API struct ac_status
+ac_command_complete(int const argc, char const *const *const argv,
+                    struct ac_command_spec const *const command,
+                    struct ac_completion *const         completion) {
+    size_t const           epoch  = _ac_memo_enter();
+    struct ac_status const status = _ac_complete(argc, argv, NULL, command, completion);
+    _ac_memo_leave(epoch);
+    return status;
+}
+
+/// @brief Release the resources owned by @p completion .
+AC_API void ac_completion_release(struct ac_completion *const completion) {
+    if(completion == NULL) {
         return;
     }
 
-    if(command->arguments != NULL) {
-        free(command->arguments);
+    free((void *) completion->candidates);
+    completion->candidates   = NULL;
+    completion->n_candidates = 0;
+}
+
+/// @brief Print completion candidates for @p argv to @p output , one per line.
+/// @par This implements the @c AC_COMPLETE_COMMAND mode that the scripts generated by
+/// @c ac_completion_script rely on, for example:
+/// @code
+/// if(argc > 1 && 0 == strcmp(argv[1], AC_COMPLETE_COMMAND)) {
+///     return ac_multi_command_complete_print(argc - 2, &argv[2], &root, stdout).code;
+/// }
+/// @endcode
+/// @result @c AC_ERROR_SUCCESS when the candidates were printed.
+AC_API struct ac_status
+ac_multi_command_complete_print(int const argc, char const *const *const argv,
+                                struct ac_multi_command_spec const *const root, FILE *const output) {
+    // The word being completed is empty when the shell doesn't pass one.
+    char const *const  empty[] = {""};
+    struct ac_completion completion;
+    struct ac_status const result = argc > 0 ? ac_multi_command_complete(argc, argv, root, &completion)
+                                             : ac_multi_command_complete(1, empty, root, &completion);
+    if(!ac_status_is_success(result)) {
+        return result;
     }
 
-    if(command->options != NULL) {
-        free(command->options);
+    for(size_t i = 0; i < completion.n_candidates; i++) {
+        fprintf(output, "%s\n", completion.candidates[i]);
+    }
+
+    ac_completion_release(&completion);
+    return result;
+}
+
+/// @brief Generate a completion script for @p shell that completes @p toolname .
+/// @par The script calls `toolname __complete <words...>` for each completion request, which the
+/// program handles with @c ac_multi_command_complete_print.
+/// @param shell The shell to generate a script for.
+/// @param toolname The name of the program as it's invoked by the user.
+/// @result A script string owned by the caller if successful, otherwise @c NULL.
+AC_API char *ac_completion_script(enum ac_shell const shell,
+                                                 char const *const   toolname) {
+    if(toolname == NULL) {
+        return NULL;
+    }
+
+    // Shell function names are derived from the tool name.
+    char function[MAX_STRING_LEN];
+    size_t const toolname_len = strnlen(toolname, MAX_STRING_LEN - 1);
+    for(size_t i = 0; i < toolname_len; i++) {
+        char const c = toolname[i];
+        bool const valid = ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || ('0' <= c && c <= '9');
+        function[i]      = valid ? c : '_';
+    }
+    function[toolname_len] = '\0';
+
+    char const *format = NULL;
+    switch(shell) {
+        case SHELL_BASH:
+            format = "_%2$s_complete() {\n"
+                     "    local IFS=$'\\n'\n"
+                     "    COMPREPLY=($(%1$s " AC_COMPLETE_COMMAND
+                     " \"${COMP_WORDS[@]:1:COMP_CWORD}\"))\n"
+                     "}\n"
+                     "complete -o default -F _%2$s_complete %1$s\n";
+            break;
+        case SHELL_ZSH:
+            format = "_%2$s_complete() {\n"
+                     "    local -a candidates\n"
+                     "    candidates=(${(f)\"$(%1$s " AC_COMPLETE_COMMAND
+                     " \"${(@)words[2,CURRENT]}\")\"})\n"
+                     "    if (( ${#candidates} )); then\n"
+                     "        compadd -a candidates\n"
+                     "    else\n"
+                     "        _files\n"
+                     "    fi\n"
+                     "}\n"
+                     "compdef _%2$s_complete %1$s\n";
+            break;
+        case SHELL_FISH:
+            format = "function __%2$s_complete\n"
+                     "    set -l words (commandline -opc) (commandline -ct)\n"
+                     "    %1$s " AC_COMPLETE_COMMAND " $words[2..-1]\n"
+                     "end\n"
+                     "complete -c %1$s -a '(__%2$s_complete)'\n";
+            break;
+    }
+    if(format == NULL) {
+        return NULL;
     }
+
+    int const length = snprintf(NULL, 0, format, toolname, function);
+    if(length < 0) {
+        return NULL;
+    }
+
+    char *const script = (char *) malloc((size_t) length + 1);
+    if(script == NULL) {
+        return NULL;
+    }
+    snprintf(script, (size_t) length + 1, format, toolname, function);
+
+    return script;
 }
+
+#endif // !defined(AC_EXTERN) || defined(AC_IMPLEMENTATION)
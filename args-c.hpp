@@ -0,0 +1,545 @@
+/**
+ * @file args-c.hpp
+ * @brief C++ interface to args-c with compile time spec validation and typed accessors
+ */
+
+#pragma once
+
+// The implementation in args-c.h is C, so C++ programs always use its declarations and link against
+// libargs-c.a.
+#ifndef AC_EXTERN
+#define AC_EXTERN
+#endif
+
+extern "C" {
+#include "args-c.h"
+}
+
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace ac {
+
+/// @brief Describes how a parameter of an @c ac::command appears on the command line.
+enum class kind {
+    /// @brief A positional value, see @c ac_argument_spec.
+    argument,
+    /// @brief A named value, see @c ac_option_spec.
+    option,
+    /// @brief A named option without a value, see @c ac_option_spec::is_flag.
+    flag,
+};
+
+/// @brief A constexpr builder for a parameter of an @c ac::command.
+/// @par Parameters are declared as the @c spec member of a tag type, which is then used to access
+/// the parsed value:
+/// @code
+/// struct level_t {
+///     static constexpr auto spec = ac::option<int>("level").short_name('l').help("1 to 9");
+/// };
+/// @endcode
+/// @tparam T The type that the value is converted to, see @c ac::value_traits.
+template <typename T> struct parameter {
+    /// @brief The type that the value is converted to.
+    using value_type = T;
+
+    ac::kind    kind_;
+    char const *name_;
+    char const *help_           = nullptr;
+    bool        has_short_name_ = false;
+    char        short_name_     = '\0';
+    bool        required_       = false;
+
+    /// @brief A help string that will appear in the @c ac_command_help output.
+    constexpr parameter help(char const *const help) const {
+        parameter copy = *this;
+        copy.help_     = help;
+        return copy;
+    }
+
+    /// @brief The short name of an option, used on the command line as -c.
+    constexpr parameter short_name(char const short_name) const {
+        parameter copy       = *this;
+        copy.has_short_name_ = true;
+        copy.short_name_     = short_name;
+        return copy;
+    }
+
+    /// @brief Make an option mandatory. The value is then accessed as a @c T rather than a
+    /// @c std::optional<T>.
+    constexpr parameter required() const {
+        parameter copy = *this;
+        copy.required_ = true;
+        return copy;
+    }
+};
+
+/// @brief Declare an option with a value of type @p T .
+template <typename T> constexpr parameter<T> option(char const *const long_name) {
+    return {kind::option, long_name};
+}
+
+/// @brief Declare a flag, which is accessed as a @c bool.
+constexpr parameter<bool> flag(char const *const long_name) {
+    return {kind::flag, long_name};
+}
+
+/// @brief Declare an argument with a value of type @p T .
+template <typename T = std::string_view> constexpr parameter<T> argument(char const *const name) {
+    return {kind::argument, name, nullptr, false, '\0', true};
+}
+
+/// @brief Converts values from the command line to @p T .
+/// @par Specializations are provided for strings, integers and floating point numbers. Other types
+/// may be supported by specializing this template with a
+/// `static bool parse(char const *value, T &out)` function.
+template <typename T, typename = void> struct value_traits;
+
+template <> struct value_traits<std::string_view> {
+    static bool parse(char const *const value, std::string_view &out) {
+        out = value;
+        return true;
+    }
+};
+
+template <> struct value_traits<char const *> {
+    static bool parse(char const *const value, char const *&out) {
+        out = value;
+        return true;
+    }
+};
+
+template <> struct value_traits<std::string> {
+    static bool parse(char const *const value, std::string &out) {
+        out = value;
+        return true;
+    }
+};
+
+template <typename T>
+struct value_traits<T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>>> {
+    static bool parse(char const *const value, T &out) {
+        char const *const end    = value + std::char_traits<char>::length(value);
+        auto const        result = std::from_chars(value, end, out);
+        return result.ec == std::errc() && result.ptr == end && end != value;
+    }
+};
+
+template <typename T> struct value_traits<T, std::enable_if_t<std::is_floating_point_v<T>>> {
+    static bool parse(char const *const value, T &out) {
+        char *end = nullptr;
+        out       = static_cast<T>(std::strtold(value, &end));
+        return end != value && *end == '\0';
+    }
+};
+
+namespace detail {
+
+// Called when a spec breaks a rule during constant evaluation. This isn't constexpr, so the
+// compiler reports the call, and `reason`, as the error.
+inline void invalid_spec(char const *const reason) {
+    std::fputs(reason, stderr);
+    std::abort();
+}
+
+constexpr bool equal(std::string_view const a, std::string_view const b) {
+    return a == b;
+}
+
+constexpr uint64_t hash(std::string_view const name, uint64_t const seed) {
+    uint64_t hash = 0xcbf29ce484222325ULL ^ (seed * 0x9e3779b97f4a7c15ULL);
+    for(char const c : name) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001b3ULL;
+    }
+
+    // The low bits of FNV only depend on the low bits of its input, so mix the high bits down
+    // before the hash is masked to a slot.
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+constexpr std::size_t next_power_of_two(std::size_t const n) {
+    std::size_t power = 1;
+    while(power < n) {
+        power *= 2;
+    }
+    return power;
+}
+
+// The position of `T` in `Ts`.
+template <typename T, typename... Ts> constexpr std::size_t index_of() {
+    constexpr bool matches[] = {std::is_same_v<T, Ts>..., false};
+    std::size_t    index     = 0;
+    while(index < sizeof...(Ts) && !matches[index]) {
+        index++;
+    }
+    return index;
+}
+
+// The position of `T` among the parameters in `Ts` that have the same kind of spec as `T`.
+template <typename T, typename... Ts> constexpr std::size_t index_of_kind() {
+    constexpr bool matches[] = {std::is_same_v<T, Ts>..., false};
+    constexpr bool named[]   = {(Ts::spec.kind_ != kind::argument)..., false};
+    bool const     is_named  = T::spec.kind_ != kind::argument;
+    std::size_t    index     = 0;
+    for(std::size_t i = 0; i < sizeof...(Ts) && !matches[i]; i++) {
+        index += named[i] == is_named ? 1 : 0;
+    }
+    return index;
+}
+
+// How the parsed value of the parameter `T` is stored: flags are a bool, arguments and required
+// options are the value itself, and other options are optional.
+template <typename T>
+using storage_t = std::conditional_t<
+    T::spec.kind_ == kind::flag, bool,
+    std::conditional_t<T::spec.required_, typename std::remove_cv_t<decltype(T::spec)>::value_type,
+                       std::optional<typename std::remove_cv_t<decltype(T::spec)>::value_type>>>;
+
+} // namespace detail
+
+/// @brief A perfect hash table over a fixed set of names, built at compile time.
+/// @par Names are hashed into buckets, and each bucket has a displacement that places all of its
+/// names into distinct slots ("hash and displace"). A lookup is two hashes and one comparison.
+/// @tparam N The number of names.
+template <std::size_t N> class perfect_hash {
+  public:
+    static constexpr std::size_t n_slots   = detail::next_power_of_two(N == 0 ? 1 : N);
+    static constexpr std::size_t n_buckets = N / 2 + 1;
+
+    /// @brief Build the table. @p names must be distinct.
+    constexpr explicit perfect_hash(std::array<char const *, N> const &names) : names_(names) {
+        std::array<std::size_t, n_buckets> sizes {};
+        for(std::size_t i = 0; i < N; i++) {
+            sizes[bucket(names[i])]++;
+        }
+
+        // Place the largest buckets first, while there are the most free slots.
+        std::array<bool, n_buckets> placed {};
+        for(std::size_t round = 0; round < n_buckets; round++) {
+            std::size_t largest = n_buckets;
+            for(std::size_t b = 0; b < n_buckets; b++) {
+                if(!placed[b] && (largest == n_buckets || sizes[b] > sizes[largest])) {
+                    largest = b;
+                }
+            }
+            placed[largest] = true;
+            if(sizes[largest] > 0) {
+                place(largest);
+            }
+        }
+    }
+
+    /// @brief Find the index of @p name in the names that the table was built from.
+    /// @result The index, or @c N when @p name isn't one of the names.
+    constexpr std::size_t find(std::string_view const name) const {
+        std::size_t const index = slots_[slot(name, displacements_[bucket(name)])];
+        return index != 0 && detail::equal(names_[index - 1], name) ? index - 1 : N;
+    }
+
+  private:
+    static constexpr std::size_t bucket(std::string_view const name) {
+        return static_cast<std::size_t>(detail::hash(name, 0) % n_buckets);
+    }
+
+    static constexpr std::size_t slot(std::string_view const name, uint32_t const displacement) {
+        return static_cast<std::size_t>(detail::hash(name, displacement) & (n_slots - 1));
+    }
+
+    // Find a displacement that places every name in bucket `b` into a free slot.
+    constexpr void place(std::size_t const b) {
+        for(uint32_t displacement = 1; displacement < (1u << 20); displacement++) {
+            std::array<bool, n_slots> taken {};
+            bool                      fits = true;
+            for(std::size_t i = 0; i < N && fits; i++) {
+                if(bucket(names_[i]) != b) {
+                    continue;
+                }
+                std::size_t const s = slot(names_[i], displacement);
+                fits                = slots_[s] == 0 && !taken[s];
+                taken[s]            = true;
+            }
+
+            if(fits) {
+                displacements_[b] = displacement;
+                for(std::size_t i = 0; i < N; i++) {
+                    if(bucket(names_[i]) == b) {
+                        slots_[slot(names_[i], displacement)] = i + 1;
+                    }
+                }
+                return;
+            }
+        }
+
+        detail::invalid_spec("args-c: failed to build a perfect hash of the option names");
+    }
+
+    std::array<char const *, N>      names_;
+    std::array<uint32_t, n_buckets>  displacements_ {};
+    std::array<std::size_t, n_slots> slots_ {};
+};
+
+template <typename... Params> class command;
+
+/// @brief The result of @c ac::command::parse.
+/// @par Values are converted to their declared types while parsing, so @c get is a load from this
+/// structure. String values point into the @c argv that was parsed, so they're valid for as long as
+/// it is.
+template <typename... Params> class parsed {
+  public:
+    parsed(parsed const &)            = delete;
+    parsed &operator=(parsed const &) = delete;
+
+    parsed(parsed &&other) noexcept
+        : command_(other.command_), status_(other.status_), args_(other.args_),
+          raw_(other.raw_), values_(std::move(other.values_)) {
+        other.args_ = {};
+    }
+
+    ~parsed() {
+        ac_command_release(&args_);
+    }
+
+    /// @brief @c true when parsing succeeded.
+    explicit operator bool() const {
+        return ac_status_is_success(status_);
+    }
+
+    /// @brief The status of parsing, see @c ac_status.
+    ac_status const &status() const {
+        return status_;
+    }
+
+    /// @brief A helpful error string when parsing failed, see @c ac_status_string.
+    std::string error() const {
+        char *const error = ac_status_string(status_);
+        if(error == nullptr) {
+            return {};
+        }
+        std::string result(error);
+        std::free(error);
+        return result;
+    }
+
+    /// @brief The parsed value of the parameter with tag type @p Tag .
+    /// @result A @c bool for flags, the value for arguments and required options, and a
+    /// @c std::optional of the value for other options.
+    template <typename Tag> detail::storage_t<Tag> const &get() const {
+        static_assert((std::is_same_v<Tag, Params> || ...), "Tag is not a parameter of this command");
+        return std::get<detail::index_of<Tag, Params...>()>(values_);
+    }
+
+    /// @brief The unconverted value of the option with @p long_name , found through the command's
+    /// perfect hash.
+    /// @result The value, an empty string for flags, or @c nullptr when the option wasn't provided.
+    char const *value(std::string_view const long_name) const {
+        std::size_t const index = command_->find(long_name);
+        return index < raw_.size() ? raw_[index] : nullptr;
+    }
+
+  private:
+    friend class command<Params...>;
+
+    explicit parsed(command<Params...> const *const command) : command_(command) {}
+
+    command<Params...> const                                  *command_;
+    ac_status                                                  status_ {};
+    ac_command                                                 args_ {};
+    std::array<char const *, command<Params...>::n_options>     raw_ {};
+    std::tuple<detail::storage_t<Params>...>                   values_ {};
+};
+
+/// @brief A command whose parameters are declared by the tag types @p Params .
+/// @par The command must be declared @c constexpr so that its spec and the perfect hash of its option
+/// names are built at compile time, and duplicate long names fail to compile. The other rules are
+/// checked by @c ac_command_validate when the command is first parsed:
+/// @code
+/// inline constexpr ac::command<file_t, level_t, progress_t> compress {"Compress a file."};
+///
+/// auto const args = compress.parse(argc - 1, &argv[1]);
+/// if(!args) {
+///     std::fputs(args.error().c_str(), stderr);
+/// }
+/// int const level = args.get<level_t>().value_or(6);
+/// @endcode
+/// @par Parsing is done by @c ac_command_parse, so the command line semantics are the same as for
+/// an equivalent C spec, and the value of a repeated option is its first one, like
+/// @c ac_extract_option returns.
+template <typename... Params> class command {
+  public:
+    static constexpr std::size_t n_arguments =
+        ((Params::spec.kind_ == kind::argument ? 1 : 0) + ... + 0);
+    static constexpr std::size_t n_options = sizeof...(Params) - n_arguments;
+
+    command(command const &)            = delete;
+    command &operator=(command const &) = delete;
+
+    /// @brief Build the spec and the perfect hash of its option names.
+    /// @param help A help string that will appear in the @c ac_command_help output.
+    /// @param allow_abbreviations See @c ac_command_spec::allow_abbreviations.
+    constexpr explicit command(char const *const help, bool const allow_abbreviations = false)
+        : arguments_(make_arguments()), options_(make_options()),
+          spec_(make_spec(help, allow_abbreviations)), names_(make_names()) {}
+
+    /// @brief The underlying C spec, for use with the rest of the args-c API.
+    constexpr ac_command_spec const *spec() const {
+        return &spec_;
+    }
+
+    /// @brief The index of the option with @p long_name in @c spec()->options , or @c n_options.
+    constexpr std::size_t find(std::string_view const long_name) const {
+        return names_.find(long_name);
+    }
+
+    /// @brief Check the spec with @c ac_command_validate, which memoizes the result.
+    ac_status validate() const {
+        return ac_command_validate(&spec_);
+    }
+
+    /// @brief Parse @p argv and convert each value to the type declared by its parameter.
+    /// @par A spec that @c ac_command_validate rejects fails with its status. A value that can't be
+    /// converted fails with @c AC_ERROR_OPTION_VALUE_INVALID.
+    parsed<Params...> parse(int const argc, char const *const *const argv) const {
+        parsed<Params...> result(this);
+        result.status_ = validate();
+        if(!result) {
+            return result;
+        }
+        result.status_ = ac_command_parse(argc, argv, &spec_, &result.args_);
+        if(!result) {
+            return result;
+        }
+
+        // Later occurrences of an option follow its first one, which is the effective value.
+        for(std::size_t i = 0; i < result.args_.n_options; i++) {
+            ac_option const &option = result.args_.options[i];
+            char const     *&raw    = result.raw_[static_cast<std::size_t>(option.option - spec_.options)];
+            if(raw == nullptr) {
+                raw = option.value != nullptr ? option.value : "";
+            }
+        }
+
+        // Conversion stops at the first value that fails.
+        (void) (convert<Params>(result, std::get<detail::index_of<Params, Params...>()>(result.values_)) &&
+                ...);
+        return result;
+    }
+
+  private:
+    static constexpr std::array<ac_argument_spec, n_arguments> make_arguments() {
+        std::array<ac_argument_spec, n_arguments> arguments {};
+        std::size_t                               index = 0;
+        (
+            [&] {
+                if constexpr(Params::spec.kind_ == kind::argument) {
+                    ac_argument_spec &argument = arguments[index++];
+                    argument.name              = const_cast<char *>(Params::spec.name_);
+                    argument.help              = const_cast<char *>(Params::spec.help_);
+                }
+            }(),
+            ...);
+        return arguments;
+    }
+
+    static constexpr std::array<ac_option_spec, n_options> make_options() {
+        std::array<ac_option_spec, n_options> options {};
+        std::size_t                           index = 0;
+        (
+            [&] {
+                if constexpr(Params::spec.kind_ != kind::argument) {
+                    ac_option_spec &option = options[index++];
+                    option.help            = const_cast<char *>(Params::spec.help_);
+                    option.long_name       = const_cast<char *>(Params::spec.name_);
+                    option.has_short_name  = Params::spec.has_short_name_;
+                    option.short_name      = Params::spec.short_name_;
+                    option.is_flag         = Params::spec.kind_ == kind::flag;
+                    option.required        = Params::spec.required_;
+                }
+            }(),
+            ...);
+        return options;
+    }
+
+    // The C spec over the arrays above, which are initialized first. Fields that the wrapper
+    // doesn't support are left zero.
+    constexpr ac_command_spec make_spec(char const *const help, bool const allow_abbreviations) const {
+        ac_command_spec spec {};
+        spec.help                = const_cast<char *>(help);
+        spec.n_arguments         = n_arguments;
+        spec.arguments           = n_arguments > 0 ? const_cast<ac_argument_spec *>(arguments_.data()) : nullptr;
+        spec.n_options           = n_options;
+        spec.options             = n_options > 0 ? const_cast<ac_option_spec *>(options_.data()) : nullptr;
+        spec.allow_abbreviations = allow_abbreviations;
+        return spec;
+    }
+
+    // The long names of the options, for the perfect hash, which requires them to be distinct.
+    constexpr std::array<char const *, n_options> make_names() const {
+        std::array<char const *, n_options> names {};
+        for(std::size_t i = 0; i < n_options; i++) {
+            for(std::size_t j = 0; j < i; j++) {
+                if(detail::equal(options_[j].long_name, options_[i].long_name)) {
+                    detail::invalid_spec("args-c: option has a duplicate long name");
+                }
+            }
+            names[i] = options_[i].long_name;
+        }
+
+        return names;
+    }
+
+    // Convert the parsed value of the parameter `Param` into `out`, returning false on failure.
+    template <typename Param>
+    bool convert(parsed<Params...> &result, detail::storage_t<Param> &out) const {
+        using value_type = typename std::remove_cv_t<decltype(Param::spec)>::value_type;
+        constexpr std::size_t index = detail::index_of_kind<Param, Params...>();
+
+        char const *value = nullptr;
+        if constexpr(Param::spec.kind_ == kind::argument) {
+            value = result.args_.arguments[index].value;
+        } else {
+            value = result.raw_[index];
+        }
+
+        if constexpr(Param::spec.kind_ == kind::flag) {
+            out = value != nullptr;
+            return true;
+        } else {
+            if(value == nullptr) {
+                return true;
+            }
+
+            value_type converted {};
+            if(!value_traits<value_type>::parse(value, converted)) {
+                result.status_         = ac_status {};
+                result.status_.code    = AC_ERROR_OPTION_VALUE_INVALID;
+                result.status_.single  = &spec_;
+                result.status_.option  = Param::spec.kind_ == kind::argument ? nullptr : &options_[index];
+                result.status_.context = const_cast<char *>(value);
+                return false;
+            }
+            out = std::move(converted);
+            return true;
+        }
+    }
+
+    std::array<ac_argument_spec, n_arguments> arguments_;
+    std::array<ac_option_spec, n_options>     options_;
+    ac_command_spec                           spec_;
+    perfect_hash<n_options>                   names_;
+};
+
+} // namespace ac
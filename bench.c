@@ -0,0 +1,194 @@
+#include "args-c.h"
+
+#include <time.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+// Benchmarks for the parser. Each case is run for a fixed number of iterations several times, and
+// reports the best mean time per iteration and its overhead against the case it compares to. Where
+// the kernel allows it, the best mean number of cache misses per iteration is reported too.
+
+enum {
+    BENCH_ITERATIONS  = 100000,
+    BENCH_REPETITIONS = 7,
+};
+
+struct bench_case {
+    char const                   *name;
+    struct ac_command_spec const *command;
+    int                           argc;
+    char const *const            *argv;
+    // The index of the case that this one is compared to, or -1.
+    int baseline;
+    // Whether the case parses with a caching ac_parser, so every iteration after the first is a hit.
+    bool cached;
+};
+
+struct bench_result {
+    double time;
+    // The mean number of cache misses, or a negative number when they can't be counted.
+    double cache_misses;
+};
+
+static struct ac_command_spec const bench_ascii = {
+    .help        = "Benchmark command.",
+    .n_arguments = 2,
+    .arguments   = (struct ac_argument_spec[]) {{.name = "INPUT"}, {.name = "OUTPUT"}},
+    .n_options   = 4,
+    .options     = (struct ac_option_spec[]) {{.long_name = "level", .has_short_name = true, .short_name = 'l'},
+                                              {.long_name = "format"},
+                                              {.long_name = "comment"},
+                                              {.long_name = "verbose", .is_flag = true}},
+};
+
+static struct ac_command_spec const bench_utf8 = {
+    .help        = "Benchmark command.",
+    .n_arguments = 2,
+    .arguments   = (struct ac_argument_spec[]) {{.name = "INPUT"}, {.name = "OUTPUT"}},
+    .n_options   = 4,
+    .options     = (struct ac_option_spec[]) {{.long_name = "level", .has_short_name = true, .short_name = 'l'},
+                                              {.long_name = "format"},
+                                              {.long_name = "comment"},
+                                              {.long_name = "verbose", .is_flag = true}},
+    .utf8        = true,
+};
+
+static char const *const ascii_argv[] = {
+    "/var/log/application/requests-2024-01-01.log",
+    "/var/backups/application/requests-2024-01-01.log.gz",
+    "--level",
+    "9",
+    "--format",
+    "gzip",
+    "--comment",
+    "Nightly backup of the request logs, kept for thirty days before rotation.",
+    "--verbose",
+};
+
+static char const *const utf8_argv[] = {
+    "/var/log/application/r\xc3\xa9sum\xc3\xa9-2024-01-01.log",
+    "/var/backups/application/r\xc3\xa9sum\xc3\xa9-2024-01-01.log.gz",
+    "--level",
+    "9",
+    "--format",
+    "gzip",
+    "--comment",
+    "Sauvegarde nocturne des journaux, conserv\xc3\xa9" "e trente jours avant la rotation \xe2\x80\x94 ok.",
+    "--verbose",
+};
+
+static struct bench_case const cases[] = {
+    {"parse ascii", &bench_ascii, 9, ascii_argv, -1},
+    {"parse ascii, utf8 validation", &bench_utf8, 9, ascii_argv, 0},
+    {"parse non-ascii, utf8 validation", &bench_utf8, 9, utf8_argv, 0},
+    {"parse ascii, cached", &bench_ascii, 9, ascii_argv, 0, true},
+};
+
+static double bench_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec * 1e9 + (double) now.tv_nsec;
+}
+
+// Open a counter of the cache misses of this thread, or return -1 when that isn't allowed.
+static int bench_cache_misses_open(void) {
+#ifdef __linux__
+    struct perf_event_attr attr = {
+        .type           = PERF_TYPE_HARDWARE,
+        .size           = sizeof(attr),
+        .config         = PERF_COUNT_HW_CACHE_MISSES,
+        .disabled       = 1,
+        .exclude_kernel = 1,
+        .exclude_hv     = 1,
+    };
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+static struct bench_result bench_run(struct bench_case const *const bench, size_t const iterations,
+                                     int const counter) {
+    struct ac_parser *parser = NULL;
+    if(bench->cached && !ac_status_is_success(ac_command_parser_create(bench->command, 1, &parser))) {
+        fprintf(stderr, "%s: failed to create the parser\n", bench->name);
+        exit(1);
+    }
+#ifdef __linux__
+    if(counter >= 0) {
+        ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+        ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+    double const start = bench_now();
+    for(size_t i = 0; i < iterations; i++) {
+        struct ac_command        args   = {0};
+        struct ac_command const *shared = NULL;
+        struct ac_status const   status = parser != NULL
+                                              ? ac_parser_parse(parser, bench->argc, bench->argv, &shared)
+                                              : ac_command_parse(bench->argc, bench->argv, bench->command, &args);
+        if(!ac_status_is_success(status)) {
+            fprintf(stderr, "%s: %s", bench->name, ac_status_string(status));
+            exit(1);
+        }
+        if(parser != NULL) {
+            ac_parser_result_release(shared);
+        } else {
+            ac_command_release(&args);
+        }
+    }
+    struct bench_result result = {.time = (bench_now() - start) / (double) iterations, .cache_misses = -1};
+
+    uint64_t misses = 0;
+    if(counter >= 0 && read(counter, &misses, sizeof(misses)) == sizeof(misses)) {
+        result.cache_misses = (double) misses / (double) iterations;
+    }
+    ac_parser_destroy(parser);
+    return result;
+}
+
+int main() {
+    // The compiled layout of the options that parsing reads, against the specs that it replaces.
+    struct _ac_option_index const *const index = _ac_option_index(_ac_option_layer_single(&bench_ascii));
+    size_t spec_size = bench_ascii.n_options * sizeof(struct ac_option_spec);
+    for(size_t i = 0; i < bench_ascii.n_options; i++) {
+        spec_size += strlen(bench_ascii.options[i].long_name) + 1;
+    }
+    printf("%-40s %10.1f B\n", "option spec, bytes per option",
+           (double) spec_size / (double) bench_ascii.n_options);
+    printf("%-40s %10.1f B  plus %zu B per layer\n", "compiled option, bytes per option",
+           (double) (index->size - sizeof(*index)) / (double) bench_ascii.n_options, sizeof(*index));
+
+    int const           counter = bench_cache_misses_open();
+    size_t const        n_cases = sizeof(cases) / sizeof(*cases);
+    struct bench_result results[sizeof(cases) / sizeof(*cases)];
+    for(size_t i = 0; i < n_cases; i++) {
+        results[i] = bench_run(&cases[i], BENCH_ITERATIONS, counter);
+        for(size_t j = 1; j < BENCH_REPETITIONS; j++) {
+            struct bench_result const result = bench_run(&cases[i], BENCH_ITERATIONS, counter);
+            results[i].time         = result.time < results[i].time ? result.time : results[i].time;
+            results[i].cache_misses = result.cache_misses < results[i].cache_misses
+                                          ? result.cache_misses
+                                          : results[i].cache_misses;
+        }
+
+        printf("%-40s %10.1f ns", cases[i].name, results[i].time);
+        if(cases[i].baseline >= 0) {
+            printf("  %+6.1f%%", 100.0 * (results[i].time / results[cases[i].baseline].time - 1.0));
+        } else {
+            printf("  %7s", "");
+        }
+        if(results[i].cache_misses >= 0) {
+            printf("  %8.2f misses", results[i].cache_misses);
+        }
+        printf("\n");
+    }
+    if(counter < 0) {
+        printf("Cache misses aren't reported, since perf events aren't available.\n");
+    } else {
+        close(counter);
+    }
+}
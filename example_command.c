@@ -1,5 +1,5 @@
-#include <assert.h>
 #include "args-c.h"
+#include <assert.h>
 
 static struct ac_command_spec const example_command = {
     .help      = "A command for specifying fruit quantities.",
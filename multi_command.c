@@ -11,27 +11,10 @@ enum command_identifier {
 static struct ac_command_spec compression = {.help        = "Perform zlib compression.",
                                              .n_arguments = 1,
                                              .context     = (void *) COMPRESSION,
-                                             .arguments =
-                                                 (struct ac_argument_spec[]) {
-                                                     {
-                                                         .name = "FILE",
-                                                         .help = "A path to the file to compress.",
-                                                     },
-                                                 },
-                                             .n_options = 2,
-                                             .options   = (struct ac_option_spec[]) {
-                                                 {
-                                                       .help      = "The compression level to use.",
-                                                       .long_name = "level",
-                                                       .has_short_name = true,
-                                                       .short_name     = 'l',
-                                                 },
+                                             .arguments   = (struct ac_argument_spec[]) {
                                                  {
-                                                       .help = "Whether to print progress to stdout",
-                                                       .long_name      = "progress",
-                                                       .has_short_name = true,
-                                                       .short_name     = 'p',
-                                                       .is_flag        = true,
+                                                       .name = "FILE",
+                                                       .help = "A path to the file to compress.",
                                                  },
                                              }};
 
@@ -39,13 +22,17 @@ static struct ac_command_spec decompression = {
     .help        = "Perform zlib decompression.",
     .n_arguments = 1,
     .context     = (void *) DECOMPRESSION,
-    .arguments =
-        (struct ac_argument_spec[]) {
-            {
-                .name = "FILE",
-                .help = "A path to the file to decompress.",
-            },
+    .arguments   = (struct ac_argument_spec[]) {
+        {
+              .name = "FILE",
+              .help = "A path to the file to decompress.",
         },
+    }};
+
+static struct ac_multi_command_spec multi_command = {
+    .help = "A zlib compress command line utility",
+    // Options declared on a multi-command apply to all of its subcommands, and may be used either
+    // before or after the subcommand name.
     .n_options = 2,
     .options   = (struct ac_option_spec[]) {
         {
@@ -53,6 +40,7 @@ static struct ac_command_spec decompression = {
               .long_name      = "level",
               .has_short_name = true,
               .short_name     = 'l',
+              .default_value  = "6",
         },
         {
               .help           = "Whether to print progress to stdout",
@@ -61,10 +49,7 @@ static struct ac_command_spec decompression = {
               .short_name     = 'p',
               .is_flag        = true,
         },
-    }};
-
-static struct ac_multi_command_spec multi_command = {
-    .help          = "A zlib compress command line utility",
+    },
     .n_subcommands = 2,
     .subcommands =
         (struct ac_multi_command_subcommand[]) {
@@ -83,7 +68,23 @@ static struct ac_multi_command_spec multi_command = {
         },
 };
 
+// `ac-specc` includes this file to compile `multi_command` into a spec image, and has its own main.
+#ifndef AC_SPECC
 int main(int argc, char const *const argv[]) {
+    // Shell completion scripts call back into the program to get completion candidates.
+    if(argc > 1 && 0 == strcmp(argv[1], AC_COMPLETE_COMMAND)) {
+        return ac_multi_command_complete_print(argc - 2, &argv[2], &multi_command, stdout).code;
+    }
+    if(argc > 2 && 0 == strcmp(argv[1], "__script")) {
+        enum ac_shell const shell = 0 == strcmp(argv[2], "zsh")    ? SHELL_ZSH
+                                    : 0 == strcmp(argv[2], "fish") ? SHELL_FISH
+                                                                   : SHELL_BASH;
+        char *const         script = ac_completion_script(shell, "args-c-multi");
+        printf("%s", script);
+        free(script);
+        return 0;
+    }
+
     if(argc <= 1) {
         // The @c ac_multi_command_help function is used for generating a help string. This returns
         // an owned string, so the caller is responsible outputting and freeing the buffer.
@@ -128,11 +129,9 @@ int main(int argc, char const *const argv[]) {
     bool progress = ac_extract_option(&args, "progress") != NULL;
     printf("tracking progress: %s\n", progress ? "YES" : "NO");
 
-    // Default values are handled by the caller. If `level` is not in the output structure, then a
-    // default may be chosen instead.
-    struct ac_option *level_opt = ac_extract_option(&args, "level");
-    char             *level     = (level_opt && level_opt->value) ? level_opt->value : "DEFAULT";
-    printf("level set to: %s\n", level);
+    // Options with a `default_value` are always in the output structure, so their value can be used
+    // directly.
+    printf("level set to: %s\n", ac_extract_option(&args, "level")->value);
 
     // ... do something with the parsed command.
 
@@ -141,3 +140,4 @@ int main(int argc, char const *const argv[]) {
 
     return 0;
 }
+#endif
@@ -0,0 +1,362 @@
+// Performance budget tests. Each case builds a pathological input at a small and a large size, and
+// fails when the time or the number of allocations of the large size grows faster than linearly
+// from the small one, so that a parser that goes quadratic fails the build.
+//
+// Allocations are counted by redirecting the allocator calls of args-c.h, which is why the standard
+// headers are included first. That means the POSIX features that args-c.h asks for have to be
+// requested here instead.
+#define _POSIX_C_SOURCE 200809L
+#if defined(__APPLE__)
+#define _DARWIN_C_SOURCE
+#elif defined(__linux__)
+#define _DEFAULT_SOURCE
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static struct {
+    size_t allocations;
+} perf_counters;
+
+static void *perf_malloc(size_t const size) {
+    perf_counters.allocations++;
+    return malloc(size);
+}
+
+static void *perf_calloc(size_t const count, size_t const size) {
+    perf_counters.allocations++;
+    return calloc(count, size);
+}
+
+static void *perf_realloc(void *const pointer, size_t const size) {
+    perf_counters.allocations++;
+    return realloc(pointer, size);
+}
+
+#define malloc(size) perf_malloc(size)
+#define calloc(count, size) perf_calloc(count, size)
+#define realloc(pointer, size) perf_realloc(pointer, size)
+#include "args-c.h"
+#undef malloc
+#undef calloc
+#undef realloc
+
+enum {
+    PERF_REPETITIONS = 7,
+    // The large size of each case is this many times the small size.
+    PERF_SCALE = 8,
+    // The large size may take this many times longer than linear growth predicts, which absorbs
+    // timer noise but not quadratic growth, which would take PERF_SCALE times longer again.
+    PERF_TIME_SLACK = 3,
+    // The number of allocations may grow linearly from this many, like a table that only spills
+    // from the stack to the heap for the large size.
+    PERF_ALLOCATIONS_BASE = 4,
+};
+
+// A case runs `run` on an input of size `n`, which is built by `setup`. Inputs that are memoized by
+// the address of their spec are built again for each repetition.
+struct perf_case {
+    char const *name;
+    size_t      n;
+    void *(*setup)(size_t n);
+    void (*run)(void *input);
+    bool cold;
+};
+
+struct perf_sample {
+    double time;
+    size_t allocations;
+};
+
+static double perf_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec * 1e9 + (double) now.tv_nsec;
+}
+
+static void perf_expect(bool const condition, char const *const what) {
+    if(!condition) {
+        fprintf(stderr, "perf: %s\n", what);
+        exit(1);
+    }
+}
+
+// `prefix` followed by `value` in base 26, since names are made of letters. Inputs are never
+// freed, since memoized structures are keyed on their addresses.
+static char *perf_name(char const *const prefix, size_t value) {
+    size_t const length = strlen(prefix);
+    char *const  name   = (char *) malloc(length + 5);
+    memcpy(name, prefix, length);
+    for(size_t i = 0; i < 4; i++, value /= 26) {
+        name[length + 3 - i] = (char) ('a' + value % 26);
+    }
+    name[length + 4] = '\0';
+    return name;
+}
+
+// Thousands of long option names that only differ in their last few characters.
+
+struct perf_names {
+    struct ac_command_spec command;
+    char const            *argv[MAX_NUM_ARGS];
+    int                    argc;
+};
+
+static void *perf_names_setup(size_t const n) {
+    struct perf_names *const input = (struct perf_names *) calloc(1, sizeof(*input));
+    input->command.help            = "Near-identical names.";
+    input->command.n_options       = n;
+    input->command.options         = (struct ac_option_spec *) calloc(n, sizeof(struct ac_option_spec));
+    for(size_t i = 0; i < n; i++) {
+        input->command.options[i].long_name =
+            perf_name("optionwithalongsharedprefixforeveryname", i);
+    }
+
+    for(size_t i = 0; i + 1 < MAX_NUM_ARGS; i += 2) {
+        input->argv[i]     = perf_name("--optionwithalongsharedprefixforeveryname", (i * 7919) % n);
+        input->argv[i + 1] = "value";
+        input->argc        = (int) i + 2;
+    }
+    return input;
+}
+
+static void perf_names_validate(void *const context) {
+    struct perf_names const *const input = (struct perf_names const *) context;
+    perf_expect(ac_command_validate(&input->command).code == AC_ERROR_SUCCESS, "names are invalid");
+}
+
+static void perf_names_parse(void *const context) {
+    struct perf_names const *const input = (struct perf_names const *) context;
+    struct ac_command              args  = {0};
+    struct ac_status const status = ac_command_parse(input->argc, input->argv, &input->command, &args);
+    perf_expect(status.code == AC_ERROR_SUCCESS, "names didn't parse");
+    ac_command_release(&args);
+}
+
+static void perf_names_suggest(void *const context) {
+    struct perf_names const *const input   = (struct perf_names const *) context;
+    char const *const              argv[]  = {"--optionwithalongsharedprefixforeverynamexyz"};
+    struct ac_command              args    = {0};
+    struct ac_status const         status  = ac_command_parse(1, argv, &input->command, &args);
+    char *const                    message = ac_status_string(status);
+    perf_expect(status.code == AC_ERROR_OPTION_NAME_NOT_IN_SPEC && message != NULL, "no suggestion");
+    free(message);
+}
+
+// Tokens up to MAX_STRING_LEN, with values attached by '=' and validated as UTF-8.
+
+static struct ac_command_spec const perf_tokens_command = {
+    .help        = "Long tokens.",
+    .n_arguments = 1,
+    .arguments   = (struct ac_argument_spec[]) {{.name = "INPUT"}},
+    .n_options   = 1,
+    .options     = (struct ac_option_spec[]) {{.long_name = "comment"}},
+    .utf8        = true,
+};
+
+struct perf_tokens {
+    char const *argv[MAX_NUM_ARGS];
+};
+
+static void *perf_tokens_setup(size_t const n) {
+    struct perf_tokens *const input = (struct perf_tokens *) calloc(1, sizeof(*input));
+    for(size_t i = 0; i < MAX_NUM_ARGS; i++) {
+        char *const token = (char *) malloc(n + 1);
+        memset(token, 'a' + (char) (i % 26), n);
+        if(i > 0) {
+            memcpy(token, "--comment=", 10);
+        }
+        // A multibyte character at the end of each token.
+        memcpy(&token[n - 2], "\xc3\xa9", 2);
+        token[n]       = '\0';
+        input->argv[i] = token;
+    }
+    return input;
+}
+
+static void perf_tokens_parse(void *const context) {
+    struct perf_tokens const *const input = (struct perf_tokens const *) context;
+    struct ac_command               args  = {0};
+    struct ac_status const status = ac_command_parse(MAX_NUM_ARGS, input->argv, &perf_tokens_command, &args);
+    perf_expect(status.code == AC_ERROR_SUCCESS, "long tokens didn't parse");
+    ac_command_release(&args);
+}
+
+// A chain of multi-commands, each with its own options, where the options of the root are used
+// below the leaf.
+
+struct perf_tree {
+    struct ac_multi_command_spec *root;
+    char const                   *argv[MAX_NUM_ARGS];
+    int                           argc;
+};
+
+static void *perf_tree_setup(size_t const n) {
+    struct perf_tree *const input = (struct perf_tree *) calloc(1, sizeof(*input));
+    struct ac_multi_command_spec *const multis =
+        (struct ac_multi_command_spec *) calloc(n, sizeof(*multis));
+    struct ac_multi_command_subcommand *const subcommands =
+        (struct ac_multi_command_subcommand *) calloc(n, sizeof(*subcommands));
+    struct ac_command_spec *const leaf = (struct ac_command_spec *) calloc(1, sizeof(*leaf));
+    leaf->help                         = "The leaf.";
+
+    for(size_t i = 0; i < n; i++) {
+        multis[i].help      = "A level of the tree.";
+        multis[i].n_options = 4;
+        multis[i].options   = (struct ac_option_spec *) calloc(4, sizeof(struct ac_option_spec));
+        for(size_t j = 0; j < 4; j++) {
+            multis[i].options[j].long_name = perf_name(j == 0 ? "level" : "extra", i * 4 + j);
+            multis[i].options[j].is_flag   = true;
+        }
+        multis[i].n_subcommands = 1;
+        multis[i].subcommands   = &subcommands[i];
+        subcommands[i].name     = perf_name("level", i);
+        subcommands[i].type     = i + 1 < n ? COMMAND_MULTI : COMMAND_SINGLE;
+        if(i + 1 < n) {
+            subcommands[i].multi = &multis[i + 1];
+        } else {
+            subcommands[i].single = leaf;
+        }
+    }
+
+    input->root = multis;
+    for(size_t i = 0; i < n; i++) {
+        input->argv[input->argc++] = subcommands[i].name;
+    }
+    while(input->argc < MAX_NUM_ARGS) {
+        input->argv[input->argc++] = "--levelaaaa";
+    }
+    return input;
+}
+
+static void perf_tree_validate(void *const context) {
+    struct perf_tree const *const input = (struct perf_tree const *) context;
+    perf_expect(ac_multi_command_validate(input->root).code == AC_ERROR_SUCCESS, "tree is invalid");
+}
+
+static void perf_tree_parse(void *const context) {
+    struct perf_tree const *const input = (struct perf_tree const *) context;
+    struct ac_command             args  = {0};
+    struct ac_status const status = ac_multi_command_parse(input->argc, input->argv, input->root, &args);
+    perf_expect(status.code == AC_ERROR_SUCCESS, "tree didn't parse");
+    ac_command_release(&args);
+}
+
+static void perf_tree_help(void *const context) {
+    struct perf_tree const *const input = (struct perf_tree const *) context;
+    char *const                   help  = ac_multi_command_help_tree(input->root, "tool", 0);
+    perf_expect(help != NULL, "tree help failed");
+    free(help);
+}
+
+// As many elements of argv as are allowed, mixing clusters, attached values and separate values.
+
+static struct ac_command_spec const perf_argv_command = {
+    .help      = "Maximal argv.",
+    .n_options = 4,
+    .options   = (struct ac_option_spec[]) {{.long_name = "verbose", .has_short_name = true, .short_name = 'v', .is_flag = true},
+                                            {.long_name = "quiet", .has_short_name = true, .short_name = 'q', .is_flag = true},
+                                            {.long_name = "level", .has_short_name = true, .short_name = 'l'},
+                                            {.long_name = "format"}},
+};
+
+struct perf_argv {
+    char const *argv[MAX_NUM_ARGS];
+    int         argc;
+};
+
+static void *perf_argv_setup(size_t const n) {
+    static char const *const pattern[] = {"-vq", "-l", "9", "--format=json", "--level", "3", "-qv"};
+    struct perf_argv *const  input     = (struct perf_argv *) calloc(1, sizeof(*input));
+    for(size_t i = 0; i < n; i++) {
+        input->argv[i] = pattern[i % (sizeof(pattern) / sizeof(*pattern))];
+    }
+    // The pattern may stop after an option that takes a value.
+    input->argc = (int) n;
+    if(0 == strcmp(input->argv[n - 1], "-l") || 0 == strcmp(input->argv[n - 1], "--level")) {
+        input->argv[n - 1] = "-v";
+    }
+    return input;
+}
+
+static void perf_argv_parse(void *const context) {
+    struct perf_argv const *const input = (struct perf_argv const *) context;
+    struct ac_command             args  = {0};
+    struct ac_status const status = ac_command_parse(input->argc, input->argv, &perf_argv_command, &args);
+    perf_expect(status.code == AC_ERROR_SUCCESS, "argv didn't parse");
+    ac_command_release(&args);
+}
+
+// Sizes are chosen so that the large size is PERF_SCALE times the small one.
+static struct perf_case const cases[][2] = {
+    {{"near-identical names, validate", 500, perf_names_setup, perf_names_validate, true},
+     {"near-identical names, validate", 4000, perf_names_setup, perf_names_validate, true}},
+    {{"near-identical names, first parse", 500, perf_names_setup, perf_names_parse, true},
+     {"near-identical names, first parse", 4000, perf_names_setup, perf_names_parse, true}},
+    {{"near-identical names, suggestion", 500, perf_names_setup, perf_names_suggest, true},
+     {"near-identical names, suggestion", 4000, perf_names_setup, perf_names_suggest, true}},
+    {{"long tokens, parse", 512, perf_tokens_setup, perf_tokens_parse, false},
+     {"long tokens, parse", 4096 - 1, perf_tokens_setup, perf_tokens_parse, false}},
+    {{"deep tree, validate", 16, perf_tree_setup, perf_tree_validate, true},
+     {"deep tree, validate", 128, perf_tree_setup, perf_tree_validate, true}},
+    {{"deep tree, parse", 16, perf_tree_setup, perf_tree_parse, false},
+     {"deep tree, parse", 128, perf_tree_setup, perf_tree_parse, false}},
+    {{"deep tree, help", 16, perf_tree_setup, perf_tree_help, false},
+     {"deep tree, help", 128, perf_tree_setup, perf_tree_help, false}},
+    {{"maximal argv, parse", 32, perf_argv_setup, perf_argv_parse, false},
+     {"maximal argv, parse", 256, perf_argv_setup, perf_argv_parse, false}},
+};
+
+// The best time and the allocations of one run of `perf`. Warm cases are run once before they're
+// measured, so that memoized structures are built.
+static struct perf_sample perf_measure(struct perf_case const *const perf) {
+    struct perf_sample sample = {.time = -1};
+    void              *input  = perf->cold ? NULL : perf->setup(perf->n);
+    if(input != NULL) {
+        perf->run(input);
+    }
+
+    for(size_t i = 0; i < PERF_REPETITIONS; i++) {
+        if(perf->cold) {
+            input = perf->setup(perf->n);
+        }
+
+        size_t const allocations = perf_counters.allocations;
+        double const start       = perf_now();
+        perf->run(input);
+        double const time        = perf_now() - start;
+
+        sample.allocations = perf_counters.allocations - allocations;
+        sample.time        = sample.time < 0 || time < sample.time ? time : sample.time;
+    }
+    return sample;
+}
+
+int main() {
+    size_t const n_cases  = sizeof(cases) / sizeof(*cases);
+    size_t       failures = 0;
+    for(size_t i = 0; i < n_cases; i++) {
+        struct perf_case const  *small  = &cases[i][0];
+        struct perf_case const  *large  = &cases[i][1];
+        struct perf_sample const before = perf_measure(small);
+        struct perf_sample const after  = perf_measure(large);
+
+        double const scale       = (double) large->n / (double) small->n;
+        bool const   time_ok     = after.time <= before.time * scale * PERF_TIME_SLACK;
+        bool const   alloc_ok    = (double) after.allocations <=
+                              (double) (before.allocations + PERF_ALLOCATIONS_BASE) * scale;
+        failures += time_ok && alloc_ok ? 0 : 1;
+
+        printf("%-36s n=%-5zu %10.1f us %6zu allocs | n=%-5zu %10.1f us %6zu allocs  %s\n",
+               small->name, small->n, before.time / 1e3, before.allocations, large->n,
+               after.time / 1e3, after.allocations,
+               time_ok && alloc_ok ? "ok" : !time_ok ? "TIME OVER BUDGET" : "ALLOCATIONS OVER BUDGET");
+    }
+
+    if(failures > 0) {
+        fprintf(stderr, "perf: %zu cases are over budget\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,40 @@
+// ac-specc compiles a multi-command specification into a spec image at build time. The program
+// then loads the image with `ac_spec_image_map` instead of building the spec structures at startup.
+//
+// The spec is compiled into this tool. `AC_SPECC_SOURCE` names a source file that defines the root
+// `ac_multi_command_spec`, and `AC_SPECC_ROOT` names the variable. `AC_SPECC` is defined while the
+// source file is included, so it can exclude its own `main`.
+#define AC_SPECC
+#include "args-c.h"
+#include AC_SPECC_SOURCE
+
+int main(int argc, char const *const argv[]) {
+    if(argc != 2) {
+        fprintf(stderr, "Usage: %s <output image path>\n", argv[0]);
+        return -1;
+    }
+
+    struct ac_status result = ac_multi_command_validate(&AC_SPECC_ROOT);
+    if(!ac_status_is_success(result)) {
+        fprintf(stderr, "%s", ac_status_string(result));
+        return -1;
+    }
+
+    void  *image    = NULL;
+    size_t image_sz = 0;
+    result          = ac_spec_image_compile(&AC_SPECC_ROOT, &image, &image_sz);
+    if(!ac_status_is_success(result)) {
+        fprintf(stderr, "%s", ac_status_string(result));
+        return -1;
+    }
+
+    FILE *const output = fopen(argv[1], "wb");
+    if(output == NULL || fwrite(image, 1, image_sz, output) != image_sz) {
+        fprintf(stderr, "Failed to write %s\n", argv[1]);
+        return -1;
+    }
+
+    fclose(output);
+    free(image);
+    return 0;
+}
@@ -49,7 +49,7 @@ static struct ac_command_spec const command1 = {
 };
 
 static void test_command_1() {
-    printf("%s\n", ac_command_help(&command1));
+    printf("%s\n", ac_command_help(&command1, NULL));
     assert_int_eq(ac_command_validate(&command1).code, AC_ERROR_SUCCESS);
 
     char const *const                   argv1[]     = {};
@@ -100,7 +100,7 @@ static struct ac_command_spec const command2 = {
                                           }}};
 
 static void test_command_2() {
-    printf("%s\n", ac_command_help(&command2));
+    printf("%s\n", ac_command_help(&command2, NULL));
     assert_int_eq(ac_command_validate(&command2).code, AC_ERROR_SUCCESS);
 
     char const *const                   argv1[]     = {};
@@ -217,7 +217,7 @@ static struct ac_command_spec const command3 = {.help        = "Testing command
                                                 }};
 
 static void test_command_3() {
-    printf("%s\n", ac_command_help(&command3));
+    printf("%s\n", ac_command_help(&command3, NULL));
     assert_int_eq(ac_command_validate(&command3).code, AC_ERROR_SUCCESS);
 
     char const *const                   argv1[]     = {};
@@ -301,7 +301,7 @@ static struct ac_multi_command_spec const command4 = {
                        .single = (struct ac_command_spec *) &command3}}}}}}};
 
 static void test_command_4() {
-    printf("%s\n", ac_multi_command_help(&command4));
+    printf("%s\n", ac_multi_command_help(&command4, NULL));
     assert_int_eq(ac_multi_command_validate(&command4).code, AC_ERROR_SUCCESS);
 
     char const *const argv1[] = {""};
@@ -359,6 +359,1640 @@ static void test_command_4() {
     assert_sizet_eq(args.n_options, 1UL);
     assert_ptr_neq(args.arguments, NULL);
     assert_ptr_neq(args.options, NULL);
+
+    // Subcommands are still found after they're renamed in place.
+    char                               name[8]       = "build";
+    struct ac_multi_command_subcommand subcommands[] = {
+        {.name = "test", .type = COMMAND_SINGLE, .single = (struct ac_command_spec *) &command2},
+        {.name = name, .type = COMMAND_SINGLE, .single = (struct ac_command_spec *) &command1}};
+    struct ac_multi_command_spec renamed = {.n_subcommands = 2, .subcommands = subcommands};
+    char const *const            argv7[] = {"build"};
+    assert_int_eq(ac_multi_command_parse(1, argv7, &renamed, &args).code, AC_ERROR_SUCCESS);
+    assert_ptr_eq(args.command, &command1);
+    ac_command_release(&args);
+
+    strcpy(name, "run");
+    char const *const argv8[] = {"run"};
+    assert_int_eq(ac_multi_command_parse(1, argv8, &renamed, &args).code, AC_ERROR_SUCCESS);
+    assert_ptr_eq(args.command, &command1);
+    ac_command_release(&args);
+    assert_int_eq(ac_multi_command_parse(1, argv7, &renamed, &args).code, AC_ERROR_COMMAND_NAME_NOT_IN_SPEC);
+}
+
+static bool count_stream_argument(char const *value, size_t index, void *context) {
+    char expected[32];
+    snprintf(expected, sizeof(expected), "/path/to/%zu", index);
+    assert_str_eq(value, expected);
+    (*(size_t *) context)++;
+    return true;
+}
+
+static void test_argument_stream() {
+    // Write more data than fits in the stream buffer to make sure partial arguments are carried
+    // over between reads.
+    int fds[2];
+    assert_int_eq(pipe(fds), 0);
+    size_t const n_paths = 2000;
+    for(size_t i = 0; i < n_paths; i++) {
+        char path[32];
+        int  len = snprintf(path, sizeof(path), "/path/to/%zu", i);
+        assert_int_eq((int) write(fds[1], path, len + 1), len + 1);
+    }
+    close(fds[1]);
+
+    size_t           n_read = 0;
+    struct ac_status result =
+        ac_argument_stream_foreach(fds[0], STREAM_DELIMITER_NUL, count_stream_argument, &n_read);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+    assert_sizet_eq(n_read, n_paths);
+    close(fds[0]);
+
+    // The final argument doesn't need a delimiter.
+    assert_int_eq(pipe(fds), 0);
+    assert_int_eq((int) write(fds[1], "a\nbb\nccc", 8), 8);
+    close(fds[1]);
+
+    struct ac_argument_stream stream;
+    char const               *value = NULL;
+    assert_int_eq(ac_argument_stream_init(&stream, fds[0], STREAM_DELIMITER_NEWLINE).code,
+                  AC_ERROR_SUCCESS);
+    assert_int_eq(ac_argument_stream_next(&stream, &value).code, AC_ERROR_SUCCESS);
+    assert_str_eq(value, "a");
+    assert_int_eq(ac_argument_stream_next(&stream, &value).code, AC_ERROR_SUCCESS);
+    assert_str_eq(value, "bb");
+    assert_int_eq(ac_argument_stream_next(&stream, &value).code, AC_ERROR_SUCCESS);
+    assert_str_eq(value, "ccc");
+    assert_int_eq(ac_argument_stream_next(&stream, &value).code, AC_ERROR_SUCCESS);
+    assert_ptr_eq(value, NULL);
+    close(fds[0]);
+
+    // Arguments longer than MAX_STRING_LEN are rejected.
+    assert_int_eq(pipe(fds), 0);
+    char long_value[MAX_STRING_LEN + 2];
+    memset(long_value, 'x', sizeof(long_value));
+    assert_int_eq((int) write(fds[1], long_value, sizeof(long_value)), (int) sizeof(long_value));
+    close(fds[1]);
+    assert_int_eq(ac_argument_stream_init(&stream, fds[0], STREAM_DELIMITER_NUL).code,
+                  AC_ERROR_SUCCESS);
+    result = ac_argument_stream_next(&stream, &value);
+    assert_int_eq(result.code, AC_ERROR_STREAM_ARGUMENT_TOO_LONG);
+    assert_ptr_eq(value, NULL);
+    close(fds[0]);
+
+    // They're rejected even when their delimiter arrives in the same read.
+    assert_int_eq(pipe(fds), 0);
+    long_value[MAX_STRING_LEN + 1] = '\0';
+    assert_int_eq((int) write(fds[1], long_value, sizeof(long_value)), (int) sizeof(long_value));
+    close(fds[1]);
+    assert_int_eq(ac_argument_stream_init(&stream, fds[0], STREAM_DELIMITER_NUL).code,
+                  AC_ERROR_SUCCESS);
+    result = ac_argument_stream_next(&stream, &value);
+    assert_int_eq(result.code, AC_ERROR_STREAM_ARGUMENT_TOO_LONG);
+    assert_ptr_eq(value, NULL);
+    close(fds[0]);
+}
+
+static void test_command_serialize() {
+    char const *const argv[] = {"subcommand3", "command3", "/path/to/a", "/path/to/b",
+                                "--banana",    "10",       "-c"};
+    struct ac_command args   = {0};
+    struct ac_status  result = ac_multi_command_parse(7, argv, &command4, &args);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+
+    size_t size = 0;
+    result      = ac_command_serialize(&args, NULL, 0, &size);
+    assert_int_eq(result.code, AC_ERROR_BUFFER_TOO_SMALL);
+
+    unsigned char *const blob = malloc(size);
+    result                    = ac_command_serialize(&args, blob, size, &size);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+    ac_command_release(&args);
+
+    struct ac_command_view view = {0};
+    result                      = ac_command_view_from_blob(blob, size, &command2, &view);
+    assert_int_eq(result.code, AC_ERROR_BLOB_FINGERPRINT_MISMATCH);
+    result = ac_command_view_from_blob(blob, size - 1, &command3, &view);
+    assert_int_eq(result.code, AC_ERROR_BLOB_INVALID);
+
+    result = ac_multi_command_view_from_blob(blob, size, &command4, &view);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+    assert_ptr_eq(view.command, &command3);
+    assert_sizet_eq(view.n_arguments, 2UL);
+    assert_sizet_eq(view.n_options, 2UL);
+    assert_str_eq(ac_command_view_argument(&view, 0), "/path/to/a");
+    assert_str_eq(ac_command_view_argument(&view, 1), "/path/to/b");
+    assert_ptr_eq(ac_command_view_argument(&view, 2), NULL);
+
+    char const *value = NULL;
+    assert_ptr_eq(ac_command_view_option(&view, 0, &value), &command3.options[1]);
+    assert_str_eq(value, "10");
+    assert_ptr_eq(ac_command_view_option(&view, 1, &value), &command3.options[2]);
+    assert_ptr_eq(value, NULL);
+    assert_ptr_eq(ac_command_view_option(&view, 2, &value), NULL);
+
+    free(blob);
+}
+
+static void test_spec_image() {
+    void  *buffer    = NULL;
+    size_t buffer_sz = 0;
+    assert_int_eq(ac_spec_image_compile(&command4, &buffer, &buffer_sz).code, AC_ERROR_SUCCESS);
+
+    // Corrupt images are rejected when they're loaded, rather than read out of bounds when parsing.
+    struct ac_spec_image          image   = {0};
+    void *const                   corrupt = malloc(buffer_sz);
+    struct ac_image_header *const header  = (struct ac_image_header *) corrupt;
+    memcpy(corrupt, buffer, buffer_sz);
+    struct ac_image_node *const nodes = (struct ac_image_node *) &((char *) corrupt)[header->nodes];
+    header->size = (uint32_t) (buffer_sz - 8);
+    assert_int_eq(ac_spec_image_from_buffer(corrupt, buffer_sz - 8, &image).code, AC_ERROR_BLOB_INVALID);
+    memcpy(corrupt, buffer, buffer_sz);
+    nodes[header->root].n_options = UINT32_MAX;
+    assert_int_eq(ac_spec_image_from_buffer(corrupt, buffer_sz, &image).code, AC_ERROR_BLOB_INVALID);
+    memcpy(corrupt, buffer, buffer_sz);
+    nodes[1].n_slots = 0;
+    assert_int_eq(ac_spec_image_from_buffer(corrupt, buffer_sz, &image).code, AC_ERROR_BLOB_INVALID);
+    memcpy(corrupt, buffer, buffer_sz);
+    nodes[1].help = (uint32_t) buffer_sz - 1;
+    ((char *) corrupt)[buffer_sz - 1] = 'x';
+    assert_int_eq(ac_spec_image_from_buffer(corrupt, buffer_sz, &image).code, AC_ERROR_BLOB_INVALID);
+    memcpy(corrupt, buffer, buffer_sz);
+    assert_int_eq(ac_spec_image_from_buffer(corrupt, buffer_sz, &image).code, AC_ERROR_SUCCESS);
+    free(corrupt);
+
+    char path[] = "/tmp/args-c-test-XXXXXX";
+    int  fd     = mkstemp(path);
+    assert_int_eq((int) write(fd, buffer, buffer_sz), (int) buffer_sz);
+    close(fd);
+    free(buffer);
+
+    struct ac_status result = ac_spec_image_map(path, &image);
+    unlink(path);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+
+    char const *const       argv1[] = {"subcommand3", "command3", "/path/to/a",
+                                       "/path/to/b",  "--banana", "10", "-c"};
+    struct ac_image_command args    = {0};
+    result                          = ac_spec_image_parse(&image, 7, argv1, &args);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+    assert_sizet_eq(args.n_arguments, 2UL);
+    assert_str_eq(args.arguments[1], "/path/to/b");
+    assert_sizet_eq(args.n_options, 2UL);
+    struct ac_image_option_value *banana = ac_image_extract_option(&args, "banana");
+    assert_ptr_neq(banana, NULL);
+    assert_str_eq(banana->value, "10");
+    assert_ptr_neq(ac_image_extract_option(&args, "cherry"), NULL);
+    assert_ptr_eq(ac_image_extract_option(&args, "apple"), NULL);
+    ac_image_command_release(&args);
+
+    char const *const argv2[] = {"command2", "--banana", "-1"};
+    result                    = ac_spec_image_parse(&image, 3, argv2, &args);
+    assert_int_eq(result.code, AC_ERROR_OPTION_NAME_REQUIRED_IN_SPEC);
+
+    char const *const argv3[] = {"command2", "--dragon", "1"};
+    result                    = ac_spec_image_parse(&image, 3, argv3, &args);
+    assert_int_eq(result.code, AC_ERROR_OPTION_NAME_NOT_IN_SPEC);
+
+    char const *const argv4[] = {"subcommand3", "blah"};
+    result                    = ac_spec_image_parse(&image, 2, argv4, &args);
+    assert_int_eq(result.code, AC_ERROR_COMMAND_NAME_NOT_IN_SPEC);
+
+    char const *const argv5[] = {"command2", "-a", "5"};
+    result                    = ac_spec_image_parse(&image, 3, argv5, &args);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+    assert_sizet_eq(args.n_options, 1UL);
+    assert_str_eq(ac_image_extract_option(&args, "apple")->value, "5");
+    ac_image_command_release(&args);
+
+    ac_spec_image_unmap(&image);
+}
+
+static size_t n_resolved = 0;
+
+static bool resolve_command3(char const *name, void *context,
+                             struct ac_multi_command_subcommand *resolved) {
+    n_resolved++;
+    // Give concurrent parses time to find the subcommand unresolved.
+    usleep(1000);
+    assert_str_eq(name, "lazy3");
+    resolved->type   = COMMAND_SINGLE;
+    resolved->single = (struct ac_command_spec *) context;
+    return true;
+}
+
+static struct ac_multi_command_spec const command5 = {
+    .help          = "Lazy commands",
+    .n_subcommands = 2,
+    .subcommands   = (struct ac_multi_command_subcommand[]) {
+        {
+              .name   = "command1",
+              .type   = COMMAND_SINGLE,
+              .single = (struct ac_command_spec *) &command1,
+        },
+        {
+              .name             = "lazy3",
+              .type             = COMMAND_LAZY,
+              .resolver         = resolve_command3,
+              .resolver_context = (void *) &command3,
+              .help             = "A lazily resolved command",
+        }}};
+
+static void *lazy_worker(void *const root) {
+    char const *const argv[] = {"lazy3", "/path/to/a", "/path/to/b"};
+    struct ac_command args   = {0};
+    assert_int_eq(ac_multi_command_parse(3, argv, (struct ac_multi_command_spec const *) root, &args).code,
+                  AC_ERROR_SUCCESS);
+    assert_ptr_eq(args.command, &command3);
+    ac_command_release(&args);
+    return NULL;
+}
+
+static void test_lazy_command() {
+    // Codes keep their values, since resolving failures was added after the stream and blob ones.
+    assert_int_eq(AC_ERROR_MULTICOMMAND_NEEDS_NAME, 19);
+    assert_int_eq(AC_ERROR_STREAM_READ_FAILED, 20);
+    assert_int_eq(AC_ERROR_COMMAND_RESOLVE_FAILED, AC_ERROR_FILE_OPEN_FAILED + 1);
+
+    printf("%s\n", ac_multi_command_help(&command5, NULL));
+    assert_int_eq(ac_multi_command_validate(&command5).code, AC_ERROR_SUCCESS);
+
+    struct ac_command args     = {0};
+    char const *const argv1[] = {"command1"};
+    struct ac_status  result   = ac_multi_command_parse(1, argv1, &command5, &args);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+    assert_sizet_eq(n_resolved, 0UL);
+
+    // Concurrent parses resolve the subcommand once, and the spec isn't modified.
+    pthread_t threads[4];
+    for(size_t i = 0; i < 4; i++) {
+        assert_int_eq(pthread_create(&threads[i], NULL, lazy_worker, (void *) &command5), 0);
+    }
+    for(size_t i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    lazy_worker((void *) &command5);
+    assert_sizet_eq(n_resolved, 1UL);
+    assert_int_eq(command5.subcommands[1].type, COMMAND_LAZY);
+}
+
+static struct ac_multi_command_spec const command6 = {
+    .help      = "Inherited options",
+    .n_options = 2,
+    .options   = (struct ac_option_spec[]) {{
+                                                .long_name      = "verbose",
+                                                .has_short_name = true,
+                                                .short_name     = 'v',
+                                                .is_flag        = true,
+                                          },
+                                            {
+                                                .long_name = "token",
+                                                .required  = true,
+                                          }},
+    .n_subcommands = 2,
+    .subcommands   = (struct ac_multi_command_subcommand[]) {
+        {
+              .name   = "command2",
+              .type   = COMMAND_SINGLE,
+              .single = (struct ac_command_spec *) &command2,
+        },
+        {
+              .name  = "nested",
+              .type  = COMMAND_MULTI,
+              .multi = (struct ac_multi_command_spec[]) {
+                {.n_options     = 1,
+                   .options       = (struct ac_option_spec[]) {{.long_name = "cherry"}},
+                   .n_subcommands = 1,
+                   .subcommands   = (struct ac_multi_command_subcommand[]) {
+                     {.name   = "command3",
+                        .type   = COMMAND_SINGLE,
+                        .single = (struct ac_command_spec *) &command3}}}}}}};
+
+static void test_inherited_options() {
+    printf("%s\n", ac_multi_command_help(&command6, NULL));
+    assert_int_eq(ac_multi_command_validate(&command6).code, AC_ERROR_SUCCESS);
+
+    struct ac_command args     = {0};
+    char const *const argv1[] = {"-v", "command2", "-a", "5"};
+    struct ac_status  result   = ac_multi_command_parse(4, argv1, &command6, &args);
+    assert_int_eq(result.code, AC_ERROR_OPTION_NAME_REQUIRED_IN_SPEC);
+    assert_str_eq((char *) result.context, "token");
+
+    char const *const argv2[] = {"--token", "t", "-v", "command2", "-a", "5"};
+    result                    = ac_multi_command_parse(6, argv2, &command6, &args);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+    assert_ptr_eq(args.command, &command2);
+    assert_sizet_eq(args.n_options, 3UL);
+    assert_str_eq(ac_extract_option(&args, "apple")->value, "5");
+    assert_str_eq(ac_extract_option(&args, "token")->value, "t");
+    assert_ptr_eq(ac_extract_option(&args, "verbose")->option, &command6.options[0]);
+    assert_sizet_eq(args.n_parents, 1UL);
+    ac_command_release(&args);
+
+    // A command's own options take precedence over the inherited ones.
+    char const *const argv3[] = {"nested", "command3", "/path/to/a", "/path/to/b",
+                                 "--cherry", "--token",  "t"};
+    result                    = ac_multi_command_parse(7, argv3, &command6, &args);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+    assert_ptr_eq(ac_extract_option(&args, "cherry")->option, &command3.options[2]);
+    assert_sizet_eq(args.n_parents, 2UL);
+
+    // Inherited options survive serialization.
+    unsigned char blob[0x200];
+    size_t        size = 0;
+    assert_int_eq(ac_command_serialize(&args, blob, sizeof(blob), &size).code, AC_ERROR_SUCCESS);
+    ac_command_release(&args);
+
+    struct ac_command_view view = {0};
+    assert_int_eq(ac_multi_command_view_from_blob(blob, size, &command6, &view).code,
+                  AC_ERROR_SUCCESS);
+    char const *value = NULL;
+    assert_ptr_eq(ac_command_view_option(&view, 1, &value), &command6.options[1]);
+    assert_str_eq(value, "t");
+
+    // A tree whose inherited options differ doesn't accept the blob, even when the command does.
+    struct ac_option_spec        root_options[2] = {command6.options[0], command6.options[1]};
+    struct ac_multi_command_spec changed         = command6;
+    root_options[1].env                          = "ARGS_C_TEST_TOKEN";
+    changed.options                              = root_options;
+    assert_int_eq(ac_multi_command_view_from_blob(blob, size, &changed, &view).code,
+                  AC_ERROR_BLOB_FINGERPRINT_MISMATCH);
+
+    char const *const argv4[] = {"nested", "--cherry", "x", "command3", "/path/to/a",
+                                 "/path/to/b", "--token", "t"};
+    result                    = ac_multi_command_parse(8, argv4, &command6, &args);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+    assert_sizet_eq(args.n_options, 2UL);
+    assert_str_eq(ac_extract_option(&args, "cherry")->value, "x");
+    assert_ptr_eq(ac_extract_option(&args, "cherry")->option,
+                  &command6.subcommands[1].multi->options[0]);
+    ac_command_release(&args);
+
+    char const *const argv5[] = {"--apple", "5", "command2"};
+    result                    = ac_multi_command_parse(3, argv5, &command6, &args);
+    assert_int_eq(result.code, AC_ERROR_OPTION_NAME_NOT_IN_SPEC);
+
+    // Spec images support inherited options too.
+    void  *buffer    = NULL;
+    size_t buffer_sz = 0;
+    assert_int_eq(ac_spec_image_compile(&command6, &buffer, &buffer_sz).code, AC_ERROR_SUCCESS);
+    struct ac_spec_image image = {0};
+    assert_int_eq(ac_spec_image_from_buffer(buffer, buffer_sz, &image).code, AC_ERROR_SUCCESS);
+
+    struct ac_image_command image_args = {0};
+    result                             = ac_spec_image_parse(&image, 8, argv4, &image_args);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+    assert_str_eq(ac_image_extract_option(&image_args, "cherry")->value, "x");
+    assert_str_eq(ac_image_extract_option(&image_args, "token")->value, "t");
+    ac_image_command_release(&image_args);
+
+    result = ac_spec_image_parse(&image, 4, argv1, &image_args);
+    assert_int_eq(result.code, AC_ERROR_OPTION_NAME_REQUIRED_IN_SPEC);
+    free(buffer);
+}
+
+static void assert_candidates(int argc, char const *const *argv, size_t n, char const **expected) {
+    struct ac_completion completion = {0};
+    assert_int_eq(ac_multi_command_complete(argc, argv, &command6, &completion).code,
+                  AC_ERROR_SUCCESS);
+    assert_sizet_eq(completion.n_candidates, n);
+    for(size_t i = 0; i < n; i++) {
+        assert_str_eq(completion.candidates[i], expected[i]);
+    }
+    ac_completion_release(&completion);
+}
+
+static void test_completion() {
+    char const *const argv1[]     = {""};
+    char const       *expected1[] = {"command2", "nested"};
+    assert_candidates(1, argv1, 2, expected1);
+
+    char const *const argv2[]     = {"--token", "n", "n"};
+    char const       *expected2[] = {"nested"};
+    assert_candidates(3, argv2, 1, expected2);
+
+    // The value of an option is left to the shell.
+    char const *const argv3[] = {"--token", ""};
+    assert_candidates(2, argv3, 0, NULL);
+
+    // Options are merged across the inherited layers.
+    char const *const argv4[]     = {"nested", "--"};
+    char const       *expected4[] = {"--cherry", "--token", "--verbose"};
+    assert_candidates(2, argv4, 3, expected4);
+
+    char const *const argv5[]     = {"nested", "command3", "/path/to/a", "--c"};
+    char const       *expected5[] = {"--cherry"};
+    assert_candidates(4, argv5, 1, expected5);
+
+    char const *const argv6[] = {"unknown", ""};
+    assert_candidates(2, argv6, 0, NULL);
+
+    // Clusters and `--name=value` are read like the parser reads them.
+    char const *const argv7[] = {"nested", "command3", "-ca", "--c"};
+    assert_candidates(4, argv7, 0, NULL);
+
+    char const *const argv8[] = {"nested", "command3", "-ca", "5", "--c"};
+    assert_candidates(5, argv8, 1, expected5);
+
+    char const *const argv9[]     = {"-vv", "--token=t", "n"};
+    char const       *expected9[] = {"nested"};
+    assert_candidates(3, argv9, 1, expected9);
+
+    char *script = ac_completion_script(SHELL_BASH, "my-tool");
+    assert(script != NULL);
+    assert(strstr(script, "complete -o default -F _my_tool_complete my-tool") != NULL);
+    free(script);
+}
+
+static void test_suggestions() {
+    struct ac_command args     = {0};
+    char const *const argv1[] = {"--aple", "5"};
+    struct ac_status  result   = ac_command_parse(2, argv1, &command2, &args);
+    assert_int_eq(result.code, AC_ERROR_OPTION_NAME_NOT_IN_SPEC);
+    char *error = ac_status_string(result);
+    assert(strstr(error, "Did you mean '--apple'?") != NULL);
+    free(error);
+
+    char const *const argv2[] = {"comand"};
+    result                    = ac_multi_command_parse(1, argv2, &command4, &args);
+    assert_int_eq(result.code, AC_ERROR_COMMAND_NAME_NOT_IN_SPEC);
+    error = ac_status_string(result);
+    assert(strstr(error, "Did you mean 'command1' or 'command2'?") != NULL);
+    free(error);
+
+    char const *const argv3[] = {"zebra"};
+    result                    = ac_multi_command_parse(1, argv3, &command4, &args);
+    error                     = ac_status_string(result);
+    assert(strstr(error, "Did you mean") == NULL);
+    free(error);
+}
+
+static struct ac_command_spec const command7 = {
+    .help                = "Abbreviated options",
+    .allow_abbreviations = true,
+    .n_options           = 4,
+    .options             = (struct ac_option_spec[]) {{.long_name = "verbose", .is_flag = true},
+                                                      {.long_name = "version", .is_flag = true},
+                                                      {.long_name = "color", .is_flag = true},
+                                                      {.long_name = "colors"}}};
+
+static void test_abbreviations() {
+    struct ac_command args     = {0};
+    char const *const argv1[] = {"--verb", "--color"};
+    struct ac_status  result   = ac_command_parse(2, argv1, &command7, &args);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+    assert_ptr_eq(args.options[0].option, &command7.options[0]);
+    // An exact match wins over the longer names it's a prefix of.
+    assert_ptr_eq(args.options[1].option, &command7.options[2]);
+    ac_command_release(&args);
+
+    char const *const argv2[] = {"--ver"};
+    result                    = ac_command_parse(1, argv2, &command7, &args);
+    assert_int_eq(result.code, AC_ERROR_OPTION_NAME_AMBIGUOUS);
+    char *error = ac_status_string(result);
+    assert(strstr(error, "It could be --verbose --version") != NULL);
+    free(error);
+
+    // Options must be provided in full unless the spec allows abbreviations.
+    char const *const argv3[] = {"--app", "5"};
+    result                    = ac_command_parse(2, argv3, &command2, &args);
+    assert_int_eq(result.code, AC_ERROR_OPTION_NAME_NOT_IN_SPEC);
+
+    // A spec whose memory is reused for a different one, like a spec on the stack, isn't parsed
+    // with what was derived from the old one.
+    char                  name[8]   = "gamma";
+    struct ac_option_spec options[] = {{.long_name = "alpha", .is_flag = true},
+                                       {.long_name = name, .is_flag = true}};
+    struct ac_command_spec reused   = {.n_options = 2, .options = options, .allow_abbreviations = true};
+    char const *const      argv4[]  = {"--gam"};
+    assert_int_eq(ac_command_parse(1, argv4, &reused, &args).code, AC_ERROR_SUCCESS);
+    assert_ptr_eq(args.options[0].option, &options[1]);
+    ac_command_release(&args);
+
+    strcpy(name, "xray");
+    char const *const argv5[] = {"--xray"};
+    assert_int_eq(ac_command_parse(1, argv5, &reused, &args).code, AC_ERROR_SUCCESS);
+    assert_str_eq(args.options[0].option->long_name, "xray");
+    ac_command_release(&args);
+    assert_int_eq(ac_command_parse(1, argv4, &reused, &args).code, AC_ERROR_OPTION_NAME_NOT_IN_SPEC);
+
+    options[0].long_name = "beta";
+    options[1].is_flag   = false;
+    char const *const argv6[] = {"--be", "--xray", "1"};
+    assert_int_eq(ac_command_parse(3, argv6, &reused, &args).code, AC_ERROR_SUCCESS);
+    assert_str_eq(ac_extract_option(&args, "xray")->value, "1");
+    ac_command_release(&args);
+    assert_int_eq(ac_command_validate(&reused).code, AC_ERROR_SUCCESS);
+    options[1].long_name = "beta";
+    assert_int_eq(ac_command_validate(&reused).code, AC_ERROR_OPTION_LONG_NAME_DUPLICATE);
+}
+
+static struct ac_command_spec const command8 = {
+    .help          = "Constrained options",
+    .n_options     = 6,
+    .options       = (struct ac_option_spec[]) {{.long_name = "json", .is_flag = true},
+                                                {.long_name = "yaml", .is_flag = true},
+                                                {.long_name = "compress", .is_flag = true},
+                                                {.long_name = "output"},
+                                                {.long_name = "quiet", .is_flag = true},
+                                                {.long_name = "verbose", .is_flag = true}},
+    .n_constraints = 3,
+    .constraints   = (struct ac_constraint_spec[]) {
+        {.type = CONSTRAINT_ONE_OF, .n_options = 2, .options = (char *[]) {"json", "yaml"}},
+        {.type      = CONSTRAINT_REQUIRES,
+           .option    = "compress",
+           .n_options = 1,
+           .options   = (char *[]) {"output"}},
+        {.type      = CONSTRAINT_CONFLICTS,
+           .option    = "quiet",
+           .n_options = 1,
+           .options   = (char *[]) {"verbose"}}}};
+
+static struct ac_command_spec const invalid_constraint = {
+    .n_options     = 1,
+    .options       = (struct ac_option_spec[]) {{.long_name = "json", .is_flag = true}},
+    .n_constraints = 1,
+    .constraints   = (struct ac_constraint_spec[]) {
+        {.type = CONSTRAINT_ONE_OF, .n_options = 1, .options = (char *[]) {"xml"}}}};
+
+static void test_constraints() {
+    assert_int_eq(ac_command_validate(&command8).code, AC_ERROR_SUCCESS);
+
+    struct ac_command args     = {0};
+    char const *const argv1[] = {"--json", "--compress", "--output", "out", "--quiet"};
+    struct ac_status  result   = ac_command_parse(5, argv1, &command8, &args);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+    ac_command_release(&args);
+
+    char const *const argv2[] = {"--quiet"};
+    result                    = ac_command_parse(1, argv2, &command8, &args);
+    assert_int_eq(result.code, AC_ERROR_CONSTRAINT_ONE_OF_MISSING);
+    char *error = ac_status_string(result);
+    assert(strstr(error, "required: --json --yaml") != NULL);
+    free(error);
+
+    char const *const argv3[] = {"--yaml", "--json"};
+    result                    = ac_command_parse(2, argv3, &command8, &args);
+    assert_int_eq(result.code, AC_ERROR_CONSTRAINT_ONE_OF_MULTIPLE);
+    assert_ptr_eq(result.option, &command8.options[0]);
+    assert_str_eq((char *) result.context, "yaml");
+
+    char const *const argv4[] = {"--json", "--compress"};
+    result                    = ac_command_parse(2, argv4, &command8, &args);
+    assert_int_eq(result.code, AC_ERROR_CONSTRAINT_REQUIRES);
+    assert_ptr_eq(result.option, &command8.options[2]);
+    assert_str_eq((char *) result.context, "output");
+
+    char const *const argv5[] = {"--verbose", "--json", "--quiet"};
+    result                    = ac_command_parse(3, argv5, &command8, &args);
+    assert_int_eq(result.code, AC_ERROR_CONSTRAINT_CONFLICTS);
+    assert_ptr_eq(result.option, &command8.options[4]);
+    assert_str_eq((char *) result.context, "verbose");
+
+    assert_int_eq(ac_command_validate(&invalid_constraint).code, AC_ERROR_CONSTRAINT_INVALID);
+}
+
+static struct ac_command_spec const duplicate_long = {
+    .n_options = 3,
+    .options   = (struct ac_option_spec[]) {{.long_name = "apple"},
+                                            {.long_name = "banana"},
+                                            {.long_name = "apple"}}};
+
+static struct ac_command_spec const duplicate_short = {
+    .n_options = 2,
+    .options   = (struct ac_option_spec[]) {
+        {.long_name = "apple", .has_short_name = true, .short_name = 'a'},
+        {.long_name = "avocado", .has_short_name = true, .short_name = 'a'}}};
+
+static struct ac_multi_command_spec const duplicate_command = {
+    .n_subcommands = 3,
+    .subcommands   = (struct ac_multi_command_subcommand[]) {
+        {.name = "command1", .type = COMMAND_SINGLE, .single = (struct ac_command_spec *) &command1},
+        {.name = "command2", .type = COMMAND_SINGLE, .single = (struct ac_command_spec *) &command2},
+        {.name = "command1", .type = COMMAND_SINGLE, .single = (struct ac_command_spec *) &command3}}};
+
+static struct ac_multi_command_spec const invalid_nested = {
+    .n_subcommands = 2,
+    .subcommands   = (struct ac_multi_command_subcommand[]) {
+        {.name = "command1", .type = COMMAND_SINGLE, .single = (struct ac_command_spec *) &command1},
+        {.name   = "short",
+           .type   = COMMAND_SINGLE,
+           .single = (struct ac_command_spec *) &duplicate_short}}};
+
+static void test_validate() {
+    struct ac_status result = ac_command_validate(&duplicate_long);
+    assert_int_eq(result.code, AC_ERROR_OPTION_LONG_NAME_DUPLICATE);
+    assert_sizet_eq((size_t) result.context, 2UL);
+
+    result = ac_command_validate(&duplicate_short);
+    assert_int_eq(result.code, AC_ERROR_OPTION_SHORT_NAME_DUPLICATE);
+    assert_ptr_eq(result.option, &duplicate_short.options[1]);
+
+    result = ac_multi_command_validate(&duplicate_command);
+    assert_int_eq(result.code, AC_ERROR_COMMAND_NAME_DUPLICATE);
+    assert_str_eq((char *) result.context, "command1");
+
+    // Every subcommand is validated, not only the first one.
+    for(size_t i = 0; i < 2; i++) {
+        result = ac_multi_command_validate(&invalid_nested);
+        assert_int_eq(result.code, AC_ERROR_OPTION_SHORT_NAME_DUPLICATE);
+        assert_ptr_eq(result.single, &duplicate_short);
+    }
+
+    // The compiled lookup tables hold 16-bit option indices, so larger specs are rejected.
+    struct ac_command_spec const huge = {
+        .n_options = MAX_NUM_SPEC_OPTIONS + 1,
+        .options   = calloc(MAX_NUM_SPEC_OPTIONS + 1, sizeof(struct ac_option_spec))};
+    result = ac_command_validate(&huge);
+    assert_int_eq(result.code, AC_ERROR_OPTION_TOO_MANY);
+    assert_sizet_eq((size_t) result.context, (size_t) MAX_NUM_SPEC_OPTIONS + 1);
+    struct ac_command args   = {0};
+    char const *const argv[] = {"--verbose"};
+    assert_int_eq(ac_command_parse(1, argv, &huge, &args).code, AC_ERROR_OPTION_TOO_MANY);
+    free(huge.options);
+}
+
+static struct ac_command_spec const command9 = {
+    .help        = "Testing command 9.",
+    .n_arguments = 1,
+    .arguments   = (struct ac_argument_spec[]) {{.name = "NAME"}},
+    .n_options   = 2,
+    .options     = (struct ac_option_spec[]) {{.long_name = "gr\xc3\xb6\xc3\x9f" "e"},
+                                              {.long_name = "verbose", .is_flag = true}},
+    .utf8        = true,
+};
+
+static struct ac_command_spec const command9_ascii = {
+    .n_arguments = 1,
+    .arguments   = (struct ac_argument_spec[]) {{.name = "NAME"}},
+    .n_options   = 1,
+    .options     = (struct ac_option_spec[]) {{.long_name = "gr\xc3\xb6\xc3\x9f" "e"}},
+};
+
+static void test_utf8() {
+    assert_int_eq(ac_command_validate(&command9).code, AC_ERROR_SUCCESS);
+    assert_int_eq(ac_command_validate(&command9_ascii).code, AC_ERROR_OPTION_LONG_NAME_INVALID);
+
+    struct ac_command args      = {0};
+    char const *const argv1[]   = {"Zo\xc3\xab", "--gr\xc3\xb6\xc3\x9f" "e", "\xe2\x82\xac" "3", "--verbose"};
+    struct ac_status  result    = ac_command_parse(4, argv1, &command9, &args);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+    assert_str_eq(args.arguments[0].value, "Zo\xc3\xab");
+    assert_ptr_eq(args.options[0].option, &command9.options[0]);
+    assert_str_eq(args.options[0].value, "\xe2\x82\xac" "3");
+    ac_command_release(&args);
+
+    // Truncated, overlong, surrogate and out of range sequences.
+    char const *const invalid[] = {"\xc3\x28", "\xe2\x82", "\xc0\xaf", "\xed\xa0\x80", "\xf4\x90\x80\x80",
+                                   "\xff"};
+    for(size_t i = 0; i < sizeof(invalid) / sizeof(*invalid); i++) {
+        char const *const argv2[] = {invalid[i]};
+        result                    = ac_command_parse(1, argv2, &command9, &args);
+        assert_int_eq(result.code, AC_ERROR_UTF8_INVALID);
+        assert_ptr_eq(result.context, (void *) invalid[i]);
+    }
+
+    // Specs that don't opt in accept any bytes.
+    char const *const argv3[] = {"\xff"};
+    result                    = ac_command_parse(1, argv3, &command9_ascii, &args);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+    ac_command_release(&args);
+
+    // Input is scanned in aligned blocks, so try every alignment and position.
+    char buffer[160];
+    for(size_t offset = 0; offset < 32; offset++) {
+        for(size_t position = 0; position < 100; position += 7) {
+            memset(buffer, 'a', sizeof(buffer));
+            buffer[offset + 100] = '\0';
+            memcpy(&buffer[offset + position], "\xc3\xab", 2);
+
+            char const *const argv4[] = {&buffer[offset]};
+            result                    = ac_command_parse(1, argv4, &command9, &args);
+            assert_int_eq(result.code, AC_ERROR_SUCCESS);
+            assert_sizet_eq(strlen(args.arguments[0].value), 100UL);
+            ac_command_release(&args);
+
+            buffer[offset + position + 1] = 'a';
+            result                        = ac_command_parse(1, argv4, &command9, &args);
+            assert_int_eq(result.code, AC_ERROR_UTF8_INVALID);
+        }
+    }
+}
+
+static struct ac_command_spec const command10 = {
+    .help      = "Testing command 10.",
+    .n_options = 3,
+    .options   = (struct ac_option_spec[]) {
+        {.long_name = "verbose", .has_short_name = true, .short_name = 'v', .is_flag = true},
+        {.long_name = "extract", .has_short_name = true, .short_name = 'x', .is_flag = true},
+        {.long_name = "level", .has_short_name = true, .short_name = 'l'}},
+};
+
+static void test_clusters() {
+    struct ac_command args     = {0};
+    char const *const argv1[] = {"-vvvx", "-vl", "9"};
+    struct ac_status  result   = ac_command_parse(3, argv1, &command10, &args);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+    // A flag counts every occurrence, in clusters or not.
+    assert_sizet_eq(args.n_options, 3UL);
+    assert_ptr_eq(args.options[0].option, &command10.options[0]);
+    assert_sizet_eq(args.options[0].count, 4UL);
+    assert_ptr_eq(args.options[1].option, &command10.options[1]);
+    assert_sizet_eq(args.options[1].count, 1UL);
+    assert_ptr_eq(args.options[2].option, &command10.options[2]);
+    assert_ptr_eq(args.options[2].value, (char *) argv1[2]);
+
+    // Repeated flags are serialized as separate records.
+    unsigned char blob[0x100];
+    size_t        size = 0;
+    assert_int_eq(ac_command_serialize(&args, blob, sizeof(blob), &size).code, AC_ERROR_SUCCESS);
+    struct ac_command_view view = {0};
+    assert_int_eq(ac_command_view_from_blob(blob, size, &command10, &view).code, AC_ERROR_SUCCESS);
+    assert_sizet_eq(view.n_options, 6UL);
+    ac_command_release(&args);
+
+    char const *const argv14[] = {"-vv", "-v", "--verbose"};
+    assert_int_eq(ac_command_parse(3, argv14, &command10, &args).code, AC_ERROR_SUCCESS);
+    assert_sizet_eq(args.n_options, 1UL);
+    assert_sizet_eq(ac_extract_option(&args, "verbose")->count, 4UL);
+    ac_command_release(&args);
+
+    // A long run of one flag is a single entry, so it doesn't count against the option limit.
+    char long_cluster[MAX_NUM_OPTIONS + 8];
+    memset(long_cluster, 'v', sizeof(long_cluster) - 1);
+    long_cluster[0]                        = '-';
+    long_cluster[sizeof(long_cluster) - 1] = '\0';
+    char const *const argv9[]              = {long_cluster};
+    result                                 = ac_command_parse(1, argv9, &command10, &args);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+    assert_sizet_eq(args.n_options, 1UL);
+    assert_sizet_eq(args.options[0].count, sizeof(long_cluster) - 2);
+    ac_command_release(&args);
+
+    // The value of `--name=value` points into the token.
+    char const *const argv2[] = {"--level=9", "--extract"};
+    result                    = ac_command_parse(2, argv2, &command10, &args);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+    assert_ptr_eq(args.options[0].value, (char *) &argv2[0][8]);
+    assert_str_eq(args.options[0].value, "9");
+    ac_command_release(&args);
+
+    char const *const argv3[] = {"--level="};
+    result                    = ac_command_parse(1, argv3, &command10, &args);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+    assert_str_eq(args.options[0].value, "");
+    ac_command_release(&args);
+
+    char const *const argv4[] = {"--verbose=1"};
+    result                    = ac_command_parse(1, argv4, &command10, &args);
+    assert_int_eq(result.code, AC_ERROR_OPTION_VALUE_UNEXPECTED);
+
+    // Only the last option in a cluster may take a value.
+    char const *const argv5[] = {"-lv", "9"};
+    result                    = ac_command_parse(2, argv5, &command10, &args);
+    assert_int_eq(result.code, AC_ERROR_OPTION_VALUE_EXPECTED);
+
+    char const *const argv6[] = {"-vq"};
+    result                    = ac_command_parse(1, argv6, &command10, &args);
+    assert_int_eq(result.code, AC_ERROR_OPTION_NAME_NOT_IN_SPEC);
+
+    char const *const argv7[] = {"--levl=9"};
+    result                    = ac_command_parse(1, argv7, &command10, &args);
+    assert_int_eq(result.code, AC_ERROR_OPTION_NAME_NOT_IN_SPEC);
+    char *const error = ac_status_string(result);
+    assert_ptr_neq(strstr(error, "Did you mean '--level'?"), NULL);
+    free(error);
+
+    // Inherited options can be clustered and assigned before the subcommand too.
+    char const *const argv8[] = {"-vv", "--token=t", "command2", "-va", "5"};
+    result                    = ac_multi_command_parse(5, argv8, &command6, &args);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+    assert_sizet_eq(args.n_options, 3UL);
+    assert_sizet_eq(args.options[0].count, 3UL);
+    assert_str_eq(ac_extract_option(&args, "token")->value, "t");
+    assert_str_eq(ac_extract_option(&args, "apple")->value, "5");
+    ac_command_release(&args);
+
+    // Spec images accept the same clusters and assignments.
+    struct ac_multi_command_spec const root = {
+        .n_subcommands = 1,
+        .subcommands   = (struct ac_multi_command_subcommand[]) {
+            {.name = "run", .type = COMMAND_SINGLE, .single = (struct ac_command_spec *) &command10}}};
+    void  *buffer    = NULL;
+    size_t buffer_sz = 0;
+    assert_int_eq(ac_spec_image_compile(&root, &buffer, &buffer_sz).code, AC_ERROR_SUCCESS);
+    struct ac_spec_image image = {0};
+    assert_int_eq(ac_spec_image_from_buffer(buffer, buffer_sz, &image).code, AC_ERROR_SUCCESS);
+
+    struct ac_image_command image_args = {0};
+    char const *const       argv10[]   = {"run", "-vvvx", "-vl", "9", "--level=8"};
+    result                             = ac_spec_image_parse(&image, 5, argv10, &image_args);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+    assert_sizet_eq(image_args.n_options, 4UL);
+    assert_int_eq((int) image_args.options[0].index, 0);
+    assert_sizet_eq(image_args.options[0].count, 4UL);
+    assert_int_eq((int) image_args.options[1].index, 1);
+    assert_sizet_eq(image_args.options[1].count, 1UL);
+    assert_ptr_eq(image_args.options[2].value, argv10[3]);
+    assert_ptr_eq(image_args.options[3].value, &argv10[4][8]);
+    ac_image_command_release(&image_args);
+
+    char const *const argv11[] = {"run", "--verbose=1"};
+    result                     = ac_spec_image_parse(&image, 2, argv11, &image_args);
+    assert_int_eq(result.code, AC_ERROR_OPTION_VALUE_UNEXPECTED);
+    char const *const argv12[] = {"run", "-lv", "9"};
+    result                     = ac_spec_image_parse(&image, 3, argv12, &image_args);
+    assert_int_eq(result.code, AC_ERROR_OPTION_VALUE_EXPECTED);
+    char const *const argv13[] = {"run", "-vq"};
+    result                     = ac_spec_image_parse(&image, 2, argv13, &image_args);
+    assert_int_eq(result.code, AC_ERROR_OPTION_NAME_NOT_IN_SPEC);
+    assert_ptr_eq(result.context, argv13[1]);
+    free(buffer);
+}
+
+static struct ac_command_spec const command11 = {
+    .help      = "Testing command 11.",
+    .n_options = 2,
+    .options   = (struct ac_option_spec[]) {
+        {.long_name = "format",
+           .n_choices = 5,
+           .choices   = (char *[]) {"json", "yaml", "toml", "csv", "xml"}},
+        {.long_name = "verbose", .is_flag = true}},
+};
+
+static struct ac_command_spec const duplicate_choices = {
+    .n_options = 1,
+    .options   = (struct ac_option_spec[]) {
+        {.long_name = "format", .n_choices = 3, .choices = (char *[]) {"json", "yaml", "json"}}},
+};
+
+static struct ac_command_spec const flag_choices = {
+    .n_options = 1,
+    .options   = (struct ac_option_spec[]) {
+        {.long_name = "verbose", .is_flag = true, .n_choices = 1, .choices = (char *[]) {"yes"}}},
+};
+
+enum {
+    N_MANY_CHOICES = 500,
+};
+static char                  many_choice_names[N_MANY_CHOICES][8];
+static char                 *many_choices[N_MANY_CHOICES];
+static struct ac_option_spec many_choices_option = {
+    .long_name = "choice",
+    .n_choices = N_MANY_CHOICES,
+    .choices   = many_choices,
+};
+static struct ac_command_spec const many_choices_command = {
+    .n_options = 1,
+    .options   = &many_choices_option,
+};
+
+static void test_choices() {
+    assert_int_eq(ac_command_validate(&command11).code, AC_ERROR_SUCCESS);
+
+    char *const help = ac_command_help(&command11, NULL);
+    assert_ptr_neq(strstr(help, "{json, yaml, toml, csv, xml}"), NULL);
+    free(help);
+
+    struct ac_command args     = {0};
+    char const *const argv1[] = {"--format", "yaml"};
+    struct ac_status  result   = ac_command_parse(2, argv1, &command11, &args);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+    assert_sizet_eq(args.options[0].choice, 1UL);
+    ac_command_release(&args);
+
+    char const *const argv2[] = {"--verbose", "--format=xml"};
+    result                    = ac_command_parse(2, argv2, &command11, &args);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+    assert_sizet_eq(ac_extract_option(&args, "format")->choice, 4UL);
+    ac_command_release(&args);
+
+    char const *const argv3[] = {"--format", "jsn"};
+    result                    = ac_command_parse(2, argv3, &command11, &args);
+    assert_int_eq(result.code, AC_ERROR_OPTION_VALUE_NOT_IN_CHOICES);
+    assert_ptr_eq(result.option, &command11.options[0]);
+    assert_str_eq((char *) result.context, "jsn");
+    char *const error = ac_status_string(result);
+    assert_ptr_neq(strstr(error, "It must be one of: json yaml toml csv xml"), NULL);
+    free(error);
+
+    result = ac_command_validate(&duplicate_choices);
+    assert_int_eq(result.code, AC_ERROR_OPTION_CHOICES_INVALID);
+    assert_sizet_eq((size_t) result.context, 2UL);
+    assert_int_eq(ac_command_validate(&flag_choices).code, AC_ERROR_OPTION_CHOICES_INVALID);
+
+    // Every one of a large set of choices resolves to its own index.
+    for(size_t i = 0; i < N_MANY_CHOICES; i++) {
+        snprintf(many_choice_names[i], sizeof(many_choice_names[i]), "c%zu", i);
+        many_choices[i] = many_choice_names[i];
+    }
+    assert_int_eq(ac_command_validate(&many_choices_command).code, AC_ERROR_SUCCESS);
+    for(size_t i = 0; i < N_MANY_CHOICES; i++) {
+        char const *const argv4[] = {"--choice", many_choices[i]};
+        result                    = ac_command_parse(2, argv4, &many_choices_command, &args);
+        assert_int_eq(result.code, AC_ERROR_SUCCESS);
+        assert_sizet_eq(args.options[0].choice, i);
+        ac_command_release(&args);
+    }
+    char const *const argv5[] = {"--choice", "c500"};
+    result                    = ac_command_parse(2, argv5, &many_choices_command, &args);
+    assert_int_eq(result.code, AC_ERROR_OPTION_VALUE_NOT_IN_CHOICES);
+}
+
+static struct ac_command_spec const command12 = {
+    .help      = "Testing command 12.",
+    .n_options = 3,
+    .options   = (struct ac_option_spec[]) {
+        {.long_name = "token", .required = true, .env = "ARGS_C_TEST_TOKEN"},
+        {.long_name = "format",
+           .n_choices = 2,
+           .choices   = (char *[]) {"json", "yaml"},
+           .env       = "ARGS_C_TEST_FORMAT"},
+        {.long_name = "debug", .is_flag = true, .env = "ARGS_C_TEST_DEBUG"}},
+};
+
+static void test_env() {
+    // The environment is read once, on the first parse that needs it.
+    setenv("ARGS_C_TEST_TOKEN", "secret", 1);
+    setenv("ARGS_C_TEST_FORMAT", "yaml", 1);
+    setenv("ARGS_C_TEST_DEBUG", "0", 1);
+
+    char *const help = ac_command_help(&command12, NULL);
+    assert_ptr_neq(strstr(help, "[env: ARGS_C_TEST_TOKEN] (required)"), NULL);
+    free(help);
+
+    // A required option is satisfied by the environment, and the command line takes precedence.
+    struct ac_command args     = {0};
+    char const *const argv1[] = {"--format", "json"};
+    struct ac_status  result   = ac_command_parse(2, argv1, &command12, &args);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+    assert_sizet_eq(args.n_options, 2UL);
+    struct ac_option const *option = ac_extract_option(&args, "token");
+    assert_str_eq(option->value, "secret");
+    assert_int_eq(option->source, SOURCE_ENV);
+    option = ac_extract_option(&args, "format");
+    assert_int_eq(option->source, SOURCE_ARGV);
+    assert_sizet_eq(option->choice, 0UL);
+    assert_ptr_eq(ac_extract_option(&args, "debug"), NULL);
+    ac_command_release(&args);
+
+    // Values from the environment are checked against the choices too.
+    char const *const argv2[] = {NULL};
+    result                    = ac_command_parse(0, argv2, &command12, &args);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+    assert_sizet_eq(ac_extract_option(&args, "format")->choice, 1UL);
+    ac_command_release(&args);
+
+    // The snapshot doesn't see later changes.
+    setenv("ARGS_C_TEST_DEBUG", "1", 1);
+    result = ac_command_parse(0, argv2, &command12, &args);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+    assert_ptr_eq(ac_extract_option(&args, "debug"), NULL);
+    ac_command_release(&args);
+}
+
+static char                         config_path[] = "/tmp/args-c-test-XXXXXX";
+static struct ac_command_spec const command13     = {
+        .help      = "Testing command 13.",
+        .n_options = 3,
+        .options   = (struct ac_option_spec[]) {{.long_name = "level"},
+                                                {.long_name = "token", .env = "ARGS_C_TEST_TOKEN"},
+                                                {.long_name = "debug", .is_flag = true}},
+        .config    = config_path,
+};
+
+// Config files are replaced rather than rewritten, since results borrow from their mappings.
+static void write_config(char const *const contents) {
+    char path[sizeof(config_path) + 4];
+    snprintf(path, sizeof(path), "%s.new", config_path);
+    FILE *const file = fopen(path, "w");
+    assert_ptr_neq(file, NULL);
+    fputs(contents, file);
+    fclose(file);
+    assert_int_eq(rename(path, config_path), 0);
+}
+
+static void test_config() {
+    int const fd = mkstemp(config_path);
+    assert(fd >= 0);
+    close(fd);
+
+    // The command line takes precedence over the environment, which takes precedence over the file.
+    write_config("# Defaults\n\n level = 3\ntoken=file\ndebug=1\nlevel=4");
+    struct ac_command args     = {0};
+    char const *const argv1[] = {"--level", "9"};
+    struct ac_status  result   = ac_command_parse(2, argv1, &command13, &args);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+    assert_sizet_eq(args.n_options, 3UL);
+    assert_str_eq(ac_extract_option(&args, "level")->value, "9");
+    assert_int_eq(ac_extract_option(&args, "token")->source, SOURCE_ENV);
+    assert_int_eq(ac_extract_option(&args, "debug")->source, SOURCE_CONFIG);
+    ac_command_release(&args);
+
+    // A later line overrides an earlier one.
+    char const *const argv2[] = {NULL};
+    result                    = ac_command_parse(0, argv2, &command13, &args);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+    struct ac_option const *const level = ac_extract_option(&args, "level");
+    assert_str_eq(level->value, "4");
+    assert_int_eq(level->source, SOURCE_CONFIG);
+
+    // A changed file is reloaded, and earlier results keep their values until they're released.
+    write_config("level=5\ndebug=0\n");
+    struct ac_command args2 = {0};
+    result                  = ac_command_parse(0, argv2, &command13, &args2);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+    assert_str_eq(ac_extract_option(&args2, "level")->value, "5");
+    assert_ptr_eq(ac_extract_option(&args2, "debug"), NULL);
+    assert_str_eq(level->value, "4");
+    ac_command_release(&args);
+    ac_command_release(&args2);
+
+    write_config("level=5\ncolour=red\n");
+    result = ac_command_parse(0, argv2, &command13, &args);
+    assert_int_eq(result.code, AC_ERROR_CONFIG_INVALID);
+    assert_str_eq((char *) result.context, "colour");
+    char *const error = ac_status_string(result);
+    assert_ptr_neq(strstr(error, "has an invalid entry 'colour'"), NULL);
+    free(error);
+
+    // A missing file is ignored.
+    unlink(config_path);
+    result = ac_command_parse(0, argv2, &command13, &args);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+    assert_sizet_eq(args.n_options, 1UL);
+    ac_command_release(&args);
+}
+
+enum {
+    N_TREE_COMMANDS = 2000,
+};
+static char                                tree_names[N_TREE_COMMANDS][16];
+static struct ac_multi_command_subcommand tree_subcommands[N_TREE_COMMANDS];
+static struct ac_multi_command_spec        tree_group = {
+           .help          = "A large group of commands",
+           .n_subcommands = N_TREE_COMMANDS,
+           .subcommands   = tree_subcommands,
+};
+static struct ac_multi_command_spec const tree_root = {
+    .help          = "A large tree",
+    .n_subcommands = 2,
+    .subcommands   = (struct ac_multi_command_subcommand[]) {
+        {.name = "group", .type = COMMAND_MULTI, .multi = &tree_group},
+        {.name = "command3", .type = COMMAND_SINGLE, .single = (struct ac_command_spec *) &command3}},
+};
+
+static bool append_sink(char const *text, size_t length, void *context) {
+    size_t *const cursor = (size_t *) context;
+    assert_int_eq(0 == memcmp(&((char *) cursor[1])[cursor[0]], text, length), 1);
+    cursor[0] += length;
+    return true;
+}
+
+static void test_help_tree() {
+    char *help = ac_multi_command_help_tree(&command4, "tool", 0);
+    assert_ptr_neq(help, NULL);
+    assert_ptr_neq(strstr(help, "tool {subcommands}\nMultiple commands\n"), NULL);
+    assert_ptr_neq(strstr(help, "tool command2 {options}\nTesting command 2.\n"), NULL);
+    assert_ptr_neq(strstr(help, "tool subcommand3 command3 <FILE> <OUTPUT> {options}\n"), NULL);
+    free(help);
+
+    // Limiting the depth renders subcommand3 without its subcommands.
+    help = ac_multi_command_help_tree(&command4, "tool", 1);
+    assert_ptr_neq(strstr(help, "tool subcommand3 {subcommands}\n"), NULL);
+    assert_ptr_eq(strstr(help, "tool subcommand3 command3"), NULL);
+    free(help);
+
+    // A tree deeper than MAX_NUM_ARGS is reported rather than silently cut short, unless the depth
+    // is limited.
+    static struct ac_multi_command_spec        deep[MAX_NUM_ARGS + 2];
+    static struct ac_multi_command_subcommand deep_subcommands[MAX_NUM_ARGS + 1];
+    for(size_t i = 0; i <= MAX_NUM_ARGS; i++) {
+        deep_subcommands[i] = (struct ac_multi_command_subcommand) {
+            .name = "d", .type = COMMAND_MULTI, .multi = &deep[i + 1]};
+        deep[i] = (struct ac_multi_command_spec) {.n_subcommands = 1, .subcommands = &deep_subcommands[i]};
+    }
+    assert_ptr_eq(ac_multi_command_help_tree(deep, "tool", 0), NULL);
+    struct ac_help_pager deep_pager;
+    assert_int_eq(ac_help_pager_init(&deep_pager, deep, "tool", 0).code, AC_ERROR_SUCCESS);
+    struct ac_status status = {.code = AC_ERROR_SUCCESS};
+    for(char *page = ""; ac_status_is_success(status) && page != NULL;) {
+        status = ac_help_pager_next(&deep_pager, 100, &page);
+    }
+    assert_int_eq(status.code, AC_ERROR_ARGUMENT_MAX_EXCEEDED);
+    assert_ptr_eq(status.multi, &deep[MAX_NUM_ARGS - 1]);
+    ac_help_pager_release(&deep_pager);
+    help = ac_multi_command_help_tree(deep, "tool", MAX_NUM_ARGS);
+    assert_ptr_neq(help, NULL);
+    free(help);
+
+    // A tree whose reference is much larger than HELP_BUFFER_SZ.
+    for(size_t i = 0; i < N_TREE_COMMANDS; i++) {
+        snprintf(tree_names[i], sizeof(tree_names[i]), "command%zu", i);
+        tree_subcommands[i] = (struct ac_multi_command_subcommand) {
+            .name = tree_names[i], .type = COMMAND_SINGLE, .single = (struct ac_command_spec *) &command2};
+    }
+    help = ac_multi_command_help_tree(&tree_root, "tool", 0);
+    assert_ptr_neq(help, NULL);
+    size_t const help_len = strlen(help);
+    assert_int_eq(help_len > 10 * HELP_BUFFER_SZ, 1);
+    assert_ptr_neq(strstr(help, "tool group command1999 {options}\n"), NULL);
+    assert_ptr_neq(strstr(help, "tool command3 <FILE> <OUTPUT> {options}\n"), NULL);
+
+    // Streaming produces the same text.
+    size_t cursor[2] = {0, (size_t) help};
+    assert_int_eq(ac_multi_command_help_tree_write(&tree_root, "tool", 0, append_sink, cursor).code,
+                  AC_ERROR_SUCCESS);
+    assert_sizet_eq(cursor[0], help_len);
+
+    // The first page only renders the commands on it, and the pages add up to the whole tree.
+    struct ac_help_pager pager;
+    assert_int_eq(ac_help_pager_init(&pager, &tree_root, "tool", 0).code, AC_ERROR_SUCCESS);
+    char *page = NULL;
+    assert_int_eq(ac_help_pager_next(&pager, 24, &page).code, AC_ERROR_SUCCESS);
+    assert_ptr_neq(page, NULL);
+    assert_int_eq(pager.n_rendered < 10, 1);
+    size_t offset = 0;
+    while(page != NULL) {
+        size_t const page_len = strlen(page);
+        assert_int_eq(0 == memcmp(&help[offset], page, page_len), 1);
+        offset += page_len;
+        assert_int_eq(ac_help_pager_next(&pager, 24, &page).code, AC_ERROR_SUCCESS);
+    }
+    assert_sizet_eq(offset, help_len);
+    assert_sizet_eq(pager.n_rendered, N_TREE_COMMANDS + 3UL);
+    ac_help_pager_release(&pager);
+    free(help);
+}
+
+static struct ac_command_spec const command14 = {
+    .help      = "Testing command 14.",
+    .n_options = 3,
+    .options   = (struct ac_option_spec[]) {
+        {.long_name = "level", .default_value = "6"},
+        {.long_name     = "format",
+           .n_choices     = 2,
+           .choices       = (char *[]) {"json", "yaml"},
+           .default_value = "yaml"},
+        {.long_name = "verbose", .is_flag = true}},
+};
+
+static struct ac_command_spec const invalid_defaults[] = {
+    {.n_options = 1,
+     .options   = (struct ac_option_spec[]) {{.long_name = "verbose", .is_flag = true, .default_value = "1"}}},
+    {.n_options = 1,
+     .options   = (struct ac_option_spec[]) {{.long_name = "level", .required = true, .default_value = "1"}}},
+    {.n_options = 1,
+     .options   = (struct ac_option_spec[]) {
+         {.long_name = "format", .n_choices = 1, .choices = (char *[]) {"json"}, .default_value = "xml"}}},
+};
+
+static void test_defaults() {
+    assert_int_eq(ac_command_validate(&command14).code, AC_ERROR_SUCCESS);
+    for(size_t i = 0; i < sizeof(invalid_defaults) / sizeof(*invalid_defaults); i++) {
+        struct ac_status const result = ac_command_validate(&invalid_defaults[i]);
+        assert_int_eq(result.code, AC_ERROR_OPTION_DEFAULT_INVALID);
+        assert_ptr_eq(result.option, &invalid_defaults[i].options[0]);
+    }
+
+    char *const help = ac_command_help(&command14, NULL);
+    assert_ptr_neq(strstr(help, "{json, yaml} [default: yaml]"), NULL);
+    free(help);
+
+    // Options that aren't provided come from their defaults, with their choices resolved.
+    char const *const argv1[] = {"--verbose"};
+    struct ac_command args    = {0};
+    struct ac_status  result  = ac_command_parse(1, argv1, &command14, &args);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+    assert_sizet_eq(args.n_options, 3UL);
+    assert_str_eq(ac_extract_option(&args, "level")->value, "6");
+    assert_int_eq(ac_extract_option(&args, "level")->source, SOURCE_DEFAULT);
+    assert_sizet_eq(ac_extract_option(&args, "format")->choice, 1UL);
+    ac_command_release(&args);
+
+    // Provided options replace their defaults.
+    char const *const argv2[] = {"--format", "json", "--level=9"};
+    result                    = ac_command_parse(3, argv2, &command14, &args);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+    assert_sizet_eq(args.n_options, 2UL);
+    assert_str_eq(ac_extract_option(&args, "level")->value, "9");
+    assert_int_eq(ac_extract_option(&args, "format")->source, SOURCE_ARGV);
+    assert_sizet_eq(ac_extract_option(&args, "format")->choice, 0UL);
+    ac_command_release(&args);
+
+    // Only options on the command line count towards MAX_NUM_OPTIONS, not defaults or environment
+    // variables that the spec names.
+    enum { n_many = MAX_NUM_OPTIONS + 44 };
+    static char                  names[n_many][16];
+    static char                  envs[n_many][32];
+    static struct ac_option_spec many[n_many];
+    for(size_t i = 0; i < n_many; i++) {
+        // Digits would make the names look like values.
+        snprintf(names[i], sizeof(names[i]), "option%c%c", (char) ('a' + i / 26), (char) ('a' + i % 26));
+        snprintf(envs[i], sizeof(envs[i]), "AC_TEST_UNSET_%zu", i);
+        many[i] = (struct ac_option_spec) {.long_name = names[i], .default_value = "1"};
+    }
+    struct ac_command_spec defaulted = {.n_options = n_many, .options = many};
+    char const *const      argv3[]   = {"--optionah", "2"};
+    assert_int_eq(ac_command_parse(2, argv3, &defaulted, &args).code, AC_ERROR_SUCCESS);
+    assert_sizet_eq(args.n_options, (size_t) n_many);
+    assert_str_eq(ac_extract_option(&args, "optionah")->value, "2");
+    // A provided option takes the place of its default.
+    assert_ptr_eq(args.options[7].option, &many[7]);
+    assert_int_eq(args.options[7].source, SOURCE_ARGV);
+    assert_str_eq(ac_extract_option(&args, "optionlm")->value, "1");
+    ac_command_release(&args);
+
+    for(size_t i = 0; i < n_many; i++) {
+        many[i] = (struct ac_option_spec) {.long_name = names[i], .env = envs[i]};
+    }
+    struct ac_command_spec named = {.n_options = n_many, .options = many};
+    assert_int_eq(ac_command_parse(0, argv3, &named, &args).code, AC_ERROR_SUCCESS);
+    assert_sizet_eq(args.n_options, 0UL);
+    ac_command_release(&args);
+}
+
+static void test_image_options() {
+    struct ac_multi_command_spec const root = {
+        .n_subcommands = 2,
+        .subcommands   = (struct ac_multi_command_subcommand[]) {
+            {.name = "env", .type = COMMAND_SINGLE, .single = (struct ac_command_spec *) &command12},
+            {.name = "defaults", .type = COMMAND_SINGLE, .single = (struct ac_command_spec *) &command14}}};
+    void  *buffer    = NULL;
+    size_t buffer_sz = 0;
+    assert_int_eq(ac_spec_image_compile(&root, &buffer, &buffer_sz).code, AC_ERROR_SUCCESS);
+    struct ac_spec_image image = {0};
+    assert_int_eq(ac_spec_image_from_buffer(buffer, buffer_sz, &image).code, AC_ERROR_SUCCESS);
+
+    // Defaults and choices parse the same as they do from the spec.
+    struct ac_image_command args    = {0};
+    char const *const       argv1[] = {"defaults"};
+    struct ac_status        result  = ac_spec_image_parse(&image, 1, argv1, &args);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+    assert_sizet_eq(args.n_options, 2UL);
+    assert_str_eq(ac_image_extract_option(&args, "level")->value, "6");
+    assert_int_eq(ac_image_extract_option(&args, "level")->source, SOURCE_DEFAULT);
+    assert_sizet_eq(ac_image_extract_option(&args, "format")->choice, 1UL);
+    ac_image_command_release(&args);
+
+    char const *const argv2[] = {"defaults", "--format", "xml"};
+    result                    = ac_spec_image_parse(&image, 3, argv2, &args);
+    assert_int_eq(result.code, AC_ERROR_OPTION_VALUE_NOT_IN_CHOICES);
+    assert_str_eq((char *) result.context, "xml");
+
+    // So do environment variables, which test_env has set.
+    char const *const argv3[] = {"env", "--format", "json"};
+    result                    = ac_spec_image_parse(&image, 3, argv3, &args);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+    assert_sizet_eq(args.n_options, 2UL);
+    assert_str_eq(ac_image_extract_option(&args, "token")->value, "secret");
+    assert_int_eq(ac_image_extract_option(&args, "token")->source, SOURCE_ENV);
+    assert_sizet_eq(ac_image_extract_option(&args, "format")->choice, 0UL);
+    assert_ptr_eq(ac_image_extract_option(&args, "debug"), NULL);
+    ac_image_command_release(&args);
+    free(buffer);
+
+    // Features that the image can't represent are rejected rather than dropped.
+    struct ac_multi_command_spec const configured = {
+        .n_subcommands = 1,
+        .subcommands   = (struct ac_multi_command_subcommand[]) {
+            {.name = "config", .type = COMMAND_SINGLE, .single = (struct ac_command_spec *) &command13}}};
+    result = ac_spec_image_compile(&configured, &buffer, &buffer_sz);
+    assert_int_eq(result.code, AC_ERROR_IMAGE_UNSUPPORTED);
+    assert_ptr_eq(result.single, &command13);
+    assert_str_eq((char *) result.context, "config");
+}
+
+// The fingerprint of parsing `argv` against `command`, or of `root` when it isn't NULL.
+static uint64_t fingerprint_of(int const argc, char const *const *const argv,
+                               struct ac_command_spec const *const       command,
+                               struct ac_multi_command_spec const *const root) {
+    struct ac_command      args   = {0};
+    struct ac_status const result = root != NULL ? ac_multi_command_parse(argc, argv, root, &args)
+                                                 : ac_command_parse(argc, argv, command, &args);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+    uint64_t const fingerprint = ac_command_fingerprint(&args);
+    ac_command_release(&args);
+    return fingerprint;
+}
+
+static void test_fingerprint() {
+    char const *const argv1[] = {"in", "out", "--apple", "1", "-b", "2", "-cc"};
+    char const *const argv2[] = {"in", "out", "-cc", "--banana=2", "-a", "1"};
+    char const *const argv3[] = {"out", "in", "--apple", "1", "-b", "2", "-cc"};
+    char const *const argv4[] = {"in", "out", "--apple", "2", "-b", "1", "-cc"};
+    char const *const argv5[] = {"in", "out", "--apple", "1", "-b", "2", "-c"};
+    uint64_t const    first   = fingerprint_of(7, argv1, &command3, NULL);
+    assert_int_eq(first != 0, 1);
+
+    // The order of the options doesn't matter, but the arguments and values do.
+    assert_int_eq(fingerprint_of(6, argv2, &command3, NULL) == first, 1);
+    assert_int_eq(fingerprint_of(7, argv3, &command3, NULL) == first, 0);
+    assert_int_eq(fingerprint_of(7, argv4, &command3, NULL) == first, 0);
+    assert_int_eq(fingerprint_of(7, argv5, &command3, NULL) == first, 0);
+
+    // A flag counts all of its occurrences, in a cluster or not.
+    char const *const argv11[] = {"in", "out", "--apple", "1", "-b", "2", "-c", "-c"};
+    char const *const argv12[] = {"in", "out", "--apple", "1", "-b", "2", "-c", "-c", "-c"};
+    assert_int_eq(fingerprint_of(8, argv11, &command3, NULL) == first, 1);
+    assert_int_eq(fingerprint_of(9, argv12, &command3, NULL) == first, 0);
+
+    // Only the first occurrence of a repeated option is effective, so their order matters.
+    char const *const argv8[] = {"in", "out", "--apple", "1", "--apple", "2"};
+    char const *const argv9[] = {"in", "out", "--apple", "2", "--apple", "1"};
+    char const *const argv10[] = {"in", "out", "--apple", "1"};
+    assert_int_eq(fingerprint_of(6, argv8, &command3, NULL) == fingerprint_of(6, argv9, &command3, NULL), 0);
+    assert_int_eq(fingerprint_of(6, argv8, &command3, NULL) == fingerprint_of(4, argv10, &command3, NULL), 1);
+
+    // So does the command path.
+    char const *const argv6[] = {"subcommand3", "command3", "in", "out", "--apple", "1", "-b", "2", "-cc"};
+    assert_int_eq(fingerprint_of(9, argv6, NULL, &command4) == first, 0);
+    assert_int_eq(fingerprint_of(9, argv6, NULL, &command4) == fingerprint_of(9, argv6, NULL, &command4), 1);
+
+    // Spec fingerprints cover defaults, choices and environment variables too.
+    struct ac_option_spec  options14[3] = {command14.options[0], command14.options[1], command14.options[2]};
+    struct ac_command_spec changed14    = command14;
+    changed14.options                   = options14;
+    assert_int_eq(ac_command_spec_fingerprint(&changed14) == ac_command_spec_fingerprint(&command14), 1);
+    options14[0].default_value = "7";
+    assert_int_eq(ac_command_spec_fingerprint(&changed14) == ac_command_spec_fingerprint(&command14), 0);
+    options14[0].default_value = "6";
+    options14[1].choices       = (char *[]) {"json", "toml"};
+    assert_int_eq(ac_command_spec_fingerprint(&changed14) == ac_command_spec_fingerprint(&command14), 0);
+
+    // A default is the same as providing its value.
+    char const *const argv7[] = {"--level", "6", "--format", "yaml"};
+    assert_int_eq(fingerprint_of(4, argv7, &command14, NULL) == fingerprint_of(0, argv7, &command14, NULL), 1);
+}
+
+// Parse a rotating set of command lines with a shared parser, checking each result.
+static void *parser_worker(void *const context) {
+    struct ac_parser *const parser = (struct ac_parser *) context;
+    char const *const       files[] = {"one", "two", "three"};
+    for(size_t i = 0; i < 3000; i++) {
+        char const *const        argv[] = {files[i % 3], "out", "--apple", "1"};
+        struct ac_command const *args   = NULL;
+        assert_int_eq(ac_parser_parse(parser, 4, argv, &args).code, AC_ERROR_SUCCESS);
+        assert_str_eq(args->arguments[0].value, files[i % 3]);
+        ac_parser_result_release(args);
+    }
+    return NULL;
+}
+
+static void test_parser() {
+    struct ac_parser *parser = NULL;
+    assert_int_eq(ac_command_parser_create(&command3, 2, &parser).code, AC_ERROR_SUCCESS);
+
+    // A repeated command line returns the same result, which doesn't borrow from the input.
+    char                     file[]  = "in";
+    char const *const        argv1[] = {file, "out", "--apple", "1", "-c"};
+    struct ac_command const *first   = NULL;
+    assert_int_eq(ac_parser_parse(parser, 5, argv1, &first).code, AC_ERROR_SUCCESS);
+    file[0] = 'X';
+    assert_str_eq(ac_extract_argument(first, "FILE")->value, "in");
+    char const *const        argv2[] = {"in", "out", "--apple", "1", "-c"};
+    struct ac_command const *second  = NULL;
+    assert_int_eq(ac_parser_parse(parser, 5, argv2, &second).code, AC_ERROR_SUCCESS);
+    assert_ptr_eq(second, first);
+    assert_str_eq(ac_extract_option(second, "apple")->value, "1");
+    ac_parser_result_release(second);
+
+    // Errors refer to the input, and aren't cached.
+    char const *const        argv3[] = {"in", "out", "--pear"};
+    struct ac_command const *args    = NULL;
+    struct ac_status const   result  = ac_parser_parse(parser, 3, argv3, &args);
+    assert_int_eq(result.code, AC_ERROR_OPTION_NAME_NOT_IN_SPEC);
+    assert_ptr_eq(result.context, argv3[2]);
+
+    // The least recently used result is evicted, and stays valid while it's held.
+    char const *const argv4[] = {"a", "b"};
+    char const *const argv5[] = {"c", "d"};
+    assert_int_eq(ac_parser_parse(parser, 2, argv4, &args).code, AC_ERROR_SUCCESS);
+    ac_parser_result_release(args);
+    assert_int_eq(ac_parser_parse(parser, 2, argv5, &args).code, AC_ERROR_SUCCESS);
+    ac_parser_result_release(args);
+    assert_str_eq(first->arguments[1].value, "out");
+
+    struct ac_parser_stats stats = ac_parser_stats_read(parser);
+    assert_sizet_eq((size_t) stats.hits, 1UL);
+    assert_sizet_eq((size_t) stats.misses, 4UL);
+    assert_sizet_eq((size_t) stats.evictions, 1UL);
+    assert_sizet_eq(stats.n_entries, 2UL);
+
+    // Only the first MAX_STRING_LEN bytes of an element are read, and its copy is terminated there.
+    char long_file[MAX_STRING_LEN + 2];
+    memset(long_file, 'x', MAX_STRING_LEN + 1);
+    long_file[MAX_STRING_LEN + 1] = '\0';
+    char const *const argv6[]     = {long_file, "out"};
+    assert_int_eq(ac_parser_parse(parser, 2, argv6, &args).code, AC_ERROR_SUCCESS);
+    assert_sizet_eq(strlen(args->arguments[0].value), (size_t) MAX_STRING_LEN);
+    struct ac_command const *bounded = NULL;
+    long_file[MAX_STRING_LEN]        = 'y';
+    assert_int_eq(ac_parser_parse(parser, 2, argv6, &bounded).code, AC_ERROR_SUCCESS);
+    assert_ptr_eq(bounded, args);
+    ac_parser_result_release(bounded);
+    ac_parser_result_release(args);
+
+    // Results outlive the parser.
+    ac_parser_destroy(parser);
+    assert_str_eq(first->arguments[0].value, "in");
+    ac_parser_result_release(first);
+
+    // Concurrent parses with more distinct command lines than the cache holds.
+    assert_int_eq(ac_command_parser_create(&command3, 2, &parser).code, AC_ERROR_SUCCESS);
+    pthread_t threads[4];
+    for(size_t i = 0; i < 4; i++) {
+        assert_int_eq(pthread_create(&threads[i], NULL, parser_worker, parser), 0);
+    }
+    for(size_t i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    stats = ac_parser_stats_read(parser);
+    assert_sizet_eq((size_t) (stats.hits + stats.misses), 12000UL);
+    ac_parser_destroy(parser);
+}
+
+static void test_collect_all() {
+    struct ac_diagnostics diagnostics = {0};
+    struct ac_command     args        = {0};
+
+    // Every error is recorded, and the value after an unknown option isn't blamed a second time.
+    char const *const argv1[] = {"extra", "--bogus", "value", "--compress", "--quiet", "--verbose", "--output"};
+    struct ac_status  result  = ac_command_parse_all(7, argv1, &command8, &args, &diagnostics);
+    assert_int_eq(result.code, AC_ERROR_ARGUMENT_EXCEEDED_SPEC);
+    assert_ptr_eq(result.diagnostics, &diagnostics);
+    assert_ptr_eq(diagnostics.single, &command8);
+    assert_sizet_eq(diagnostics.n_diagnostics, 5UL);
+    assert_int_eq(diagnostics.diagnostics[0].code, AC_ERROR_ARGUMENT_EXCEEDED_SPEC);
+    assert_int_eq(diagnostics.diagnostics[0].token, 0);
+    assert_int_eq(diagnostics.diagnostics[1].code, AC_ERROR_OPTION_NAME_NOT_IN_SPEC);
+    assert_int_eq(diagnostics.diagnostics[1].token, 1);
+    assert_int_eq(diagnostics.diagnostics[2].code, AC_ERROR_OPTION_VALUE_EXPECTED);
+    assert_int_eq(diagnostics.diagnostics[2].token, 6);
+    assert_int_eq(diagnostics.diagnostics[3].code, AC_ERROR_CONSTRAINT_ONE_OF_MISSING);
+    assert_int_eq(diagnostics.diagnostics[3].token, AC_DIAGNOSTIC_NO_TOKEN);
+    assert_int_eq(diagnostics.diagnostics[4].code, AC_ERROR_CONSTRAINT_CONFLICTS);
+    assert_ptr_eq(diagnostics.diagnostics[4].option, &command8.options[4]);
+    assert_ptr_eq(args.options, NULL);
+
+    // They're all rendered, with the help once.
+    char *const error = ac_status_string(result);
+    assert_ptr_neq(strstr(error, "Option name '--bogus' is not valid."), NULL);
+    assert_ptr_neq(strstr(error, "Expected value for option --output"), NULL);
+    assert_ptr_neq(strstr(error, "Option '--quiet' can't be used with '--verbose'."), NULL);
+    assert_ptr_eq(strstr(strstr(error, "Constrained options") + 1, "Constrained options"), NULL);
+    free(error);
+
+    // The diagnostics are reset by each parse, and valid input parses as usual.
+    char const *const argv2[] = {"--json", "--compress", "--output", "out.gz"};
+    result                    = ac_command_parse_all(4, argv2, &command8, &args, &diagnostics);
+    assert_int_eq(result.code, AC_ERROR_SUCCESS);
+    assert_sizet_eq(diagnostics.n_diagnostics, 0UL);
+    assert_str_eq(ac_extract_option(&args, "output")->value, "out.gz");
+    ac_command_release(&args);
+
+    // Tokens after a command path are indices into the whole argv.
+    char const *const argv3[] = {"subcommand3", "command3", "a", "--bogus", "x", "--apple"};
+    result                    = ac_multi_command_parse_all(6, argv3, &command4, &args, &diagnostics);
+    assert_int_eq(result.code, AC_ERROR_ARGUMENT_EXPECTED_IN_SPEC);
+    assert_sizet_eq(diagnostics.n_diagnostics, 3UL);
+    assert_int_eq(diagnostics.diagnostics[1].code, AC_ERROR_OPTION_NAME_NOT_IN_SPEC);
+    assert_int_eq(diagnostics.diagnostics[1].token, 3);
+    assert_int_eq(diagnostics.diagnostics[2].code, AC_ERROR_OPTION_VALUE_EXPECTED);
+    assert_int_eq(diagnostics.diagnostics[2].token, 5);
+
+    // An error in the command path stops parsing, and is the only one.
+    char const *const argv4[] = {"blah", "--bogus"};
+    result                    = ac_multi_command_parse_all(2, argv4, &command4, &args, &diagnostics);
+    assert_int_eq(result.code, AC_ERROR_COMMAND_NAME_NOT_IN_SPEC);
+    assert_ptr_eq(result.diagnostics, &diagnostics);
+    assert_ptr_eq(diagnostics.single, NULL);
+    assert_sizet_eq(diagnostics.n_diagnostics, 1UL);
+
+    ac_diagnostics_release(&diagnostics);
+    assert_ptr_eq(diagnostics.diagnostics, NULL);
+}
+
+// Parse a snapshot while the memoized structures of the command it dispatches to are forgotten.
+static void *snapshot_worker(void *const context) {
+    struct ac_multi_command_spec const *const snapshot = (struct ac_multi_command_spec const *) context;
+    char const *const                         argv[]   = {"--verbose", "plugin", "--format", "json"};
+    for(size_t i = 0; i < 2000; i++) {
+        struct ac_command args = {0};
+        assert_int_eq(ac_multi_command_parse(4, argv, snapshot, &args).code, AC_ERROR_SUCCESS);
+        assert_str_eq(ac_extract_option(&args, "level")->value, "6");
+        ac_command_release(&args);
+    }
+    return NULL;
+}
+
+static void test_spec_builder() {
+    struct ac_spec_builder *builder = NULL;
+    assert_int_eq(ac_spec_builder_create(&command4, &builder).code, AC_ERROR_SUCCESS);
+
+    // Adding a subcommand and an option publishes a snapshot that parses like a static spec.
+    struct ac_multi_command_subcommand const plugin = {
+        .name = "plugin", .type = COMMAND_SINGLE, .single = (struct ac_command_spec *) &command14};
+    struct ac_option_spec const verbose = {.long_name = "verbose", .is_flag = true};
+    assert_int_eq(ac_spec_builder_add_subcommand(builder, &plugin).code, AC_ERROR_SUCCESS);
+    assert_int_eq(ac_spec_builder_add_option(builder, &verbose).code, AC_ERROR_SUCCESS);
+    struct ac_multi_command_spec const *first = NULL;
+    assert_int_eq(ac_spec_builder_publish(builder, &first).code, AC_ERROR_SUCCESS);
+    assert_int_eq(ac_multi_command_validate(first).code, AC_ERROR_SUCCESS);
+    assert_sizet_eq(first->n_subcommands, 4UL);
+    assert_str_eq(first->help, command4.help);
+
+    struct ac_command args    = {0};
+    char const *const argv1[] = {"--verbose", "plugin", "--format", "json"};
+    assert_int_eq(ac_multi_command_parse(4, argv1, first, &args).code, AC_ERROR_SUCCESS);
+    assert_ptr_eq(args.command, &command14);
+    assert_ptr_eq(ac_extract_option(&args, "verbose")->option, &first->options[0]);
+    assert_str_eq(ac_extract_option(&args, "level")->value, "6");
+    ac_command_release(&args);
+
+    // Duplicates and unknown names are rejected.
+    struct ac_status result = ac_spec_builder_add_subcommand(builder, &plugin);
+    assert_int_eq(result.code, AC_ERROR_COMMAND_NAME_DUPLICATE);
+    assert_str_eq((char *) result.context, "plugin");
+    assert_int_eq(ac_spec_builder_add_option(builder, &verbose).code, AC_ERROR_OPTION_LONG_NAME_DUPLICATE);
+    assert_int_eq(ac_spec_builder_remove_subcommand(builder, "blah").code, AC_ERROR_COMMAND_NAME_NOT_IN_SPEC);
+    assert_int_eq(ac_spec_builder_remove_option(builder, "blah").code, AC_ERROR_OPTION_NAME_NOT_IN_SPEC);
+
+    // A removal only copies the array that it changes, and earlier snapshots keep what was removed.
+    assert_int_eq(ac_spec_builder_remove_subcommand(builder, "command1").code, AC_ERROR_SUCCESS);
+    struct ac_multi_command_spec const *second = NULL;
+    assert_int_eq(ac_spec_builder_publish(builder, &second).code, AC_ERROR_SUCCESS);
+    assert_ptr_eq(second->options, first->options);
+    assert_ptr_neq(second->subcommands, first->subcommands);
+    assert_sizet_eq(second->n_subcommands, 3UL);
+
+    char const *const argv2[] = {"command1"};
+    assert_int_eq(ac_multi_command_parse(1, argv2, second, &args).code, AC_ERROR_COMMAND_NAME_NOT_IN_SPEC);
+    assert_int_eq(ac_multi_command_parse(1, argv2, first, &args).code, AC_ERROR_SUCCESS);
+    ac_command_release(&args);
+
+    // Snapshots outlive the builder, and the one that's released doesn't affect the other.
+    ac_spec_builder_destroy(builder);
+    ac_spec_snapshot_release(first);
+    assert_int_eq(ac_multi_command_parse(4, argv1, second, &args).code, AC_ERROR_SUCCESS);
+    ac_command_release(&args);
+    ac_spec_snapshot_release(second);
+
+    // A forgotten command is indexed again the next time it's parsed.
+    ac_command_spec_forget(&command14);
+    char const *const argv3[] = {"--level", "3"};
+    assert_int_eq(ac_command_parse(2, argv3, &command14, &args).code, AC_ERROR_SUCCESS);
+    assert_str_eq(ac_extract_option(&args, "format")->value, "yaml");
+    ac_command_release(&args);
+
+#ifndef AC_EXTERN
+    // A forgotten or replaced value stays valid until the read section that looked it up is left.
+    // The memo is internal, so this is only checked when the implementation is compiled in.
+    static int const key   = 0;
+    int *const       value = (int *) malloc(sizeof(*value));
+    int *const       other = (int *) malloc(sizeof(*other));
+    *value                 = 42;
+    *other                 = 43;
+    assert_ptr_eq(_ac_memo_put(&key, _AC_MEMO_CHOICES, 0, value), value);
+    size_t const     epoch    = _ac_memo_enter();
+    int const *const memoized = (int const *) _ac_memo_get(&key, _AC_MEMO_CHOICES, 0);
+    assert_ptr_eq(_ac_memo_put(&key, _AC_MEMO_CHOICES, 1, other), other);
+    assert_ptr_eq(_ac_memo_get(&key, _AC_MEMO_CHOICES, 0), NULL);
+    int const *const replaced = (int const *) _ac_memo_get(&key, _AC_MEMO_CHOICES, 1);
+    _ac_memo_forget(&key, &key + 1);
+    assert_ptr_eq(_ac_memo_get(&key, _AC_MEMO_CHOICES, 1), NULL);
+    assert_int_eq(*memoized, 42);
+    assert_int_eq(*replaced, 43);
+    _ac_memo_leave(epoch);
+#endif
+
+    // Snapshots are published, parsed and released, and a command they share is forgotten, while
+    // other threads parse.
+    assert_int_eq(ac_spec_builder_create(&command4, &builder).code, AC_ERROR_SUCCESS);
+    assert_int_eq(ac_spec_builder_add_subcommand(builder, &plugin).code, AC_ERROR_SUCCESS);
+    assert_int_eq(ac_spec_builder_add_option(builder, &verbose).code, AC_ERROR_SUCCESS);
+    struct ac_multi_command_spec const *held = NULL;
+    assert_int_eq(ac_spec_builder_publish(builder, &held).code, AC_ERROR_SUCCESS);
+    pthread_t threads[4];
+    for(size_t i = 0; i < 4; i++) {
+        assert_int_eq(pthread_create(&threads[i], NULL, snapshot_worker, (void *) held), 0);
+    }
+    struct ac_multi_command_subcommand const extra = {
+        .name = "extra", .type = COMMAND_SINGLE, .single = (struct ac_command_spec *) &command14};
+    for(size_t i = 0; i < 500; i++) {
+        ac_command_spec_forget(&command14);
+        assert_int_eq(ac_spec_builder_add_subcommand(builder, &extra).code, AC_ERROR_SUCCESS);
+        struct ac_multi_command_spec const *snapshot = NULL;
+        assert_int_eq(ac_spec_builder_publish(builder, &snapshot).code, AC_ERROR_SUCCESS);
+        assert_int_eq(ac_multi_command_parse(4, argv1, snapshot, &args).code, AC_ERROR_SUCCESS);
+        ac_command_release(&args);
+        ac_spec_snapshot_release(snapshot);
+        assert_int_eq(ac_spec_builder_remove_subcommand(builder, "extra").code, AC_ERROR_SUCCESS);
+    }
+    for(size_t i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    ac_spec_snapshot_release(held);
+    ac_spec_builder_destroy(builder);
 }
 
 int main() {
@@ -366,4 +2000,26 @@ int main() {
     test_command_2();
     test_command_3();
     test_command_4();
+    test_argument_stream();
+    test_command_serialize();
+    test_spec_image();
+    test_lazy_command();
+    test_inherited_options();
+    test_completion();
+    test_suggestions();
+    test_abbreviations();
+    test_constraints();
+    test_validate();
+    test_utf8();
+    test_clusters();
+    test_choices();
+    test_env();
+    test_config();
+    test_help_tree();
+    test_defaults();
+    test_image_options();
+    test_fingerprint();
+    test_parser();
+    test_collect_all();
+    test_spec_builder();
 }
\ No newline at end of file
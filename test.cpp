@@ -0,0 +1,154 @@
+#include "args-c.hpp"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+#define assert_int_eq(real, expected)                                                              \
+    do {                                                                                           \
+        if((real) != (expected)) {                                                                 \
+            printf("expected result %d but got %d\n", (int) (expected), (int) (real));             \
+            assert(false);                                                                         \
+        }                                                                                          \
+    } while(false)
+
+#define assert_str_eq(real, expected)                                                              \
+    do {                                                                                           \
+        if(0 != strcmp(real, expected)) {                                                          \
+            printf("expected ptr %s but got %s\n", (expected), (real));                            \
+            assert(false);                                                                         \
+        }                                                                                          \
+    } while(false)
+
+struct file_t {
+    static constexpr auto spec = ac::argument("FILE").help("The file to compress.");
+};
+
+struct level_t {
+    static constexpr auto spec = ac::option<int>("level").short_name('l').help("From 1 to 9.");
+};
+
+struct output_t {
+    static constexpr auto spec = ac::option<std::string_view>("output").short_name('o').required();
+};
+
+struct ratio_t {
+    static constexpr auto spec = ac::option<double>("ratio");
+};
+
+struct progress_t {
+    static constexpr auto spec = ac::flag("progress").short_name('p');
+};
+
+inline constexpr ac::command<file_t, level_t, output_t, ratio_t, progress_t> compress {
+    "Compress a file."};
+
+static_assert(compress.n_arguments == 1);
+static_assert(compress.n_options == 4);
+static_assert(compress.find("level") == 0);
+static_assert(compress.find("progress") == 3);
+static_assert(compress.find("missing") == compress.n_options);
+
+static void test_cpp_spec() {
+    ac_command_spec const *const spec = compress.spec();
+    assert_int_eq(ac_command_validate(spec).code, AC_ERROR_SUCCESS);
+    assert_int_eq(spec->n_options, 4);
+    assert_str_eq(spec->options[2].long_name, "ratio");
+    assert_int_eq(spec->options[3].is_flag, true);
+    assert_str_eq(spec->arguments[0].name, "FILE");
+}
+
+static void test_cpp_parse() {
+    char const *const argv[] = {"in.txt", "-l", "9", "--output", "out.z", "-p"};
+    auto const        args   = compress.parse(6, argv);
+    assert(args);
+    assert_str_eq(args.get<file_t>().data(), "in.txt");
+    assert_int_eq(*args.get<level_t>(), 9);
+    assert_str_eq(args.get<output_t>().data(), "out.z");
+    assert(!args.get<ratio_t>().has_value());
+    assert(args.get<progress_t>());
+    assert_str_eq(args.value("level"), "9");
+    assert_str_eq(args.value("progress"), "");
+    assert(args.value("ratio") == nullptr);
+    assert(args.value("missing") == nullptr);
+
+    char const *const argv2[] = {"in.txt", "-o", "out.z", "--ratio", "0.5"};
+    auto const        args2   = compress.parse(5, argv2);
+    assert(args2);
+    assert(!args2.get<level_t>().has_value());
+    assert(*args2.get<ratio_t>() == 0.5);
+    assert(!args2.get<progress_t>());
+}
+
+static void test_cpp_errors() {
+    char const *const argv[] = {"in.txt"};
+    auto const        args   = compress.parse(1, argv);
+    assert(!args);
+    assert_int_eq(args.status().code, AC_ERROR_OPTION_NAME_REQUIRED_IN_SPEC);
+
+    char const *const argv2[] = {"in.txt", "-o", "out.z", "-l", "high"};
+    auto const        args2   = compress.parse(5, argv2);
+    assert(!args2);
+    assert_int_eq(args2.status().code, AC_ERROR_OPTION_VALUE_INVALID);
+    assert(args2.status().option == &compress.spec()->options[0]);
+    assert(args2.error().find("Value 'high' is not valid for option '--level'.") != std::string::npos);
+
+    char const *const argv3[] = {"in.txt", "-o", "out.z", "--ratio", "0.5x"};
+    assert_int_eq(compress.parse(5, argv3).status().code, AC_ERROR_OPTION_VALUE_INVALID);
+}
+
+static void test_cpp_repeated() {
+    // The first value of a repeated option is the effective one, as in C.
+    char const *const argv[] = {"in.txt", "-o", "out.z", "--level", "1", "-pl", "9"};
+    auto const        args   = compress.parse(7, argv);
+    assert(args);
+    assert_int_eq(*args.get<level_t>(), 1);
+    assert_str_eq(args.value("level"), "1");
+}
+
+struct quiet_t {
+    static constexpr auto spec = ac::flag("quiet").short_name('p');
+};
+
+inline constexpr ac::command<file_t, progress_t, quiet_t> clashing {"Two flags with one short name."};
+
+static void test_cpp_validate() {
+    // The spec is checked by ac_command_validate before it's parsed.
+    assert_int_eq(clashing.validate().code, AC_ERROR_OPTION_SHORT_NAME_DUPLICATE);
+    char const *const argv[] = {"in.txt"};
+    auto const        args   = clashing.parse(1, argv);
+    assert(!args);
+    assert_int_eq(args.status().code, AC_ERROR_OPTION_SHORT_NAME_DUPLICATE);
+}
+
+struct count_t {
+    static constexpr auto spec = ac::argument<unsigned>("COUNT");
+};
+
+inline constexpr ac::command<count_t> repeat {"Repeat COUNT times."};
+
+static void test_cpp_argument() {
+    char const *const argv[] = {"3"};
+    auto              args   = repeat.parse(1, argv);
+    assert(args);
+    assert_int_eq(args.get<count_t>(), 3u);
+
+    // Moving the result keeps the values valid.
+    auto const moved = std::move(args);
+    assert_int_eq(moved.get<count_t>(), 3u);
+
+    char const *const argv2[] = {"-3"};
+    auto const        args2   = repeat.parse(1, argv2);
+    assert_int_eq(args2.status().code, AC_ERROR_OPTION_VALUE_INVALID);
+    assert(args2.status().option == nullptr);
+}
+
+int main() {
+    test_cpp_spec();
+    test_cpp_parse();
+    test_cpp_errors();
+    test_cpp_repeated();
+    test_cpp_validate();
+    test_cpp_argument();
+    return 0;
+}